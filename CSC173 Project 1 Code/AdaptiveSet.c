@@ -0,0 +1,532 @@
+/*
+ * File: AdaptiveSet.c
+ *
+ * Implementation of the self-adjusting set of ints in AdaptiveSet.h.
+ * Each set tracks its count and smallest and largest elements, which is
+ * all it takes to decide on a representation (see choose). A set only
+ * changes representation when an insert doesn't fit the one it has, and
+ * it is then rebuilt in the one that suits its new contents best.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "AdaptiveSet.h"
+
+/**
+ * Sets with no more elements than this that don't fit in a word are kept
+ * as sorted arrays.
+ */
+#define ARRAY_LIMIT 16
+
+/**
+ * Marks an empty slot in the hash representation.
+ */
+#define EMPTY INT_MIN
+
+struct AdaptiveSet {
+	AdaptiveSetKind kind;
+	int count;
+	int min;		// Smallest and largest elements, if count > 0
+	int max;
+	uint64_t word;		// SET_WORD: bit i for element i
+	int *elements;		// SET_ARRAY: sorted; SET_HASH: EMPTY or element per slot
+	uint64_t *bits;		// SET_BITS: bit i%64 of bits[i/64] for element i
+	int capacity;		// Array length, hash slots, or words of bits
+};
+
+/**
+ * Return the best representation for a set with the given number of
+ * elements and smallest and largest elements.
+ */
+static AdaptiveSetKind choose(int count, int min, int max) {
+	if (min >= 0 && max < 64) {
+		return SET_WORD;
+	} else if (count <= ARRAY_LIMIT) {
+		return SET_ARRAY;
+	} else if (min >= 0 && max / AdaptiveSet_DENSITY < count) {
+		return SET_BITS;
+	} else {
+		return SET_HASH;
+	}
+}
+
+/**
+ * Return the first slot to probe for the given element in a hash table
+ * with the given number of slots (a power of 2).
+ */
+static int hash_slot(int element, int capacity) {
+	unsigned x = (unsigned)element * 2654435769u;
+	return (x ^ (x >> 15)) & (capacity - 1);
+}
+
+/**
+ * Return the next element of the given set from the given position on,
+ * and advance the position past it. There must be one.
+ */
+static int next_element(const AdaptiveSet this, int *position) {
+	int i = *position;
+	switch (this->kind) {
+	case SET_WORD:
+		while (!((this->word >> i) & 1)) {
+			i += 1;
+		}
+		break;
+	case SET_ARRAY:
+		*position = i + 1;
+		return this->elements[i];
+	case SET_BITS:
+		while (!((this->bits[i / 64] >> (i % 64)) & 1)) {
+			i = ((this->bits[i / 64] >> (i % 64)) == 0) ? (i / 64 + 1) * 64 : i + 1;
+		}
+		break;
+	case SET_HASH:
+		while (this->elements[i] == EMPTY) {
+			i += 1;
+		}
+		*position = i + 1;
+		return this->elements[i];
+	}
+	*position = i + 1;
+	return i;
+}
+
+/**
+ * Return the index of the first element of the given set's sorted array
+ * that is not less than the given element.
+ */
+static int array_search(const AdaptiveSet this, int element) {
+	int lo = 0, hi = this->count;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (this->elements[mid] < element) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/**
+ * Add the given element, which isn't there, to the given set, whose
+ * representation must have room for it.
+ */
+static void raw_insert(AdaptiveSet this, int element) {
+	switch (this->kind) {
+	case SET_WORD:
+		this->word |= (uint64_t)1 << element;
+		break;
+	case SET_ARRAY: {
+		int i = array_search(this, element);
+		memmove(this->elements + i + 1, this->elements + i, sizeof(int) * (this->count - i));
+		this->elements[i] = element;
+		break;
+	}
+	case SET_BITS:
+		this->bits[element / 64] |= (uint64_t)1 << (element % 64);
+		break;
+	case SET_HASH: {
+		int i = hash_slot(element, this->capacity);
+		while (this->elements[i] != EMPTY) {
+			i = (i + 1) & (this->capacity - 1);
+		}
+		this->elements[i] = element;
+		break;
+	}
+	}
+	if (this->count == 0 || element < this->min) {
+		this->min = element;
+	}
+	if (this->count == 0 || element > this->max) {
+		this->max = element;
+	}
+	this->count += 1;
+}
+
+/**
+ * Rebuild the given set in the given representation, with room for
+ * elements up to max and count elements in all.
+ */
+static void rebuild(AdaptiveSet this, AdaptiveSetKind kind, int max, int count) {
+	int n = this->count;
+	int *old = (int*)malloc(sizeof(int) * (n > 0 ? n : 1));
+	int position = 0;
+	for (int i=0; i < n; i++) {
+		old[i] = next_element(this, &position);
+	}
+	free(this->elements);
+	free(this->bits);
+	this->elements = NULL;
+	this->bits = NULL;
+	this->word = 0;
+	this->kind = kind;
+	switch (kind) {
+	case SET_WORD:
+		this->capacity = 0;
+		break;
+	case SET_ARRAY:
+		this->capacity = ARRAY_LIMIT;
+		this->elements = (int*)malloc(sizeof(int) * this->capacity);
+		break;
+	case SET_BITS:
+		this->capacity = 1;
+		while (this->capacity * 64 <= max) {
+			this->capacity *= 2;
+		}
+		this->bits = (uint64_t*)calloc(this->capacity, sizeof(uint64_t));
+		break;
+	case SET_HASH:
+		this->capacity = 16;
+		while (this->capacity < 4 * count) {
+			this->capacity *= 2;
+		}
+		this->elements = (int*)malloc(sizeof(int) * this->capacity);
+		for (int i=0; i < this->capacity; i++) {
+			this->elements[i] = EMPTY;
+		}
+		break;
+	}
+	this->count = 0;
+	for (int i=0; i < n; i++) {
+		raw_insert(this, old[i]);
+	}
+	free(old);
+}
+
+/**
+ * Allocate and return a new empty AdaptiveSet.
+ */
+AdaptiveSet new_AdaptiveSet(int universe) {
+	AdaptiveSet this = (AdaptiveSet)malloc(sizeof(struct AdaptiveSet));
+	if (this == NULL) {
+		return NULL;
+	}
+	this->count = 0;
+	this->min = this->max = 0;
+	this->word = 0;
+	this->elements = NULL;
+	this->bits = NULL;
+	this->capacity = 0;
+	this->kind = SET_WORD;
+	if (universe > 64) {
+		rebuild(this, SET_ARRAY, 0, 0);
+	}
+	return this;
+}
+
+/**
+ * Free the given AdaptiveSet.
+ */
+void AdaptiveSet_free(AdaptiveSet this) {
+	if (this == NULL) {
+		return;
+	}
+	free(this->elements);
+	free(this->bits);
+	free(this);
+}
+
+/**
+ * Return true if the given element is in the given AdaptiveSet, otherwise
+ * false.
+ */
+bool AdaptiveSet_lookup(AdaptiveSet this, int element) {
+	if (this->count == 0 || element < this->min || element > this->max) {
+		return false;
+	}
+	switch (this->kind) {
+	case SET_WORD:
+		return (this->word >> element) & 1;
+	case SET_ARRAY: {
+		int i = array_search(this, element);
+		return i < this->count && this->elements[i] == element;
+	}
+	case SET_BITS:
+		return (this->bits[element / 64] >> (element % 64)) & 1;
+	case SET_HASH:
+		for (int i=hash_slot(element, this->capacity); this->elements[i] != EMPTY; i = (i + 1) & (this->capacity - 1)) {
+			if (this->elements[i] == element) {
+				return true;
+			}
+		}
+		return false;
+	}
+	return false;
+}
+
+/**
+ * Insert the given element into the given AdaptiveSet if it isn't already
+ * present.
+ */
+void AdaptiveSet_insert(AdaptiveSet this, int element) {
+	if (AdaptiveSet_lookup(this, element)) {
+		return;
+	}
+	if (element == EMPTY) {
+		fprintf(stderr, "AdaptiveSet_insert: can't store %d\n", element);
+		abort();
+	}
+	int count = this->count + 1;
+	int min = (this->count == 0 || element < this->min) ? element : this->min;
+	int max = (this->count == 0 || element > this->max) ? element : this->max;
+	bool fits = false;
+	switch (this->kind) {
+	case SET_WORD:
+		fits = element >= 0 && element < 64;
+		break;
+	case SET_ARRAY:
+		fits = count <= this->capacity;
+		break;
+	case SET_BITS:
+		fits = element >= 0 && element / 64 < this->capacity;
+		break;
+	case SET_HASH:
+		fits = 2 * count <= this->capacity;
+		break;
+	}
+	if (!fits) {
+		rebuild(this, choose(count, min, max), max, count);
+	}
+	raw_insert(this, element);
+}
+
+/**
+ * Add the elements of the second AdaptiveSet to the first.
+ */
+void AdaptiveSet_union(AdaptiveSet this, const AdaptiveSet other) {
+	if (this->kind == SET_WORD && other->kind == SET_WORD) {
+		uint64_t word = this->word | other->word;
+		if (word != this->word) {
+			this->word = 0;
+			this->count = 0;
+			for (int i=0; i < 64; i++) {
+				if ((word >> i) & 1) {
+					raw_insert(this, i);
+				}
+			}
+		}
+		return;
+	}
+	int position = 0;
+	for (int i=0; i < other->count; i++) {
+		AdaptiveSet_insert(this, next_element(other, &position));
+	}
+}
+
+/**
+ * Return the number of elements in the given AdaptiveSet.
+ */
+int AdaptiveSet_count(AdaptiveSet this) {
+	return this->count;
+}
+
+/**
+ * Return true if the given AdaptiveSet is empty.
+ */
+bool AdaptiveSet_isEmpty(AdaptiveSet this) {
+	return this->count == 0;
+}
+
+/**
+ * Return true if the two given AdaptiveSets contain exactly the same
+ * elements, otherwise false.
+ */
+bool AdaptiveSet_equals(AdaptiveSet this, AdaptiveSet other) {
+	if (this->count != other->count) {
+		return false;
+	} else if (this->count == 0) {
+		return true;
+	} else if (this->min != other->min || this->max != other->max) {
+		return false;
+	} else if (this->kind == SET_WORD && other->kind == SET_WORD) {
+		return this->word == other->word;
+	} else if (this->kind == SET_ARRAY && other->kind == SET_ARRAY) {
+		return memcmp(this->elements, other->elements, sizeof(int) * this->count) == 0;
+	}
+	int position = 0;
+	for (int i=0; i < this->count; i++) {
+		if (!AdaptiveSet_lookup(other, next_element(this, &position))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Return the representation the given AdaptiveSet is using now.
+ */
+AdaptiveSetKind AdaptiveSet_get_kind(AdaptiveSet this) {
+	return this->kind;
+}
+
+/**
+ * Call the given function on each element of the given AdaptiveSet.
+ */
+void AdaptiveSet_iterate(const AdaptiveSet this, void (*func)(int)) {
+	int position = 0;
+	for (int i=0; i < this->count; i++) {
+		func(next_element(this, &position));
+	}
+}
+
+/**
+ * An AdaptiveSetIterator iterates over the elements of an AdaptiveSet.
+ */
+struct AdaptiveSetIterator {
+	AdaptiveSet set;
+	int position;
+	int remaining;
+};
+
+/**
+ * Return an AdaptiveSetIterator for the given AdaptiveSet.
+ * Don't forget to free() this when you're done iterating.
+ */
+AdaptiveSetIterator AdaptiveSet_iterator(const AdaptiveSet this) {
+	AdaptiveSetIterator iterator = (AdaptiveSetIterator)malloc(sizeof(struct AdaptiveSetIterator));
+	iterator->set = this;
+	iterator->position = 0;
+	iterator->remaining = this->count;
+	return iterator;
+}
+
+/**
+ * Return true if the next call to AdaptiveSetIterator_next on the given
+ * AdaptiveSetIterator will not fail.
+ */
+bool AdaptiveSetIterator_hasNext(const AdaptiveSetIterator this) {
+	return this->remaining > 0;
+}
+
+/**
+ * Return the next element from the given AdaptiveSetIterator, or -1 if
+ * there are no more.
+ */
+int AdaptiveSetIterator_next(AdaptiveSetIterator this) {
+	if (this->remaining == 0) {
+		return -1;
+	}
+	this->remaining -= 1;
+	return next_element(this->set, &this->position);
+}
+
+/**
+ * Print the given AdaptiveSet to stdout.
+ */
+void AdaptiveSet_print(AdaptiveSet this) {
+	char *s = AdaptiveSet_toString(this);
+	printf("{%s}", s);
+	free(s);
+}
+
+/**
+ * Return the string representation of the given AdaptiveSet.
+ * Don't forget to free() this string.
+ */
+char *AdaptiveSet_toString(AdaptiveSet this) {
+	int length = 0;
+	int capacity = 16;
+	char *result = (char*)malloc(capacity);
+	result[0] = '\0';
+	int position = 0;
+	for (int i=0; i < this->count; i++) {
+		char buf[16];
+		int n = snprintf(buf, sizeof(buf), (i > 0) ? ",%d" : "%d", next_element(this, &position));
+		while (length + n + 1 > capacity) {
+			capacity *= 2;
+			result = (char*)realloc(result, capacity);
+		}
+		strcpy(result + length, buf);
+		length += n;
+	}
+	return result;
+}
+
+#ifdef MAIN
+
+static const char *kinds[] = { "word", "array", "bits", "hash" };
+
+/**
+ * Insert count random elements from lo to hi-1 into one set created with
+ * a small universe and another created with a big one, checking every
+ * operation against a table of booleans, and return the number of
+ * mismatches.
+ */
+static int check(int lo, int hi, int count) {
+	bool *member = (bool*)calloc(hi - lo, sizeof(bool));
+	AdaptiveSet a = new_AdaptiveSet(1);
+	AdaptiveSet b = new_AdaptiveSet(1000000);
+	int n = 0;
+	int mismatches = 0;
+	for (int i=0; i < count; i++) {
+		int x = lo + rand() % (hi - lo);
+		n += !member[x - lo];
+		member[x - lo] = true;
+		AdaptiveSet_insert(a, x);
+		AdaptiveSet_insert(b, x);
+		int y = lo + rand() % (hi - lo);
+		mismatches += AdaptiveSet_lookup(a, y) != member[y - lo];
+		mismatches += AdaptiveSet_lookup(b, y) != member[y - lo];
+	}
+	mismatches += AdaptiveSet_count(a) != n || AdaptiveSet_count(b) != n;
+	mismatches += !AdaptiveSet_equals(a, b) || !AdaptiveSet_equals(b, a);
+	AdaptiveSetIterator iterator = AdaptiveSet_iterator(a);
+	int seen = 0;
+	while (AdaptiveSetIterator_hasNext(iterator)) {
+		int x = AdaptiveSetIterator_next(iterator);
+		mismatches += !member[x - lo];
+		seen += 1;
+	}
+	free(iterator);
+	mismatches += seen != n;
+	AdaptiveSet_insert(b, hi);
+	mismatches += AdaptiveSet_equals(a, b);
+	printf("%7d inserts from %8d to %8d: %5s, %d mismatches\n",
+	       count, lo, hi, kinds[AdaptiveSet_get_kind(a)], mismatches);
+	AdaptiveSet_free(a);
+	AdaptiveSet_free(b);
+	free(member);
+	return mismatches;
+}
+
+int main(int argc, char* argv[]) {
+	printf("testing insert and kinds...\n");
+	AdaptiveSet set = new_AdaptiveSet(8);
+	AdaptiveSet_insert(set, 3);
+	AdaptiveSet_insert(set, 63);
+	AdaptiveSet_insert(set, 3);
+	AdaptiveSet_print(set);
+	printf(" %s\n", kinds[AdaptiveSet_get_kind(set)]);
+	AdaptiveSet_insert(set, -7);
+	AdaptiveSet_insert(set, 1000000);
+	AdaptiveSet_print(set);
+	printf(" %s\n", kinds[AdaptiveSet_get_kind(set)]);
+	for (int i=0; i < 20; i++) {
+		AdaptiveSet_insert(set, i * 1000);
+	}
+	printf("count %d %s\n", AdaptiveSet_count(set), kinds[AdaptiveSet_get_kind(set)]);
+	AdaptiveSet dense = new_AdaptiveSet(1000);
+	for (int i=0; i < 1000; i += 3) {
+		AdaptiveSet_insert(dense, i);
+	}
+	printf("count %d %s\n", AdaptiveSet_count(dense), kinds[AdaptiveSet_get_kind(dense)]);
+	AdaptiveSet_union(set, dense);
+	printf("union count %d %s\n", AdaptiveSet_count(set), kinds[AdaptiveSet_get_kind(set)]);
+	AdaptiveSet_free(set);
+	AdaptiveSet_free(dense);
+
+	printf("testing against a table of booleans...\n");
+	int mismatches = 0;
+	mismatches += check(0, 64, 40);
+	mismatches += check(0, 1000, 10);
+	mismatches += check(-500, 500, 12);
+	mismatches += check(0, 4000, 2000);
+	mismatches += check(0, 10000000, 5000);
+	mismatches += check(-10000000, 10000000, 100000);
+	return mismatches != 0;
+}
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * File: AdaptiveSet.h
+ *
+ * A set of ints that picks its own representation, set by set, from the
+ * range and number of its elements, and changes it as elements are added:
+ *   - a single 64-bit word while every element is from 0 to 63
+ *   - a sorted array while it has only a few elements
+ *   - a bit vector over 0..max while at least one in AdaptiveSet_DENSITY
+ *     of the values up to its largest element are in it
+ *   - an open-addressing hash table otherwise
+ * So a set of NFA states is as fast as a BitSet for small NFAs, and still
+ * correct (unlike BitSet) for big ones, without recompiling anything.
+ * This is the Set that Set.h uses unless told otherwise.
+ * Any int can be stored except INT_MIN.
+ */
+
+#ifndef _AdaptiveSet_h
+#define _AdaptiveSet_h
+
+#include <stdbool.h>
+
+/**
+ * Sets with values up to this many times their number of elements are
+ * kept as bit vectors.
+ */
+#define AdaptiveSet_DENSITY 32
+
+typedef struct AdaptiveSet* AdaptiveSet;
+
+/**
+ * The representations an AdaptiveSet can use.
+ */
+typedef enum { SET_WORD, SET_ARRAY, SET_BITS, SET_HASH } AdaptiveSetKind;
+
+/**
+ * Allocate and return a new empty AdaptiveSet. The universe is a hint at
+ * how big its elements will get: sets whose elements are all less than 64
+ * start out as a single word.
+ */
+extern AdaptiveSet new_AdaptiveSet(int universe);
+
+/**
+ * Free the given AdaptiveSet.
+ */
+extern void AdaptiveSet_free(AdaptiveSet this);
+
+/**
+ * Insert the given element into the given AdaptiveSet if it isn't already
+ * present.
+ */
+extern void AdaptiveSet_insert(AdaptiveSet this, int element);
+
+/**
+ * Return true if the given element is in the given AdaptiveSet, otherwise
+ * false.
+ */
+extern bool AdaptiveSet_lookup(AdaptiveSet this, int element);
+
+/**
+ * Add the elements of the second AdaptiveSet to the first.
+ */
+extern void AdaptiveSet_union(AdaptiveSet this, const AdaptiveSet other);
+
+/**
+ * Return the number of elements in the given AdaptiveSet.
+ */
+extern int AdaptiveSet_count(AdaptiveSet this);
+
+/**
+ * Return true if the given AdaptiveSet is empty.
+ */
+extern bool AdaptiveSet_isEmpty(AdaptiveSet this);
+
+/**
+ * Return true if the two given AdaptiveSets contain exactly the same
+ * elements, whatever their representations, otherwise false.
+ */
+extern bool AdaptiveSet_equals(AdaptiveSet this, AdaptiveSet other);
+
+/**
+ * Return the representation the given AdaptiveSet is using now.
+ */
+extern AdaptiveSetKind AdaptiveSet_get_kind(AdaptiveSet this);
+
+/**
+ * Call the given function on each element of the given AdaptiveSet.
+ */
+extern void AdaptiveSet_iterate(const AdaptiveSet this, void (*func)(int));
+
+typedef struct AdaptiveSetIterator* AdaptiveSetIterator;
+
+/**
+ * Return an AdaptiveSetIterator for the given AdaptiveSet, which must not
+ * change while it is in use. Elements come in increasing order except in
+ * the hash representation.
+ * Don't forget to free() this when you're done iterating.
+ */
+extern AdaptiveSetIterator AdaptiveSet_iterator(const AdaptiveSet this);
+
+/**
+ * Return true if the next call to AdaptiveSetIterator_next on the given
+ * AdaptiveSetIterator will not fail.
+ */
+extern bool AdaptiveSetIterator_hasNext(const AdaptiveSetIterator this);
+
+/**
+ * Return the next element from the given AdaptiveSetIterator, or -1 if
+ * there are no more.
+ */
+extern int AdaptiveSetIterator_next(AdaptiveSetIterator this);
+
+/**
+ * Print the given AdaptiveSet to stdout.
+ */
+extern void AdaptiveSet_print(AdaptiveSet this);
+
+/**
+ * Return the string representation of the given AdaptiveSet: its elements
+ * separated by commas.
+ * Don't forget to free() this string.
+ */
+extern char *AdaptiveSet_toString(AdaptiveSet this);
+
+#endif
@@ -0,0 +1,352 @@
+/*
+ * File: AhoCorasick.c
+ *
+ * Aho-Corasick keyword matching on top of dfa.h.
+ * The trie of keywords is built directly in the DFA: state 0 is the root,
+ * and a trie edge is a DFA transition (every other transition is still
+ * DFA_NO_STATE). Compiling visits the trie breadth-first, so when state s
+ * is reached its failure state fail(s) (a shallower state) already has a
+ * complete row. Every missing transition of s on c is then set to the
+ * transition of fail(s) on c, which is where the classic algorithm would
+ * end up after following failure links.
+ * The output set of s is the keyword ending at s (if any) followed by the
+ * output set of fail(s); the sets are flattened into one array.
+ * Since every transition is then set, the scans step through the DFA's
+ * own table (DFA_get_table) at whatever width it has, one lookup per byte.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "AhoCorasick.h"
+#include "profile.h"
+
+struct AhoCorasick {
+	DFA dfa;
+	bool compiled;
+	int *keywordAt;		// Keyword ending at each trie state, or -1
+	int capacity;		// Room in keywordAt
+	int *lengths;		// Length of each keyword
+	int nkeywords;
+	int keywordCapacity;	// Room in lengths
+	int *outStart;		// outputs[outStart[s]..outStart[s+1]) end at s
+	int *outputs;
+};
+
+/**
+ * Allocate and return a new AhoCorasick with no keywords.
+ */
+AhoCorasick new_AhoCorasick() {
+	AhoCorasick this = (AhoCorasick)malloc(sizeof(struct AhoCorasick));
+	if (this == NULL) {
+		return NULL;
+	}
+	this->dfa = new_DFA(1);
+	this->compiled = false;
+	this->capacity = 64;
+	this->keywordAt = (int*)malloc(sizeof(int) * this->capacity);
+	this->keywordAt[0] = -1;
+	this->keywordCapacity = 64;
+	this->lengths = (int*)malloc(sizeof(int) * this->keywordCapacity);
+	this->nkeywords = 0;
+	this->outStart = NULL;
+	this->outputs = NULL;
+	return this;
+}
+
+/**
+ * Free the given AhoCorasick (including its DFA).
+ */
+void AhoCorasick_free(AhoCorasick this) {
+	if (this == NULL) {
+		return;
+	}
+	DFA_free(this->dfa);
+	free(this->keywordAt);
+	free(this->lengths);
+	free(this->outStart);
+	free(this->outputs);
+	free(this);
+}
+
+/**
+ * Add the given (non-empty) keyword to the given AhoCorasick and return its
+ * keyword number.
+ */
+int AhoCorasick_add(AhoCorasick this, const char *keyword) {
+	if (this->compiled) {
+		fprintf(stderr, "AhoCorasick_add: already compiled\n");
+		abort();
+	}
+	int s = 0;
+	for (const char *p=keyword; *p != '\0'; p++) {
+		int t = DFA_get_transition(this->dfa, s, *p);
+		if (t == DFA_NO_STATE) {
+			t = DFA_add_state(this->dfa);
+			if (t >= this->capacity) {
+				this->capacity *= 2;
+				this->keywordAt = (int*)realloc(this->keywordAt, sizeof(int) * this->capacity);
+			}
+			this->keywordAt[t] = -1;
+			DFA_set_transition(this->dfa, s, *p, t);
+		}
+		s = t;
+	}
+	if (this->keywordAt[s] < 0) {
+		if (this->nkeywords == this->keywordCapacity) {
+			this->keywordCapacity *= 2;
+			this->lengths = (int*)realloc(this->lengths, sizeof(int) * this->keywordCapacity);
+		}
+		this->lengths[this->nkeywords] = strlen(keyword);
+		this->keywordAt[s] = this->nkeywords++;
+	}
+	return this->keywordAt[s];
+}
+
+/**
+ * Return the number of distinct keywords in the given AhoCorasick.
+ */
+int AhoCorasick_get_count(AhoCorasick this) {
+	return this->nkeywords;
+}
+
+/**
+ * Return the length of the given keyword of the given AhoCorasick.
+ */
+int AhoCorasick_get_length(AhoCorasick this, int keyword) {
+	return this->lengths[keyword];
+}
+
+/**
+ * Compute the failure links and the output sets of the given AhoCorasick
+ * and fill in every missing transition of its DFA.
+ */
+void AhoCorasick_compile(AhoCorasick this) {
+	if (this->compiled) {
+		return;
+	}
+	DFA dfa = this->dfa;
+	int n = DFA_get_size(dfa);
+	int *fail = (int*)malloc(sizeof(int) * n);
+	int *queue = (int*)malloc(sizeof(int) * n);
+	int head = 0;
+	int tail = 0;
+
+	fail[0] = 0;
+	queue[tail++] = 0;
+	while (head < tail) {
+		int s = queue[head++];
+		for (int c=0; c < DFA_NSYMBOLS; c++) {
+			int t = DFA_get_transition(dfa, s, (char)c);
+			if (t != DFA_NO_STATE) {
+				// A trie edge: the failure state of t is where fail(s) goes on c
+				fail[t] = (s == 0) ? 0 : DFA_get_transition(dfa, fail[s], (char)c);
+				queue[tail++] = t;
+			} else {
+				DFA_set_transition(dfa, s, (char)c, (s == 0) ? 0 : DFA_get_transition(dfa, fail[s], (char)c));
+			}
+		}
+	}
+
+	// Output set sizes, then the sets themselves, in BFS order
+	this->outStart = (int*)malloc(sizeof(int) * (n + 1));
+	int *count = (int*)malloc(sizeof(int) * n);
+	int total = 0;
+	for (int i=0; i < n; i++) {
+		int s = queue[i];
+		count[s] = (this->keywordAt[s] >= 0 ? 1 : 0) + (s == 0 ? 0 : count[fail[s]]);
+		total += count[s];
+	}
+	this->outputs = (int*)malloc(sizeof(int) * (total > 0 ? total : 1));
+	this->outStart[0] = 0;
+	for (int s=0; s < n; s++) {
+		this->outStart[s+1] = this->outStart[s] + count[s];
+	}
+	for (int i=0; i < n; i++) {
+		int s = queue[i];
+		int *out = this->outputs + this->outStart[s];
+		if (this->keywordAt[s] >= 0) {
+			*out++ = this->keywordAt[s];
+		}
+		if (s != 0) {
+			memcpy(out, this->outputs + this->outStart[fail[s]], sizeof(int) * count[fail[s]]);
+		}
+		DFA_set_accepting(dfa, s, count[s] > 0);
+	}
+	free(count);
+	free(fail);
+	free(queue);
+	this->compiled = true;
+}
+
+/**
+ * Return the DFA of the given (compiled) AhoCorasick.
+ */
+DFA AhoCorasick_get_DFA(AhoCorasick this) {
+	return this->dfa;
+}
+
+/**
+ * Return the number of keywords that end at the given state of the given
+ * (compiled) AhoCorasick's DFA, and set *keywords to point at their numbers.
+ */
+int AhoCorasick_get_outputs(AhoCorasick this, int state, const int **keywords) {
+	*keywords = this->outputs + this->outStart[state];
+	return this->outStart[state+1] - this->outStart[state];
+}
+
+/**
+ * Return the transition of the given DFA from the given state on symbol
+ * c, from the table of the given width that DFA_get_table returned for it
+ * if there is one. The width is the same every time in a scan, so the
+ * branches on it are always predicted.
+ */
+static inline int step(DFA dfa, const void *table, int width, int state, unsigned char c) {
+	size_t i = (size_t)state * DFA_NSYMBOLS + c;
+	if (width == 1) {
+		return ((const uint8_t*)table)[i];
+	} else if (width == 2) {
+		return ((const uint16_t*)table)[i];
+	} else if (width == 4) {
+		return ((const int32_t*)table)[i];
+	}
+	return DFA_get_transition(dfa, state, (char)c);
+}
+
+/**
+ * Scan the given text with the given (compiled) AhoCorasick, calling
+ * report(keyword, end, arg) for every occurrence of every keyword.
+ */
+long AhoCorasick_scan(AhoCorasick this, const char *text,
+		      void (*report)(int keyword, long end, void *arg), void *arg) {
+	int width;
+	const void *table = DFA_get_table(this->dfa, &width);
+	long occurrences = 0;
+	int state = 0;
+	long i;
+	PROFILE_BEGIN(this);
+	for (i=0; text[i] != '\0'; i++) {
+		PROFILE_STEP(state, (unsigned char)text[i]);
+		state = step(this->dfa, table, width, state, (unsigned char)text[i]);
+		int first = this->outStart[state];
+		int last = this->outStart[state+1];
+		for (int j=first; j < last; j++) {
+			if (report != NULL) {
+				report(this->outputs[j], i + 1, arg);
+			}
+		}
+		occurrences += last - first;
+	}
+	PROFILE_END(state, i, false);
+	return occurrences;
+}
+
+/**
+ * Scan the given text with the given (compiled) AhoCorasick and set
+ * found[k] to whether keyword k occurs in it.
+ */
+int AhoCorasick_find(AhoCorasick this, const char *text, bool *found) {
+	memset(found, 0, sizeof(bool) * this->nkeywords);
+	int width;
+	const void *table = DFA_get_table(this->dfa, &width);
+	int nfound = 0;
+	int state = 0;
+	const char *p;
+	PROFILE_BEGIN(this);
+	for (p=text; *p != '\0'; p++) {
+		PROFILE_STEP(state, (unsigned char)*p);
+		state = step(this->dfa, table, width, state, (unsigned char)*p);
+		for (int j=this->outStart[state]; j < this->outStart[state+1]; j++) {
+			int k = this->outputs[j];
+			if (!found[k]) {
+				found[k] = true;
+				nfound += 1;
+			}
+		}
+	}
+	PROFILE_END(state, p - text, false);
+	return nfound;
+}
+
+#ifdef MAIN
+
+static char *keywords[] = { "he", "she", "his", "hers", "end", "got" };
+#define NKEYWORDS (sizeof(keywords) / sizeof(keywords[0]))
+
+static void print_occurrence(int keyword, long end, void *arg) {
+	AhoCorasick ac = (AhoCorasick)arg;
+	printf("  \"%s\" at %ld\n", keywords[keyword], end - AhoCorasick_get_length(ac, keyword));
+}
+
+int main(int argc, char* argv[]) {
+	AhoCorasick ac = new_AhoCorasick();
+	for (int i=0; i < NKEYWORDS; i++) {
+		AhoCorasick_add(ac, keywords[i]);
+	}
+	printf("re-adding \"she\" gives keyword %d\n", AhoCorasick_add(ac, "she"));
+	AhoCorasick_compile(ac);
+	printf("%d keywords, %d states\n", AhoCorasick_get_count(ac), DFA_get_size(AhoCorasick_get_DFA(ac)));
+
+	printf("scanning \"ushers\":\n");
+	AhoCorasick_scan(ac, "ushers", print_occurrence, ac);
+
+	char *texts[] = { "ened", "the end", "forgot", "gogt", "" };
+	bool found[NKEYWORDS];
+	for (int i=0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+		AhoCorasick_find(ac, texts[i], found);
+		printf("\"%s\": contains end %s, contains got %s\n", texts[i],
+		       found[4] ? "true" : "false", found[5] ? "true" : "false");
+	}
+
+	printf("comparing with strstr on a random vocabulary...\n");
+	AhoCorasick big = new_AhoCorasick();
+	int nwords = 5000;
+	char (*words)[8] = malloc(sizeof(*words) * nwords);
+	int *ids = (int*)malloc(sizeof(int) * nwords);
+	unsigned int seed = 42;
+	for (int i=0; i < nwords; i++) {
+		int len = 2 + i % 5;
+		for (int j=0; j < len; j++) {
+			seed = seed * 1103515245 + 12345;
+			words[i][j] = 'a' + (seed >> 16) % 6;
+		}
+		words[i][len] = '\0';
+		ids[i] = AhoCorasick_add(big, words[i]);
+	}
+	AhoCorasick_compile(big);
+	char text[2001];
+	for (int j=0; j < 2000; j++) {
+		seed = seed * 1103515245 + 12345;
+		text[j] = 'a' + (seed >> 16) % 7;
+	}
+	text[2000] = '\0';
+	bool *bigFound = (bool*)malloc(sizeof(bool) * AhoCorasick_get_count(big));
+	AhoCorasick_find(big, text, bigFound);
+	int mismatches = 0;
+	for (int i=0; i < nwords; i++) {
+		if (bigFound[ids[i]] != (strstr(text, words[i]) != NULL)) {
+			mismatches += 1;
+		}
+	}
+	int width;
+	DFA_get_table(AhoCorasick_get_DFA(big), &width);
+	printf("%d distinct keywords, %d states (%d-byte transitions), %d mismatches\n",
+	       AhoCorasick_get_count(big), DFA_get_size(AhoCorasick_get_DFA(big)), width, mismatches);
+
+	// Without a table to step through, the scans go through the DFA
+	bool *combFound = (bool*)malloc(sizeof(bool) * AhoCorasick_get_count(big));
+	DFA_set_storage(AhoCorasick_get_DFA(big), DFA_COMB);
+	AhoCorasick_find(big, text, combFound);
+	printf("with comb storage: same keywords found %s\n",
+	       memcmp(bigFound, combFound, sizeof(bool) * AhoCorasick_get_count(big)) == 0 ? "true" : "false");
+	free(combFound);
+
+	free(words);
+	free(ids);
+	free(bigFound);
+	AhoCorasick_free(big);
+	AhoCorasick_free(ac);
+}
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * File: AhoCorasick.h
+ *
+ * Aho-Corasick automaton for finding every occurrence of any of a set of
+ * keywords in one pass over a text.
+ * @see Aho & Corasick, "Efficient String Matching: An Aid to Bibliographic
+ * Search", CACM 18(6), 1975.
+ * Keywords are added to a trie, then AhoCorasick_compile computes failure
+ * links and flattens goto+failure into a full table DFA (dfa.h), so each
+ * input byte costs exactly one table lookup. Each state also has the set of
+ * keywords that end there.
+ */
+
+#ifndef _AhoCorasick_h
+#define _AhoCorasick_h
+
+#include <stdbool.h>
+#include "dfa.h"
+
+typedef struct AhoCorasick *AhoCorasick;
+
+/**
+ * Allocate and return a new AhoCorasick with no keywords.
+ */
+extern AhoCorasick new_AhoCorasick();
+
+/**
+ * Free the given AhoCorasick (including its DFA).
+ */
+extern void AhoCorasick_free(AhoCorasick ac);
+
+/**
+ * Add the given (non-empty) keyword to the given AhoCorasick and return its
+ * keyword number. Keywords are numbered from 0 in the order they are added;
+ * adding a keyword again returns its existing number.
+ * Keywords can't be added once the AhoCorasick has been compiled.
+ */
+extern int AhoCorasick_add(AhoCorasick ac, const char *keyword);
+
+/**
+ * Return the number of distinct keywords in the given AhoCorasick.
+ */
+extern int AhoCorasick_get_count(AhoCorasick ac);
+
+/**
+ * Return the length of the given keyword of the given AhoCorasick.
+ */
+extern int AhoCorasick_get_length(AhoCorasick ac, int keyword);
+
+/**
+ * Compute the failure links and the output sets of the given AhoCorasick
+ * and fill in every missing transition of its DFA.
+ */
+extern void AhoCorasick_compile(AhoCorasick ac);
+
+/**
+ * Return the DFA of the given (compiled) AhoCorasick. It belongs to the
+ * AhoCorasick. A state is accepting when some keyword ends there, so the
+ * DFA accepts exactly the strings that end with a keyword.
+ */
+extern DFA AhoCorasick_get_DFA(AhoCorasick ac);
+
+/**
+ * Return the number of keywords that end at the given state of the given
+ * (compiled) AhoCorasick's DFA, and set *keywords to point at their numbers
+ * (longest keyword first). The array belongs to the AhoCorasick.
+ */
+extern int AhoCorasick_get_outputs(AhoCorasick ac, int state, const int **keywords);
+
+/**
+ * Scan the given text with the given (compiled) AhoCorasick, calling
+ * report(keyword, end, arg) for every occurrence of every keyword, where
+ * end is the offset just past the occurrence. Returns the number of
+ * occurrences.
+ */
+extern long AhoCorasick_scan(AhoCorasick ac, const char *text,
+			     void (*report)(int keyword, long end, void *arg), void *arg);
+
+/**
+ * Scan the given text with the given (compiled) AhoCorasick and set
+ * found[k] to whether keyword k occurs in it. Returns the number of
+ * distinct keywords found.
+ */
+extern int AhoCorasick_find(AhoCorasick ac, const char *text, bool *found);
+
+#endif
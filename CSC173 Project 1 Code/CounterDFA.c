@@ -0,0 +1,464 @@
+/*
+ * File: CounterDFA.c
+ *
+ * Table-driven implementation of the CounterDFA API in CounterDFA.h.
+ * Like dfa.c, each state has a full row of destinations. A second table
+ * gives each (state, symbol) the index of an Edge holding its actions and
+ * guards, or -1 if it has none, so plain transitions cost one extra
+ * lookup. Symbols given together in one call share one Edge, which makes
+ * an Edge the counter behavior of a whole class of symbols. Adding to the
+ * transitions of every user of an Edge grows it in place; only adding to
+ * some of them copies it for those.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CounterDFA.h"
+
+typedef struct Action {
+	int counter;
+	CounterOp op;
+} Action;
+
+typedef struct Test {
+	int counter;
+	CounterTest test;
+	Counter value;
+	int dst;		// Where a guard goes if the test passes
+} Test;
+
+typedef struct Edge {
+	int nactions;
+	Action *actions;
+	int nguards;
+	Test *guards;
+	int users;		// (state, symbol) pairs with this Edge
+} Edge;
+
+struct CounterDFA {
+	int nstates;
+	int ncounters;
+	int *delta;		// nstates rows of DFA_NSYMBOLS destinations
+	int *edge;		// nstates rows of DFA_NSYMBOLS Edge indexes, or -1
+	Edge *edges;
+	int nedges;
+	int edgeCapacity;
+	Counter *bound;		// Per counter
+	bool *accepting;
+	int *nconditions;	// Per state
+	Test **conditions;
+};
+
+/**
+ * The largest value a test can use, so that counters fit in a Counter.
+ */
+#define MAX_TEST_VALUE 65534
+
+/**
+ * Allocate and return a new CounterDFA with the given numbers of states
+ * and counters.
+ */
+CounterDFA new_CounterDFA(int nstates, int ncounters) {
+	CounterDFA this = (CounterDFA)malloc(sizeof(struct CounterDFA));
+	if (this == NULL) {
+		return NULL;
+	}
+	this->nstates = nstates;
+	this->ncounters = ncounters;
+	this->delta = (int*)malloc(sizeof(int) * nstates * DFA_NSYMBOLS);
+	this->edge = (int*)malloc(sizeof(int) * nstates * DFA_NSYMBOLS);
+	for (int i=0; i < nstates * DFA_NSYMBOLS; i++) {
+		this->delta[i] = DFA_NO_STATE;
+		this->edge[i] = -1;
+	}
+	this->edges = NULL;
+	this->nedges = 0;
+	this->edgeCapacity = 0;
+	this->bound = (Counter*)calloc(ncounters, sizeof(Counter));
+	this->accepting = (bool*)calloc(nstates, sizeof(bool));
+	this->nconditions = (int*)calloc(nstates, sizeof(int));
+	this->conditions = (Test**)calloc(nstates, sizeof(Test*));
+	return this;
+}
+
+/**
+ * Free the given CounterDFA.
+ */
+void CounterDFA_free(CounterDFA this) {
+	if (this == NULL) {
+		return;
+	}
+	for (int i=0; i < this->nedges; i++) {
+		free(this->edges[i].actions);
+		free(this->edges[i].guards);
+	}
+	for (int s=0; s < this->nstates; s++) {
+		free(this->conditions[s]);
+	}
+	free(this->delta);
+	free(this->edge);
+	free(this->edges);
+	free(this->bound);
+	free(this->accepting);
+	free(this->nconditions);
+	free(this->conditions);
+	free(this);
+}
+
+/**
+ * Return the number of states in the given CounterDFA.
+ */
+int CounterDFA_get_size(CounterDFA this) {
+	return this->nstates;
+}
+
+/**
+ * Return the number of counters in the given CounterDFA.
+ */
+int CounterDFA_get_ncounters(CounterDFA this) {
+	return this->ncounters;
+}
+
+/**
+ * Return the value the given counter of the given CounterDFA saturates at.
+ */
+int CounterDFA_get_bound(CounterDFA this, int counter) {
+	return this->bound[counter];
+}
+
+/**
+ * Set the destination of the transitions from state src on each symbol in
+ * the given string to dst.
+ */
+void CounterDFA_set_transition_str(CounterDFA this, int src, char *str, int dst) {
+	for (const unsigned char *p=(const unsigned char*)str; *p != '\0'; p++) {
+		this->delta[src * DFA_NSYMBOLS + *p] = dst;
+	}
+}
+
+/**
+ * Set the destination of the transitions from state src on every symbol
+ * to dst.
+ */
+void CounterDFA_set_transition_all(CounterDFA this, int src, int dst) {
+	for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+		this->delta[src * DFA_NSYMBOLS + sym] = dst;
+	}
+}
+
+/**
+ * Check the value of a test and raise the bound of its counter so that
+ * saturating never changes the test's outcome.
+ */
+static Counter use_value(CounterDFA this, int counter, CounterTest test, int value) {
+	if (value < 0 || value > MAX_TEST_VALUE) {
+		fprintf(stderr, "CounterDFA: test value %d out of range\n", value);
+		abort();
+	}
+	int needed = (test == COUNTER_AT_LEAST) ? value : value + 1;
+	if (needed > this->bound[counter]) {
+		this->bound[counter] = needed;
+	}
+	return (Counter)value;
+}
+
+/**
+ * Return the index of a new Edge that is a copy of the given one (or
+ * empty, if index is -1) with room for one more action and guard.
+ */
+static int copy_edge(CounterDFA this, int index) {
+	if (this->nedges == this->edgeCapacity) {
+		this->edgeCapacity = (this->edgeCapacity == 0) ? 16 : 2 * this->edgeCapacity;
+		this->edges = (Edge*)realloc(this->edges, sizeof(Edge) * this->edgeCapacity);
+	}
+	Edge *copy = &this->edges[this->nedges];
+	Edge empty = { 0, NULL, 0, NULL, 0 };
+	Edge *old = (index >= 0) ? &this->edges[index] : &empty;
+	copy->nactions = old->nactions;
+	copy->actions = (Action*)malloc(sizeof(Action) * (old->nactions + 1));
+	copy->nguards = old->nguards;
+	copy->guards = (Test*)malloc(sizeof(Test) * (old->nguards + 1));
+	copy->users = 0;
+	if (index >= 0) {
+		memcpy(copy->actions, old->actions, sizeof(Action) * old->nactions);
+		memcpy(copy->guards, old->guards, sizeof(Test) * old->nguards);
+	}
+	return this->nedges++;
+}
+
+/**
+ * Make room in the given Edge for one more action and guard.
+ */
+static void grow_edge(Edge *edge) {
+	edge->actions = (Action*)realloc(edge->actions, sizeof(Action) * (edge->nactions + 1));
+	edge->guards = (Test*)realloc(edge->guards, sizeof(Test) * (edge->nguards + 1));
+}
+
+/**
+ * Set changed to the indexes of the Edges to add to for the transitions
+ * from src on the symbols in str, each with room for one more action and
+ * guard, and return how many there are. An Edge whose users are all in
+ * str is changed in place. One that is also used by other transitions is
+ * copied for the symbols in str, which share the copy.
+ */
+static int change_edges(CounterDFA this, int src, char *str, int changed[DFA_NSYMBOLS]) {
+	bool seen[DFA_NSYMBOLS] = { false };
+	int old[DFA_NSYMBOLS];		// Edge that changed[i] replaces, or -1
+	int moving[DFA_NSYMBOLS];	// Users of old[i] among the symbols
+	int n = 0;
+	for (const unsigned char *p=(const unsigned char*)str; *p != '\0'; p++) {
+		if (seen[*p]) {
+			continue;	// Symbol repeated in str
+		}
+		seen[*p] = true;
+		int edge = this->edge[src * DFA_NSYMBOLS + *p];
+		int i;
+		for (i=0; i < n && old[i] != edge; i++) {
+		}
+		if (i == n) {
+			old[n] = edge;
+			moving[n++] = 0;
+		}
+		moving[i] += 1;
+	}
+	for (int i=0; i < n; i++) {
+		if (old[i] >= 0 && moving[i] == this->edges[old[i]].users) {
+			changed[i] = old[i];
+			grow_edge(&this->edges[old[i]]);
+		} else {
+			changed[i] = copy_edge(this, old[i]);
+			this->edges[changed[i]].users = moving[i];
+			if (old[i] >= 0) {
+				this->edges[old[i]].users -= moving[i];
+			}
+		}
+	}
+	for (const unsigned char *p=(const unsigned char*)str; *p != '\0'; p++) {
+		int *edge = &this->edge[src * DFA_NSYMBOLS + *p];
+		for (int i=0; i < n; i++) {
+			if (old[i] == *edge) {
+				*edge = changed[i];
+				break;
+			}
+		}
+	}
+	return n;
+}
+
+/**
+ * Make the transitions from state src on each symbol in the given string
+ * do op to the given counter.
+ */
+void CounterDFA_add_action_str(CounterDFA this, int src, char *str, int counter, CounterOp op) {
+	int changed[DFA_NSYMBOLS];
+	int n = change_edges(this, src, str, changed);
+	for (int i=0; i < n; i++) {
+		Edge *edge = &this->edges[changed[i]];
+		edge->actions[edge->nactions].counter = counter;
+		edge->actions[edge->nactions].op = op;
+		edge->nactions += 1;
+	}
+}
+
+/**
+ * Make the transitions from state src on each symbol in the given string
+ * go to dst if the given counter passes the given test against value.
+ */
+void CounterDFA_add_guard_str(CounterDFA this, int src, char *str,
+			      int counter, CounterTest test, int value, int dst) {
+	Counter v = use_value(this, counter, test, value);
+	int changed[DFA_NSYMBOLS];
+	int n = change_edges(this, src, str, changed);
+	for (int i=0; i < n; i++) {
+		Edge *edge = &this->edges[changed[i]];
+		Test guard = { counter, test, v, dst };
+		edge->guards[edge->nguards++] = guard;
+	}
+}
+
+/**
+ * Set whether the given state of the given CounterDFA is accepting.
+ */
+void CounterDFA_set_accepting(CounterDFA this, int state, bool value) {
+	this->accepting[state] = value;
+}
+
+/**
+ * Require the given counter to pass the given test against value for
+ * input ending in the given state to be accepted.
+ */
+void CounterDFA_add_accept_condition(CounterDFA this, int state,
+				     int counter, CounterTest test, int value) {
+	Counter v = use_value(this, counter, test, value);
+	int n = this->nconditions[state];
+	this->conditions[state] = (Test*)realloc(this->conditions[state], sizeof(Test) * (n + 1));
+	Test condition = { counter, test, v, DFA_NO_STATE };
+	this->conditions[state][n] = condition;
+	this->nconditions[state] = n + 1;
+}
+
+static bool passes(const Test *test, const Counter *counters) {
+	Counter c = counters[test->counter];
+	return (test->test == COUNTER_AT_LEAST) ? c >= test->value : c <= test->value;
+}
+
+/**
+ * Run the given CounterDFA on the given input string starting from the
+ * given state and counter values, updating the counters and returning the
+ * state it ends up in.
+ */
+int CounterDFA_run(CounterDFA this, int state, Counter *counters, const char *input) {
+	const int *delta = this->delta;
+	const int *edges = this->edge;
+	const Counter *bound = this->bound;
+	const unsigned char *p = (const unsigned char*)input;
+	while (*p != '\0' && state != DFA_NO_STATE) {
+		int i = state * DFA_NSYMBOLS + *p++;
+		state = delta[i];
+		if (edges[i] < 0) {
+			continue;
+		}
+		const Edge *edge = &this->edges[edges[i]];
+		for (int a=0; a < edge->nactions; a++) {
+			int c = edge->actions[a].counter;
+			if (edge->actions[a].op == COUNTER_RESET) {
+				counters[c] = 0;
+			} else if (counters[c] < bound[c]) {
+				counters[c] += 1;
+			}
+		}
+		for (int g=0; g < edge->nguards; g++) {
+			if (passes(&edge->guards[g], counters)) {
+				state = edge->guards[g].dst;
+				break;
+			}
+		}
+	}
+	return state;
+}
+
+/**
+ * Return true if the given state and counter values of the given
+ * CounterDFA mean the input so far is accepted.
+ */
+bool CounterDFA_accepts(CounterDFA this, int state, const Counter *counters) {
+	if (state == DFA_NO_STATE || !this->accepting[state]) {
+		return false;
+	}
+	for (int i=0; i < this->nconditions[state]; i++) {
+		if (!passes(&this->conditions[state][i], counters)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Run the given CounterDFA on the given input string, and return true if
+ * it accepts the input, otherwise false.
+ */
+bool CounterDFA_execute(CounterDFA this, const char *input) {
+	Counter *counters = (Counter*)calloc(this->ncounters > 0 ? this->ncounters : 1, sizeof(Counter));
+	int state = CounterDFA_run(this, 0, counters, input);
+	bool result = CounterDFA_accepts(this, state, counters);
+	free(counters);
+	return result;
+}
+
+#ifdef MAIN
+
+static void test(CounterDFA cdfa, char *input) {
+	printf("  \"%s\": %s\n", input, CounterDFA_execute(cdfa, input) ? "true" : "false");
+}
+
+/**
+ * The same rule counted by hand, to check against.
+ */
+static bool character_counts(const char *input) {
+	int counts[DFA_NSYMBOLS] = {0};
+	for (const unsigned char *p=(const unsigned char*)input; *p != '\0'; p++) {
+		counts[*p] += 1;
+	}
+	return counts['a'] > 1 || counts['e'] > 1 || counts['h'] > 1 || counts['i'] > 1
+		|| counts['g'] > 1 || counts['n'] > 2 || counts['p'] > 2;
+}
+
+int main(int argc, char* argv[]) {
+	printf("more than one a, e, h, i or g, or more than two n's or p's...\n");
+	// State 0 counts; state 1 has seen enough and accepts anything
+	CounterDFA counts = new_CounterDFA(2, 7);
+	CounterDFA_set_transition_all(counts, 0, 0);
+	CounterDFA_set_transition_all(counts, 1, 1);
+	CounterDFA_set_accepting(counts, 1, true);
+	char *letters[] = { "a", "e", "h", "i", "g", "n", "p" };
+	for (int c=0; c < 7; c++) {
+		CounterDFA_add_action_str(counts, 0, letters[c], c, COUNTER_INCREMENT);
+		CounterDFA_add_guard_str(counts, 0, letters[c], c, COUNTER_AT_LEAST, c < 5 ? 2 : 3, 1);
+	}
+	test(counts, "a");
+	test(counts, "banana");
+	test(counts, "pipe");
+	test(counts, "pippin");
+	test(counts, "xyz");
+
+	printf("checking against counting by hand...\n");
+	unsigned int seed = 173;
+	int errors = 0;
+	char input[16];
+	for (int i=0; i < 100000; i++) {
+		int len = i % 15;
+		for (int j=0; j < len; j++) {
+			seed = seed * 1103515245 + 12345;
+			input[j] = "aehignpxyz"[(seed >> 16) % 10];
+		}
+		input[len] = '\0';
+		if (CounterDFA_execute(counts, input) != character_counts(input)) {
+			errors += 1;
+		}
+	}
+	printf("  %d errors\n", errors);
+
+	// Each letter's Edge grew in place for its guard, and adding to one
+	// of two symbols that share an Edge copies it just for that one
+	printf("  %d Edges for 7 letters with an action and a guard each\n", counts->nedges);
+	CounterDFA_add_action_str(counts, 0, "xy", 0, COUNTER_INCREMENT);
+	CounterDFA_add_action_str(counts, 0, "xy", 1, COUNTER_INCREMENT);
+	CounterDFA_add_action_str(counts, 0, "x", 2, COUNTER_INCREMENT);
+	printf("  %d Edges after three actions on x and two on y\n", counts->nedges);
+	test(counts, "xa");
+	test(counts, "xxa");
+
+	printf("at least 5 digits and at most 3 @'s...\n");
+	CounterDFA email = new_CounterDFA(1, 2);
+	CounterDFA_set_transition_all(email, 0, 0);
+	CounterDFA_add_action_str(email, 0, "0123456789", 0, COUNTER_INCREMENT);
+	CounterDFA_add_action_str(email, 0, "@", 1, COUNTER_INCREMENT);
+	CounterDFA_add_guard_str(email, 0, "@", 1, COUNTER_AT_LEAST, 4, DFA_NO_STATE);
+	CounterDFA_set_accepting(email, 0, true);
+	CounterDFA_add_accept_condition(email, 0, 0, COUNTER_AT_LEAST, 5);
+	printf("  counter bounds %d and %d\n", CounterDFA_get_bound(email, 0), CounterDFA_get_bound(email, 1));
+	test(email, "a1b2c3d4e5@x");
+	test(email, "1234@@@@5");
+	test(email, "1234");
+	test(email, "9999999999999999999999999999");
+
+	printf("feeding input in pieces, resetting between lines...\n");
+	CounterDFA lines = new_CounterDFA(1, 1);
+	CounterDFA_set_transition_all(lines, 0, 0);
+	CounterDFA_add_action_str(lines, 0, "x", 0, COUNTER_INCREMENT);
+	CounterDFA_add_action_str(lines, 0, "\n", 0, COUNTER_RESET);
+	CounterDFA_set_accepting(lines, 0, true);
+	CounterDFA_add_accept_condition(lines, 0, 0, COUNTER_AT_MOST, 2);
+	Counter counter = 0;
+	int state = CounterDFA_run(lines, 0, &counter, "xxx\nx");
+	printf("  after \"xxx\\nx\": %s\n", CounterDFA_accepts(lines, state, &counter) ? "true" : "false");
+	state = CounterDFA_run(lines, state, &counter, "xx");
+	printf("  then \"xx\": %s\n", CounterDFA_accepts(lines, state, &counter) ? "true" : "false");
+
+	CounterDFA_free(counts);
+	CounterDFA_free(email);
+	CounterDFA_free(lines);
+}
+
+#endif
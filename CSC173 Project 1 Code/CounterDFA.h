@@ -0,0 +1,127 @@
+/*
+ * File: CounterDFA.h
+ *
+ * DFAs extended with bounded counters, for rules like "more than one a"
+ * or "at least 5 digits and at most 3 @'s". As a plain DFA such a rule
+ * needs a state for every combination of counts, which multiplies as the
+ * thresholds rise; here the counts live in a small vector of counters
+ * next to the state instead.
+ * Each transition can increment or reset counters, and then test them
+ * with guards that send it somewhere other than its usual destination.
+ * An accepting state can also require counters to pass tests at the end.
+ * Counters saturate just above the largest value any test uses, so they
+ * fit in a few bytes whatever the input length.
+ */
+
+#ifndef _CounterDFA_h
+#define _CounterDFA_h
+
+#include <stdbool.h>
+#include "dfa.h"
+
+typedef struct CounterDFA *CounterDFA;
+
+/**
+ * The value of a counter. Counters never go past CounterDFA_get_bound.
+ */
+typedef unsigned short Counter;
+
+/**
+ * What a transition does to a counter.
+ */
+typedef enum { COUNTER_INCREMENT, COUNTER_RESET } CounterOp;
+
+/**
+ * How a guard or accepting condition compares a counter with a value.
+ */
+typedef enum { COUNTER_AT_LEAST, COUNTER_AT_MOST } CounterTest;
+
+/**
+ * Allocate and return a new CounterDFA with the given numbers of states
+ * and counters. Transitions start out as DFA_NO_STATE with no actions or
+ * guards, no state is accepting, and counters start at 0.
+ */
+extern CounterDFA new_CounterDFA(int nstates, int ncounters);
+
+/**
+ * Free the given CounterDFA.
+ */
+extern void CounterDFA_free(CounterDFA cdfa);
+
+/**
+ * Return the number of states in the given CounterDFA.
+ */
+extern int CounterDFA_get_size(CounterDFA cdfa);
+
+/**
+ * Return the number of counters in the given CounterDFA.
+ */
+extern int CounterDFA_get_ncounters(CounterDFA cdfa);
+
+/**
+ * Return the value the given counter of the given CounterDFA saturates
+ * at: one more than the largest value any of its tests uses.
+ */
+extern int CounterDFA_get_bound(CounterDFA cdfa, int counter);
+
+/**
+ * Set the destination of the transitions from state src on each symbol in
+ * the given string to dst.
+ */
+extern void CounterDFA_set_transition_str(CounterDFA cdfa, int src, char *str, int dst);
+
+/**
+ * Set the destination of the transitions from state src on every symbol
+ * to dst.
+ */
+extern void CounterDFA_set_transition_all(CounterDFA cdfa, int src, int dst);
+
+/**
+ * Make the transitions from state src on each symbol in the given string
+ * do op to the given counter. Actions happen in the order they are added.
+ */
+extern void CounterDFA_add_action_str(CounterDFA cdfa, int src, char *str, int counter, CounterOp op);
+
+/**
+ * Make the transitions from state src on each symbol in the given string
+ * go to dst (which may be DFA_NO_STATE) instead of their destination if,
+ * after their actions, the given counter passes the given test against
+ * value. Guards are tried in the order they are added; the first that
+ * passes wins.
+ */
+extern void CounterDFA_add_guard_str(CounterDFA cdfa, int src, char *str,
+				     int counter, CounterTest test, int value, int dst);
+
+/**
+ * Set whether the given state of the given CounterDFA is accepting.
+ */
+extern void CounterDFA_set_accepting(CounterDFA cdfa, int state, bool value);
+
+/**
+ * Require the given counter to pass the given test against value for
+ * input ending in the given (accepting) state to be accepted.
+ */
+extern void CounterDFA_add_accept_condition(CounterDFA cdfa, int state,
+					    int counter, CounterTest test, int value);
+
+/**
+ * Run the given CounterDFA on the given input string starting from the
+ * given state and counter values (one per counter), updating the counters
+ * and returning the state it ends up in, or DFA_NO_STATE if it got stuck.
+ * As with DFA_run, the caller owns all the run state.
+ */
+extern int CounterDFA_run(CounterDFA cdfa, int state, Counter *counters, const char *input);
+
+/**
+ * Return true if the given state and counter values of the given
+ * CounterDFA mean the input so far is accepted.
+ */
+extern bool CounterDFA_accepts(CounterDFA cdfa, int state, const Counter *counters);
+
+/**
+ * Run the given CounterDFA on the given input string, and return true if
+ * it accepts the input, otherwise false.
+ */
+extern bool CounterDFA_execute(CounterDFA cdfa, const char *input);
+
+#endif
@@ -0,0 +1,562 @@
+/*
+ * File: DictBuilder.c
+ *
+ * Daciuk-style incremental construction of minimal acyclic DFAs.
+ * The "register" is a hash table holding one representative of each class
+ * of equivalent states, where two states of an acyclic automaton are
+ * equivalent when they have the same finality and the same labelled edges
+ * to the same (already unique) states. Before a state is changed it leaves
+ * the register; afterwards replace_or_register either finds an equivalent
+ * state to use instead or registers it.
+ *
+ * Sorted input: the states along the last word added are kept out of the
+ * register. The next word can only share a prefix with it, so everything
+ * below that prefix is final and gets registered bottom-up.
+ *
+ * Unsorted input: every state except the start state is registered. A new
+ * word's path is taken out of the register, states from the first one with
+ * more than one incoming edge (a "confluence" state, shared with other
+ * words) onwards are cloned so that other words aren't changed, the rest
+ * of the word is added, and the whole path is re-registered bottom-up.
+ * The builder switches from sorted to unsorted for good the first time a
+ * word arrives out of order.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "DictBuilder.h"
+
+typedef struct Edge {
+	unsigned char sym;
+	int target;
+} Edge;
+
+typedef struct State {
+	Edge *edges;		// Sorted by sym
+	int nedges;
+	int capacity;
+	int indegree;
+	bool final;
+	bool registered;
+	unsigned long long hash;	// Valid while registered
+	int next;		// Next in register bucket, or in free list
+} State;
+
+struct DictBuilder {
+	State *states;
+	int nstates;		// High-water mark of states array
+	int capacity;
+	int live;		// States in use
+	int freeList;
+	int *buckets;		// Register: chains of states through next
+	int nbuckets;		// Always a power of 2
+	int nregistered;
+	bool sorted;		// Still using the sorted algorithm
+	char *last;		// Last word added (sorted algorithm only)
+	int lastLen;
+	int *path;		// States along a word; path[0] is the start state
+	int pathCapacity;
+};
+
+static int new_state(DictBuilder this) {
+	int s;
+	if (this->freeList >= 0) {
+		s = this->freeList;
+		this->freeList = this->states[s].next;
+	} else {
+		if (this->nstates == this->capacity) {
+			this->capacity *= 2;
+			this->states = (State*)realloc(this->states, sizeof(State) * this->capacity);
+		}
+		s = this->nstates++;
+	}
+	State *state = &this->states[s];
+	state->edges = NULL;
+	state->nedges = 0;
+	state->capacity = 0;
+	state->indegree = 0;
+	state->final = false;
+	state->registered = false;
+	state->next = -1;
+	this->live += 1;
+	return s;
+}
+
+static void delete_state(DictBuilder this, int s) {
+	State *state = &this->states[s];
+	for (int i=0; i < state->nedges; i++) {
+		this->states[state->edges[i].target].indegree -= 1;
+	}
+	free(state->edges);
+	state->edges = NULL;
+	state->next = this->freeList;
+	this->freeList = s;
+	this->live -= 1;
+}
+
+/**
+ * Return the index of the edge of state s on sym, or if there is none the
+ * negative of one more than the index where it would go.
+ */
+static int find_edge(State *state, unsigned char sym) {
+	int lo = 0;
+	int hi = state->nedges;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (state->edges[mid].sym < sym) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo < state->nedges && state->edges[lo].sym == sym) {
+		return lo;
+	}
+	return -(lo + 1);
+}
+
+static int get_edge(DictBuilder this, int s, unsigned char sym) {
+	State *state = &this->states[s];
+	int i = find_edge(state, sym);
+	return (i >= 0) ? state->edges[i].target : -1;
+}
+
+/**
+ * Make the edge of state s on sym go to target, keeping in-degrees right.
+ */
+static void set_edge(DictBuilder this, int s, unsigned char sym, int target) {
+	State *state = &this->states[s];
+	int i = find_edge(state, sym);
+	if (i >= 0) {
+		this->states[state->edges[i].target].indegree -= 1;
+	} else {
+		i = -i - 1;
+		if (state->nedges == state->capacity) {
+			state->capacity = (state->capacity == 0) ? 2 : state->capacity * 2;
+			state->edges = (Edge*)realloc(state->edges, sizeof(Edge) * state->capacity);
+		}
+		memmove(&state->edges[i+1], &state->edges[i], sizeof(Edge) * (state->nedges - i));
+		state->nedges += 1;
+		state->edges[i].sym = sym;
+	}
+	state->edges[i].target = target;
+	this->states[target].indegree += 1;
+}
+
+/**
+ * Return a new state with the same finality and edges as state s.
+ */
+static int clone_state(DictBuilder this, int s) {
+	int c = new_state(this);
+	State *src = &this->states[s];
+	State *clone = &this->states[c];
+	clone->final = src->final;
+	clone->nedges = src->nedges;
+	clone->capacity = src->nedges;
+	clone->edges = (Edge*)malloc(sizeof(Edge) * (src->nedges > 0 ? src->nedges : 1));
+	memcpy(clone->edges, src->edges, sizeof(Edge) * src->nedges);
+	for (int i=0; i < clone->nedges; i++) {
+		this->states[clone->edges[i].target].indegree += 1;
+	}
+	return c;
+}
+
+static unsigned long long state_hash(State *state) {
+	unsigned long long h = state->final ? 0x9e3779b97f4a7c15ULL : 14695981039346656037ULL;
+	for (int i=0; i < state->nedges; i++) {
+		h = (h ^ state->edges[i].sym) * 1099511628211ULL;
+		h = (h ^ (unsigned)state->edges[i].target) * 1099511628211ULL;
+	}
+	return h ^ (h >> 29);
+}
+
+static bool states_equal(State *a, State *b) {
+	if (a->final != b->final || a->nedges != b->nedges) {
+		return false;
+	}
+	// Not memcmp: Edge has padding
+	for (int i=0; i < a->nedges; i++) {
+		if (a->edges[i].sym != b->edges[i].sym || a->edges[i].target != b->edges[i].target) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void register_grow(DictBuilder this) {
+	int nbuckets = this->nbuckets * 2;
+	int *buckets = (int*)malloc(sizeof(int) * nbuckets);
+	for (int i=0; i < nbuckets; i++) {
+		buckets[i] = -1;
+	}
+	for (int b=0; b < this->nbuckets; b++) {
+		int s = this->buckets[b];
+		while (s >= 0) {
+			int next = this->states[s].next;
+			int i = (int)(this->states[s].hash & (nbuckets - 1));
+			this->states[s].next = buckets[i];
+			buckets[i] = s;
+			s = next;
+		}
+	}
+	free(this->buckets);
+	this->buckets = buckets;
+	this->nbuckets = nbuckets;
+}
+
+static void register_add(DictBuilder this, int s) {
+	if (this->nregistered >= this->nbuckets) {
+		register_grow(this);
+	}
+	State *state = &this->states[s];
+	state->hash = state_hash(state);
+	int i = (int)(state->hash & (this->nbuckets - 1));
+	state->next = this->buckets[i];
+	this->buckets[i] = s;
+	state->registered = true;
+	this->nregistered += 1;
+}
+
+static void register_remove(DictBuilder this, int s) {
+	State *state = &this->states[s];
+	if (!state->registered) {
+		return;
+	}
+	int *link = &this->buckets[state->hash & (this->nbuckets - 1)];
+	while (*link != s) {
+		link = &this->states[*link].next;
+	}
+	*link = state->next;
+	state->registered = false;
+	this->nregistered -= 1;
+}
+
+/**
+ * Return a registered state equivalent to state s, or -1 if there is none.
+ */
+static int register_find(DictBuilder this, int s) {
+	State *state = &this->states[s];
+	unsigned long long hash = state_hash(state);
+	for (int r=this->buckets[hash & (this->nbuckets - 1)]; r >= 0; r=this->states[r].next) {
+		if (this->states[r].hash == hash && states_equal(&this->states[r], state)) {
+			return r;
+		}
+	}
+	return -1;
+}
+
+/**
+ * The child of parent on sym is finished: replace it with an equivalent
+ * registered state if there is one, otherwise register it.
+ * The child must have no other incoming edges.
+ */
+static void replace_or_register(DictBuilder this, int parent, unsigned char sym) {
+	int child = get_edge(this, parent, sym);
+	int r = register_find(this, child);
+	if (r >= 0 && r != child) {
+		set_edge(this, parent, sym, r);
+		delete_state(this, child);
+	} else {
+		register_add(this, child);
+	}
+}
+
+static void ensure_path(DictBuilder this, int len) {
+	if (len + 1 > this->pathCapacity) {
+		this->pathCapacity = 2 * (len + 1);
+		this->path = (int*)realloc(this->path, sizeof(int) * this->pathCapacity);
+	}
+}
+
+/**
+ * Allocate and return a new DictBuilder for the empty set of words.
+ */
+DictBuilder new_DictBuilder() {
+	DictBuilder this = (DictBuilder)malloc(sizeof(struct DictBuilder));
+	if (this == NULL) {
+		return NULL;
+	}
+	this->capacity = 1024;
+	this->states = (State*)malloc(sizeof(State) * this->capacity);
+	this->nstates = 0;
+	this->live = 0;
+	this->freeList = -1;
+	this->nbuckets = 1024;
+	this->buckets = (int*)malloc(sizeof(int) * this->nbuckets);
+	for (int i=0; i < this->nbuckets; i++) {
+		this->buckets[i] = -1;
+	}
+	this->nregistered = 0;
+	this->sorted = true;
+	this->last = NULL;
+	this->lastLen = 0;
+	this->pathCapacity = 64;
+	this->path = (int*)malloc(sizeof(int) * this->pathCapacity);
+	this->path[0] = new_state(this);
+	return this;
+}
+
+/**
+ * Free the given DictBuilder.
+ */
+void DictBuilder_free(DictBuilder this) {
+	if (this == NULL) {
+		return;
+	}
+	for (int s=0; s < this->nstates; s++) {
+		free(this->states[s].edges);
+	}
+	free(this->states);
+	free(this->buckets);
+	free(this->last);
+	free(this->path);
+	free(this);
+}
+
+/**
+ * Register the states along the last word below the given depth.
+ */
+static void register_last_below(DictBuilder this, int depth) {
+	for (int d=this->lastLen; d > depth; d--) {
+		replace_or_register(this, this->path[d-1], (unsigned char)this->last[d-1]);
+	}
+}
+
+static void add_sorted(DictBuilder this, const char *word, int len) {
+	int p = 0;
+	while (p < len && p < this->lastLen && word[p] == this->last[p]) {
+		p += 1;
+	}
+	register_last_below(this, p);
+	ensure_path(this, len);
+	int s = this->path[p];
+	for (int i=p; i < len; i++) {
+		int t = new_state(this);
+		set_edge(this, s, (unsigned char)word[i], t);
+		this->path[i+1] = t;
+		s = t;
+	}
+	this->states[s].final = true;
+	this->last = (char*)realloc(this->last, len + 1);
+	memcpy(this->last, word, len + 1);
+	this->lastLen = len;
+}
+
+static void add_unsorted(DictBuilder this, const char *word, int len) {
+	ensure_path(this, len);
+	int *path = this->path;
+	int k = 0;
+	while (k < len) {
+		int t = get_edge(this, path[k], (unsigned char)word[k]);
+		if (t < 0) {
+			break;
+		}
+		path[k+1] = t;
+		k += 1;
+	}
+	if (k == len && this->states[path[k]].final) {
+		return;
+	}
+	int confluence = k + 1;
+	for (int i=1; i <= k; i++) {
+		if (this->states[path[i]].indegree > 1) {
+			confluence = i;
+			break;
+		}
+	}
+	for (int i=1; i < confluence; i++) {
+		register_remove(this, path[i]);
+	}
+	for (int i=confluence; i <= k; i++) {
+		int c = clone_state(this, path[i]);
+		set_edge(this, path[i-1], (unsigned char)word[i-1], c);
+		path[i] = c;
+	}
+	int s = path[k];
+	for (int i=k; i < len; i++) {
+		int t = new_state(this);
+		set_edge(this, s, (unsigned char)word[i], t);
+		path[i+1] = t;
+		s = t;
+	}
+	this->states[s].final = true;
+	for (int d=len; d > 0; d--) {
+		replace_or_register(this, path[d-1], (unsigned char)word[d-1]);
+	}
+}
+
+/**
+ * Stop using the sorted algorithm: register the last word's states.
+ */
+static void switch_to_unsorted(DictBuilder this) {
+	if (this->sorted) {
+		register_last_below(this, 0);
+		this->sorted = false;
+		this->lastLen = 0;
+	}
+}
+
+/**
+ * Add the given word to the given DictBuilder's set of words.
+ */
+void DictBuilder_add(DictBuilder this, const char *word) {
+	int len = strlen(word);
+	if (this->sorted && this->last != NULL) {
+		int cmp = strcmp(word, this->last);
+		if (cmp == 0) {
+			return;
+		} else if (cmp < 0) {
+			switch_to_unsorted(this);
+		}
+	}
+	if (this->sorted) {
+		add_sorted(this, word, len);
+	} else {
+		add_unsorted(this, word, len);
+	}
+}
+
+/**
+ * Return true if the given word has been added to the given DictBuilder.
+ */
+bool DictBuilder_contains(DictBuilder this, const char *word) {
+	int s = this->path[0];
+	for (const char *p=word; *p != '\0' && s >= 0; p++) {
+		s = get_edge(this, s, (unsigned char)*p);
+	}
+	return s >= 0 && this->states[s].final;
+}
+
+/**
+ * Return the number of states the given DictBuilder is currently using.
+ */
+int DictBuilder_get_size(DictBuilder this) {
+	return this->live;
+}
+
+/**
+ * Return a new DFA accepting exactly the words added to the given
+ * DictBuilder, numbering states breadth-first from the start state.
+ */
+DFA DictBuilder_to_DFA(DictBuilder this) {
+	switch_to_unsorted(this);
+	int *number = (int*)malloc(sizeof(int) * this->nstates);
+	int *order = (int*)malloc(sizeof(int) * this->live);
+	for (int s=0; s < this->nstates; s++) {
+		number[s] = -1;
+	}
+	int count = 0;
+	number[this->path[0]] = count;
+	order[count++] = this->path[0];
+	for (int i=0; i < count; i++) {
+		State *state = &this->states[order[i]];
+		for (int j=0; j < state->nedges; j++) {
+			int t = state->edges[j].target;
+			if (number[t] < 0) {
+				number[t] = count;
+				order[count++] = t;
+			}
+		}
+	}
+	DFA dfa = new_DFA(count);
+	for (int i=0; i < count; i++) {
+		State *state = &this->states[order[i]];
+		DFA_set_accepting(dfa, i, state->final);
+		for (int j=0; j < state->nedges; j++) {
+			DFA_set_transition(dfa, i, (char)state->edges[j].sym, number[state->edges[j].target]);
+		}
+	}
+	free(number);
+	free(order);
+	return dfa;
+}
+
+#ifdef MAIN
+
+#include <time.h>
+#include "dfaops.h"
+
+static char *words[] = { "cat", "cats", "dog", "dogs", "got", "gotten", "hot", "hotter", "rot", "rotten" };
+#define NWORDS (sizeof(words) / sizeof(words[0]))
+
+static int compare_strings(const void *a, const void *b) {
+	return strcmp(*(char**)a, *(char**)b);
+}
+
+int main(int argc, char* argv[]) {
+	printf("adding %d words in sorted order...\n", (int)NWORDS);
+	DictBuilder sorted = new_DictBuilder();
+	for (int i=0; i < NWORDS; i++) {
+		DictBuilder_add(sorted, words[i]);
+	}
+	DFA sortedDFA = DictBuilder_to_DFA(sorted);
+	DFA minimal = DFA_minimize(sortedDFA);
+	printf("%d states, %d after DFA_minimize\n", DFA_get_size(sortedDFA), DFA_get_size(minimal));
+
+	printf("adding the same words in reverse order...\n");
+	DictBuilder unsorted = new_DictBuilder();
+	for (int i=NWORDS-1; i >= 0; i--) {
+		DictBuilder_add(unsorted, words[i]);
+	}
+	DFA unsortedDFA = DictBuilder_to_DFA(unsorted);
+	printf("%d states\n", DFA_get_size(unsortedDFA));
+	char *tests[] = { "cat", "ca", "rotten", "rotte", "gotten", "hots", "" };
+	for (int i=0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		printf("\"%s\": %s %s\n", tests[i],
+		       DFA_execute(sortedDFA, tests[i]) ? "true" : "false",
+		       DFA_execute(unsortedDFA, tests[i]) ? "true" : "false");
+	}
+
+	int n = 1000000;
+	printf("adding %d numbers as words in lexicographic order...\n", n);
+	char **numbers = (char**)malloc(sizeof(char*) * n);
+	for (int i=0; i < n; i++) {
+		numbers[i] = (char*)malloc(16);
+		snprintf(numbers[i], 16, "%d", (int)((i * 2654435761U) % 100000000));
+	}
+	qsort(numbers, n, sizeof(char*), compare_strings);
+	clock_t start = clock();
+	DictBuilder big = new_DictBuilder();
+	for (int i=0; i < n; i++) {
+		DictBuilder_add(big, numbers[i]);
+	}
+	printf("%d states in %.2fs\n", DictBuilder_get_size(big),
+	       (double)(clock() - start) / CLOCKS_PER_SEC);
+
+	printf("adding them again in random order...\n");
+	for (int i=n-1; i > 0; i--) {
+		int j = (int)((i * 2654435761U) % (i + 1));
+		char *tmp = numbers[i];
+		numbers[i] = numbers[j];
+		numbers[j] = tmp;
+	}
+	start = clock();
+	DictBuilder shuffled = new_DictBuilder();
+	for (int i=0; i < n; i++) {
+		DictBuilder_add(shuffled, numbers[i]);
+	}
+	printf("%d states in %.2fs\n", DictBuilder_get_size(shuffled),
+	       (double)(clock() - start) / CLOCKS_PER_SEC);
+	int missing = 0;
+	for (int i=0; i < n; i++) {
+		if (!DictBuilder_contains(big, numbers[i]) || !DictBuilder_contains(shuffled, numbers[i])) {
+			missing += 1;
+		}
+	}
+	printf("missing words: %d\n", missing);
+
+	for (int i=0; i < n; i++) {
+		free(numbers[i]);
+	}
+	free(numbers);
+	DictBuilder_free(sorted);
+	DictBuilder_free(unsorted);
+	DictBuilder_free(big);
+	DictBuilder_free(shuffled);
+	DFA_free(sortedDFA);
+	DFA_free(minimal);
+	DFA_free(unsortedDFA);
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * File: DictBuilder.h
+ *
+ * Incremental construction of the minimal DFA accepting a finite set of
+ * words (a dictionary), after Daciuk, Mihov, Watson & Watson, "Incremental
+ * Construction of Minimal Acyclic Finite-State Automata" (2000).
+ * The automaton is kept minimal (or, for sorted input, minimal except along
+ * the last word added) as each word is added, so memory stays proportional
+ * to the minimal automaton rather than to the total length of the words.
+ */
+
+#ifndef _DictBuilder_h
+#define _DictBuilder_h
+
+#include <stdbool.h>
+#include "dfa.h"
+
+typedef struct DictBuilder *DictBuilder;
+
+/**
+ * Allocate and return a new DictBuilder for the empty set of words.
+ */
+extern DictBuilder new_DictBuilder();
+
+/**
+ * Free the given DictBuilder.
+ */
+extern void DictBuilder_free(DictBuilder builder);
+
+/**
+ * Add the given word to the given DictBuilder's set of words.
+ * Words may come in any order, but words in increasing (strcmp) order
+ * take a faster path. Adding a word that is already there does nothing.
+ */
+extern void DictBuilder_add(DictBuilder builder, const char *word);
+
+/**
+ * Return true if the given word has been added to the given DictBuilder.
+ */
+extern bool DictBuilder_contains(DictBuilder builder, const char *word);
+
+/**
+ * Return the number of states the given DictBuilder is currently using.
+ */
+extern int DictBuilder_get_size(DictBuilder builder);
+
+/**
+ * Return a new DFA accepting exactly the words added to the given
+ * DictBuilder. The DFA is minimal, with states numbered breadth-first.
+ * Words can still be added afterwards (by the unsorted algorithm).
+ */
+extern DFA DictBuilder_to_DFA(DictBuilder builder);
+
+#endif
@@ -0,0 +1,703 @@
+/*
+ * File: JitDFA.c
+ *
+ * A one-pass x86-64 code generator for DFAs.
+ * The generated function is int f(const unsigned char *input, int state)
+ * (System V calling convention: input in rdi, state in esi, result in
+ * eax). It jumps through a table to the block of the given state, and the
+ * block for state s is
+ *
+ *	S_s:	movzx eax, byte [rdi]
+ *		lea rdi, [rdi+1]
+ *		(dispatch on eax)
+ *	E_s:	mov eax, s		; the NUL at the end of the input
+ *		ret
+ *
+ * The row of s is cut into ranges of symbols with the same destination,
+ * with symbol 0 going to E_s and DFA_NO_STATE to a shared block returning
+ * DFA_NO_STATE. If all but a few ranges go to one destination, the
+ * dispatch compares against those few and then jumps to it; when that
+ * destination is s itself, as in the states of ".*got.*", this makes a
+ * tight scanning loop. A state that loops on every symbol (such as an
+ * accepting sink) returns at once, since the rest of the input can't
+ * change the result.
+ * A state whose row has many ranges would branch unpredictably however
+ * its dispatch was written (binary searches and jump tables were both
+ * slower than a table lookup on real text), so those states share one
+ * loop that steps through a table of their rows, kept with the code,
+ * until it reaches a state that has a block.
+ * The code is built in an ordinary buffer with relative jumps fixed up
+ * once every label is placed, then copied into a mapping that is made
+ * executable only after it is written.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "JitDFA.h"
+#include "profile.h"
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#define JIT_NATIVE
+#endif
+
+/**
+ * Don't map more code than this; bigger DFAs run from a table.
+ */
+#define JIT_MAX_CODE (64L << 20)
+
+/**
+ * A state's compare chain tests at most this many ranges before jumping
+ * to its most common destination.
+ */
+#define JIT_MAX_CHAIN 4
+
+typedef int (*JitCode)(const unsigned char *input, int state);
+
+struct JitDFA {
+	int nstates;
+	bool *accepting;
+	JitCode code;		// Entry point of the native code, or NULL
+	void *region;		// Mapping holding the code
+	long regionSize;
+	int *delta;		// nstates rows of DFA_NSYMBOLS transitions, if not compiled
+};
+
+#ifdef JIT_NATIVE
+
+/**
+ * A 32-bit field at offset at that must hold the offset of a label from
+ * offset base: the end of the instruction for a jump, or the start of the
+ * table for a jump table entry.
+ */
+typedef struct Fixup {
+	long at;
+	long base;
+	int label;
+} Fixup;
+
+typedef struct Code {
+	unsigned char *bytes;
+	long size;
+	long capacity;
+	long *labels;		// Offset of each label, or -1 until placed
+	int nlabels;
+	int labelCapacity;
+	Fixup *fixups;
+	int nfixups;
+	int fixupCapacity;
+} Code;
+
+/**
+ * A run of symbols lo..hi with the same destination label.
+ */
+typedef struct Range {
+	int lo;
+	int hi;
+	int label;
+} Range;
+
+static void emit(Code *this, const void *bytes, int n) {
+	if (this->size + n > this->capacity) {
+		this->capacity = (this->capacity < 4096) ? 4096 : 2 * this->capacity;
+		if (this->capacity < this->size + n) {
+			this->capacity = this->size + n;
+		}
+		this->bytes = (unsigned char*)realloc(this->bytes, this->capacity);
+	}
+	memcpy(this->bytes + this->size, bytes, n);
+	this->size += n;
+}
+
+static void emit1(Code *this, unsigned char byte) {
+	emit(this, &byte, 1);
+}
+
+static void emit4(Code *this, int32_t value) {
+	emit(this, &value, 4);
+}
+
+static int new_label(Code *this) {
+	if (this->nlabels == this->labelCapacity) {
+		this->labelCapacity = (this->labelCapacity < 64) ? 64 : 2 * this->labelCapacity;
+		this->labels = (long*)realloc(this->labels, sizeof(long) * this->labelCapacity);
+	}
+	this->labels[this->nlabels] = -1;
+	return this->nlabels++;
+}
+
+static void place_label(Code *this, int label) {
+	this->labels[label] = this->size;
+}
+
+/**
+ * Emit a 32-bit field to be filled in with the offset of the given label
+ * from base.
+ */
+static void emit_label(Code *this, int label, long base) {
+	if (this->nfixups == this->fixupCapacity) {
+		this->fixupCapacity = (this->fixupCapacity < 64) ? 64 : 2 * this->fixupCapacity;
+		this->fixups = (Fixup*)realloc(this->fixups, sizeof(Fixup) * this->fixupCapacity);
+	}
+	this->fixups[this->nfixups].at = this->size;
+	this->fixups[this->nfixups].base = base;
+	this->fixups[this->nfixups].label = label;
+	this->nfixups += 1;
+	emit4(this, 0);
+}
+
+/**
+ * Emit jmp rel32 to the given label.
+ */
+static void emit_jmp(Code *this, int label) {
+	emit1(this, 0xe9);
+	emit_label(this, label, this->size + 4);
+}
+
+/**
+ * Emit a conditional jump rel32 (0f 8x) to the given label.
+ */
+static void emit_jcc(Code *this, unsigned char cc, int label) {
+	emit1(this, 0x0f);
+	emit1(this, cc);
+	emit_label(this, label, this->size + 4);
+}
+
+#define JCC_E 0x84
+#define JCC_AE 0x83
+#define JCC_BE 0x86
+#define JCC_NS 0x89
+#define JCC_L 0x8c
+
+/**
+ * Emit cmp eax, imm32.
+ */
+static void emit_cmp_eax(Code *this, int value) {
+	emit1(this, 0x3d);
+	emit4(this, value);
+}
+
+/**
+ * Emit mov eax, imm32; ret.
+ */
+static void emit_return(Code *this, int value) {
+	emit1(this, 0xb8);
+	emit4(this, value);
+	emit1(this, 0xc3);
+}
+
+/**
+ * Emit a jump to the given label if eax is in lo..hi.
+ */
+static void emit_range_jump(Code *this, int lo, int hi, int label) {
+	if (lo == 0 && hi == 0) {
+		static const unsigned char test[] = { 0x85, 0xc0 };	// test eax, eax
+		emit(this, test, sizeof(test));
+		emit_jcc(this, JCC_E, label);
+	} else if (lo == hi) {
+		emit_cmp_eax(this, lo);
+		emit_jcc(this, JCC_E, label);
+	} else {
+		emit1(this, 0x8d);	// lea ecx, [rax - lo]
+		emit1(this, 0x88);
+		emit4(this, -lo);
+		emit1(this, 0x81);	// cmp ecx, hi - lo
+		emit1(this, 0xf9);
+		emit4(this, hi - lo);
+		emit_jcc(this, JCC_BE, label);
+	}
+}
+
+/**
+ * Cut the row of state s of the given DFA into ranges of symbols with
+ * the same destination label (see compile), storing them in ranges and
+ * returning how many there are.
+ */
+static int get_ranges(DFA dfa, int s, int stuck, Range ranges[DFA_NSYMBOLS]) {
+	int n = DFA_get_size(dfa);
+	int nranges = 0;
+	for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+		int t = DFA_get_transition(dfa, s, (char)sym);
+		int label = (sym == 0) ? n + s : (t == DFA_NO_STATE) ? stuck : t;
+		if (nranges > 0 && ranges[nranges - 1].label == label) {
+			ranges[nranges - 1].hi = sym;
+		} else {
+			ranges[nranges].lo = ranges[nranges].hi = sym;
+			ranges[nranges].label = label;
+			nranges += 1;
+		}
+	}
+	return nranges;
+}
+
+/**
+ * Return the label of state s's ranges covering the most symbols,
+ * preferring s itself, and store the number of ranges going elsewhere in
+ * *others. weight has a zero for every label, and is left that way.
+ */
+static int most_common(const Range *ranges, int nranges, int s, int *weight, int *others) {
+	for (int i=0; i < nranges; i++) {
+		weight[ranges[i].label] += ranges[i].hi - ranges[i].lo + 1;
+	}
+	int dflt = s;
+	for (int i=0; i < nranges; i++) {
+		if (weight[ranges[i].label] > weight[dflt]) {
+			dflt = ranges[i].label;
+		}
+	}
+	*others = 0;
+	for (int i=0; i < nranges; i++) {
+		*others += (ranges[i].label != dflt);
+		weight[ranges[i].label] = 0;
+	}
+	weight[s] = 0;
+	return dflt;
+}
+
+/**
+ * Emit the compare chain for state s, whose row is the given ranges,
+ * jumping to dflt for the symbols not in any other range.
+ */
+static void emit_chain(Code *this, int s, const Range *ranges, int nranges, int dflt) {
+	static const unsigned char load[] = {
+		0x0f, 0xb6, 0x07,		// movzx eax, byte [rdi]
+		0x48, 0x8d, 0x7f, 0x01		// lea rdi, [rdi + 1]
+	};
+	emit(this, load, sizeof(load));
+	for (int i=0; i < nranges; i++) {
+		if (ranges[i].label != dflt) {
+			emit_range_jump(this, ranges[i].lo, ranges[i].hi, ranges[i].label);
+		}
+	}
+	emit_jmp(this, dflt);
+}
+
+/**
+ * Emit the loop that runs the table states: esi is the row of the
+ * current one, r8 the start of the rows, and table the label of the
+ * original state numbers of the rows. A row entry is the next row, or
+ * -1 for DFA_NO_STATE, -2 for the NUL at the end, or -3-t to leave for
+ * chain state t, whose block is found through entries.
+ */
+static void emit_table_loop(Code *this, int loop, int stuck, int table, int entries) {
+	static const unsigned char step[] = {
+		0x89, 0xf2,			// mov edx, esi
+		0x0f, 0xb6, 0x07,		// movzx eax, byte [rdi]
+		0x48, 0x8d, 0x7f, 0x01,		// lea rdi, [rdi + 1]
+		0xc1, 0xe6, 0x08,		// shl esi, 8
+		0x01, 0xc6,			// add esi, eax
+		0x41, 0x8b, 0x34, 0xb0,		// mov esi, [r8 + rsi*4]
+		0x85, 0xf6			// test esi, esi
+	};
+	static const unsigned char cmp[] = { 0x83, 0xfe, 0xfe };	// cmp esi, -2
+	static const unsigned char lea[] = { 0x48, 0x8d, 0x0d };	// lea rcx, [rip + label]
+	static const unsigned char end[] = {
+		0x8b, 0x04, 0x91,		// mov eax, [rcx + rdx*4]
+		0xc3				// ret
+	};
+	static const unsigned char leave[] = {
+		0xf7, 0xde,			// neg esi
+		0x83, 0xee, 0x03		// sub esi, 3
+	};
+	static const unsigned char jump[] = {
+		0x48, 0x63, 0x14, 0xb1,		// movsxd rdx, dword [rcx + rsi*4]
+		0x48, 0x01, 0xca,		// add rdx, rcx
+		0xff, 0xe2			// jmp rdx
+	};
+	int atEnd = new_label(this);
+	int toChain = new_label(this);
+	place_label(this, loop);
+	emit(this, step, sizeof(step));
+	emit_jcc(this, JCC_NS, loop);
+	emit(this, cmp, sizeof(cmp));
+	emit_jcc(this, JCC_L, toChain);
+	emit_jcc(this, JCC_E, atEnd);
+	emit_jmp(this, stuck);
+	place_label(this, atEnd);
+	emit(this, lea, sizeof(lea));
+	emit_label(this, table, this->size + 4);
+	emit(this, end, sizeof(end));
+	place_label(this, toChain);
+	emit(this, leave, sizeof(leave));
+	emit(this, lea, sizeof(lea));
+	emit_label(this, entries, this->size + 4);
+	emit(this, jump, sizeof(jump));
+}
+
+/**
+ * Emit 0xcc (int3) until the code is a multiple of n bytes long.
+ */
+static void emit_align(Code *this, int n) {
+	while (this->size % n != 0) {
+		emit1(this, 0xcc);
+	}
+}
+
+/**
+ * Compile the given DFA into the given JitDFA, returning false if it is
+ * too big or executable memory can't be had.
+ * Labels 0..n-1 are the blocks of the states and n..2n-1 their NUL
+ * returns. A state with at most JIT_MAX_CHAIN ranges going somewhere
+ * other than its most common destination gets a compare chain; the rest,
+ * where a chain would branch unpredictably, get a row of the table.
+ */
+static bool compile(JitDFA this, DFA dfa) {
+	int n = DFA_get_size(dfa);
+	Code code = { NULL, 0, 0, NULL, 0, 0, NULL, 0, 0 };
+	for (int i=0; i < 2 * n; i++) {
+		new_label(&code);
+	}
+	int stuck = new_label(&code);
+	int entries = new_label(&code);
+	int loop = new_label(&code);
+	int table = new_label(&code);
+	int rows = new_label(&code);
+
+	Range ranges[DFA_NSYMBOLS];
+	int *weight = (int*)calloc(2 * n + 1, sizeof(int));
+	int *row = (int*)malloc(sizeof(int) * (n > 0 ? n : 1));	// Row of each table state, or -1
+	int nrows = 0;
+	for (int s=0; s < n; s++) {
+		int others;
+		int nranges = get_ranges(dfa, s, stuck, ranges);
+		most_common(ranges, nranges, s, weight, &others);
+		row[s] = (others > JIT_MAX_CHAIN) ? nrows++ : -1;
+	}
+
+	static const unsigned char enter[] = {
+		0x89, 0xf6,			// mov esi, esi
+		0x81, 0xfe			// cmp esi, imm32
+	};
+	static const unsigned char leaR8[] = { 0x4c, 0x8d, 0x05 };	// lea r8, [rip + rows]
+	static const unsigned char leaRcx[] = { 0x48, 0x8d, 0x0d };	// lea rcx, [rip + entries]
+	static const unsigned char jump[] = {
+		0x48, 0x63, 0x14, 0xb1,		// movsxd rdx, dword [rcx + rsi*4]
+		0x48, 0x01, 0xca,		// add rdx, rcx
+		0xff, 0xe2			// jmp rdx
+	};
+	emit(&code, enter, sizeof(enter));
+	emit4(&code, n);
+	emit_jcc(&code, JCC_AE, stuck);	// Includes DFA_NO_STATE
+	emit(&code, leaR8, sizeof(leaR8));
+	emit_label(&code, rows, code.size + 4);
+	emit(&code, leaRcx, sizeof(leaRcx));
+	emit_label(&code, entries, code.size + 4);
+	emit(&code, jump, sizeof(jump));
+	place_label(&code, stuck);
+	emit_return(&code, DFA_NO_STATE);
+	if (nrows > 0) {
+		emit_align(&code, 16);
+		emit_table_loop(&code, loop, stuck, table, entries);
+	}
+
+	for (int s=0; s < n && code.size <= JIT_MAX_CODE; s++) {
+		emit_align(&code, 16);	// Most blocks are loop heads
+		place_label(&code, s);
+		if (row[s] >= 0) {
+			emit1(&code, 0xbe);	// mov esi, row
+			emit4(&code, row[s]);
+			emit_jmp(&code, loop);
+			continue;
+		}
+		int others;
+		int nranges = get_ranges(dfa, s, stuck, ranges);
+		int dflt = most_common(ranges, nranges, s, weight, &others);
+		if (nranges == 2 && dflt == s) {
+			emit_return(&code, s);	// A sink: nothing can change the result
+			continue;
+		}
+		emit_chain(&code, s, ranges, nranges, dflt);
+		place_label(&code, n + s);
+		emit_return(&code, s);
+	}
+	free(weight);
+
+	emit_align(&code, 4);
+	place_label(&code, entries);
+	long base = code.size;
+	for (int s=0; s < n; s++) {
+		emit_label(&code, s, base);
+	}
+	place_label(&code, table);
+	for (int s=0; s < n; s++) {
+		if (row[s] >= 0) {
+			emit4(&code, s);
+		}
+	}
+	emit_align(&code, 64);
+	place_label(&code, rows);
+	for (int s=0; s < n && code.size <= JIT_MAX_CODE; s++) {
+		if (row[s] < 0) {
+			continue;
+		}
+		emit4(&code, -2);
+		for (int sym=1; sym < DFA_NSYMBOLS; sym++) {
+			int t = DFA_get_transition(dfa, s, (char)sym);
+			emit4(&code, (t == DFA_NO_STATE) ? -1 : (row[t] >= 0) ? row[t] : -3 - t);
+		}
+	}
+	free(row);
+
+	bool ok = code.size <= JIT_MAX_CODE;
+	if (ok) {
+		for (int i=0; i < code.nfixups; i++) {
+			Fixup *fixup = &code.fixups[i];
+			int32_t offset = (int32_t)(code.labels[fixup->label] - fixup->base);
+			memcpy(code.bytes + fixup->at, &offset, 4);
+		}
+		void *region = mmap(NULL, code.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		ok = region != MAP_FAILED;
+		if (ok) {
+			memcpy(region, code.bytes, code.size);
+			ok = mprotect(region, code.size, PROT_READ | PROT_EXEC) == 0;
+			if (ok) {
+				this->region = region;
+				this->regionSize = code.size;
+				this->code = (JitCode)region;
+			} else {
+				munmap(region, code.size);
+			}
+		}
+	}
+	free(code.bytes);
+	free(code.labels);
+	free(code.fixups);
+	return ok;
+}
+
+#endif
+
+/**
+ * Return a new JitDFA for running the given DFA, compiled to native code
+ * if possible.
+ */
+JitDFA new_JitDFA(DFA dfa) {
+	JitDFA this = (JitDFA)malloc(sizeof(struct JitDFA));
+	int n = DFA_get_size(dfa);
+	this->nstates = n;
+	this->accepting = (bool*)malloc(sizeof(bool) * (n > 0 ? n : 1));
+	for (int s=0; s < n; s++) {
+		this->accepting[s] = DFA_get_accepting(dfa, s);
+	}
+	this->code = NULL;
+	this->region = NULL;
+	this->regionSize = 0;
+	this->delta = NULL;
+#ifdef JIT_NATIVE
+	if (compile(this, dfa)) {
+		return this;
+	}
+#endif
+	this->delta = (int*)malloc(sizeof(int) * (n > 0 ? n : 1) * DFA_NSYMBOLS);
+	for (int s=0; s < n; s++) {
+		for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+			this->delta[s * DFA_NSYMBOLS + sym] = DFA_get_transition(dfa, s, (char)sym);
+		}
+	}
+	return this;
+}
+
+/**
+ * Free the given JitDFA and its code.
+ */
+void JitDFA_free(JitDFA this) {
+	if (this == NULL) {
+		return;
+	}
+#ifdef JIT_NATIVE
+	if (this->region != NULL) {
+		munmap(this->region, this->regionSize);
+	}
+#endif
+	free(this->accepting);
+	free(this->delta);
+	free(this);
+}
+
+/**
+ * Return true if the given JitDFA runs as native code.
+ */
+bool JitDFA_is_compiled(JitDFA this) {
+	return this->code != NULL;
+}
+
+/**
+ * Return the number of bytes of native code in the given JitDFA.
+ */
+long JitDFA_get_code_size(JitDFA this) {
+	return this->regionSize;
+}
+
+/**
+ * Run the given JitDFA on the given input string starting from the given
+ * state and return the state it ends up in, or DFA_NO_STATE if it got
+ * stuck. A state the DFA doesn't have is treated as DFA_NO_STATE. The
+ * native code has no profiling hooks, so a profile counts the call and
+ * all of its input as skipped.
+ */
+int JitDFA_run(JitDFA this, int state, const char *input) {
+	const unsigned char *p = (const unsigned char*)input;
+	PROFILE_BEGIN(this);
+	if (this->code != NULL) {
+		state = this->code(p, state);
+		PROFILE_SKIP(this, strlen(input));
+		PROFILE_END(state, 0, false);
+		return state;
+	}
+	if ((unsigned)state >= (unsigned)this->nstates) {
+		state = DFA_NO_STATE;	// As the native code does
+	}
+	const int *delta = this->delta;
+	while (*p != '\0' && state != DFA_NO_STATE) {
+		PROFILE_STEP(state, *p);
+		state = delta[state * DFA_NSYMBOLS + *p++];
+	}
+	PROFILE_END(state, p - (const unsigned char*)input, *p != '\0');
+	return state;
+}
+
+/**
+ * Run the given JitDFA on the given input string, and return true if its
+ * DFA accepts the input, otherwise false.
+ */
+bool JitDFA_execute(JitDFA this, const char *input) {
+	int state = JitDFA_run(this, 0, input);
+	return state != DFA_NO_STATE && this->accepting[state];
+}
+
+#ifdef MAIN
+
+#include <stdio.h>
+#include <time.h>
+#include "regexp.h"
+#include "nfa2dfa.h"
+
+/**
+ * Return a random DFA with n states. Rows are sparse (a few symbols to
+ * random states, the rest to one state or stuck) or, if dense is true,
+ * every symbol goes to a random state.
+ */
+static DFA random_DFA(int n, bool dense, unsigned *seed) {
+	DFA dfa = new_DFA(n);
+	for (int s=0; s < n; s++) {
+		if (dense) {
+			for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+				DFA_set_transition(dfa, s, (char)sym, rand_r(seed) % n);
+			}
+		} else {
+			int r = rand_r(seed) % 4;
+			DFA_set_transition_all(dfa, s, r == 0 ? DFA_NO_STATE : r == 1 ? s : rand_r(seed) % n);
+			int k = rand_r(seed) % 8;
+			for (int i=0; i < k; i++) {
+				int lo = rand_r(seed) % DFA_NSYMBOLS;
+				int hi = lo + rand_r(seed) % 4;
+				int t = rand_r(seed) % 8 == 0 ? DFA_NO_STATE : rand_r(seed) % n;
+				for (int sym=lo; sym <= hi && sym < DFA_NSYMBOLS; sym++) {
+					DFA_set_transition(dfa, s, (char)sym, t);
+				}
+			}
+		}
+		DFA_set_accepting(dfa, s, rand_r(seed) % 3 == 0);
+	}
+	return dfa;
+}
+
+/**
+ * Run the given DFA and JitDFA from every state on random strings over
+ * the given alphabet (all bytes but NUL if it is NULL), returning the
+ * number of times they disagree.
+ */
+static int compare(DFA dfa, JitDFA jit, const char *alphabet, unsigned *seed) {
+	int mismatches = 0;
+	char input[32];
+	int k = (alphabet != NULL) ? strlen(alphabet) : 255;
+	for (int s=-1; s < DFA_get_size(dfa); s++) {
+		for (int i=0; i < 20; i++) {
+			int len = rand_r(seed) % 32;
+			for (int j=0; j < len; j++) {
+				int c = rand_r(seed) % k;
+				input[j] = (alphabet != NULL) ? alphabet[c] : (char)(c + 1);
+			}
+			input[len] = '\0';
+			mismatches += JitDFA_run(jit, s, input) != DFA_run(dfa, s, input);
+		}
+	}
+	return mismatches;
+}
+
+int main(int argc, char* argv[]) {
+	unsigned seed = 173;
+	char *patterns[] = {
+		".*got.*", "(a|b)*a(a|b)(a|b)", "CSC", "[^a]*a[^a]*", ".*(cat|dog|hot|rot)s?", "[a-z]+@[a-z]+\\.com", NULL
+	};
+	printf("testing rules...\n");
+	for (int i=0; patterns[i] != NULL; i++) {
+		NFA nfa = regexp_compile(patterns[i], NULL);
+		DFA dfa = NFA_to_DFA(nfa);
+		JitDFA jit = new_JitDFA(dfa);
+		printf("  %-24s %3d states, %s, %5ld bytes of code, %d mismatches\n", patterns[i],
+		       DFA_get_size(dfa), JitDFA_is_compiled(jit) ? "compiled" : "table",
+		       JitDFA_get_code_size(jit), compare(dfa, jit, "abcdgot@.CS", &seed));
+		JitDFA_free(jit);
+		DFA_free(dfa);
+		NFA_free(nfa);
+	}
+
+	printf("testing random DFAs...\n");
+	int mismatches = 0;
+	for (int i=0; i < 200; i++) {
+		DFA dfa = random_DFA(1 + i % 50, i % 5 == 0, &seed);
+		JitDFA jit = new_JitDFA(dfa);
+		mismatches += compare(dfa, jit, (i % 2 == 0) ? NULL : "abc", &seed);
+		JitDFA_free(jit);
+		DFA_free(dfa);
+	}
+	DFA empty = new_DFA(0);
+	JitDFA jit = new_JitDFA(empty);
+	mismatches += JitDFA_run(jit, 0, "x") != DFA_NO_STATE;
+	JitDFA_free(jit);
+	DFA_free(empty);
+	printf("  %d mismatches\n", mismatches);
+
+	long length = 1 << 23;
+	char *text = (char*)malloc(length + 1);
+	const char *words[] = { "the ", "cat ", "got ", "a ", "dog; ", "hot ", "x@y.com ", "rotten ", "CSC173 " };
+	long filled = 0;
+	while (filled < length) {
+		const char *word = words[rand_r(&seed) % (sizeof(words) / sizeof(words[0]))];
+		for (const char *p=word; *p != '\0' && filled < length; p++) {
+			text[filled++] = *p;
+		}
+	}
+	text[length] = '\0';
+	printf("comparing DFA_run and JitDFA_run on %ld bytes of text...\n", length);
+	char *rules[] = { ".*zebra.*", ".*(cat|dog|hot|rot)s?", "(.*[aeiou]){3}", NULL };
+	for (int i=0; rules[i] != NULL; i++) {
+		NFA nfa = regexp_compile(rules[i], NULL);
+		DFA dfa = NFA_to_DFA(nfa);
+		JitDFA jit = new_JitDFA(dfa);
+		double seconds[2] = { 1e9, 1e9 };
+		int ends[2];
+		for (int k=0; k < 6; k++) {
+			clock_t start = clock();
+			ends[k % 2] = (k % 2 == 0) ? DFA_run(dfa, 0, text) : JitDFA_run(jit, 0, text);
+			double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+			if (elapsed < seconds[k % 2]) {
+				seconds[k % 2] = elapsed;
+			}
+		}
+		printf("  %-24s table %6.1f MB/s, %s %6.1f MB/s, same result: %s\n", rules[i],
+		       length / seconds[0] / 1e6, JitDFA_is_compiled(jit) ? "compiled" : "table",
+		       length / seconds[1] / 1e6, ends[0] == ends[1] ? "true" : "false");
+		JitDFA_free(jit);
+		DFA_free(dfa);
+		NFA_free(nfa);
+	}
+	free(text);
+	return mismatches > 0;
+}
+
+#endif
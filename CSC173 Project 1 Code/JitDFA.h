@@ -0,0 +1,60 @@
+/*
+ * File: JitDFA.h
+ *
+ * DFAs compiled at run time into native code, for the rules that see so
+ * much input that even one table lookup per byte is too slow. Each state
+ * becomes a block of code that reads a byte and jumps straight to the
+ * block of the next state, so the state lives in the program counter
+ * instead of in a register used to index a table.
+ * Compiling only happens on x86-64; elsewhere, or if the system won't
+ * map executable memory, a JitDFA runs a transition table like DFA_run
+ * does, so callers never need to care which they got.
+ */
+
+#ifndef _JitDFA_h
+#define _JitDFA_h
+
+#include <stdbool.h>
+#include "dfa.h"
+
+typedef struct JitDFA *JitDFA;
+
+/**
+ * Return a new JitDFA for running the given DFA, compiled to native code
+ * if possible. The DFA isn't used after this returns.
+ */
+extern JitDFA new_JitDFA(DFA dfa);
+
+/**
+ * Free the given JitDFA and its code.
+ */
+extern void JitDFA_free(JitDFA jit);
+
+/**
+ * Return true if the given JitDFA runs as native code, false if it runs
+ * a transition table.
+ */
+extern bool JitDFA_is_compiled(JitDFA jit);
+
+/**
+ * Return the number of bytes of native code in the given JitDFA (0 if it
+ * isn't compiled).
+ */
+extern long JitDFA_get_code_size(JitDFA jit);
+
+/**
+ * Run the given JitDFA on the given input string starting from the given
+ * state and return the state it ends up in, or DFA_NO_STATE if it got
+ * stuck (or the state isn't one of its DFA's), just as DFA_run does.
+ * Like a DFA, a JitDFA is only read when it runs and can be shared by
+ * any number of threads.
+ */
+extern int JitDFA_run(JitDFA jit, int state, const char *input);
+
+/**
+ * Run the given JitDFA on the given input string, and return true if its
+ * DFA accepts the input, otherwise false.
+ */
+extern bool JitDFA_execute(JitDFA jit, const char *input);
+
+#endif
@@ -0,0 +1,528 @@
+/*
+ * File: Prefilter.c
+ *
+ * Implementation of the literal prefilter in Prefilter.h.
+ * Every accepted string enters the set of accepting states for a first
+ * time, and so does it any state that lies on every path from the start
+ * state to an accepting state (one that "dominates" acceptance). So
+ * whatever every path to that first entry ends with is a literal the
+ * string must contain. Those endings are found by walking backward from
+ * the target states over the transitions that enter each set of states
+ * from outside the targets, a byte at a time, splitting the walk where
+ * the bytes differ. Every dominator is on any one accepting path, so only
+ * the states on a shortest one are candidates.
+ */
+
+#define _GNU_SOURCE	// For memmem
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "Prefilter.h"
+
+/**
+ * DFAs bigger than this aren't searched for literals.
+ */
+#define MAX_STATES (1 << 16)
+
+struct Prefilter {
+	int count;
+	char literals[PREFILTER_MAX_LITERALS][PREFILTER_MAX_LENGTH];
+	int lengths[PREFILTER_MAX_LITERALS];
+	uint8_t first[DFA_NSYMBOLS];	// Bit i if literal i starts with the byte
+	uint8_t second[DFA_NSYMBOLS];	// Bit i if it has the byte second
+};
+
+/**
+ * The DFA's transitions over its symbol classes, turned around.
+ */
+typedef struct Graph {
+	int n;
+	int k;
+	unsigned char classmap[DFA_NSYMBOLS];
+	int *dst;		// n rows of k, DFA_NO_STATE for none
+	bool *reachable;	// From the start state
+	int *predStart;		// Edges into t are pred[predStart[t]..predStart[t+1])
+	int *pred;		// Each s*k+c for a transition from s on class c
+} Graph;
+
+/**
+ * A set of states and the (reversed) string that every path from the
+ * start state into one of them, not passing through the targets, ends
+ * with.
+ */
+typedef struct Branch {
+	int *states;
+	int nstates;
+	char reversed[PREFILTER_MAX_LENGTH];
+	int length;
+	bool done;
+} Branch;
+
+static void build_graph(Graph *this, DFA dfa) {
+	int n = this->n = DFA_get_size(dfa);
+	int k = this->k = DFA_get_classes(dfa, this->classmap);
+	int rep[DFA_NSYMBOLS];
+	for (int sym=DFA_NSYMBOLS-1; sym >= 0; sym--) {
+		rep[this->classmap[sym]] = sym;
+	}
+	this->dst = (int*)malloc(sizeof(int) * n * k);
+	for (int s=0; s < n; s++) {
+		for (int c=0; c < k; c++) {
+			this->dst[s * k + c] = DFA_get_transition(dfa, s, (char)rep[c]);
+		}
+	}
+	this->reachable = (bool*)calloc(n, sizeof(bool));
+	int *queue = (int*)malloc(sizeof(int) * n);
+	int head = 0, tail = 0;
+	this->reachable[0] = true;
+	queue[tail++] = 0;
+	while (head < tail) {
+		int s = queue[head++];
+		for (int c=0; c < k; c++) {
+			int t = this->dst[s * k + c];
+			if (t != DFA_NO_STATE && !this->reachable[t]) {
+				this->reachable[t] = true;
+				queue[tail++] = t;
+			}
+		}
+	}
+	free(queue);
+	this->predStart = (int*)calloc(n + 1, sizeof(int));
+	for (int i=0; i < n * k; i++) {
+		if (this->reachable[i / k] && this->dst[i] != DFA_NO_STATE) {
+			this->predStart[this->dst[i] + 1] += 1;
+		}
+	}
+	for (int t=0; t < n; t++) {
+		this->predStart[t + 1] += this->predStart[t];
+	}
+	int *fill = (int*)malloc(sizeof(int) * (n + 1));
+	memcpy(fill, this->predStart, sizeof(int) * (n + 1));
+	this->pred = (int*)malloc(sizeof(int) * (this->predStart[n] > 0 ? this->predStart[n] : 1));
+	for (int i=0; i < n * k; i++) {
+		if (this->reachable[i / k] && this->dst[i] != DFA_NO_STATE) {
+			this->pred[fill[this->dst[i]]++] = i;
+		}
+	}
+	free(fill);
+}
+
+static void Graph_free(Graph *this) {
+	free(this->dst);
+	free(this->reachable);
+	free(this->predStart);
+	free(this->pred);
+}
+
+/**
+ * Return true if every path from the start state to an accepting state
+ * of the given DFA passes through state d.
+ */
+static bool dominates(const Graph *this, DFA dfa, int d, int *queue, bool *seen) {
+	memset(seen, 0, sizeof(bool) * this->n);
+	int head = 0, tail = 0;
+	seen[0] = true;
+	queue[tail++] = 0;
+	while (head < tail) {
+		int s = queue[head++];
+		if (DFA_get_accepting(dfa, s)) {
+			return false;
+		}
+		for (int c=0; c < this->k; c++) {
+			int t = this->dst[s * this->k + c];
+			if (t != DFA_NO_STATE && t != d && !seen[t]) {
+				seen[t] = true;
+				queue[tail++] = t;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Store in branches the literals that every first entry to one of the
+ * target states ends with, and return how many there are (0 if one is
+ * too short to use).
+ */
+static int find_endings(const Graph *this, const bool *target, Branch *branches, int *stamp, int *round) {
+	int k = this->k;
+	int nbranches = 1;
+	branches[0].states = (int*)malloc(sizeof(int) * this->n);
+	branches[0].nstates = 0;
+	for (int s=0; s < this->n; s++) {
+		if (target[s]) {
+			branches[0].states[branches[0].nstates++] = s;
+		}
+	}
+	branches[0].length = 0;
+	branches[0].done = false;
+	int *classes = (int*)malloc(sizeof(int) * k);
+	bool *used = (bool*)malloc(sizeof(bool) * k);
+	Branch next[PREFILTER_MAX_LITERALS];
+	bool extended = true;
+	while (extended) {
+		extended = false;
+		int nnext = 0;
+		bool overflow = false;
+		for (int b=0; b < nbranches && !overflow; b++) {
+			Branch *branch = &branches[b];
+			if (!branch->done) {
+				branch->done = (branch->length == PREFILTER_MAX_LENGTH);
+				for (int i=0; i < branch->nstates; i++) {
+					branch->done |= (branch->states[i] == 0);
+				}
+			}
+			int nclasses = 0;
+			if (!branch->done) {
+				memset(used, 0, sizeof(bool) * k);
+				for (int i=0; i < branch->nstates; i++) {
+					int q = branch->states[i];
+					for (int e=this->predStart[q]; e < this->predStart[q + 1]; e++) {
+						int c = this->pred[e] % k;
+						if (!target[this->pred[e] / k] && !used[c]) {
+							used[c] = true;
+							classes[nclasses++] = c;
+						}
+					}
+				}
+			}
+			if (nclasses == 0) {
+				branch->done = true;
+				if (nnext == PREFILTER_MAX_LITERALS) {
+					overflow = true;
+					break;
+				}
+				next[nnext] = *branch;
+				next[nnext].states = NULL;
+				nnext += 1;
+				continue;
+			}
+			// A branch for each byte, sharing the predecessors of its class
+			for (int j=0; j < nclasses && !overflow; j++) {
+				int c = classes[j];
+				*round += 1;
+				int *states = (int*)malloc(sizeof(int) * this->n);
+				int nstates = 0;
+				for (int i=0; i < branch->nstates; i++) {
+					int q = branch->states[i];
+					for (int e=this->predStart[q]; e < this->predStart[q + 1]; e++) {
+						int p = this->pred[e] / k;
+						if (this->pred[e] % k == c && !target[p] && stamp[p] != *round) {
+							stamp[p] = *round;
+							states[nstates++] = p;
+						}
+					}
+				}
+				for (int sym=0; sym < DFA_NSYMBOLS && !overflow; sym++) {
+					if (this->classmap[sym] != c) {
+						continue;
+					}
+					if (nnext == PREFILTER_MAX_LITERALS) {
+						overflow = true;
+						break;
+					}
+					Branch *child = &next[nnext++];
+					child->states = (int*)malloc(sizeof(int) * (nstates > 0 ? nstates : 1));
+					memcpy(child->states, states, sizeof(int) * nstates);
+					child->nstates = nstates;
+					memcpy(child->reversed, branch->reversed, branch->length);
+					child->reversed[branch->length] = (char)sym;
+					child->length = branch->length + 1;
+					child->done = false;
+				}
+				free(states);
+			}
+			extended = true;
+		}
+		if (overflow || !extended) {
+			// Keep what we have
+			for (int i=0; i < nnext; i++) {
+				free(next[i].states);
+			}
+			break;
+		}
+		for (int i=0; i < nbranches; i++) {
+			free(branches[i].states);
+		}
+		memcpy(branches, next, sizeof(Branch) * nnext);
+		nbranches = nnext;
+	}
+	bool usable = true;
+	for (int i=0; i < nbranches; i++) {
+		free(branches[i].states);
+		branches[i].states = NULL;
+		usable &= (branches[i].length >= PREFILTER_MIN_LENGTH);
+	}
+	free(classes);
+	free(used);
+	return usable ? nbranches : 0;
+}
+
+/**
+ * Return a new Prefilter for literals that every string the given DFA
+ * accepts contains at least one of, or NULL if there are none.
+ */
+Prefilter new_Prefilter(DFA dfa) {
+	int n = DFA_get_size(dfa);
+	if (n > MAX_STATES || DFA_get_accepting(dfa, 0)) {
+		return NULL;
+	}
+	Graph graph;
+	build_graph(&graph, dfa);
+
+	// A shortest accepting path, backward from its end
+	int *parent = (int*)malloc(sizeof(int) * n);
+	int *queue = (int*)malloc(sizeof(int) * n);
+	bool *seen = (bool*)calloc(n, sizeof(bool));
+	int head = 0, tail = 0, end = DFA_NO_STATE;
+	seen[0] = true;
+	parent[0] = DFA_NO_STATE;
+	queue[tail++] = 0;
+	while (head < tail && end == DFA_NO_STATE) {
+		int s = queue[head++];
+		for (int c=0; c < graph.k; c++) {
+			int t = graph.dst[s * graph.k + c];
+			if (t != DFA_NO_STATE && !seen[t]) {
+				seen[t] = true;
+				parent[t] = s;
+				queue[tail++] = t;
+				if (DFA_get_accepting(dfa, t)) {
+					end = t;
+					break;
+				}
+			}
+		}
+	}
+
+	// The candidates: entering the accepting states, and entering each
+	// state on that path that every accepting path goes through
+	Prefilter this = NULL;
+	Branch branches[PREFILTER_MAX_LITERALS];
+	int *stamp = (int*)calloc(n, sizeof(int));
+	int round = 0;
+	int bestLength = 0;
+	bool *target = (bool*)malloc(sizeof(bool) * n);
+	for (int d=end; d > 0; d=parent[d]) {
+		if (d == end) {
+			for (int s=0; s < n; s++) {
+				target[s] = DFA_get_accepting(dfa, s);
+			}
+		} else if (dominates(&graph, dfa, d, queue, seen)) {
+			memset(target, 0, sizeof(bool) * n);
+			target[d] = true;
+		} else {
+			continue;
+		}
+		int count = find_endings(&graph, target, branches, stamp, &round);
+		int shortest = PREFILTER_MAX_LENGTH + 1;
+		for (int i=0; i < count; i++) {
+			if (branches[i].length < shortest) {
+				shortest = branches[i].length;
+			}
+		}
+		// The shortest literal decides how often the search stops
+		if (count == 0 || shortest < bestLength || (shortest == bestLength && count >= this->count)) {
+			continue;
+		}
+		if (this == NULL) {
+			this = (Prefilter)malloc(sizeof(struct Prefilter));
+		}
+		bestLength = shortest;
+		this->count = count;
+		for (int i=0; i < count; i++) {
+			this->lengths[i] = branches[i].length;
+			for (int j=0; j < branches[i].length; j++) {
+				this->literals[i][j] = branches[i].reversed[branches[i].length - 1 - j];
+			}
+		}
+	}
+	free(target);
+	if (this != NULL) {
+		memset(this->first, 0, sizeof(this->first));
+		memset(this->second, 0, sizeof(this->second));
+		for (int i=0; i < this->count; i++) {
+			this->first[(unsigned char)this->literals[i][0]] |= 1 << i;
+			this->second[(unsigned char)this->literals[i][1]] |= 1 << i;
+		}
+	}
+	free(parent);
+	free(queue);
+	free(seen);
+	free(stamp);
+	Graph_free(&graph);
+	return this;
+}
+
+/**
+ * Free the given Prefilter.
+ */
+void Prefilter_free(Prefilter this) {
+	free(this);
+}
+
+/**
+ * Return the number of literals in the given Prefilter.
+ */
+int Prefilter_get_count(Prefilter this) {
+	return this->count;
+}
+
+/**
+ * Return the i'th literal of the given Prefilter.
+ */
+const char *Prefilter_get_literal(Prefilter this, int i, int *length) {
+	*length = this->lengths[i];
+	return this->literals[i];
+}
+
+/**
+ * Return a pointer to the first place in the given buffer where one of
+ * the given Prefilter's literals starts, or NULL if there isn't one.
+ */
+const char *Prefilter_find(Prefilter this, const char *buf, size_t n) {
+	if (this->count == 1) {
+		return (const char*)memmem(buf, n, this->literals[0], this->lengths[0]);
+	}
+	// Teddy's idea without the vector instructions: a byte of bits says
+	// which literals could start at each position from its first two
+	// bytes, and only those are compared
+	const unsigned char *p = (const unsigned char*)buf;
+	size_t i = 0;
+	while (i + 1 < n) {
+		// Four positions at a time while nothing could start there
+		if (i + 5 <= n
+		    && ((this->first[p[i]] & this->second[p[i + 1]])
+			| (this->first[p[i + 1]] & this->second[p[i + 2]])
+			| (this->first[p[i + 2]] & this->second[p[i + 3]])
+			| (this->first[p[i + 3]] & this->second[p[i + 4]])) == 0) {
+			i += 4;
+			continue;
+		}
+		unsigned candidates = this->first[p[i]] & this->second[p[i + 1]];
+		while (candidates != 0) {
+			int j = 0;
+			while (!((candidates >> j) & 1)) {
+				j += 1;
+			}
+			candidates &= ~(1u << j);
+			if ((size_t)this->lengths[j] <= n - i && memcmp(p + i, this->literals[j], this->lengths[j]) == 0) {
+				return buf + i;
+			}
+		}
+		i += 1;
+	}
+	return NULL;
+}
+
+#ifdef MAIN
+
+#include <stdio.h>
+#include <time.h>
+#include "regexp.h"
+#include "nfa2dfa.h"
+
+/**
+ * Return true if the given string contains one of the given Prefilter's
+ * literals, checking the slow way.
+ */
+static bool contains(Prefilter prefilter, const char *s) {
+	for (int i=0; i < Prefilter_get_count(prefilter); i++) {
+		int length;
+		const char *literal = Prefilter_get_literal(prefilter, i, &length);
+		for (const char *p=s; *p != '\0'; p++) {
+			if (strncmp(p, literal, length) == 0) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * Print the literals for the given pattern, and check them (and the
+ * search) on random strings from the given alphabet.
+ */
+static int test(const char *pattern, const char *alphabet) {
+	NFA nfa = regexp_compile(pattern, NULL);
+	DFA dfa = NFA_to_DFA(nfa);
+	Prefilter prefilter = new_Prefilter(dfa);
+	printf("%-24s", pattern);
+	if (prefilter == NULL) {
+		printf(" no literals\n");
+		NFA_free(nfa);
+		DFA_free(dfa);
+		return 0;
+	}
+	for (int i=0; i < Prefilter_get_count(prefilter); i++) {
+		int length;
+		const char *literal = Prefilter_get_literal(prefilter, i, &length);
+		printf(" \"%.*s\"", length, literal);
+	}
+	int mismatches = 0;
+	int k = strlen(alphabet);
+	char input[24];
+	for (int trial=0; trial < 200000; trial++) {
+		int length = rand() % 12;
+		for (int i=0; i < length; i++) {
+			input[i] = alphabet[rand() % k];
+		}
+		input[length] = '\0';
+		bool found = Prefilter_find(prefilter, input, length) != NULL;
+		mismatches += (found != contains(prefilter, input));
+		mismatches += (DFA_execute(dfa, input) && !found);
+	}
+	printf(": %d mismatches\n", mismatches);
+	Prefilter_free(prefilter);
+	NFA_free(nfa);
+	DFA_free(dfa);
+	return mismatches;
+}
+
+int main(int argc, char* argv[]) {
+	int mismatches = 0;
+	mismatches += test(".*got.*", "gotx");
+	mismatches += test("CSC", "CSx");
+	mismatches += test(".*(got|end).*", "gotend");
+	mismatches += test("(ab|cd)(ef|gh)", "abcdefgh");
+	mismatches += test(".*[Ee]nd", "Endx");
+	mismatches += test("[a-c]*ing[a-c]*", "abcing");
+	mismatches += test(".*a.*b.*", "abc");
+	mismatches += test("x\\d{3}", "x0123");
+	mismatches += test("(a|b)*", "ab");
+
+	// Searching text that doesn't contain the literals
+	int length = 10000000;
+	char *text = (char*)malloc(length);
+	for (int i=0; i < length; i++) {
+		text[i] = "abcdefghijklmnoprstuvwy "[rand() % 24];
+	}
+	const char *patterns[] = { ".*qqq.*", ".*(qqq|zzz|xxx).*" };
+	for (int i=0; i < 2; i++) {
+		NFA nfa = regexp_compile(patterns[i], NULL);
+		DFA dfa = NFA_to_DFA(nfa);
+		Prefilter prefilter = new_Prefilter(dfa);
+		if (prefilter == NULL) {
+			printf("%-24s no literals\n", patterns[i]);
+			return 1;
+		}
+		clock_t start = clock();
+		const char *found = Prefilter_find(prefilter, text, length);
+		double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+		start = clock();
+		int state = 0;
+		for (int j=0; j < length && state != DFA_NO_STATE; j++) {
+			state = DFA_get_transition(dfa, state, text[j]);
+		}
+		double dfaSeconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+		printf("%-24s search %.1f MB/s, DFA %.1f MB/s (found %s)\n", patterns[i],
+		       length / 1e6 / seconds, length / 1e6 / dfaSeconds, found ? "yes" : "no");
+		Prefilter_free(prefilter);
+		NFA_free(nfa);
+		DFA_free(dfa);
+	}
+	free(text);
+	return mismatches != 0;
+}
+
+#endif
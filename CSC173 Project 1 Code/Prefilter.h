@@ -0,0 +1,60 @@
+/*
+ * File: Prefilter.h
+ *
+ * Literals that every string a DFA accepts must contain, and a fast
+ * search for them, so a scanner can skip text that can't match without
+ * running the DFA over it. For example, every string matching ".*got.*"
+ * contains "got", and every string matching "(ab|cd)(ef|gh)" contains
+ * one of "abef", "abgh", "cdef" and "cdgh" (here as a prefix). When the
+ * literals are rare in the text, the search (memmem for one literal, and
+ * a Teddy-style table of the literals' first two bytes for several)
+ * runs much faster than the DFA.
+ */
+
+#ifndef _Prefilter_h
+#define _Prefilter_h
+
+#include <stddef.h>
+#include "dfa.h"
+
+/**
+ * At most this many literals are used, each at most PREFILTER_MAX_LENGTH
+ * long and at least PREFILTER_MIN_LENGTH long.
+ */
+#define PREFILTER_MAX_LITERALS 8
+#define PREFILTER_MAX_LENGTH 16
+#define PREFILTER_MIN_LENGTH 2
+
+typedef struct Prefilter *Prefilter;
+
+/**
+ * Return a new Prefilter for literals that every string the given DFA
+ * accepts contains at least one of, or NULL if there are no such
+ * literals worth searching for. The DFA isn't used after this returns.
+ */
+extern Prefilter new_Prefilter(DFA dfa);
+
+/**
+ * Free the given Prefilter.
+ */
+extern void Prefilter_free(Prefilter prefilter);
+
+/**
+ * Return the number of literals in the given Prefilter.
+ */
+extern int Prefilter_get_count(Prefilter prefilter);
+
+/**
+ * Return the i'th literal of the given Prefilter (not NUL-terminated:
+ * its length is stored in length).
+ */
+extern const char *Prefilter_get_literal(Prefilter prefilter, int i, int *length);
+
+/**
+ * Return a pointer to the first place in the given buffer of n bytes
+ * where one of the given Prefilter's literals starts, or NULL if none
+ * of them occurs in it.
+ */
+extern const char *Prefilter_find(Prefilter prefilter, const char *buf, size_t n);
+
+#endif
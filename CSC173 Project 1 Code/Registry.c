@@ -0,0 +1,447 @@
+/*
+ * File: Registry.c
+ *
+ * Implementation of the rule set registry in Registry.h, with epoch-based
+ * reclamation. There is a global epoch, and each registered reader has a
+ * slot holding the epoch it read when it entered, or 0 while it is
+ * outside. Publishing swaps the current RuleSet, then advances the epoch
+ * and tags the old RuleSet with the new epoch. A reader whose slot holds
+ * that epoch or later entered after the swap, so it has the new RuleSet;
+ * once every slot is 0 or at least the tag, the old RuleSet is freed.
+ * Readers only ever store to their own slot and load the epoch and the
+ * current pointer; writers take a mutex among themselves.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "Registry.h"
+#include "regexp.h"
+#include "nfa2dfa.h"
+#include "dfaops.h"
+
+struct RuleSet {
+	long version;
+	int nrules;
+	char **names;
+	BatchDFA *rules;
+	long retired;		// Epoch it was replaced in
+	RuleSet next;		// In the list of retired RuleSets
+};
+
+// Each slot in a cache line of its own, so readers don't slow each other
+typedef struct Reader {
+	_Alignas(64) atomic_long active;	// Epoch when it entered, or 0
+	atomic_bool used;
+} Reader;
+
+struct Registry {
+	_Atomic(RuleSet) current;
+	atomic_long epoch;
+	Reader readers[REGISTRY_MAX_READERS];
+	pthread_mutex_t lock;	// Serializes publishing and collecting
+	long version;
+	RuleSet retired;
+	int nretired;
+};
+
+/**
+ * Allocate and return a new RuleSet of the n given DFAs, named by the
+ * given names.
+ */
+static RuleSet new_RuleSet(DFA *dfas, char **names, int n) {
+	RuleSet this = (RuleSet)malloc(sizeof(struct RuleSet));
+	this->version = 0;
+	this->nrules = n;
+	this->names = (char**)malloc(sizeof(char*) * (n > 0 ? n : 1));
+	this->rules = (BatchDFA*)malloc(sizeof(BatchDFA) * (n > 0 ? n : 1));
+	for (int i=0; i < n; i++) {
+		this->names[i] = (char*)malloc(strlen(names[i]) + 1);
+		strcpy(this->names[i], names[i]);
+		this->rules[i] = new_BatchDFA(dfas[i]);
+	}
+	this->retired = 0;
+	this->next = NULL;
+	return this;
+}
+
+/**
+ * Free the given RuleSet.
+ */
+static void RuleSet_free(RuleSet this) {
+	for (int i=0; i < this->nrules; i++) {
+		free(this->names[i]);
+		BatchDFA_free(this->rules[i]);
+	}
+	free(this->names);
+	free(this->rules);
+	free(this);
+}
+
+/**
+ * Allocate and return a new Registry whose current RuleSet is version 0,
+ * with no rules.
+ */
+Registry new_Registry(void) {
+	Registry this = (Registry)malloc(sizeof(struct Registry));
+	atomic_init(&this->current, new_RuleSet(NULL, NULL, 0));
+	atomic_init(&this->epoch, 1);
+	for (int i=0; i < REGISTRY_MAX_READERS; i++) {
+		atomic_init(&this->readers[i].active, 0);
+		atomic_init(&this->readers[i].used, false);
+	}
+	pthread_mutex_init(&this->lock, NULL);
+	this->version = 0;
+	this->retired = NULL;
+	this->nretired = 0;
+	return this;
+}
+
+/**
+ * Free the given Registry and every RuleSet in it.
+ */
+void Registry_free(Registry this) {
+	if (this == NULL) {
+		return;
+	}
+	RuleSet_free(atomic_load(&this->current));
+	while (this->retired != NULL) {
+		RuleSet next = this->retired->next;
+		RuleSet_free(this->retired);
+		this->retired = next;
+	}
+	pthread_mutex_destroy(&this->lock);
+	free(this);
+}
+
+/**
+ * Free the retired RuleSets that no reader can still be using. The
+ * caller holds the lock.
+ */
+static void collect(Registry this) {
+	long oldest = LONG_MAX;
+	for (int i=0; i < REGISTRY_MAX_READERS; i++) {
+		long active = atomic_load(&this->readers[i].active);
+		if (active != 0 && active < oldest) {
+			oldest = active;
+		}
+	}
+	RuleSet *link = &this->retired;
+	while (*link != NULL) {
+		RuleSet rules = *link;
+		if (rules->retired <= oldest) {
+			*link = rules->next;
+			RuleSet_free(rules);
+			this->nretired -= 1;
+		} else {
+			link = &rules->next;
+		}
+	}
+}
+
+/**
+ * Build a RuleSet from the n given DFAs and make it the current one,
+ * returning its version number.
+ */
+long Registry_publish(Registry this, DFA *dfas, char **names, int n) {
+	// The tables are built before taking the lock
+	RuleSet rules = new_RuleSet(dfas, names, n);
+	pthread_mutex_lock(&this->lock);
+	this->version += 1;
+	rules->version = this->version;
+	RuleSet old = atomic_exchange(&this->current, rules);
+	old->retired = atomic_fetch_add(&this->epoch, 1) + 1;
+	old->next = this->retired;
+	this->retired = old;
+	this->nretired += 1;
+	collect(this);
+	pthread_mutex_unlock(&this->lock);
+	return rules->version;
+}
+
+/**
+ * Compile the rules in the given file and publish them, returning the
+ * new version number, or -1 (having printed why to errors) if any rule
+ * is bad.
+ */
+long Registry_load(Registry this, const char *path, FILE *errors) {
+	int n;
+	RegexpRule *rules = regexp_read_rules(path, &n, errors);
+	if (rules == NULL) {
+		return -1;
+	}
+	DFA *dfas = (DFA*)malloc(sizeof(DFA) * (n > 0 ? n : 1));
+	char **names = (char**)malloc(sizeof(char*) * (n > 0 ? n : 1));
+	for (int i=0; i < n; i++) {
+		DFA dfa = NFA_to_DFA(rules[i].nfa);
+		dfas[i] = DFA_minimize(dfa);
+		names[i] = rules[i].name;
+		DFA_free(dfa);
+	}
+	long version = Registry_publish(this, dfas, names, n);
+	for (int i=0; i < n; i++) {
+		DFA_free(dfas[i]);
+	}
+	free(dfas);
+	free(names);
+	regexp_free_rules(rules, n);
+	return version;
+}
+
+/**
+ * Free the old RuleSets that no reader can still be using.
+ */
+void Registry_collect(Registry this) {
+	pthread_mutex_lock(&this->lock);
+	collect(this);
+	pthread_mutex_unlock(&this->lock);
+}
+
+/**
+ * Return the number of old RuleSets waiting to be freed.
+ */
+int Registry_get_retired(Registry this) {
+	pthread_mutex_lock(&this->lock);
+	int nretired = this->nretired;
+	pthread_mutex_unlock(&this->lock);
+	return nretired;
+}
+
+/**
+ * Return a reader number for the calling thread, or -1 if there are no
+ * more.
+ */
+int Registry_register(Registry this) {
+	for (int i=0; i < REGISTRY_MAX_READERS; i++) {
+		bool unused = false;
+		if (atomic_compare_exchange_strong(&this->readers[i].used, &unused, true)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Give back the given reader number.
+ */
+void Registry_unregister(Registry this, int reader) {
+	atomic_store(&this->readers[reader].active, 0);
+	atomic_store(&this->readers[reader].used, false);
+}
+
+/**
+ * Return the current RuleSet for the given reader to use until it calls
+ * Registry_leave.
+ */
+RuleSet Registry_enter(Registry this, int reader) {
+	// The store has to be seen before the load of current, so that a
+	// writer that misses it also swapped before the load
+	atomic_store(&this->readers[reader].active, atomic_load(&this->epoch));
+	return atomic_load(&this->current);
+}
+
+/**
+ * Say that the given reader is done with its RuleSet.
+ */
+void Registry_leave(Registry this, int reader) {
+	atomic_store_explicit(&this->readers[reader].active, 0, memory_order_release);
+}
+
+/**
+ * Return the version number of the given RuleSet.
+ */
+long RuleSet_get_version(RuleSet this) {
+	return this->version;
+}
+
+/**
+ * Return the number of rules in the given RuleSet.
+ */
+int RuleSet_get_count(RuleSet this) {
+	return this->nrules;
+}
+
+/**
+ * Return the name of the i'th rule of the given RuleSet.
+ */
+const char *RuleSet_get_name(RuleSet this, int i) {
+	return this->names[i];
+}
+
+/**
+ * Return the i'th rule of the given RuleSet.
+ */
+BatchDFA RuleSet_get_rule(RuleSet this, int i) {
+	return this->rules[i];
+}
+
+/**
+ * Return the index of the rule with the given name, or -1.
+ */
+int RuleSet_find(RuleSet this, const char *name) {
+	for (int i=0; i < this->nrules; i++) {
+		if (strcmp(this->names[i], name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+#ifdef MAIN
+
+#include <unistd.h>
+#include <time.h>
+
+/**
+ * Return a DFA for the strings whose length is a multiple of k.
+ */
+static DFA new_multiple_DFA(int k) {
+	DFA dfa = new_DFA(k);
+	for (int s=0; s < k; s++) {
+		DFA_set_transition_all(dfa, s, (s + 1) % k);
+	}
+	DFA_set_accepting(dfa, 0, true);
+	return dfa;
+}
+
+#define NRECORDS 64
+
+typedef struct ReaderArgs {
+	Registry registry;
+	atomic_bool *done;
+	long reads;
+	long wrong;
+	long versions;		// Times it saw a newer version
+} ReaderArgs;
+
+/**
+ * Keep matching records of every length up to NRECORDS-1 against the
+ * current version, whose rule k accepts lengths that are multiples of
+ * the version mod 5 plus 2, until told to stop.
+ */
+static void *read_rules(void *arg) {
+	ReaderArgs *args = (ReaderArgs*)arg;
+	char data[NRECORDS * NRECORDS];
+	long offsets[NRECORDS + 1];
+	offsets[0] = 0;
+	for (int i=0; i < NRECORDS; i++) {
+		memset(data + offsets[i], 'x', i);
+		offsets[i+1] = offsets[i] + i;
+	}
+	int reader = Registry_register(args->registry);
+	long last = -1;
+	while (!atomic_load(args->done)) {
+		RuleSet rules = Registry_enter(args->registry, reader);
+		long version = RuleSet_get_version(rules);
+		if (version != last) {
+			args->versions += 1;
+			last = version;
+		}
+		if (version > 0) {
+			int k = version % 5 + 2;
+			uint64_t accepted[1];
+			BatchDFA_execute(RuleSet_get_rule(rules, 0), data, offsets, NRECORDS, accepted);
+			for (int i=0; i < NRECORDS; i++) {
+				if ((int)((accepted[0] >> i) & 1) != (i % k == 0)) {
+					args->wrong += 1;
+				}
+			}
+			char name[16];
+			snprintf(name, sizeof(name), "mod%d", k);
+			if (strcmp(RuleSet_get_name(rules, 0), name) != 0) {
+				args->wrong += 1;
+			}
+		}
+		args->reads += 1;
+		Registry_leave(args->registry, reader);
+	}
+	Registry_unregister(args->registry, reader);
+	return NULL;
+}
+
+int main(int argc, char* argv[]) {
+	Registry registry = new_Registry();
+	atomic_bool done;
+	atomic_init(&done, false);
+	int nreaders = 3;
+	pthread_t threads[3];
+	ReaderArgs args[3];
+	for (int i=0; i < nreaders; i++) {
+		args[i].registry = registry;
+		args[i].done = &done;
+		args[i].reads = args[i].wrong = args[i].versions = 0;
+		pthread_create(&threads[i], NULL, read_rules, &args[i]);
+	}
+
+	// Publish versions while the readers run
+	int nversions = 200;
+	for (long v=1; v <= nversions; v++) {
+		int k = v % 5 + 2;
+		DFA dfa = new_multiple_DFA(k);
+		char name[16];
+		snprintf(name, sizeof(name), "mod%d", k);
+		char *names[] = { name };
+		if (Registry_publish(registry, &dfa, names, 1) != v) {
+			printf("publish didn't return version %ld\n", v);
+		}
+		DFA_free(dfa);
+		struct timespec pause = { 0, 500000 };
+		nanosleep(&pause, NULL);
+	}
+	atomic_store(&done, true);
+	long reads = 0, wrong = 0, versions = 0;
+	for (int i=0; i < nreaders; i++) {
+		pthread_join(threads[i], NULL);
+		reads += args[i].reads;
+		wrong += args[i].wrong;
+		versions += args[i].versions;
+	}
+	printf("%d readers: %ld reads across %ld version changes while %d versions were published, %ld wrong\n",
+	       nreaders, reads, versions, nversions, wrong);
+	printf("old versions still held before collecting: %d\n", Registry_get_retired(registry));
+	Registry_collect(registry);
+	printf("old versions still held after the readers left: %d\n", Registry_get_retired(registry));
+
+	// A reader inside keeps the version it entered on alive
+	int reader = Registry_register(registry);
+	RuleSet held = Registry_enter(registry, reader);
+	DFA dfa = new_multiple_DFA(2);
+	char *names[] = { "mod2" };
+	Registry_publish(registry, &dfa, names, 1);
+	DFA_free(dfa);
+	printf("held version %ld kept: %s\n", RuleSet_get_version(held),
+	       Registry_get_retired(registry) == 1 ? "yes" : "no");
+	Registry_leave(registry, reader);
+	Registry_collect(registry);
+	printf("and freed after leaving: %s\n", Registry_get_retired(registry) == 0 ? "yes" : "no");
+	Registry_unregister(registry, reader);
+
+	// Loading a file, and a bad one that changes nothing
+	long version = Registry_load(registry, "rules.txt", stdout);
+	reader = Registry_register(registry);
+	RuleSet rules = Registry_enter(registry, reader);
+	printf("loaded rules.txt as version %ld: %d rules, csc is rule %d\n",
+	       version, RuleSet_get_count(rules), RuleSet_find(rules, "csc"));
+	Registry_leave(registry, reader);
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/registry-test-%d.txt", (int)getpid());
+	FILE *bad = fopen(path, "w");
+	fprintf(bad, "fine abc\nbroken (abc\nnot-a-name abc\n9lives abc\n");
+	fclose(bad);
+	printf("loading a bad file (expect three errors):\n");
+	version = Registry_load(registry, path, stdout);
+	rules = Registry_enter(registry, reader);
+	printf("returned %ld, current version still %ld\n", version, RuleSet_get_version(rules));
+	Registry_leave(registry, reader);
+	Registry_unregister(registry, reader);
+	remove(path);
+
+	Registry_free(registry);
+	return wrong > 0;
+}
+
+#endif
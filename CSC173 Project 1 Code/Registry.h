@@ -0,0 +1,120 @@
+/*
+ * File: Registry.h
+ *
+ * A registry of rule sets that can be replaced while they are in use.
+ * A RuleSet is a numbered version of a set of named rules, each ready to
+ * run as a BatchDFA, and never changes once published. Publishing a new
+ * one (usually compiled on some other thread first) swaps it in with
+ * one atomic store: readers that started on the old version finish on
+ * it, and the old version is freed only once no reader can still be
+ * using it. Readers never lock or wait, so matching goes on at full speed
+ * while rules change.
+ * A thread that reads registers once for a reader number, then brackets
+ * each use of a RuleSet with Registry_enter and Registry_leave. It must
+ * not keep the RuleSet after Registry_leave.
+ */
+
+#ifndef _Registry_h
+#define _Registry_h
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "dfa.h"
+#include "batch.h"
+
+/**
+ * At most this many readers can be registered at once.
+ */
+#define REGISTRY_MAX_READERS 64
+
+typedef struct RuleSet *RuleSet;
+typedef struct Registry *Registry;
+
+/**
+ * Allocate and return a new Registry whose current RuleSet is version 0,
+ * with no rules.
+ */
+extern Registry new_Registry(void);
+
+/**
+ * Free the given Registry and every RuleSet in it. No reader may be
+ * between Registry_enter and Registry_leave.
+ */
+extern void Registry_free(Registry registry);
+
+/**
+ * Build a RuleSet from the n given DFAs, named by the given names, and
+ * make it the current one, returning its version number. Neither the
+ * DFAs nor the names are used after this returns.
+ */
+extern long Registry_publish(Registry registry, DFA *dfas, char **names, int n);
+
+/**
+ * Compile the rules in the given file (read by regexp_read_rules, as
+ * dfagen reads them) and publish them, returning the new version number. If any
+ * rule is bad, nothing is published, the problems are printed to errors
+ * (if it isn't NULL), and -1 is returned.
+ */
+extern long Registry_load(Registry registry, const char *path, FILE *errors);
+
+/**
+ * Free the old RuleSets that no reader can still be using. Publishing
+ * does this too; the rest are freed by a later call.
+ */
+extern void Registry_collect(Registry registry);
+
+/**
+ * Return the number of old RuleSets waiting to be freed.
+ */
+extern int Registry_get_retired(Registry registry);
+
+/**
+ * Return a reader number for the calling thread to use with the given
+ * Registry, or -1 if REGISTRY_MAX_READERS are registered already.
+ */
+extern int Registry_register(Registry registry);
+
+/**
+ * Give back the given reader number.
+ */
+extern void Registry_unregister(Registry registry, int reader);
+
+/**
+ * Return the current RuleSet of the given Registry for the given reader
+ * to use until it calls Registry_leave.
+ */
+extern RuleSet Registry_enter(Registry registry, int reader);
+
+/**
+ * Say that the given reader is done with the RuleSet it got from
+ * Registry_enter.
+ */
+extern void Registry_leave(Registry registry, int reader);
+
+/**
+ * Return the version number of the given RuleSet.
+ */
+extern long RuleSet_get_version(RuleSet rules);
+
+/**
+ * Return the number of rules in the given RuleSet.
+ */
+extern int RuleSet_get_count(RuleSet rules);
+
+/**
+ * Return the name of the i'th rule of the given RuleSet.
+ */
+extern const char *RuleSet_get_name(RuleSet rules, int i);
+
+/**
+ * Return the i'th rule of the given RuleSet.
+ */
+extern BatchDFA RuleSet_get_rule(RuleSet rules, int i);
+
+/**
+ * Return the index of the rule with the given name in the given RuleSet,
+ * or -1 if there isn't one.
+ */
+extern int RuleSet_find(RuleSet rules, const char *name);
+
+#endif
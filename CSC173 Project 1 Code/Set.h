@@ -1,21 +1,43 @@
 /**
- * Definitions of the Set type and functions to use either
- * IntHashSet (based on the code in FOCS) or the bit-vector
- * implementation BitSet.
- * Note that the latter will only work if you don't need to
+ * Definitions of the Set type and functions to use
+ * AdaptiveSet, which picks a representation for each set
+ * from its contents, IntHashSet (based on the code in FOCS),
+ * or the bit-vector implementation BitSet.
+ * Note that the last will only work if you don't need to
  * store int values greater than 63 (31 on some platforms)
  * in your Sets.
+ * The argument to new_Set is the number of buckets for
+ * IntHashSet, and a hint at the largest element for
+ * AdaptiveSet.
  */
 
+//#define USE_INTHASHSET
 //#define USE_BITSET
 
-#ifndef USE_BITSET
+#if !defined(USE_INTHASHSET) && !defined(USE_BITSET)
+# include "AdaptiveSet.h"
+# define Set AdaptiveSet
+# define new_Set(N) new_AdaptiveSet(N)
+# define Set_free AdaptiveSet_free
+# define Set_isEmpty AdaptiveSet_isEmpty
+# define Set_insert AdaptiveSet_insert
+# define Set_lookup AdaptiveSet_lookup
+# define Set_union AdaptiveSet_union
+# define Set_equals AdaptiveSet_equals
+# define Set_print AdaptiveSet_print
+# define Set_toString AdaptiveSet_toString
+# define SetIterator AdaptiveSetIterator
+# define Set_iterator AdaptiveSet_iterator
+# define SetIterator_hasNext AdaptiveSetIterator_hasNext
+# define SetIterator_next AdaptiveSetIterator_next
+#elif !defined(USE_BITSET)
 # include "IntHashSet.h"
 # define Set IntHashSet
 # define new_Set(N) new_IntHashSet(N)
 # define Set_free IntHashSet_free
 # define Set_isEmpty IntHashSet_isEmpty
 # define Set_insert IntHashSet_insert
+# define Set_lookup IntHashSet_lookup
 # define Set_union IntHashSet_union
 # define Set_equals IntHashSet_equals
 # define Set_print IntHashSet_print
@@ -31,6 +53,7 @@
 # define Set_free BitSet_free
 # define Set_isEmpty BitSet_isEmpty
 # define Set_insert BitSet_insert
+# define Set_lookup BitSet_lookup
 # define Set_union BitSet_union
 # define Set_equals BitSet_equals
 # define Set_print BitSet_print
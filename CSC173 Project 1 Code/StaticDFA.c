@@ -0,0 +1,144 @@
+/*
+ * File: StaticDFA.c
+ *
+ * Running the compiled-in DFAs described in StaticDFA.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "StaticDFA.h"
+#include "profile.h"
+
+/**
+ * Run the given StaticDFA on the given input string starting from the
+ * given state, and return the state it ends up in, or -1 if it got stuck.
+ */
+int StaticDFA_run(const StaticDFA *this, int state, const char *input) {
+	const unsigned char *p = (const unsigned char*)input;
+	while (state >= 0 && *p != '\0') {
+		state = this->transitions[state * this->nclasses + this->classmap[*p++]];
+	}
+	return state;
+}
+
+/**
+ * Return true if the given state of the given StaticDFA is accepting.
+ */
+bool StaticDFA_get_accepting(const StaticDFA *this, int state) {
+	return state >= 0 && (this->accepting[state / 8] >> (state % 8)) & 1;
+}
+
+/**
+ * Return true if the given StaticDFA accepts the given input of the
+ * given length, otherwise false.
+ */
+bool StaticDFA_match(const StaticDFA *this, const char *input, size_t length) {
+	const unsigned char *p = (const unsigned char*)input;
+	const StaticDFA *dfa = (this->reverse != NULL) ? this->reverse : this;
+	int state = 0;
+	size_t i = 0;
+	if (this->reverse != NULL) {
+		for (; i < length && state >= 0 && state != dfa->acceptAll; i++) {
+			state = dfa->transitions[state * dfa->nclasses + dfa->classmap[p[length-1-i]]];
+		}
+	} else {
+		for (; i < length && state >= 0 && state != dfa->acceptAll; i++) {
+			state = dfa->transitions[state * dfa->nclasses + dfa->classmap[p[i]]];
+		}
+	}
+	PROFILE_SKIP(this, length - i);	// Left unread by an early exit
+	return StaticDFA_get_accepting(dfa, state);
+}
+
+/**
+ * Run the given StaticDFA on the given input string, and return true if
+ * it accepts the input, otherwise false.
+ */
+bool StaticDFA_execute(const StaticDFA *this, const char *input) {
+	return StaticDFA_match(this, input, strlen(input));
+}
+
+#ifdef MAIN
+
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * A StaticDFA for exactly "CSC" written out by hand, as dfagen would:
+ * class 1 is 'C', class 2 is 'S', and class 0 everything else.
+ */
+static const unsigned char csc_classmap[256] = { ['C'] = 1, ['S'] = 2 };
+static const int csc_transitions[] = {
+	-1, 1, -1,
+	-1, -1, 2,
+	-1, 3, -1,
+	-1, -1, -1,
+};
+static const unsigned char csc_accepting[] = { 0x08 };
+static const StaticDFA csc = {
+	"csc", "CSC", 4, 3, csc_classmap, csc_transitions, csc_accepting, -1, NULL
+};
+
+/*
+ * Strings ending in "at", forward and reversed ("ta" then anything):
+ * class 1 is 'a', class 2 is 't'.
+ */
+static const unsigned char endsInAt_classmap[256] = { ['a'] = 1, ['t'] = 2 };
+static const int endsInAt_transitions[] = {
+	0, 1, 0,
+	0, 1, 2,
+	0, 1, 0,
+};
+static const int endsInAt_reverse_transitions[] = {
+	-1, -1, 1,
+	-1, 2, -1,
+	2, 2, 2,
+};
+static const unsigned char endsInAt_accepting[] = { 0x04 };
+static const StaticDFA endsInAt_reverse = {
+	"endsInAt_reverse", NULL, 3, 3, endsInAt_classmap, endsInAt_reverse_transitions,
+	endsInAt_accepting, 2, NULL
+};
+static const StaticDFA endsInAt = {
+	"endsInAt", ".*at", 3, 3, endsInAt_classmap, endsInAt_transitions,
+	endsInAt_accepting, -1, &endsInAt_reverse
+};
+
+static void test(const StaticDFA *dfa, char *input) {
+	printf("\"%s\": %s\n", input, StaticDFA_execute(dfa, input) ? "true" : "false");
+}
+
+int main(int argc, char* argv[]) {
+	printf("testing StaticDFA for exactly \"CSC\"...\n");
+	test(&csc, "CSC");
+	test(&csc, "CS");
+	test(&csc, "CSCC");
+	test(&csc, "");
+	printf("state after \"CS\": %d\n", StaticDFA_run(&csc, 0, "CS"));
+
+	printf("testing StaticDFA for ending in \"at\" (run backward)...\n");
+	test(&endsInAt, "cat");
+	test(&endsInAt, "catch");
+	test(&endsInAt, "at");
+	test(&endsInAt, "t");
+
+	// A long record: forward reads all of it, backward only the end
+	int length = 10000000;
+	char *record = (char*)malloc(length + 1);
+	for (int i=0; i < length; i++) {
+		record[i] = "abt "[i % 4];
+	}
+	strcpy(record + length - 3, "hat");
+	clock_t start = clock();
+	bool forward = StaticDFA_get_accepting(&endsInAt, StaticDFA_run(&endsInAt, 0, record));
+	double forwardTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+	start = clock();
+	bool backward = StaticDFA_match(&endsInAt, record, length);
+	double backwardTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("%d byte record: forward %s in %.3fs, backward %s in %.6fs\n", length,
+	       forward ? "true" : "false", forwardTime, backward ? "true" : "false", backwardTime);
+	free(record);
+	return forward != backward;
+}
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ * File: StaticDFA.h
+ *
+ * DFAs whose tables are compiled into the program as const data, as
+ * written by dfagen (see dfagen.c). Unlike a DFA built with new_DFA there
+ * is nothing to build or allocate at startup: the tables sit in read-only
+ * memory, so every process running the program shares one copy of them
+ * through the page cache.
+ * Running one stops as soon as the answer can't change: when it gets
+ * stuck, or reaches a state that accepts whatever follows. A rule that
+ * only depends on how strings end (like ".*at") also has tables for the
+ * reversed strings, and is run from the end of the input, so it reads
+ * only as much of the input as it takes to decide.
+ */
+
+#ifndef _StaticDFA_h
+#define _StaticDFA_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * A DFA with const tables over classes of input symbols. State 0 is the
+ * start state, and transitions to DFA_NO_STATE (-1) mean no state.
+ */
+typedef struct StaticDFA {
+	const char *name;
+	const char *pattern;			// What it was compiled from
+	int nstates;
+	int nclasses;
+	const unsigned char *classmap;		// 256 entries: class of each byte
+	const int *transitions;			// nstates rows of nclasses
+	const unsigned char *accepting;		// Bit s%8 of byte s/8 for state s
+	int acceptAll;				// A state accepting any rest of the input, or -1
+	const struct StaticDFA *reverse;	// Run backward for end-anchored rules, or NULL
+} StaticDFA;
+
+/**
+ * Run the given StaticDFA on the given input string starting from the
+ * given state, and return the state it ends up in, or DFA_NO_STATE (-1)
+ * if it got stuck.
+ */
+extern int StaticDFA_run(const StaticDFA *dfa, int state, const char *input);
+
+/**
+ * Return true if the given state of the given StaticDFA is accepting.
+ */
+extern bool StaticDFA_get_accepting(const StaticDFA *dfa, int state);
+
+/**
+ * Return true if the given StaticDFA accepts the given input of the
+ * given length, otherwise false. If it has a reverse, that is run on the
+ * input from the end instead.
+ */
+extern bool StaticDFA_match(const StaticDFA *dfa, const char *input, size_t length);
+
+/**
+ * Run the given StaticDFA on the given input string, and return true if
+ * it accepts the input, otherwise false.
+ */
+extern bool StaticDFA_execute(const StaticDFA *dfa, const char *input);
+
+#endif
@@ -0,0 +1,616 @@
+/*
+ * File: TaggedDFA.c
+ *
+ * Implementation of the tagged DFAs in TaggedDFA.h.
+ * A state of a TaggedDFA is a list of the NFA states its threads are in,
+ * in priority order (see regexp.h). A transition runs every thread one
+ * step, in order, taking each thread's edges in order, and keeps only the
+ * first thread to reach each NFA state; the list that results is the next
+ * state. Each thread has a register per tag, thread j's tag t being
+ * register j*ntags + t, so the registers a state's threads use are always
+ * the same, and a transition's operations just move each surviving
+ * thread's registers to its place in the new list, and set the tags it
+ * crossed to the current offset. The moves are done in an order in
+ * which no register is overwritten before it is read, using one spare
+ * register to break cycles, so they don't need a second set of
+ * registers. At the end, the first accepting thread has the captures.
+ */
+
+#define _DEFAULT_SOURCE	// For rand_r
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "TaggedDFA.h"
+#include "regexp.h"
+
+/**
+ * Set register dst to register src, or to the current offset if src is
+ * TAG_SET_OFFSET.
+ */
+typedef struct TagOp {
+	int dst;
+	int src;
+} TagOp;
+
+#define TAG_SET_OFFSET (-1)
+#define TAG_SPARE (-2)		// The spare register, until its number is known
+
+struct TaggedDFA {
+	int ngroups;
+	int ntags;		// 2 * ngroups
+	int nstates;
+	int nclasses;
+	int nregisters;
+	unsigned char classmap[NFA_NSYMBOLS];
+	int *next;		// next[s*nclasses+c] is the next state, or -1
+	int *opStart;		// The ops for next[i] are ops[opStart[i]..opStart[i+1]]
+	TagOp *ops;
+	int *accept;		// The accepting thread of each state, or -1
+	uint64_t *finals;	// The tags its accepting thread sets at the end
+};
+
+/**
+ * The lists of NFA states found so far, stored end to end, with a hash
+ * table (open addressing) from list to index.
+ */
+typedef struct Lists {
+	int count;
+	int capacity;
+	int *start;
+	int *size;
+	uint64_t *hash;
+	int nelements;
+	int elementCapacity;
+	int *elements;
+	int tableSize;
+	int *table;
+} Lists;
+
+/**
+ * Return the hash of the given list, which depends on the order.
+ */
+static uint64_t hash_list(const int *list, int n) {
+	uint64_t h = n;
+	for (int i=0; i < n; i++) {
+		h = (h ^ (uint64_t)list[i]) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+/**
+ * Return the index of the given list, adding it if it hasn't been found.
+ */
+static int Lists_intern(Lists *this, const int *list, int n) {
+	uint64_t h = hash_list(list, n);
+	if (this->tableSize > 0) {
+		for (int i=h & (this->tableSize - 1); this->table[i] >= 0; i = (i + 1) & (this->tableSize - 1)) {
+			int j = this->table[i];
+			if (this->hash[j] == h && this->size[j] == n
+			    && memcmp(this->elements + this->start[j], list, sizeof(int) * n) == 0) {
+				return j;
+			}
+		}
+	}
+	if (2 * (this->count + 1) > this->tableSize) {
+		free(this->table);
+		this->tableSize = (this->tableSize == 0) ? 64 : 2 * this->tableSize;
+		this->table = (int*)malloc(sizeof(int) * this->tableSize);
+		memset(this->table, -1, sizeof(int) * this->tableSize);
+		for (int j=0; j < this->count; j++) {
+			int i = this->hash[j] & (this->tableSize - 1);
+			while (this->table[i] >= 0) {
+				i = (i + 1) & (this->tableSize - 1);
+			}
+			this->table[i] = j;
+		}
+	}
+	if (this->count == this->capacity) {
+		this->capacity = (this->capacity == 0) ? 64 : 2 * this->capacity;
+		this->start = (int*)realloc(this->start, sizeof(int) * this->capacity);
+		this->size = (int*)realloc(this->size, sizeof(int) * this->capacity);
+		this->hash = (uint64_t*)realloc(this->hash, sizeof(uint64_t) * this->capacity);
+	}
+	while (this->nelements + n > this->elementCapacity) {
+		this->elementCapacity = (this->elementCapacity == 0) ? 256 : 2 * this->elementCapacity;
+		this->elements = (int*)realloc(this->elements, sizeof(int) * this->elementCapacity);
+	}
+	int j = this->count++;
+	this->start[j] = this->nelements;
+	this->size[j] = n;
+	this->hash[j] = h;
+	memcpy(this->elements + this->nelements, list, sizeof(int) * n);
+	this->nelements += n;
+	int i = h & (this->tableSize - 1);
+	while (this->table[i] >= 0) {
+		i = (i + 1) & (this->tableSize - 1);
+	}
+	this->table[i] = j;
+	return j;
+}
+
+/**
+ * Free the storage of the given Lists.
+ */
+static void Lists_free(Lists *this) {
+	free(this->start);
+	free(this->size);
+	free(this->hash);
+	free(this->elements);
+	free(this->table);
+}
+
+/**
+ * The ops of the transitions made so far.
+ */
+typedef struct Ops {
+	int count;
+	int capacity;
+	TagOp *ops;
+	int *dst;		// Scratch space for the pending moves
+	int *src;
+} Ops;
+
+/**
+ * Add the op setting register dst from src to the given Ops.
+ */
+static void Ops_add(Ops *this, int dst, int src) {
+	if (this->count == this->capacity) {
+		this->capacity = (this->capacity == 0) ? 256 : 2 * this->capacity;
+		this->ops = (TagOp*)realloc(this->ops, sizeof(TagOp) * this->capacity);
+	}
+	this->ops[this->count].dst = dst;
+	this->ops[this->count].src = src;
+	this->count += 1;
+}
+
+/**
+ * Add the ops for a transition to the given Ops, where thread j of the
+ * new state comes from thread from[j] of the old one and sets the tags
+ * in set[j], for the given number of threads and tags.
+ */
+static void Ops_add_transition(Ops *this, const int *from, const uint64_t *set, int nthreads, int ntags) {
+	int *dst = this->dst;
+	int *src = this->src;
+	int m = 0;
+	for (int j=0; j < nthreads; j++) {
+		for (int t=0; t < ntags; t++) {
+			if ((set[j] >> t & 1) == 0 && from[j] != j) {
+				dst[m] = j * ntags + t;
+				src[m] = from[j] * ntags + t;
+				m += 1;
+			}
+		}
+	}
+	while (m > 0) {
+		// A move can be made once no other pending move reads its register
+		bool moved = false;
+		for (int x=0; x < m; ) {
+			int y = 0;
+			while (y < m && (y == x || src[y] != dst[x])) {
+				y += 1;
+			}
+			if (y == m) {
+				Ops_add(this, dst[x], src[x]);
+				m -= 1;
+				dst[x] = dst[m];
+				src[x] = src[m];
+				moved = true;
+			} else {
+				x += 1;
+			}
+		}
+		if (!moved) {
+			// Every move is in a cycle: save one register and read it from the spare
+			Ops_add(this, TAG_SPARE, dst[0]);
+			for (int y=0; y < m; y++) {
+				if (src[y] == dst[0]) {
+					src[y] = TAG_SPARE;
+				}
+			}
+		}
+	}
+	for (int j=0; j < nthreads; j++) {
+		for (int t=0; t < ntags; t++) {
+			if (set[j] >> t & 1) {
+				Ops_add(this, j * ntags + t, TAG_SET_OFFSET);
+			}
+		}
+	}
+}
+
+/**
+ * Allocate and return a new TaggedDFA, or NULL, as described in the header.
+ */
+TaggedDFA new_TaggedDFA(const char *pattern, const char **error) {
+	RegexpTags tags;
+	NFA nfa = regexp_compile_tagged(pattern, error, &tags);
+	if (nfa == NULL) {
+		return NULL;
+	}
+	TaggedDFA this = (TaggedDFA)calloc(1, sizeof(struct TaggedDFA));
+	this->ngroups = RegexpTags_get_groups(tags);
+	this->ntags = 2 * this->ngroups;
+	this->nclasses = NFA_get_classes(nfa, this->classmap);
+	int k = this->nclasses;
+	unsigned char rep[NFA_NSYMBOLS];
+	for (int sym=0; sym < NFA_NSYMBOLS; sym++) {
+		rep[this->classmap[sym]] = sym;
+	}
+
+	int n = NFA_get_size(nfa);
+	int *list = (int*)malloc(sizeof(int) * n);
+	int *from = (int*)malloc(sizeof(int) * n);
+	uint64_t *set = (uint64_t*)malloc(sizeof(uint64_t) * n);
+	int *stamp = (int*)calloc(n, sizeof(int));
+	int round = 0;
+	Ops ops = { 0 };
+	ops.dst = (int*)malloc(sizeof(int) * (n * this->ntags + 1));
+	ops.src = (int*)malloc(sizeof(int) * (n * this->ntags + 1));
+	Lists lists = { 0 };
+	list[0] = 0;
+	Lists_intern(&lists, list, 1);
+	int maxThreads = 1;
+	int capacity = 0;
+
+	for (int d=0; d < lists.count && lists.count <= TAGGED_DFA_MAX_STATES; d++) {
+		if (d == capacity) {
+			capacity = (capacity == 0) ? 64 : 2 * capacity;
+			this->accept = (int*)realloc(this->accept, sizeof(int) * capacity);
+			this->finals = (uint64_t*)realloc(this->finals, sizeof(uint64_t) * capacity);
+			this->next = (int*)realloc(this->next, sizeof(int) * capacity * k);
+			this->opStart = (int*)realloc(this->opStart, sizeof(int) * (capacity * k + 1));
+		}
+		this->accept[d] = -1;
+		this->finals[d] = 0;
+		for (int i=0; i < lists.size[d]; i++) {
+			int q = lists.elements[lists.start[d] + i];
+			if (NFA_get_accepting(nfa, q)) {
+				this->accept[d] = i;
+				this->finals[d] = RegexpTags_get_final(tags, q);
+				break;
+			}
+		}
+		for (int c=0; c < k; c++) {
+			round += 1;
+			int size = 0;
+			for (int i=0; i < lists.size[d]; i++) {
+				int p = lists.elements[lists.start[d] + i];
+				Set next = NFA_get_transitions(nfa, p, rep[c]);
+				for (int e=0; e < RegexpTags_get_edges(tags, p); e++) {
+					uint64_t mask;
+					int q = RegexpTags_get_edge(tags, p, e, &mask);
+					if (stamp[q] != round && Set_lookup(next, q)) {
+						stamp[q] = round;
+						list[size] = q;
+						from[size] = i;
+						set[size] = mask;
+						size += 1;
+					}
+				}
+			}
+			this->opStart[d * k + c] = ops.count;
+			if (size == 0) {
+				this->next[d * k + c] = -1;
+				continue;
+			}
+			this->next[d * k + c] = Lists_intern(&lists, list, size);
+			if (size > maxThreads) {
+				maxThreads = size;
+			}
+			Ops_add_transition(&ops, from, set, size, this->ntags);
+		}
+		this->opStart[d * k + k] = ops.count;
+	}
+	this->nstates = lists.count;
+	bool tooBig = lists.count > TAGGED_DFA_MAX_STATES;
+	Lists_free(&lists);
+	free(list);
+	free(from);
+	free(set);
+	free(stamp);
+	free(ops.dst);
+	free(ops.src);
+	RegexpTags_free(tags);
+	NFA_free(nfa);
+	this->ops = ops.ops;
+	if (tooBig) {
+		if (error != NULL) {
+			*error = "too many states";
+		}
+		TaggedDFA_free(this);
+		return NULL;
+	}
+
+	// The spare register comes after the ones the most threads use
+	int spare = maxThreads * this->ntags;
+	this->nregisters = (this->ntags > 0) ? spare + 1 : 0;
+	for (int i=0; i < ops.count; i++) {
+		if (this->ops[i].dst == TAG_SPARE) {
+			this->ops[i].dst = spare;
+		}
+		if (this->ops[i].src == TAG_SPARE) {
+			this->ops[i].src = spare;
+		}
+	}
+	return this;
+}
+
+/**
+ * Free the given TaggedDFA.
+ */
+void TaggedDFA_free(TaggedDFA this) {
+	free(this->next);
+	free(this->opStart);
+	free(this->ops);
+	free(this->accept);
+	free(this->finals);
+	free(this);
+}
+
+/**
+ * Return the number of groups in the given TaggedDFA's pattern.
+ */
+int TaggedDFA_get_groups(TaggedDFA this) {
+	return this->ngroups;
+}
+
+/**
+ * Return the number of states in the given TaggedDFA.
+ */
+int TaggedDFA_get_size(TaggedDFA this) {
+	return this->nstates;
+}
+
+/**
+ * Return the number of registers (longs) TaggedDFA_match needs.
+ */
+int TaggedDFA_get_registers(TaggedDFA this) {
+	return this->nregisters;
+}
+
+/**
+ * Run the given TaggedDFA on the given input string and return true, with
+ * the groups' offsets in captures, if its pattern matches the input.
+ */
+bool TaggedDFA_match(TaggedDFA this, const char *input, long *registers, long *captures) {
+	const unsigned char *start = (const unsigned char*)input;
+	const unsigned char *p = start;
+	for (int t=0; t < this->ntags; t++) {
+		registers[t] = -1;
+	}
+	int state = 0;
+	for (; *p != '\0'; p++) {
+		int i = state * this->nclasses + this->classmap[*p];
+		state = this->next[i];
+		if (state < 0) {
+			return false;
+		}
+		long offset = p - start;
+		const TagOp *end = this->ops + this->opStart[i + 1];
+		for (const TagOp *op = this->ops + this->opStart[i]; op < end; op++) {
+			registers[op->dst] = (op->src == TAG_SET_OFFSET) ? offset : registers[op->src];
+		}
+	}
+	int thread = this->accept[state];
+	if (thread < 0) {
+		return false;
+	}
+	long length = p - start;
+	captures[0] = 0;
+	captures[1] = length;
+	for (int t=0; t < this->ntags; t++) {
+		captures[2 + t] = (this->finals[state] >> t & 1) ? length : registers[thread * this->ntags + t];
+	}
+	return true;
+}
+
+#ifdef MAIN
+
+#include <stdio.h>
+#include <time.h>
+#include "nfa2dfa.h"
+
+/**
+ * Match the given input against the given NFA and its tags by running
+ * its threads in step (as a Pike VM does), without making a DFA, and
+ * return true, with the captures set, if it matches.
+ */
+static bool simulate(NFA nfa, RegexpTags tags, const char *input, long *captures) {
+	int n = NFA_get_size(nfa);
+	int T = 2 * RegexpTags_get_groups(tags);
+	int *threads = (int*)malloc(sizeof(int) * n);
+	int *nextThreads = (int*)malloc(sizeof(int) * n);
+	long *regs = (long*)malloc(sizeof(long) * (n * T + 1));
+	long *nextRegs = (long*)malloc(sizeof(long) * (n * T + 1));
+	bool *seen = (bool*)malloc(sizeof(bool) * n);
+	int count = 1;
+	threads[0] = 0;
+	for (int t=0; t < T; t++) {
+		regs[t] = -1;
+	}
+	long i = 0;
+	for (; input[i] != '\0' && count > 0; i++) {
+		memset(seen, 0, sizeof(bool) * n);
+		int nextCount = 0;
+		for (int j=0; j < count; j++) {
+			int p = threads[j];
+			Set next = NFA_get_transitions(nfa, p, input[i]);
+			for (int e=0; e < RegexpTags_get_edges(tags, p); e++) {
+				uint64_t mask;
+				int q = RegexpTags_get_edge(tags, p, e, &mask);
+				if (!seen[q] && Set_lookup(next, q)) {
+					seen[q] = true;
+					for (int t=0; t < T; t++) {
+						nextRegs[nextCount * T + t] = (mask >> t & 1) ? i : regs[j * T + t];
+					}
+					nextThreads[nextCount++] = q;
+				}
+			}
+		}
+		int *swapThreads = threads; threads = nextThreads; nextThreads = swapThreads;
+		long *swapRegs = regs; regs = nextRegs; nextRegs = swapRegs;
+		count = nextCount;
+	}
+	bool matched = false;
+	for (int j=0; input[i] == '\0' && j < count && !matched; j++) {
+		if (NFA_get_accepting(nfa, threads[j])) {
+			uint64_t final = RegexpTags_get_final(tags, threads[j]);
+			captures[0] = 0;
+			captures[1] = i;
+			for (int t=0; t < T; t++) {
+				captures[2 + t] = (final >> t & 1) ? i : regs[j * T + t];
+			}
+			matched = true;
+		}
+	}
+	free(threads);
+	free(nextThreads);
+	free(regs);
+	free(nextRegs);
+	free(seen);
+	return matched;
+}
+
+/**
+ * Match the given input with the given TaggedDFA and print its captures
+ * next to the expected ones (as "start,end start,end ..." or "no").
+ * Return 1 if they differ, otherwise 0.
+ */
+static int test(const char *pattern, const char *input, const char *expected) {
+	TaggedDFA tdfa = new_TaggedDFA(pattern, NULL);
+	long *registers = (long*)malloc(sizeof(long) * (TaggedDFA_get_registers(tdfa) + 1));
+	long captures[2 * (REGEXP_MAX_GROUPS + 1)];
+	char actual[256] = "no";
+	if (TaggedDFA_match(tdfa, input, registers, captures)) {
+		int len = 0;
+		for (int g=1; g <= TaggedDFA_get_groups(tdfa); g++) {
+			len += sprintf(actual + len, "%s%ld,%ld", g > 1 ? " " : "", captures[2 * g], captures[2 * g + 1]);
+		}
+		actual[len] = '\0';
+	}
+	int failed = strcmp(actual, expected) != 0;
+	printf("  %-24s %-20s %-20s%s\n", pattern, input, actual, failed ? " FAILED" : "");
+	free(registers);
+	TaggedDFA_free(tdfa);
+	return failed;
+}
+
+/**
+ * Match random strings over the given alphabet with a TaggedDFA for the
+ * given pattern, with a simulation of its NFA, and with a plain DFA, and
+ * return the number of times they disagree.
+ */
+static int compare(const char *pattern, const char *alphabet, unsigned *seed) {
+	RegexpTags tags;
+	NFA nfa = regexp_compile_tagged(pattern, NULL, &tags);
+	NFA plain = regexp_compile(pattern, NULL);
+	DFA dfa = NFA_to_DFA(plain);
+	TaggedDFA tdfa = new_TaggedDFA(pattern, NULL);
+	long *registers = (long*)malloc(sizeof(long) * (TaggedDFA_get_registers(tdfa) + 1));
+	int ncaptures = 2 * (TaggedDFA_get_groups(tdfa) + 1);
+	long captures[2 * (REGEXP_MAX_GROUPS + 1)];
+	long expected[2 * (REGEXP_MAX_GROUPS + 1)];
+	int k = strlen(alphabet);
+	int mismatches = 0;
+	char input[16];
+	for (int i=0; i < 2000; i++) {
+		int len = rand_r(seed) % 12;
+		for (int j=0; j < len; j++) {
+			input[j] = alphabet[rand_r(seed) % k];
+		}
+		input[len] = '\0';
+		bool matched = TaggedDFA_match(tdfa, input, registers, captures);
+		if (matched != simulate(nfa, tags, input, expected) || matched != DFA_execute(dfa, input)
+		    || (matched && memcmp(captures, expected, sizeof(long) * ncaptures) != 0)) {
+			mismatches += 1;
+		}
+	}
+	printf("  %-28s %4d states, %3d registers, %d mismatches\n", pattern,
+	       TaggedDFA_get_size(tdfa), TaggedDFA_get_registers(tdfa), mismatches);
+	free(registers);
+	TaggedDFA_free(tdfa);
+	DFA_free(dfa);
+	NFA_free(plain);
+	RegexpTags_free(tags);
+	NFA_free(nfa);
+	return mismatches;
+}
+
+int main(int argc, char* argv[]) {
+	int failures = 0;
+	printf("testing captures...\n");
+	failures += test(".*(at)", "ends in at", "8,10");
+	failures += test(".*(got).*", "I got it, you got it", "14,17");
+	failures += test("[^g]*(got).*", "I got it, you got it", "2,5");
+	failures += test("(\\d+)-(\\d+)", "555-1234", "0,3 4,8");
+	failures += test("([a-z]+)@([a-z]+)\\.com", "me@here.com", "0,2 3,7");
+	failures += test("(a|ab)(c|bcd)(d*)", "abcd", "0,1 1,4 4,4");
+	failures += test("(a*)(b)?", "aa", "0,2 -1,-1");
+	failures += test("((a)|b)+", "ab", "1,2 0,1");
+	failures += test("(a)|(b)", "b", "-1,-1 0,1");
+	failures += test("(ab){2}", "abab", "2,4");
+	failures += test("(x)*", "", "-1,-1");
+	failures += test("()", "", "0,0");
+	failures += test("(a*)+", "aa", "0,2");	// Perl gives 2,2: no empty iterations here
+	failures += test("(a+)(a*)", "aaa", "0,3 3,3");
+	failures += test("(a)b", "ac", "no");
+	failures += test("", "", "");
+	const char *error;
+	TaggedDFA none = new_TaggedDFA("(a", &error);
+	printf("  %-24s %s\n", "(a", none == NULL ? error : "FAILED");
+	failures += none != NULL;
+
+	printf("comparing with the NFA and a plain DFA...\n");
+	unsigned seed = 173;
+	char *patterns[] = {
+		"(a|b)*(a)(a|b)", "(a*)(a|b)*(b*)", "((a|ab)(c|bcd))(d*)", "(a|b|ab|ba)*",
+		"((a)|(b)|(c))*", "(a?)(a?)(a?)aa", "(a*|b)*c?(b)", ".*(ab|ba)(.*)", "(a+|b+)*", NULL
+	};
+	for (int i=0; patterns[i] != NULL; i++) {
+		failures += compare(patterns[i], "abcd", &seed);
+	}
+
+	long length = 1 << 23;
+	char *text = (char*)malloc(length + 1);
+	const char *words[] = { "the ", "cat ", "got ", "a ", "dog; ", "hot ", "x@y.com ", "rotten ", "CSC173 " };
+	long filled = 0;
+	while (filled < length) {
+		const char *word = words[rand_r(&seed) % (sizeof(words) / sizeof(words[0]))];
+		for (const char *p=word; *p != '\0' && filled < length; p++) {
+			text[filled++] = *p;
+		}
+	}
+	text[length] = '\0';
+	printf("comparing DFA_execute and TaggedDFA_match on %ld bytes of text...\n", length);
+	char *rules[] = { ".*(got).*", "(.*)(cat|dog)(.*)", NULL };
+	for (int i=0; rules[i] != NULL; i++) {
+		NFA nfa = regexp_compile(rules[i], NULL);
+		DFA dfa = NFA_to_DFA(nfa);
+		TaggedDFA tdfa = new_TaggedDFA(rules[i], NULL);
+		long *registers = (long*)malloc(sizeof(long) * TaggedDFA_get_registers(tdfa));
+		long captures[2 * (REGEXP_MAX_GROUPS + 1)];
+		double seconds[2] = { 1e9, 1e9 };
+		bool results[2];
+		for (int k=0; k < 6; k++) {
+			clock_t start = clock();
+			results[k % 2] = (k % 2 == 0) ? DFA_execute(dfa, text) : TaggedDFA_match(tdfa, text, registers, captures);
+			double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+			if (elapsed < seconds[k % 2]) {
+				seconds[k % 2] = elapsed;
+			}
+		}
+		printf("  %-24s DFA %6.1f MB/s, tagged %6.1f MB/s, same result: %s, group 1 at %ld\n", rules[i],
+		       length / seconds[0] / 1e6, length / seconds[1] / 1e6,
+		       results[0] == results[1] ? "true" : "false", captures[2]);
+		free(registers);
+		TaggedDFA_free(tdfa);
+		DFA_free(dfa);
+		NFA_free(nfa);
+	}
+	free(text);
+	return failures > 0;
+}
+
+#endif
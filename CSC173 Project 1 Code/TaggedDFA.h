@@ -0,0 +1,67 @@
+/*
+ * File: TaggedDFA.h
+ *
+ * DFAs that say not only whether a string matches a pattern but where
+ * its groups matched: the offset of "at" in ".*(at)", or of the keyword
+ * in ".*(got).*". The choices of an NFA thread are tracked as tags, and
+ * making the DFA turns them into register operations on its transitions,
+ * so a match is one pass over the input with no backtracking, and with
+ * registers the caller provides, so no allocation either.
+ */
+
+#ifndef _TaggedDFA_h
+#define _TaggedDFA_h
+
+#include <stdbool.h>
+
+typedef struct TaggedDFA *TaggedDFA;
+
+/**
+ * The most states new_TaggedDFA will make before giving up.
+ */
+#define TAGGED_DFA_MAX_STATES 100000
+
+/**
+ * Return a new TaggedDFA for the given regular expression (see regexp.h),
+ * or NULL if it has a syntax error, more than REGEXP_MAX_GROUPS groups, or
+ * needs more than TAGGED_DFA_MAX_STATES states. In that case, if error
+ * isn't NULL, *error is set to a message saying why.
+ */
+extern TaggedDFA new_TaggedDFA(const char *pattern, const char **error);
+
+/**
+ * Free the given TaggedDFA.
+ */
+extern void TaggedDFA_free(TaggedDFA tdfa);
+
+/**
+ * Return the number of groups in the given TaggedDFA's pattern.
+ */
+extern int TaggedDFA_get_groups(TaggedDFA tdfa);
+
+/**
+ * Return the number of states in the given TaggedDFA.
+ */
+extern int TaggedDFA_get_size(TaggedDFA tdfa);
+
+/**
+ * Return the number of registers (longs) TaggedDFA_match needs.
+ */
+extern int TaggedDFA_get_registers(TaggedDFA tdfa);
+
+/**
+ * Run the given TaggedDFA on the given input string, using the given
+ * registers, and return true if its pattern matches the whole input.
+ * In that case, captures[2g] and captures[2g+1] are set to the offsets
+ * where group g starts and ends, for g from 0 (the whole input) to the
+ * number of groups, or to -1 for a group that didn't take part in the
+ * match. Where there is a choice, repeats are greedy and alternatives
+ * are tried from the left, as in Perl, except that a repeat never takes
+ * an iteration that matches nothing (the NFA has no empty moves to take
+ * one with): on "aa", (a*)+ gives group 1 at 0,2 where Perl gives 2,2.
+ * A TaggedDFA is only read when it runs, so threads can share one as
+ * long as each has its own registers.
+ */
+extern bool TaggedDFA_match(TaggedDFA tdfa, const char *input, long *registers, long *captures);
+
+#endif
@@ -0,0 +1,314 @@
+/*
+ * File: ThreadPool.c
+ *
+ * Work-stealing pool of worker threads.
+ * Every worker owns a deque of tasks. A worker pushes the tasks it submits
+ * onto the back of its own deque and pops from the back too, so it keeps
+ * working on what it split off most recently (and is still in cache).
+ * A worker whose deque is empty steals from the front of another deque,
+ * taking the oldest (and usually biggest) piece of work.
+ * Workers with nothing to do anywhere sleep until a task is submitted.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "ThreadPool.h"
+
+typedef struct Task {
+	void (*func)(void*);
+	void *arg;
+} Task;
+
+typedef struct Worker {
+	ThreadPool pool;
+	pthread_t thread;
+	pthread_mutex_t lock;	// Protects the deque
+	Task *tasks;		// Circular buffer
+	int capacity;
+	int head;		// Index of the front (oldest) task
+	int count;
+	unsigned int seed;	// For picking victims to steal from
+} Worker;
+
+struct ThreadPool {
+	int nthreads;
+	Worker *workers;
+	atomic_int queued;	// Tasks sitting in some deque
+	atomic_int outstanding;	// Tasks submitted but not yet finished
+	atomic_int sleeping;	// Workers waiting for work
+	atomic_uint next;	// Round-robin target for outside submissions
+	pthread_mutex_t lock;
+	pthread_cond_t work;	// Signalled when a task is queued
+	pthread_cond_t done;	// Signalled when outstanding drops to 0
+	bool shutdown;
+};
+
+// The worker running on this thread, if any
+static _Thread_local Worker *self = NULL;
+
+static void Worker_push(Worker *this, Task task) {
+	pthread_mutex_lock(&this->lock);
+	if (this->count == this->capacity) {
+		int capacity = this->capacity * 2;
+		Task *tasks = (Task*)malloc(sizeof(Task) * capacity);
+		for (int i=0; i < this->count; i++) {
+			tasks[i] = this->tasks[(this->head + i) % this->capacity];
+		}
+		free(this->tasks);
+		this->tasks = tasks;
+		this->capacity = capacity;
+		this->head = 0;
+	}
+	this->tasks[(this->head + this->count) % this->capacity] = task;
+	this->count += 1;
+	pthread_mutex_unlock(&this->lock);
+}
+
+/**
+ * Take the newest task from the back of the given Worker's deque.
+ */
+static bool Worker_pop(Worker *this, Task *task) {
+	bool found = false;
+	pthread_mutex_lock(&this->lock);
+	if (this->count > 0) {
+		this->count -= 1;
+		*task = this->tasks[(this->head + this->count) % this->capacity];
+		found = true;
+	}
+	pthread_mutex_unlock(&this->lock);
+	return found;
+}
+
+/**
+ * Take the oldest task from the front of the given Worker's deque.
+ */
+static bool Worker_steal(Worker *this, Task *task) {
+	bool found = false;
+	pthread_mutex_lock(&this->lock);
+	if (this->count > 0) {
+		*task = this->tasks[this->head];
+		this->head = (this->head + 1) % this->capacity;
+		this->count -= 1;
+		found = true;
+	}
+	pthread_mutex_unlock(&this->lock);
+	return found;
+}
+
+/**
+ * Find a task for the given Worker: its own newest one if it has any,
+ * otherwise one stolen from another worker, starting at a random victim.
+ */
+static bool Worker_find(Worker *this, Task *task) {
+	ThreadPool pool = this->pool;
+	if (Worker_pop(this, task)) {
+		atomic_fetch_sub(&pool->queued, 1);
+		return true;
+	}
+	this->seed = this->seed * 1103515245 + 12345;
+	int start = (this->seed >> 16) % pool->nthreads;
+	for (int i=0; i < pool->nthreads; i++) {
+		Worker *victim = &pool->workers[(start + i) % pool->nthreads];
+		if (victim != this && Worker_steal(victim, task)) {
+			atomic_fetch_sub(&pool->queued, 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void ThreadPool_finish(ThreadPool this) {
+	if (atomic_fetch_sub(&this->outstanding, 1) == 1) {
+		pthread_mutex_lock(&this->lock);
+		pthread_cond_broadcast(&this->done);
+		pthread_mutex_unlock(&this->lock);
+	}
+}
+
+static void *Worker_main(void *arg) {
+	Worker *this = (Worker*)arg;
+	ThreadPool pool = this->pool;
+	self = this;
+	for (;;) {
+		Task task;
+		if (Worker_find(this, &task)) {
+			task.func(task.arg);
+			ThreadPool_finish(pool);
+			continue;
+		}
+		pthread_mutex_lock(&pool->lock);
+		atomic_fetch_add(&pool->sleeping, 1);
+		while (atomic_load(&pool->queued) <= 0 && !pool->shutdown) {
+			pthread_cond_wait(&pool->work, &pool->lock);
+		}
+		atomic_fetch_sub(&pool->sleeping, 1);
+		bool stop = pool->shutdown && atomic_load(&pool->queued) <= 0;
+		pthread_mutex_unlock(&pool->lock);
+		if (stop) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Allocate and return a new ThreadPool with the given number of worker
+ * threads, or one per online processor if nthreads is 0 or less.
+ */
+ThreadPool new_ThreadPool(int nthreads) {
+	if (nthreads <= 0) {
+		nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (nthreads <= 0) {
+			nthreads = 1;
+		}
+	}
+	ThreadPool this = (ThreadPool)malloc(sizeof(struct ThreadPool));
+	if (this == NULL) {
+		return NULL;
+	}
+	this->nthreads = nthreads;
+	this->workers = (Worker*)calloc(nthreads, sizeof(Worker));
+	atomic_init(&this->queued, 0);
+	atomic_init(&this->outstanding, 0);
+	atomic_init(&this->sleeping, 0);
+	atomic_init(&this->next, 0);
+	pthread_mutex_init(&this->lock, NULL);
+	pthread_cond_init(&this->work, NULL);
+	pthread_cond_init(&this->done, NULL);
+	this->shutdown = false;
+	for (int i=0; i < nthreads; i++) {
+		Worker *worker = &this->workers[i];
+		worker->pool = this;
+		pthread_mutex_init(&worker->lock, NULL);
+		worker->capacity = 64;
+		worker->tasks = (Task*)malloc(sizeof(Task) * worker->capacity);
+		worker->head = 0;
+		worker->count = 0;
+		worker->seed = i + 1;
+	}
+	for (int i=0; i < nthreads; i++) {
+		pthread_create(&this->workers[i].thread, NULL, Worker_main, &this->workers[i]);
+	}
+	return this;
+}
+
+/**
+ * Wait for all outstanding tasks, stop the worker threads, and free the
+ * given ThreadPool.
+ */
+void ThreadPool_free(ThreadPool this) {
+	if (this == NULL) {
+		return;
+	}
+	ThreadPool_wait(this);
+	pthread_mutex_lock(&this->lock);
+	this->shutdown = true;
+	pthread_cond_broadcast(&this->work);
+	pthread_mutex_unlock(&this->lock);
+	for (int i=0; i < this->nthreads; i++) {
+		pthread_join(this->workers[i].thread, NULL);
+		pthread_mutex_destroy(&this->workers[i].lock);
+		free(this->workers[i].tasks);
+	}
+	free(this->workers);
+	pthread_mutex_destroy(&this->lock);
+	pthread_cond_destroy(&this->work);
+	pthread_cond_destroy(&this->done);
+	free(this);
+}
+
+/**
+ * Return the number of worker threads in the given ThreadPool.
+ */
+int ThreadPool_size(ThreadPool this) {
+	return this->nthreads;
+}
+
+/**
+ * Arrange for func(arg) to be called by one of the workers of the given
+ * ThreadPool. A worker submitting a task keeps it on its own deque;
+ * submissions from other threads are dealt out round-robin.
+ */
+void ThreadPool_submit(ThreadPool this, void (*func)(void*), void *arg) {
+	Task task = { func, arg };
+	Worker *worker = self;
+	if (worker == NULL || worker->pool != this) {
+		worker = &this->workers[atomic_fetch_add(&this->next, 1) % this->nthreads];
+	}
+	atomic_fetch_add(&this->outstanding, 1);
+	Worker_push(worker, task);
+	atomic_fetch_add(&this->queued, 1);
+	if (atomic_load(&this->sleeping) > 0) {
+		pthread_mutex_lock(&this->lock);
+		pthread_cond_signal(&this->work);
+		pthread_mutex_unlock(&this->lock);
+	}
+}
+
+/**
+ * Block until every task submitted to the given ThreadPool has finished.
+ */
+void ThreadPool_wait(ThreadPool this) {
+	pthread_mutex_lock(&this->lock);
+	while (atomic_load(&this->outstanding) > 0) {
+		pthread_cond_wait(&this->done, &this->lock);
+	}
+	pthread_mutex_unlock(&this->lock);
+}
+
+#ifdef MAIN
+
+typedef struct Range {
+	ThreadPool pool;
+	long lo, hi;
+	atomic_long *sum;
+} Range;
+
+/**
+ * Add up the numbers in a range, splitting off the top half as a new
+ * task while the range is big, to give idle workers something to steal.
+ */
+static void sum_range(void *arg) {
+	Range *range = (Range*)arg;
+	while (range->hi - range->lo > 1000) {
+		long mid = range->lo + (range->hi - range->lo) / 2;
+		Range *top = (Range*)malloc(sizeof(Range));
+		*top = *range;
+		top->lo = mid;
+		range->hi = mid;
+		ThreadPool_submit(range->pool, sum_range, top);
+	}
+	long sum = 0;
+	for (long i=range->lo; i < range->hi; i++) {
+		sum += i;
+	}
+	atomic_fetch_add(range->sum, sum);
+	free(range);
+}
+
+int main(int argc, char* argv[]) {
+	for (int nthreads=1; nthreads <= 4; nthreads++) {
+		ThreadPool pool = new_ThreadPool(nthreads);
+		atomic_long sum;
+		atomic_init(&sum, 0);
+		long n = 1000000;
+		Range *range = (Range*)malloc(sizeof(Range));
+		range->pool = pool;
+		range->lo = 0;
+		range->hi = n;
+		range->sum = &sum;
+		ThreadPool_submit(pool, sum_range, range);
+		ThreadPool_wait(pool);
+		printf("%d threads: sum 0..%ld = %ld (expected %ld)\n",
+		       ThreadPool_size(pool), n-1, atomic_load(&sum), n*(n-1)/2);
+		ThreadPool_free(pool);
+	}
+}
+
+#endif
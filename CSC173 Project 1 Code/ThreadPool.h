@@ -0,0 +1,45 @@
+/*
+ * File: ThreadPool.h
+ *
+ * A fixed set of worker threads that run submitted tasks.
+ * Each worker has its own deque of tasks: it pushes and pops at one end,
+ * and idle workers steal from the other end of someone else's deque.
+ * Tasks may submit more tasks, which is how big jobs get split up.
+ */
+
+#ifndef _ThreadPool_h
+#define _ThreadPool_h
+
+typedef struct ThreadPool *ThreadPool;
+
+/**
+ * Allocate and return a new ThreadPool with the given number of worker
+ * threads, or one per online processor if nthreads is 0 or less.
+ */
+extern ThreadPool new_ThreadPool(int nthreads);
+
+/**
+ * Wait for all outstanding tasks, stop the worker threads, and free the
+ * given ThreadPool.
+ */
+extern void ThreadPool_free(ThreadPool pool);
+
+/**
+ * Return the number of worker threads in the given ThreadPool.
+ */
+extern int ThreadPool_size(ThreadPool pool);
+
+/**
+ * Arrange for func(arg) to be called by one of the workers of the given
+ * ThreadPool. This may be called from inside a task.
+ */
+extern void ThreadPool_submit(ThreadPool pool, void (*func)(void*), void *arg);
+
+/**
+ * Block until every task submitted to the given ThreadPool, including tasks
+ * submitted by other tasks, has finished.
+ * Don't call this from inside a task: it would wait for itself.
+ */
+extern void ThreadPool_wait(ThreadPool pool);
+
+#endif
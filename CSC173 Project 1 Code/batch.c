@@ -0,0 +1,385 @@
+/*
+ * File: batch.c
+ *
+ * Batch execution of automata on a ThreadPool.
+ * A batch starts out as one task covering every input. A task with more
+ * than GRAIN inputs splits off its top half as a new task before doing the
+ * rest, so there is always a large piece at the front of some deque for an
+ * idle worker to steal, and uneven input lengths even out.
+ * A BatchDFA keeps BATCH_LANES records in flight. Each round it finds the
+ * fewest bytes any of them has left and steps every lane that many bytes
+ * with no checks in between; lanes whose record is done are then scored
+ * and given the next record. Near the end, when there are no records left
+ * to hand out, the lanes still running finish one at a time.
+ * How much this gains over DFA_execute per record depends on the machine
+ * and on the records. For records of random lengths, lanes finish at
+ * different times and rounds are short, and at -O2 it measures only
+ * 1.07x to 1.2x. Records all the same length share rounds and gain more
+ * (1.5x to 2x here). The test program times both.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+
+// Below this many inputs a task just does the work itself
+#define GRAIN 64
+
+typedef struct BatchTask {
+	ThreadPool pool;
+	bool (*execute)(void *automaton, char *input);
+	void *automaton;
+	char **inputs;
+	bool *results;
+	int lo, hi;
+} BatchTask;
+
+static void BatchTask_run(void *arg) {
+	BatchTask *task = (BatchTask*)arg;
+	while (task->hi - task->lo > GRAIN) {
+		int mid = task->lo + (task->hi - task->lo) / 2;
+		BatchTask *top = (BatchTask*)malloc(sizeof(BatchTask));
+		*top = *task;
+		top->lo = mid;
+		task->hi = mid;
+		ThreadPool_submit(task->pool, BatchTask_run, top);
+	}
+	for (int i=task->lo; i < task->hi; i++) {
+		task->results[i] = task->execute(task->automaton, task->inputs[i]);
+	}
+	free(task);
+}
+
+static void execute_batch(ThreadPool pool, bool (*execute)(void*, char*), void *automaton,
+			  char **inputs, int n, bool *results) {
+	if (n <= 0) {
+		return;
+	}
+	BatchTask *task = (BatchTask*)malloc(sizeof(BatchTask));
+	task->pool = pool;
+	task->execute = execute;
+	task->automaton = automaton;
+	task->inputs = inputs;
+	task->results = results;
+	task->lo = 0;
+	task->hi = n;
+	ThreadPool_submit(pool, BatchTask_run, task);
+	ThreadPool_wait(pool);
+}
+
+static bool execute_DFA(void *dfa, char *input) {
+	return DFA_execute((DFA)dfa, input);
+}
+
+static bool execute_NFA(void *nfa, char *input) {
+	return NFA_execute((NFA)nfa, input);
+}
+
+/**
+ * Run the given DFA on each of the n given input strings using the workers
+ * of the given ThreadPool, storing whether inputs[i] was accepted in
+ * results[i].
+ */
+void DFA_execute_batch(ThreadPool pool, DFA dfa, char **inputs, int n, bool *results) {
+	execute_batch(pool, execute_DFA, dfa, inputs, n, results);
+}
+
+/**
+ * Run the given NFA on each of the n given input strings using the workers
+ * of the given ThreadPool, storing whether inputs[i] was accepted in
+ * results[i].
+ */
+void NFA_execute_batch(ThreadPool pool, NFA nfa, char **inputs, int n, bool *results) {
+	execute_batch(pool, execute_NFA, nfa, inputs, n, results);
+}
+
+struct BatchDFA {
+	unsigned char classmap[DFA_NSYMBOLS];
+	int nclasses;
+	int *next;		// Rows of nclasses row offsets (state * nclasses)
+	bool *accepting;	// By row offset, so finishing a record needs no division
+	int start;		// Row offset of the initial state
+};
+
+/**
+ * Return a new BatchDFA for running the given DFA. The DFA isn't used
+ * after this returns.
+ */
+BatchDFA new_BatchDFA(DFA dfa) {
+	BatchDFA this = (BatchDFA)malloc(sizeof(struct BatchDFA));
+	int k = DFA_get_classes(dfa, this->classmap);
+	int rep[DFA_NSYMBOLS];
+	for (int sym=DFA_NSYMBOLS-1; sym >= 0; sym--) {
+		rep[this->classmap[sym]] = sym;
+	}
+	// Missing transitions go to an extra state that never leaves
+	int n = DFA_get_size(dfa);
+	int dead = n;
+	this->nclasses = k;
+	this->next = (int*)malloc(sizeof(int) * (n + 1) * k);
+	this->accepting = (bool*)calloc((n + 1) * k, sizeof(bool));
+	for (int s=0; s < n; s++) {
+		for (int c=0; c < k; c++) {
+			int t = DFA_get_transition(dfa, s, (char)rep[c]);
+			this->next[s * k + c] = (t == DFA_NO_STATE ? dead : t) * k;
+		}
+		this->accepting[s * k] = DFA_get_accepting(dfa, s);
+	}
+	for (int c=0; c < k; c++) {
+		this->next[dead * k + c] = dead * k;
+	}
+	this->start = (n > 0 ? 0 : dead) * k;
+	return this;
+}
+
+/**
+ * Free the given BatchDFA.
+ */
+void BatchDFA_free(BatchDFA this) {
+	if (this == NULL) {
+		return;
+	}
+	free(this->next);
+	free(this->accepting);
+	free(this);
+}
+
+/**
+ * Run the given BatchDFA's DFA on each of n records, where record i is the
+ * bytes from data[offsets[i]] up to data[offsets[i+1]]. Bit i % 64 of
+ * accepted[i / 64] is set if record i was accepted and cleared if not.
+ */
+void BatchDFA_execute(BatchDFA this, const char *data, const long *offsets, int n, uint64_t *accepted) {
+	if (n <= 0) {
+		return;
+	}
+	memset(accepted, 0, sizeof(uint64_t) * ((n + 63) / 64));
+	const int *next = this->next;
+	const unsigned char *classmap = this->classmap;
+	const unsigned char *pos[BATCH_LANES];
+	long left[BATCH_LANES];
+	int row[BATCH_LANES];
+	int record[BATCH_LANES];
+	for (int l=0; l < BATCH_LANES; l++) {
+		record[l] = -1;
+		left[l] = 0;
+	}
+	int i = 0;
+	for (;;) {
+		long steps = -1;
+		for (int l=0; l < BATCH_LANES; l++) {
+			while (left[l] == 0) {
+				if (record[l] >= 0 && this->accepting[row[l]]) {
+					accepted[record[l] / 64] |= (uint64_t)1 << (record[l] % 64);
+				}
+				record[l] = -1;
+				if (i == n) {
+					goto drain;
+				}
+				record[l] = i;
+				pos[l] = (const unsigned char*)data + offsets[i];
+				left[l] = offsets[i+1] - offsets[i];
+				row[l] = this->start;
+				i += 1;
+			}
+			if (steps < 0 || left[l] < steps) {
+				steps = left[l];
+			}
+		}
+		// The lanes' lookups don't depend on each other, so they overlap.
+		// Each lane's row is in a variable of its own so that it can stay
+		// in a register.
+		int r0 = row[0], r1 = row[1], r2 = row[2], r3 = row[3];
+		int r4 = row[4], r5 = row[5], r6 = row[6], r7 = row[7];
+		const unsigned char *p0 = pos[0], *p1 = pos[1], *p2 = pos[2], *p3 = pos[3];
+		const unsigned char *p4 = pos[4], *p5 = pos[5], *p6 = pos[6], *p7 = pos[7];
+		for (long j=0; j < steps; j++) {
+			r0 = next[r0 + classmap[p0[j]]];
+			r1 = next[r1 + classmap[p1[j]]];
+			r2 = next[r2 + classmap[p2[j]]];
+			r3 = next[r3 + classmap[p3[j]]];
+			r4 = next[r4 + classmap[p4[j]]];
+			r5 = next[r5 + classmap[p5[j]]];
+			r6 = next[r6 + classmap[p6[j]]];
+			r7 = next[r7 + classmap[p7[j]]];
+		}
+		row[0] = r0; row[1] = r1; row[2] = r2; row[3] = r3;
+		row[4] = r4; row[5] = r5; row[6] = r6; row[7] = r7;
+		for (int l=0; l < BATCH_LANES; l++) {
+			pos[l] += steps;
+			left[l] -= steps;
+		}
+	}
+drain:
+	for (int l=0; l < BATCH_LANES; l++) {
+		if (record[l] < 0) {
+			continue;
+		}
+		int r = row[l];
+		for (long j=0; j < left[l]; j++) {
+			r = next[r + classmap[pos[l][j]]];
+		}
+		if (this->accepting[r]) {
+			accepted[record[l] / 64] |= (uint64_t)1 << (record[l] % 64);
+		}
+	}
+}
+
+#ifdef MAIN
+
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * Time DFA_execute on each of a million random records of lo to hi bytes
+ * against one BatchDFA_execute on all of them, taking the best of three
+ * runs of each, and print the speeds.
+ */
+static void time_records(DFA dfa, BatchDFA batch, int lo, int hi) {
+	int nrecords = 1000000;
+	long *offsets = (long*)malloc(sizeof(long) * (nrecords + 1));
+	char **records = (char**)malloc(sizeof(char*) * nrecords);
+	offsets[0] = 0;
+	srand(173);
+	for (int i=0; i < nrecords; i++) {
+		offsets[i+1] = offsets[i] + lo + rand() % (hi - lo + 1);
+	}
+	char *data = (char*)malloc(offsets[nrecords]);
+	for (int i=0; i < nrecords; i++) {
+		int len = offsets[i+1] - offsets[i];
+		records[i] = (char*)malloc(len + 1);
+		for (int j=0; j < len; j++) {
+			records[i][j] = data[offsets[i] + j] = '0' + (rand() & 1);
+		}
+		records[i][len] = '\0';
+	}
+	uint64_t *accepted = (uint64_t*)malloc(sizeof(uint64_t) * ((nrecords + 63) / 64));
+	double serialSeconds = 1e9;
+	double batchSeconds = 1e9;
+	int count = 0;
+	int batchCount = 0;
+	for (int run=0; run < 3; run++) {
+		clock_t start = clock();
+		count = 0;
+		for (int i=0; i < nrecords; i++) {
+			count += DFA_execute(dfa, records[i]);
+		}
+		double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+		serialSeconds = (seconds < serialSeconds) ? seconds : serialSeconds;
+		start = clock();
+		BatchDFA_execute(batch, data, offsets, nrecords, accepted);
+		seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+		batchSeconds = (seconds < batchSeconds) ? seconds : batchSeconds;
+	}
+	for (int i=0; i < (nrecords + 63) / 64; i++) {
+		batchCount += __builtin_popcountll(accepted[i]);
+	}
+	serialSeconds = (serialSeconds > 0) ? serialSeconds : 1e-9;
+	batchSeconds = (batchSeconds > 0) ? batchSeconds : 1e-9;
+	printf("%d records (%ld bytes), %d accepted by DFA_execute, %d by BatchDFA\n",
+	       nrecords, offsets[nrecords], count, batchCount);
+	printf("DFA_execute: %.0f records/s, BatchDFA: %.0f records/s, %.2fx\n",
+	       nrecords / serialSeconds, nrecords / batchSeconds, serialSeconds / batchSeconds);
+	for (int i=0; i < nrecords; i++) {
+		free(records[i]);
+	}
+	free(records);
+	free(offsets);
+	free(data);
+	free(accepted);
+}
+
+int main(int argc, char* argv[]) {
+	// Strings with an even number of 0's and of 1's
+	DFA even = new_DFA(4);
+	for (int s=0; s < 4; s++) {
+		DFA_set_transition(even, s, '0', s ^ 1);
+		DFA_set_transition(even, s, '1', s ^ 2);
+	}
+	DFA_set_accepting(even, 0, true);
+
+	// Strings ending in "at"
+	NFA endsInAt = new_NFA(3);
+	NFA_add_transition_all(endsInAt, 0, 0);
+	NFA_add_transition(endsInAt, 0, 'a', 1);
+	NFA_add_transition(endsInAt, 1, 't', 2);
+	NFA_set_accepting(endsInAt, 2, true);
+
+	int n = 10000;
+	char **inputs = (char**)malloc(sizeof(char*) * n);
+	for (int i=0; i < n; i++) {
+		inputs[i] = (char*)malloc(33);
+		int len = 0;
+		for (int bits=i; bits > 0; bits >>= 1) {
+			inputs[i][len++] = '0' + (bits & 1);
+		}
+		strcpy(inputs[i] + len, (i % 3 == 0) ? "at" : "");
+	}
+	bool *results = (bool*)malloc(sizeof(bool) * n);
+
+	ThreadPool pool = new_ThreadPool(4);
+	printf("running DFA on %d inputs with %d threads...\n", n, ThreadPool_size(pool));
+	DFA_execute_batch(pool, even, inputs, n, results);
+	int mismatches = 0;
+	for (int i=0; i < n; i++) {
+		if (results[i] != DFA_execute(even, inputs[i])) {
+			mismatches += 1;
+		}
+	}
+	printf("DFA mismatches with serial run: %d\n", mismatches);
+
+	printf("running NFA on %d inputs with %d threads...\n", n, ThreadPool_size(pool));
+	NFA_execute_batch(pool, endsInAt, inputs, n, results);
+	mismatches = 0;
+	for (int i=0; i < n; i++) {
+		if (results[i] != (i % 3 == 0)) {
+			mismatches += 1;
+		}
+	}
+	printf("NFA mismatches with expected: %d\n", mismatches);
+
+	// The same inputs as columns, for batches of up to a few rounds of
+	// lanes and for all of them give or take a few
+	BatchDFA batch = new_BatchDFA(even);
+	mismatches = 0;
+	for (int m=0; m <= 6 * BATCH_LANES; m++) {
+		int count = (m < 3 * BATCH_LANES) ? m : n - (m - 3 * BATCH_LANES);
+		long *offsets = (long*)malloc(sizeof(long) * (count + 1));
+		offsets[0] = 0;
+		for (int i=0; i < count; i++) {
+			offsets[i+1] = offsets[i] + strlen(inputs[i]);
+		}
+		char *data = (char*)malloc(offsets[count] + 1);
+		for (int i=0; i < count; i++) {
+			memcpy(data + offsets[i], inputs[i], offsets[i+1] - offsets[i]);
+		}
+		uint64_t *accepted = (uint64_t*)malloc(sizeof(uint64_t) * ((count + 63) / 64 + 1));
+		BatchDFA_execute(batch, data, offsets, count, accepted);
+		for (int i=0; i < count; i++) {
+			if (((accepted[i / 64] >> (i % 64)) & 1) != DFA_execute(even, inputs[i])) {
+				mismatches += 1;
+			}
+		}
+		free(offsets);
+		free(data);
+		free(accepted);
+	}
+	printf("BatchDFA mismatches with serial run: %d\n", mismatches);
+
+	printf("timing a million records of 10 to 80 bytes...\n");
+	time_records(even, batch, 10, 80);
+	printf("timing a million records of 44 bytes...\n");
+	time_records(even, batch, 44, 44);
+	BatchDFA_free(batch);
+
+	ThreadPool_free(pool);
+	for (int i=0; i < n; i++) {
+		free(inputs[i]);
+	}
+	free(inputs);
+	free(results);
+	DFA_free(even);
+	NFA_free(endsInAt);
+}
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * File: batch.h
+ *
+ * Run one shared automaton over a batch of inputs on all the workers of
+ * a ThreadPool. The automaton is only read, so no copies or locks are
+ * needed; each worker keeps its own run state.
+ * For many short records there is also a BatchDFA, which takes the records
+ * as one buffer of bytes plus offsets and runs several of them at once on
+ * one core, so the lookups for one record overlap the others' instead of
+ * each waiting for the last.
+ */
+
+#ifndef _batch_h
+#define _batch_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ThreadPool.h"
+#include "dfa.h"
+#include "nfa.h"
+
+/**
+ * Run the given DFA on each of the n given input strings using the workers
+ * of the given ThreadPool, storing whether inputs[i] was accepted in
+ * results[i]. Returns when all the results are in.
+ */
+extern void DFA_execute_batch(ThreadPool pool, DFA dfa, char **inputs, int n, bool *results);
+
+/**
+ * Run the given NFA on each of the n given input strings using the workers
+ * of the given ThreadPool, storing whether inputs[i] was accepted in
+ * results[i]. Returns when all the results are in.
+ */
+extern void NFA_execute_batch(ThreadPool pool, NFA nfa, char **inputs, int n, bool *results);
+
+/**
+ * Records a BatchDFA runs at the same time (its inner loop in batch.c is
+ * written out for this many).
+ */
+#define BATCH_LANES 8
+
+typedef struct BatchDFA *BatchDFA;
+
+/**
+ * Return a new BatchDFA for running the given DFA. The DFA isn't used
+ * after this returns.
+ */
+extern BatchDFA new_BatchDFA(DFA dfa);
+
+/**
+ * Free the given BatchDFA.
+ */
+extern void BatchDFA_free(BatchDFA batch);
+
+/**
+ * Run the given BatchDFA's DFA on each of n records, where record i is the
+ * bytes from data[offsets[i]] up to data[offsets[i+1]] (so offsets has n+1
+ * entries, and records may contain NULs). Bit i % 64 of accepted[i / 64]
+ * is set if record i was accepted and cleared if not; accepted must have
+ * room for (n + 63) / 64 words.
+ */
+extern void BatchDFA_execute(BatchDFA batch, const char *data, const long *offsets, int n, uint64_t *accepted);
+
+#endif
@@ -0,0 +1,826 @@
+/*
+ * File: dfa.c
+ *
+ * Table-driven implementation of the DFA API in dfa.h.
+ * Each state has a full row of DFA_NSYMBOLS transitions, so a step is
+ * one array lookup. Running a DFA only reads the table; the current
+ * state lives in the caller, never in the DFA.
+ * The transitions are stored in 1, 2 or 4 bytes each, the fewest that
+ * can hold every state number plus an all-ones value for DFA_NO_STATE,
+ * and the table is widened when a state that doesn't fit is added. A DFA
+ * of up to 255 states thus takes a quarter of the cache it would with
+ * int transitions, and DFA_run has a loop for each width.
+ * With DFA_COMB storage the rows are compressed by row displacement
+ * (a "comb vector"): symbols are replaced by their classes, each row
+ * keeps a default destination, and its other entries are slotted into one
+ * shared array at an offset (base) where they don't collide with other
+ * rows' entries. Each slot records which state owns it, so a step is
+ * still a constant number of lookups.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include "dfa.h"
+#include "profile.h"
+
+typedef struct CombRow {
+	int base;		// Slot of the row's class 0
+	int dflt;		// Destination for classes with no slot
+} CombRow;
+
+typedef struct CombSlot {
+	int next;		// Destination
+	int check;		// State that owns the slot, or -1 if free
+} CombSlot;
+
+struct DFA {
+	int nstates;
+	int capacity;		// Number of states there is room for
+	void *delta;		// nstates rows of DFA_NSYMBOLS transitions, or NULL
+	int width;		// Bytes per transition in delta: 1, 2 or 4
+	bool *accepting;
+	DFAStorage storage;
+	// For DFA_COMB storage only:
+	unsigned char classmap[DFA_NSYMBOLS];
+	int nclasses;
+	CombRow *rows;		// Per state
+	CombSlot *slots;
+	int nslots;
+};
+
+static void compress(DFA this);
+static void decompress(DFA this);
+
+/**
+ * Return the number of bytes per transition that a DFA with the given
+ * number of states needs. The largest value of each width is left for
+ * DFA_NO_STATE.
+ */
+static int width_for(int nstates) {
+	if (nstates <= UINT8_MAX) {
+		return 1;
+	} else if (nstates <= UINT16_MAX) {
+		return 2;
+	}
+	return 4;
+}
+
+/**
+ * Return the i'th transition in the given (dense) DFA's table.
+ */
+static inline int get_entry(DFA this, long i) {
+	if (this->width == 1) {
+		uint8_t dst = ((const uint8_t*)this->delta)[i];
+		return (dst == UINT8_MAX) ? DFA_NO_STATE : dst;
+	} else if (this->width == 2) {
+		uint16_t dst = ((const uint16_t*)this->delta)[i];
+		return (dst == UINT16_MAX) ? DFA_NO_STATE : dst;
+	}
+	return ((const int32_t*)this->delta)[i];
+}
+
+/**
+ * Set the i'th transition in the given (dense) DFA's table, which must be
+ * wide enough for dst. DFA_NO_STATE truncates to all ones at any width.
+ */
+static inline void set_entry(DFA this, long i, int dst) {
+	if (this->width == 1) {
+		((uint8_t*)this->delta)[i] = (uint8_t)dst;
+	} else if (this->width == 2) {
+		((uint16_t*)this->delta)[i] = (uint16_t)dst;
+	} else {
+		((int32_t*)this->delta)[i] = dst;
+	}
+}
+
+/**
+ * Copy the transitions of state src of the given (dense) DFA into row.
+ */
+static void get_row(DFA this, int src, int row[DFA_NSYMBOLS]) {
+	long base = (long)src * DFA_NSYMBOLS;
+	for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+		row[sym] = get_entry(this, base + sym);
+	}
+}
+
+/**
+ * Make the given (dense) DFA's table wide enough for nstates states.
+ */
+static void ensure_width(DFA this, int nstates) {
+	int width = width_for(nstates);
+	if (width <= this->width) {
+		return;
+	}
+	long n = (long)this->nstates * DFA_NSYMBOLS;
+	void *delta = malloc(width * (long)(this->capacity > 0 ? this->capacity : 1) * DFA_NSYMBOLS);
+	struct DFA wide = *this;
+	wide.delta = delta;
+	wide.width = width;
+	for (long i=0; i < n; i++) {
+		set_entry(&wide, i, get_entry(this, i));
+	}
+	free(this->delta);
+	this->delta = delta;
+	this->width = width;
+}
+
+/**
+ * Allocate and return a new DFA containing the given number of states.
+ * All transitions start out as DFA_NO_STATE and no state is accepting.
+ */
+DFA new_DFA(int nstates) {
+	DFA this = (DFA)malloc(sizeof(struct DFA));
+	if (this == NULL) {
+		return NULL;
+	}
+	this->nstates = nstates;
+	this->capacity = nstates;
+	this->width = width_for(nstates);
+	long n = (long)nstates * DFA_NSYMBOLS;
+	this->delta = malloc(this->width * (n > 0 ? n : 1));
+	memset(this->delta, 0xff, this->width * n);	// All DFA_NO_STATE
+	this->accepting = (bool*)calloc(nstates, sizeof(bool));
+	this->storage = DFA_DENSE;
+	this->rows = NULL;
+	this->slots = NULL;
+	this->nslots = 0;
+	return this;
+}
+
+/**
+ * Free the given DFA.
+ */
+void DFA_free(DFA this) {
+	if (this == NULL) {
+		return;
+	}
+	free(this->delta);
+	free(this->accepting);
+	free(this->rows);
+	free(this->slots);
+	free(this);
+}
+
+/**
+ * Return the number of states in the given DFA.
+ */
+int DFA_get_size(DFA this) {
+	return this->nstates;
+}
+
+/**
+ * Add a new state to the given DFA, with no transitions and not accepting,
+ * and return its number. Room is doubled as needed, so building a DFA one
+ * state at a time takes amortized constant time per state.
+ */
+int DFA_add_state(DFA this) {
+	decompress(this);
+	ensure_width(this, this->nstates + 1);
+	if (this->nstates == this->capacity) {
+		int capacity = this->capacity < 8 ? 16 : this->capacity * 2;
+		this->delta = realloc(this->delta, this->width * (long)capacity * DFA_NSYMBOLS);
+		this->accepting = (bool*)realloc(this->accepting, sizeof(bool) * capacity);
+		this->capacity = capacity;
+	}
+	int state = this->nstates;
+	this->nstates += 1;
+	DFA_set_transition_all(this, state, DFA_NO_STATE);
+	this->accepting[state] = false;
+	return state;
+}
+
+/**
+ * Return the state specified by the given DFA's transition function from
+ * state src on input symbol sym.
+ */
+int DFA_get_transition(DFA this, int src, char sym) {
+	if (this->storage == DFA_COMB) {
+		int i = this->rows[src].base + this->classmap[(unsigned char)sym];
+		return (this->slots[i].check == src) ? this->slots[i].next : this->rows[src].dflt;
+	}
+	return get_entry(this, (long)src * DFA_NSYMBOLS + (unsigned char)sym);
+}
+
+/**
+ * For the given DFA, set the transition from state src on input symbol
+ * sym to be the state dst.
+ */
+void DFA_set_transition(DFA this, int src, char sym, int dst) {
+	decompress(this);
+	ensure_width(this, dst + 1);
+	set_entry(this, (long)src * DFA_NSYMBOLS + (unsigned char)sym, dst);
+}
+
+/**
+ * Set the transitions of the given DFA for each symbol in the given str.
+ */
+void DFA_set_transition_str(DFA this, int src, char *str, int dst) {
+	for (char *p=str; *p != '\0'; p++) {
+		DFA_set_transition(this, src, *p, dst);
+	}
+}
+
+/**
+ * Set the transitions of the given DFA for all input symbols.
+ */
+void DFA_set_transition_all(DFA this, int src, int dst) {
+	decompress(this);
+	ensure_width(this, dst + 1);
+	long base = (long)src * DFA_NSYMBOLS;
+	for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+		set_entry(this, base + sym, dst);
+	}
+}
+
+/**
+ * Set whether the given DFA's state is accepting or not.
+ */
+void DFA_set_accepting(DFA this, int state, bool value) {
+	this->accepting[state] = value;
+}
+
+/**
+ * Return true if the given DFA's state is an accepting state.
+ */
+bool DFA_get_accepting(DFA this, int state) {
+	return this->accepting[state];
+}
+
+/**
+ * Run the given DFA on the given input string starting from the given state
+ * and return the state it ends up in, or DFA_NO_STATE if it got stuck.
+ */
+int DFA_run(DFA this, int state, const char *input) {
+	const unsigned char *p = (const unsigned char*)input;
+	PROFILE_BEGIN(this);
+	if (this->storage == DFA_COMB) {
+		const unsigned char *classmap = this->classmap;
+		const CombRow *rows = this->rows;
+		const CombSlot *slots = this->slots;
+		while (*p != '\0' && state != DFA_NO_STATE) {
+			PROFILE_STEP(state, *p);
+			const CombSlot *slot = &slots[rows[state].base + classmap[*p++]];
+			state = (slot->check == state) ? slot->next : rows[state].dflt;
+		}
+	} else if (this->width == 1 && state != DFA_NO_STATE) {
+		const uint8_t *delta = this->delta;
+		unsigned s = state;
+		while (*p != '\0' && s != UINT8_MAX) {
+			PROFILE_STEP(s, *p);
+			s = delta[s * DFA_NSYMBOLS + *p++];
+		}
+		state = (s == UINT8_MAX) ? DFA_NO_STATE : (int)s;
+	} else if (this->width == 2 && state != DFA_NO_STATE) {
+		const uint16_t *delta = this->delta;
+		unsigned s = state;
+		while (*p != '\0' && s != UINT16_MAX) {
+			PROFILE_STEP(s, *p);
+			s = delta[(size_t)s * DFA_NSYMBOLS + *p++];
+		}
+		state = (s == UINT16_MAX) ? DFA_NO_STATE : (int)s;
+	} else {
+		const int32_t *delta = this->delta;
+		while (*p != '\0' && state != DFA_NO_STATE) {
+			PROFILE_STEP(state, *p);
+			state = delta[(size_t)state * DFA_NSYMBOLS + *p++];
+		}
+	}
+	PROFILE_END(state, p - (const unsigned char*)input, *p != '\0');
+	return state;
+}
+
+/**
+ * Run the given DFA on the given input string, and return true if it accepts
+ * the input, otherwise false.
+ */
+bool DFA_execute(DFA this, char *input) {
+	int state = DFA_run(this, 0, input);
+	return state != DFA_NO_STATE && this->accepting[state];
+}
+
+/**
+ * Group the input symbols of the given DFA into classes of symbols with
+ * the same destination from every state.
+ * Each symbol's column gets a hash of its destinations, and symbols whose
+ * columns hash the same are grouped together. One more pass over the rows
+ * checks that each symbol really goes where the first symbol of its class
+ * goes; only if a hash collision merged different columns are the columns
+ * compared one pair at a time.
+ */
+int DFA_get_classes(DFA this, unsigned char classmap[DFA_NSYMBOLS]) {
+	if (this->storage == DFA_COMB) {
+		// The classes were computed when the rows were compressed
+		memcpy(classmap, this->classmap, DFA_NSYMBOLS);
+		return this->nclasses;
+	}
+	unsigned long long hash[DFA_NSYMBOLS];
+	for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+		hash[sym] = 14695981039346656037ULL;
+	}
+	int row[DFA_NSYMBOLS];
+	for (int src=0; src < this->nstates; src++) {
+		get_row(this, src, row);
+		for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+			hash[sym] = (hash[sym] ^ (unsigned)row[sym]) * 1099511628211ULL;
+		}
+	}
+	int rep[DFA_NSYMBOLS];	// Smallest symbol of each class
+	int nclasses = 0;
+	for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+		int c;
+		for (c=0; c < nclasses && hash[rep[c]] != hash[sym]; c++) {
+		}
+		if (c == nclasses) {
+			rep[nclasses++] = sym;
+		}
+		classmap[sym] = c;
+	}
+
+	bool collision = false;
+	for (int src=0; src < this->nstates && !collision; src++) {
+		get_row(this, src, row);
+		for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+			if (row[sym] != row[rep[classmap[sym]]]) {
+				collision = true;
+				break;
+			}
+		}
+	}
+	if (!collision) {
+		return nclasses;
+	}
+
+	nclasses = 0;
+	for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+		int c;
+		for (c=0; c < nclasses; c++) {
+			if (hash[rep[c]] != hash[sym]) {
+				continue;
+			}
+			int src;
+			for (src=0; src < this->nstates; src++) {
+				long base = (long)src * DFA_NSYMBOLS;
+				if (get_entry(this, base + rep[c]) != get_entry(this, base + sym)) {
+					break;
+				}
+			}
+			if (src == this->nstates) {
+				break;
+			}
+		}
+		if (c == nclasses) {
+			rep[nclasses++] = sym;
+		}
+		classmap[sym] = c;
+	}
+	return nclasses;
+}
+
+/**
+ * Return the most common of the given n destinations.
+ * Usually one destination is most of the row, and a majority vote finds
+ * it in one pass; only rows without a majority are counted out in full.
+ */
+static int most_common(const int *dsts, int n) {
+	int candidate = dsts[0];
+	int votes = 0;
+	for (int i=0; i < n; i++) {
+		if (votes == 0) {
+			candidate = dsts[i];
+		}
+		votes += (dsts[i] == candidate) ? 1 : -1;
+	}
+	int count = 0;
+	for (int i=0; i < n; i++) {
+		count += (dsts[i] == candidate);
+	}
+	if (2 * count > n) {
+		return candidate;
+	}
+	int best = dsts[0];
+	int bestCount = 0;
+	for (int i=0; i < n; i++) {
+		int count = 0;
+		for (int j=i; j < n; j++) {
+			count += (dsts[j] == dsts[i]);
+		}
+		if (count > bestCount) {
+			best = dsts[i];
+			bestCount = count;
+		}
+	}
+	return best;
+}
+
+/**
+ * Make sure the given DFA has at least n comb slots, all new ones free.
+ */
+static void reserve_slots(DFA this, int n) {
+	if (n <= this->nslots) {
+		return;
+	}
+	int nslots = this->nslots;
+	while (nslots < n) {
+		nslots = (nslots < 1024) ? 1024 : 2 * nslots;
+	}
+	this->slots = (CombSlot*)realloc(this->slots, sizeof(CombSlot) * nslots);
+	for (int i=this->nslots; i < nslots; i++) {
+		this->slots[i].next = DFA_NO_STATE;
+		this->slots[i].check = -1;
+	}
+	this->nslots = nslots;
+}
+
+/**
+ * Return the first free slot at or after slot i, where nextFree links each
+ * used slot to a later slot (path halving keeps the links short).
+ */
+static int next_free(int *nextFree, int i) {
+	while (nextFree[i] != i) {
+		nextFree[i] = nextFree[nextFree[i]];
+		i = nextFree[i];
+	}
+	return i;
+}
+
+/**
+ * How far back (in rows of the class table) compress looks for holes to
+ * put a row in, and how many free slots it tries there before putting the
+ * row past all the slots used so far. Holes further back are mostly ones
+ * no row fits, and searching them made compress quadratic.
+ */
+#define COMB_WINDOW 8
+#define COMB_TRIES 64
+
+/**
+ * Switch the given (dense) DFA to DFA_COMB storage.
+ * Rows are placed first-fit: each row's entries go at the lowest base
+ * where all their slots are free, trying bases that put its first entry
+ * in one of the free slots near the end of those used so far.
+ */
+static void compress(DFA this) {
+	if (this->storage == DFA_COMB) {
+		return;
+	}
+	int k = DFA_get_classes(this, this->classmap);
+	this->nclasses = k;
+	int rep[DFA_NSYMBOLS];
+	for (int sym=DFA_NSYMBOLS-1; sym >= 0; sym--) {
+		rep[this->classmap[sym]] = sym;
+	}
+	this->rows = (CombRow*)malloc(sizeof(CombRow) * (this->nstates > 0 ? this->nstates : 1));
+	this->slots = NULL;
+	this->nslots = 0;
+	int *nextFree = NULL;
+	int top = 0;		// Slots from here on are all free
+	int row[DFA_NSYMBOLS];
+	int dsts[DFA_NSYMBOLS];
+	int entries[DFA_NSYMBOLS];	// Classes that don't go to the default
+	for (int s=0; s < this->nstates; s++) {
+		get_row(this, s, row);
+		for (int c=0; c < k; c++) {
+			dsts[c] = row[rep[c]];
+		}
+		int dflt = most_common(dsts, k);
+		int n = 0;
+		for (int c=0; c < k; c++) {
+			if (dsts[c] != dflt) {
+				entries[n++] = c;
+			}
+		}
+		this->rows[s].dflt = dflt;
+		this->rows[s].base = 0;
+		if (n == 0) {
+			continue;	// No slot can be owned by s, so base 0 works
+		}
+		int old = this->nslots;
+		reserve_slots(this, top + k + 1);
+		if (this->nslots > old) {
+			nextFree = (int*)realloc(nextFree, sizeof(int) * this->nslots);
+			for (int i=old; i < this->nslots; i++) {
+				nextFree[i] = i;
+			}
+		}
+		int base = top;
+		int f = next_free(nextFree, (top > COMB_WINDOW * k) ? top - COMB_WINDOW * k : 0);
+		for (int tries=0; tries < COMB_TRIES && f < top; tries++) {
+			int b = f - entries[0];
+			int i;
+			for (i=0; b >= 0 && i < n && this->slots[b + entries[i]].check < 0; i++) {
+			}
+			if (b >= 0 && i == n) {
+				base = b;
+				break;
+			}
+			f = next_free(nextFree, f + 1);
+		}
+		if (base == top) {
+			base = (top > entries[0]) ? top - entries[0] : 0;
+		}
+		this->rows[s].base = base;
+		for (int i=0; i < n; i++) {
+			int slot = base + entries[i];
+			this->slots[slot].next = dsts[entries[i]];
+			this->slots[slot].check = s;
+			nextFree[slot] = slot + 1;
+			if (slot + 1 > top) {
+				top = slot + 1;
+			}
+		}
+	}
+	// Trim to the highest slot any row can reach
+	int used = k;
+	for (int s=0; s < this->nstates; s++) {
+		if (this->rows[s].base + k > used) {
+			used = this->rows[s].base + k;
+		}
+	}
+	reserve_slots(this, used);
+	this->slots = (CombSlot*)realloc(this->slots, sizeof(CombSlot) * used);
+	this->nslots = used;
+	free(nextFree);
+	free(this->delta);
+	this->delta = NULL;
+	this->capacity = this->nstates;
+	this->storage = DFA_COMB;
+}
+
+/**
+ * Switch the given DFA back to DFA_DENSE storage, if it isn't already.
+ */
+static void decompress(DFA this) {
+	if (this->storage == DFA_DENSE) {
+		return;
+	}
+	struct DFA dense = *this;
+	dense.width = width_for(this->nstates);
+	dense.delta = malloc(dense.width * (long)(this->nstates > 0 ? this->nstates : 1) * DFA_NSYMBOLS);
+	for (int s=0; s < this->nstates; s++) {
+		for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+			set_entry(&dense, (long)s * DFA_NSYMBOLS + sym, DFA_get_transition(this, s, (char)sym));
+		}
+	}
+	free(this->rows);
+	free(this->slots);
+	this->rows = NULL;
+	this->slots = NULL;
+	this->nslots = 0;
+	this->delta = dense.delta;
+	this->width = dense.width;
+	this->capacity = this->nstates;
+	this->storage = DFA_DENSE;
+}
+
+/**
+ * Set how the given DFA stores its transitions.
+ */
+void DFA_set_storage(DFA this, DFAStorage storage) {
+	if (storage == DFA_COMB) {
+		compress(this);
+	} else {
+		decompress(this);
+	}
+}
+
+/**
+ * Return how the given DFA stores its transitions.
+ */
+DFAStorage DFA_get_storage(DFA this) {
+	return this->storage;
+}
+
+/**
+ * Return the given DFA's table of transitions and set *width to the bytes
+ * per transition, or return NULL (with *width 0) for DFA_COMB storage.
+ */
+const void *DFA_get_table(DFA this, int *width) {
+	if (this->storage == DFA_COMB) {
+		*width = 0;
+		return NULL;
+	}
+	*width = this->width;
+	return this->delta;
+}
+
+/**
+ * Return the number of bytes the given DFA uses for its states and
+ * transitions.
+ */
+long DFA_get_memory(DFA this) {
+	long bytes = sizeof(struct DFA) + sizeof(bool) * (long)this->capacity;
+	if (this->storage == DFA_COMB) {
+		bytes += sizeof(CombRow) * (long)this->nstates + sizeof(CombSlot) * (long)this->nslots;
+	} else {
+		bytes += this->width * (long)this->capacity * DFA_NSYMBOLS;
+	}
+	return bytes;
+}
+
+/**
+ * Print the given DFA to stdout.
+ * Runs of consecutive symbols with the same destination are printed as
+ * ranges so that a DFA_set_transition_all row takes one line.
+ */
+void DFA_print(DFA this) {
+	printf("DFA with %d states\n", this->nstates);
+	for (int src=0; src < this->nstates; src++) {
+		printf("%d%s:", src, this->accepting[src] ? " (accepting)" : "");
+		int row[DFA_NSYMBOLS];
+		for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+			row[sym] = DFA_get_transition(this, src, (char)sym);
+		}
+		int lo = 0;
+		while (lo < DFA_NSYMBOLS) {
+			int hi = lo;
+			while (hi+1 < DFA_NSYMBOLS && row[hi+1] == row[lo]) {
+				hi += 1;
+			}
+			if (row[lo] != DFA_NO_STATE) {
+				if (lo == hi && isgraph(lo)) {
+					printf(" '%c'->%d", lo, row[lo]);
+				} else if (lo == hi) {
+					printf(" %d->%d", lo, row[lo]);
+				} else {
+					printf(" [%d-%d]->%d", lo, hi, row[lo]);
+				}
+			}
+			lo = hi + 1;
+		}
+		printf("\n");
+	}
+}
+
+#ifdef MAIN
+
+#include <time.h>
+
+static void test(DFA dfa, char *input) {
+	printf("\"%s\": %s\n", input, DFA_execute(dfa, input) ? "true" : "false");
+}
+
+int main(int argc, char* argv[]) {
+	printf("building DFA for exactly \"CSC\"...\n");
+	DFA csc = new_DFA(4);
+	DFA_set_transition(csc, 0, 'C', 1);
+	DFA_set_transition(csc, 1, 'S', 2);
+	DFA_set_transition(csc, 2, 'C', 3);
+	DFA_set_accepting(csc, 3, true);
+	DFA_print(csc);
+	test(csc, "CSC");
+	test(csc, "CS");
+	test(csc, "CSCC");
+	test(csc, "");
+
+	printf("building DFA for even numbers of 0's and 1's...\n");
+	DFA even = new_DFA(4);
+	for (int s=0; s < 4; s++) {
+		DFA_set_transition_all(even, s, s);
+		DFA_set_transition(even, s, '0', s ^ 1);
+		DFA_set_transition(even, s, '1', s ^ 2);
+	}
+	DFA_set_accepting(even, 0, true);
+	DFA_print(even);
+	test(even, "0011");
+	test(even, "0101x");
+	test(even, "011");
+	test(even, "");
+
+	printf("testing DFA_run in pieces...\n");
+	int state = DFA_run(even, 0, "01");
+	state = DFA_run(even, state, "10");
+	printf("state after \"01\" then \"10\": %d\n", state);
+	printf("non-ASCII byte stays put: %d\n", DFA_run(even, 0, "\xe9"));
+
+	printf("testing DFA_get_classes...\n");
+	unsigned char classmap[DFA_NSYMBOLS];
+	int nclasses = DFA_get_classes(csc, classmap);
+	printf("CSC has %d classes, 'C' and 'S' in %d and %d\n",
+	       nclasses, classmap['C'], classmap['S']);
+	printf("even has %d classes\n", DFA_get_classes(even, classmap));
+
+	printf("testing DFA_add_state...\n");
+	int s4 = DFA_add_state(csc);
+	DFA_set_transition(csc, 3, '!', s4);
+	DFA_set_accepting(csc, s4, true);
+	test(csc, "CSC!");
+	test(csc, "CSC");
+
+	printf("testing DFA_COMB storage...\n");
+	long denseBytes = DFA_get_memory(csc);
+	DFA_set_storage(csc, DFA_COMB);
+	printf("%ld bytes dense, %ld bytes comb\n", denseBytes, DFA_get_memory(csc));
+	DFA_print(csc);
+	test(csc, "CSC!");
+	test(csc, "CSX");
+	DFA_set_transition(csc, 3, '?', s4);
+	printf("after DFA_set_transition: %s\n", DFA_get_storage(csc) == DFA_DENSE ? "dense" : "comb");
+	test(csc, "CSC?");
+
+	int nstates = 200000;
+	printf("comparing dense and comb on a random %d-state DFA...\n", nstates);
+	DFA dense = new_DFA(nstates);
+	DFA comb = new_DFA(nstates);
+	unsigned int seed = 173;
+	for (int s=0; s < nstates; s++) {
+		DFA_set_transition_all(dense, s, (s + 1) % nstates);
+		DFA_set_transition_all(comb, s, (s + 1) % nstates);
+		for (int i=0; i < 4; i++) {
+			seed = seed * 1103515245 + 12345;
+			char sym = 'a' + (seed >> 16) % 26;
+			seed = seed * 1103515245 + 12345;
+			int dst = (seed >> 8) % nstates;
+			DFA_set_transition(dense, s, sym, dst);
+			DFA_set_transition(comb, s, sym, dst);
+		}
+		DFA_set_accepting(dense, s, s % 7 == 0);
+		DFA_set_accepting(comb, s, s % 7 == 0);
+	}
+	denseBytes = DFA_get_memory(comb);
+	DFA_set_storage(comb, DFA_COMB);
+	printf("%ld MB dense, %ld MB comb\n", denseBytes >> 20, DFA_get_memory(comb) >> 20);
+	int mismatches = 0;
+	for (int s=0; s < nstates; s++) {
+		for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+			mismatches += DFA_get_transition(dense, s, (char)sym) != DFA_get_transition(comb, s, (char)sym);
+		}
+	}
+	printf("%d mismatched transitions\n", mismatches);
+	char text[65];
+	int accepted[2] = { 0, 0 };
+	clock_t elapsed[2] = { 0, 0 };
+	for (int i=0; i < 100000; i++) {
+		for (int j=0; j < 64; j++) {
+			seed = seed * 1103515245 + 12345;
+			text[j] = 'a' + (seed >> 16) % 26;
+		}
+		text[64] = '\0';
+		for (int k=0; k < 2; k++) {
+			clock_t start = clock();
+			accepted[k] += DFA_execute(k == 0 ? dense : comb, text);
+			elapsed[k] += clock() - start;
+		}
+	}
+	printf("accepted %d dense, %d comb; comb/dense time %.2f\n", accepted[0], accepted[1],
+	       (double)elapsed[1] / (elapsed[0] > 0 ? elapsed[0] : 1));
+
+	printf("testing transition widths...\n");
+	DFA chain = new_DFA(1);
+	char *as = (char*)malloc(70001);
+	for (int s=1; s <= 70000; s++) {
+		DFA_add_state(chain);
+		DFA_set_transition(chain, s - 1, 'a', s);
+		if (s == 254 || s == 255 || s == 65535 || s == 70000) {
+			memset(as, 'a', s);
+			as[s] = '\0';
+			printf("%d states: %ld KB, \"a\"x%d reaches %d, one more gets stuck: %d\n",
+			       s + 1, DFA_get_memory(chain) >> 10, s, DFA_run(chain, 0, as), DFA_run(chain, s, "a"));
+		}
+	}
+	free(as);
+	DFA_free(chain);
+
+	// The same 200-state DFA twice, the second with enough unused states
+	// added that its transitions take 4 bytes instead of 1
+	DFA narrow = new_DFA(200);
+	DFA wide = new_DFA(200);
+	for (int s=0; s < 200; s++) {
+		for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+			seed = seed * 1103515245 + 12345;
+			DFA_set_transition(narrow, s, (char)sym, (seed >> 8) % 200);
+			DFA_set_transition(wide, s, (char)sym, (seed >> 8) % 200);
+		}
+	}
+	while (DFA_get_size(wide) <= 65535) {
+		DFA_add_state(wide);
+	}
+	long length = 1 << 22;
+	char *input = (char*)malloc(length + 1);
+	for (long i=0; i < length; i++) {
+		seed = seed * 1103515245 + 12345;
+		input[i] = 1 + (seed >> 16) % 255;
+	}
+	input[length] = '\0';
+	int ends[2];
+	for (int k=0; k < 2; k++) {
+		clock_t start = clock();
+		ends[k] = DFA_run(k == 0 ? narrow : wide, 0, input);
+		elapsed[k] = clock() - start;
+	}
+	printf("random 200-state DFA: same end state %s, %.1f MB/s with 1-byte transitions, %.1f MB/s with 4\n",
+	       ends[0] == ends[1] ? "true" : "false",
+	       length / ((double)elapsed[0] / CLOCKS_PER_SEC) / 1e6,
+	       length / ((double)elapsed[1] / CLOCKS_PER_SEC) / 1e6);
+	free(input);
+	DFA_free(narrow);
+	DFA_free(wide);
+
+	DFA_free(dense);
+	DFA_free(comb);
+	DFA_free(csc);
+	DFA_free(even);
+}
+
+#endif
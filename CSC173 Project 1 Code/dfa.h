@@ -18,6 +18,29 @@
  */
 typedef struct DFA *DFA;
 
+/**
+ * The number of distinct input symbols. Symbols are bytes, so a char is
+ * always treated as an unsigned char when it indexes a transition.
+ */
+#define DFA_NSYMBOLS 256
+
+/**
+ * The value of a transition that has not been set. Running into it
+ * rejects the input. State 0 is always the start state.
+ */
+#define DFA_NO_STATE (-1)
+
+/**
+ * How a DFA stores its transitions. DFA_DENSE keeps a full row of
+ * DFA_NSYMBOLS transitions per state: fastest, but 256 bytes per state
+ * for DFAs of up to 255 states, 512 up to 65535 states, and 1KB above
+ * (the width is chosen, and widened, as states are added).
+ * DFA_COMB compresses the rows into one shared array (row displacement)
+ * and is much smaller when most of a row goes to the same state, as in
+ * dictionary and keyword automata, while a step is still constant time.
+ */
+typedef enum { DFA_DENSE, DFA_COMB } DFAStorage;
+
 /**
  * Allocate and return a new DFA containing the given number of states.
  */
@@ -33,6 +56,12 @@ extern void DFA_free(DFA dfa);
  */
 extern int DFA_get_size(DFA dfa);
 
+/**
+ * Add a new state to the given DFA, with no transitions and not accepting,
+ * and return its number.
+ */
+extern int DFA_add_state(DFA dfa);
+
 /**
  * Return the state specified by the given DFA's transition function from
  * state src on input symbol sym.
@@ -71,9 +100,55 @@ extern bool DFA_get_accepting(DFA dfa, int state);
 /**
  * Run the given DFA on the given input string, and return true if it accepts
  * the input, otherwise false.
+ * Running never modifies the DFA, so once it has been built one DFA can be
+ * shared by any number of threads without locking.
  */
 extern bool DFA_execute(DFA dfa, char *input);
 
+/**
+ * Run the given DFA on the given input string starting from the given state
+ * and return the state it ends up in, or DFA_NO_STATE if it got stuck.
+ * The state is all the run state there is, so a caller can feed input in
+ * pieces by passing the result of one call to the next.
+ */
+extern int DFA_run(DFA dfa, int state, const char *input);
+
+/**
+ * Group the input symbols of the given DFA into classes of symbols that
+ * every state treats the same way (same destination everywhere), storing
+ * the class of each symbol in classmap and returning the number of classes.
+ * Classes are numbered in order of their smallest symbol.
+ * Algorithms that loop over the alphabet can loop over classes instead.
+ */
+extern int DFA_get_classes(DFA dfa, unsigned char classmap[DFA_NSYMBOLS]);
+
+/**
+ * Set how the given DFA stores its transitions. A DFA starts out
+ * DFA_DENSE; switch to DFA_COMB once it is built. Changing a DFA_COMB DFA
+ * (adding states or setting transitions) switches it back to DFA_DENSE.
+ */
+extern void DFA_set_storage(DFA dfa, DFAStorage storage);
+
+/**
+ * Return how the given DFA stores its transitions.
+ */
+extern DFAStorage DFA_get_storage(DFA dfa);
+
+/**
+ * Return the given DFA's table of transitions, a row of DFA_NSYMBOLS per
+ * state, and set *width to the bytes per transition (1, 2 or 4), for
+ * engines that step through it directly. DFA_NO_STATE is all ones at any
+ * width. Returns NULL (and sets *width to 0) for DFA_COMB storage. The
+ * table belongs to the DFA and is only good until the DFA is changed.
+ */
+extern const void *DFA_get_table(DFA dfa, int *width);
+
+/**
+ * Return the number of bytes the given DFA uses for its states and
+ * transitions.
+ */
+extern long DFA_get_memory(DFA dfa);
+
 /**
  * Print the given DFA to System.out.
  */
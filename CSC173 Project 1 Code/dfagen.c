@@ -0,0 +1,220 @@
+/*
+ * File: dfagen.c
+ *
+ * Implementation of the C source writer in dfagen.h.
+ * The transitions are written over the DFA's symbol classes (see
+ * DFA_get_classes), a row of classes per state, so the tables are no
+ * bigger than they need to be.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "dfagen.h"
+
+/**
+ * Write the given string to out as a C string literal.
+ */
+static void write_string(const char *s, FILE *out) {
+	fputc('"', out);
+	for (const unsigned char *p=(const unsigned char*)s; *p != '\0'; p++) {
+		if (*p == '"' || *p == '\\') {
+			fprintf(out, "\\%c", *p);
+		} else if (isprint(*p) && *p != '?') {
+			fputc(*p, out);
+		} else {
+			fprintf(out, "\\%03o", *p);	// Octal can't run into what follows
+		}
+	}
+	fputc('"', out);
+}
+
+/**
+ * Write the given DFA's tables to out as static const arrays named after
+ * the given name.
+ */
+void DFA_write_tables(DFA dfa, const char *name, FILE *out) {
+	unsigned char classmap[DFA_NSYMBOLS];
+	int k = DFA_get_classes(dfa, classmap);
+	int rep[DFA_NSYMBOLS];
+	for (int sym=DFA_NSYMBOLS-1; sym >= 0; sym--) {
+		rep[classmap[sym]] = sym;
+	}
+	int n = DFA_get_size(dfa);
+
+	fprintf(out, "static const unsigned char %s_classmap[%d] = {", name, DFA_NSYMBOLS);
+	for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+		fprintf(out, "%s%d,", (sym % 16 == 0) ? "\n\t" : " ", classmap[sym]);
+	}
+	fprintf(out, "\n};\n");
+
+	fprintf(out, "static const int %s_transitions[%d] = {", name, n * k);
+	for (int s=0; s < n; s++) {
+		fprintf(out, "\n\t");
+		for (int c=0; c < k; c++) {
+			fprintf(out, "%s%d,", (c > 0 && c % 16 == 0) ? "\n\t" : (c > 0) ? " " : "",
+				DFA_get_transition(dfa, s, (char)rep[c]));
+		}
+	}
+	fprintf(out, "\n};\n");
+
+	fprintf(out, "static const unsigned char %s_accepting[%d] = {", name, (n + 7) / 8);
+	for (int i=0; i < (n + 7) / 8; i++) {
+		int byte = 0;
+		for (int s=8*i; s < n && s < 8*i + 8; s++) {
+			byte |= DFA_get_accepting(dfa, s) << (s % 8);
+		}
+		fprintf(out, "%s0x%02x,", (i % 12 == 0) ? "\n\t" : " ", byte);
+	}
+	fprintf(out, "\n};\n");
+}
+
+/**
+ * Return a state of the given DFA that accepts whatever input follows it,
+ * or DFA_NO_STATE if there isn't one.
+ */
+int DFA_get_accept_all(DFA dfa) {
+	for (int s=0; s < DFA_get_size(dfa); s++) {
+		if (!DFA_get_accepting(dfa, s)) {
+			continue;
+		}
+		int sym = 0;
+		while (sym < DFA_NSYMBOLS && DFA_get_transition(dfa, s, (char)sym) == s) {
+			sym += 1;
+		}
+		if (sym == DFA_NSYMBOLS) {
+			return s;
+		}
+	}
+	return DFA_NO_STATE;
+}
+
+/**
+ * Return true if the given minimal DFA accepts the reversals of a
+ * language closed under adding anything in front.
+ */
+bool DFA_is_end_anchored(DFA reverse) {
+	// Then whatever follows an accepted string is accepted too, and in a
+	// minimal DFA that means every accepting state is the one that
+	// accepts everything
+	int all = DFA_get_accept_all(reverse);
+	for (int s=0; s < DFA_get_size(reverse); s++) {
+		if (DFA_get_accepting(reverse, s) && s != all) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Write a StaticDFA initializer for the tables DFA_write_tables wrote for
+ * the given DFA and name to out.
+ */
+void DFA_write_initializer(DFA dfa, const char *name, const char *pattern, const char *reverse, FILE *out) {
+	unsigned char classmap[DFA_NSYMBOLS];
+	fprintf(out, "{ ");
+	write_string(name, out);
+	fprintf(out, ", ");
+	if (pattern != NULL) {
+		write_string(pattern, out);
+	} else {
+		fprintf(out, "NULL");
+	}
+	fprintf(out, ", %d, %d, %s_classmap, %s_transitions, %s_accepting, %d, ",
+		DFA_get_size(dfa), DFA_get_classes(dfa, classmap), name, name, name,
+		DFA_get_accept_all(dfa));
+	if (reverse != NULL) {
+		fprintf(out, "&%s }", reverse);
+	} else {
+		fprintf(out, "NULL }");
+	}
+}
+
+#ifdef MAIN
+
+/*
+ * The test program is the build step:
+ *   dfagen rules.txt > rules.h
+ * Each line of the input is a name (a C identifier) and a regular
+ * expression (see regexp.h) that must match whole strings, separated by
+ * spaces, as regexp_read_rules reads them. If any line is bad, nothing
+ * is written and dfagen fails. The output
+ * has each rule's minimal DFA as const tables, and an array rules of
+ * NRULES StaticDFAs in the order of the input. A rule that only depends
+ * on how strings end, and can't stop early when run forwards, also gets
+ * tables for its reversal, named <name>_reverse, which StaticDFA_match
+ * runs from the end of the input.
+ */
+
+#include "regexp.h"
+#include "nfa2dfa.h"
+#include "dfaops.h"
+
+// Longest name a rule can have, from the longest line
+#define MAX_LINE 4096
+
+int main(int argc, char* argv[]) {
+	if (argc != 2) {
+		fprintf(stderr, "usage: dfagen rules.txt > rules.h\n");
+		return 2;
+	}
+	int nrules;
+	RegexpRule *rules = regexp_read_rules(argv[1], &nrules, stderr);
+	if (rules == NULL) {
+		return 1;
+	}
+	// Include guard from the file's base name: rules.txt gives _rules_h
+	const char *base = strrchr(argv[1], '/') ? strrchr(argv[1], '/') + 1 : argv[1];
+	char guard[256] = "_";
+	for (int i=0; base[i] != '\0' && base[i] != '.' && i < 200; i++) {
+		guard[i+1] = isalnum((unsigned char)base[i]) ? base[i] : '_';
+		guard[i+2] = '\0';
+	}
+	strcat(guard, "_h");
+	printf("/*\n * Generated from %s by dfagen: don't edit.\n */\n\n", argv[1]);
+	printf("#ifndef %s\n#define %s\n\n#include \"StaticDFA.h\"\n", guard, guard);
+
+	DFA *dfas = (DFA*)malloc(sizeof(DFA) * (nrules > 0 ? nrules : 1));
+	bool *reverses = (bool*)malloc(sizeof(bool) * (nrules > 0 ? nrules : 1));
+	for (int i=0; i < nrules; i++) {
+		const char *name = rules[i].name;
+		DFA dfa = NFA_to_DFA(rules[i].nfa);
+		DFA minimal = DFA_minimize(dfa);
+		DFA_free(dfa);
+		dfas[i] = minimal;
+		printf("\n/* %s: %d states */\n", name, DFA_get_size(minimal));
+		DFA_write_tables(minimal, name, stdout);
+		DFA reversed = DFA_reverse(minimal);
+		DFA reverse = DFA_minimize(reversed);
+		DFA_free(reversed);
+		// Rules that stop early forwards (like containing a word) can stay
+		reverses[i] = DFA_get_accept_all(minimal) == DFA_NO_STATE && DFA_is_end_anchored(reverse);
+		if (reverses[i]) {
+			char reverseName[MAX_LINE + 16];
+			snprintf(reverseName, sizeof(reverseName), "%s_reverse", name);
+			printf("\n/* %s: %d states, run from the end */\n", reverseName, DFA_get_size(reverse));
+			DFA_write_tables(reverse, reverseName, stdout);
+			printf("static const StaticDFA %s = ", reverseName);
+			DFA_write_initializer(reverse, reverseName, NULL, NULL, stdout);
+			printf(";\n");
+		}
+		DFA_free(reverse);
+	}
+
+	printf("\nstatic const StaticDFA rules[] = {\n");
+	for (int i=0; i < nrules; i++) {
+		printf("\t");
+		char reverseName[MAX_LINE + 16];
+		snprintf(reverseName, sizeof(reverseName), "%s_reverse", rules[i].name);
+		DFA_write_initializer(dfas[i], rules[i].name, rules[i].pattern, reverses[i] ? reverseName : NULL, stdout);
+		printf(",\n");
+		DFA_free(dfas[i]);
+	}
+	printf("};\n\n#define NRULES %d\n\n#endif\n", nrules);
+	free(dfas);
+	free(reverses);
+	regexp_free_rules(rules, nrules);
+	return 0;
+}
+
+#endif
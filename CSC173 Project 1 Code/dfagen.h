@@ -0,0 +1,49 @@
+/*
+ * File: dfagen.h
+ *
+ * Writing DFAs out as C source for StaticDFA.h, so automata that are
+ * fixed when a program is built can be compiled into it instead of being
+ * built every time it starts. The test program for this module (dfagen)
+ * is the build step: it compiles a file of named regular expressions
+ * into a header of StaticDFAs (see the rules.h target in the Makefile).
+ */
+
+#ifndef _dfagen_h
+#define _dfagen_h
+
+#include <stdio.h>
+#include "dfa.h"
+
+/**
+ * Write the given DFA's tables to out as static const arrays named after
+ * the given name, which must be a C identifier.
+ */
+extern void DFA_write_tables(DFA dfa, const char *name, FILE *out);
+
+/**
+ * Write a StaticDFA initializer for the tables DFA_write_tables wrote for
+ * the given DFA and name to out, without a trailing comma or newline.
+ * The pattern is recorded as a description of the DFA and may be NULL.
+ * The reverse is the name of a StaticDFA for the reversed strings to run
+ * instead (see StaticDFA.h), or NULL.
+ */
+extern void DFA_write_initializer(DFA dfa, const char *name, const char *pattern, const char *reverse, FILE *out);
+
+/**
+ * Return an accepting state of the given DFA whose transitions all go
+ * back to itself, so it accepts whatever input follows it, or
+ * DFA_NO_STATE if there isn't one. In a minimal DFA that is the only way
+ * a state can accept everything.
+ */
+extern int DFA_get_accept_all(DFA dfa);
+
+/**
+ * Return true if the given DFA, which must be minimal, accepts the
+ * reversals of a language whose strings can have anything in front of
+ * them: if w is in it, so is xw for any x. Such a language can be
+ * decided by running the reversed DFA from the end of the input, and
+ * stopping as soon as it accepts.
+ */
+extern bool DFA_is_end_anchored(DFA reverse);
+
+#endif
@@ -0,0 +1,974 @@
+/*
+ * File: dfaops.c
+ *
+ * Boolean combinations of DFAs by product construction, Hopcroft's
+ * minimization algorithm, Hopcroft and Karp's equivalence check, and
+ * renumbering of states for locality.
+ * The product of a and b has a state for each pair (p,q) of states of a and
+ * b, but only pairs that are reachable from (0,0) are ever built: pairs are
+ * discovered breadth-first and looked up in a hash table.
+ * All of these work on classes of input symbols (DFA_get_classes) rather
+ * than on all DFA_NSYMBOLS symbols.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "dfaops.h"
+
+typedef bool (*BoolOp)(bool a, bool b);
+
+static bool op_and(bool a, bool b) { return a && b; }
+static bool op_or(bool a, bool b) { return a || b; }
+static bool op_and_not(bool a, bool b) { return a && !b; }
+static bool op_not(bool a, bool b) { return !a; }
+
+/**
+ * Compute classes of symbols that both a and b (which may be NULL) treat
+ * the same way, storing the class of each symbol in classmap and the
+ * smallest symbol of each class in rep. Returns the number of classes.
+ */
+static int joint_classes(DFA a, DFA b, unsigned char classmap[DFA_NSYMBOLS], int rep[DFA_NSYMBOLS]) {
+	unsigned char ca[DFA_NSYMBOLS], cb[DFA_NSYMBOLS] = {0};
+	DFA_get_classes(a, ca);
+	if (b != NULL) {
+		DFA_get_classes(b, cb);
+	}
+	int nclasses = 0;
+	for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+		int c;
+		for (c=0; c < nclasses; c++) {
+			if (ca[rep[c]] == ca[sym] && cb[rep[c]] == cb[sym]) {
+				break;
+			}
+		}
+		if (c == nclasses) {
+			rep[nclasses++] = sym;
+		}
+		classmap[sym] = c;
+	}
+	return nclasses;
+}
+
+/**
+ * Open-addressing hash table from pairs of states to product states.
+ * Either state of a pair may be DFA_NO_STATE.
+ */
+typedef struct PairMap {
+	unsigned long long *keys;
+	int *values;
+	int capacity;		// Always a power of 2
+	int count;
+} PairMap;
+
+#define EMPTY_KEY (~0ULL)
+
+static unsigned long long pair_key(int p, int q) {
+	return ((unsigned long long)(unsigned)(p + 1) << 32) | (unsigned)(q + 1);
+}
+
+static unsigned long long mix64(unsigned long long x) {
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static void PairMap_init(PairMap *this, int capacity) {
+	this->capacity = capacity;
+	this->count = 0;
+	this->keys = (unsigned long long*)malloc(sizeof(unsigned long long) * capacity);
+	this->values = (int*)malloc(sizeof(int) * capacity);
+	for (int i=0; i < capacity; i++) {
+		this->keys[i] = EMPTY_KEY;
+	}
+}
+
+/**
+ * Return the slot for the given key: either where it is, or the empty
+ * slot where it would go.
+ */
+static int PairMap_slot(PairMap *this, unsigned long long key) {
+	int mask = this->capacity - 1;
+	int i = (int)(mix64(key) & mask);
+	while (this->keys[i] != EMPTY_KEY && this->keys[i] != key) {
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+static void PairMap_put(PairMap *this, unsigned long long key, int value) {
+	if (2 * (this->count + 1) > this->capacity) {
+		PairMap old = *this;
+		PairMap_init(this, old.capacity * 2);
+		for (int i=0; i < old.capacity; i++) {
+			if (old.keys[i] != EMPTY_KEY) {
+				PairMap_put(this, old.keys[i], old.values[i]);
+			}
+		}
+		free(old.keys);
+		free(old.values);
+	}
+	int i = PairMap_slot(this, key);
+	if (this->keys[i] == EMPTY_KEY) {
+		this->count += 1;
+	}
+	this->keys[i] = key;
+	this->values[i] = value;
+}
+
+/**
+ * Return true if no string can take the product from pair (p,q) to an
+ * accepting pair, judging only by which sides are already stuck.
+ */
+static bool pair_is_dead(int p, int q, BoolOp op) {
+	if (p < 0 && q < 0) {
+		return !op(false, false);
+	} else if (p < 0) {
+		return !op(false, true) && !op(false, false);
+	} else if (q < 0) {
+		return !op(true, false) && !op(false, false);
+	}
+	return false;
+}
+
+/**
+ * Build the reachable part of the product of a and b (b may be NULL,
+ * meaning a DFA that is always stuck), where a pair is accepting if op
+ * says so given whether each side is accepting.
+ */
+static DFA product(DFA a, DFA b, BoolOp op) {
+	unsigned char classmap[DFA_NSYMBOLS];
+	int rep[DFA_NSYMBOLS];
+	int nclasses = joint_classes(a, b, classmap, rep);
+
+	int capacity = 64;
+	int *pa = (int*)malloc(sizeof(int) * capacity);
+	int *pb = (int*)malloc(sizeof(int) * capacity);
+	PairMap map;
+	PairMap_init(&map, 128);
+
+	DFA result = new_DFA(0);
+	DFA_add_state(result);
+	pa[0] = 0;
+	pb[0] = (b != NULL) ? 0 : DFA_NO_STATE;
+	PairMap_put(&map, pair_key(pa[0], pb[0]), 0);
+
+	int next[DFA_NSYMBOLS];
+	for (int s=0; s < DFA_get_size(result); s++) {
+		int p = pa[s];
+		int q = pb[s];
+		bool acceptA = p >= 0 && DFA_get_accepting(a, p);
+		bool acceptB = q >= 0 && DFA_get_accepting(b, q);
+		DFA_set_accepting(result, s, op(acceptA, acceptB));
+		for (int c=0; c < nclasses; c++) {
+			char sym = (char)rep[c];
+			int np = (p >= 0) ? DFA_get_transition(a, p, sym) : DFA_NO_STATE;
+			int nq = (q >= 0) ? DFA_get_transition(b, q, sym) : DFA_NO_STATE;
+			if (pair_is_dead(np, nq, op)) {
+				next[c] = DFA_NO_STATE;
+				continue;
+			}
+			unsigned long long key = pair_key(np, nq);
+			int slot = PairMap_slot(&map, key);
+			if (map.keys[slot] != EMPTY_KEY) {
+				next[c] = map.values[slot];
+				continue;
+			}
+			int t = DFA_add_state(result);
+			if (t == capacity) {
+				capacity *= 2;
+				pa = (int*)realloc(pa, sizeof(int) * capacity);
+				pb = (int*)realloc(pb, sizeof(int) * capacity);
+			}
+			pa[t] = np;
+			pb[t] = nq;
+			PairMap_put(&map, key, t);
+			next[c] = t;
+		}
+		for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+			DFA_set_transition(result, s, (char)sym, next[classmap[sym]]);
+		}
+	}
+	free(pa);
+	free(pb);
+	free(map.keys);
+	free(map.values);
+	return result;
+}
+
+static DFA product_result(DFA a, DFA b, BoolOp op, bool minimize) {
+	DFA result = product(a, b, op);
+	if (minimize) {
+		DFA minimal = DFA_minimize(result);
+		DFA_free(result);
+		result = minimal;
+	}
+	return result;
+}
+
+/**
+ * Return a DFA accepting the strings accepted by both a and b.
+ */
+DFA DFA_intersect(DFA a, DFA b, bool minimize) {
+	return product_result(a, b, op_and, minimize);
+}
+
+/**
+ * Return a DFA accepting the strings accepted by a or b (or both).
+ */
+DFA DFA_union(DFA a, DFA b, bool minimize) {
+	return product_result(a, b, op_or, minimize);
+}
+
+/**
+ * Return a DFA accepting the strings accepted by a but not by b.
+ */
+DFA DFA_difference(DFA a, DFA b, bool minimize) {
+	return product_result(a, b, op_and_not, minimize);
+}
+
+/**
+ * Return a DFA accepting exactly the strings not accepted by a.
+ * Where a gets stuck the result goes to an accepting sink instead.
+ */
+DFA DFA_complement(DFA a, bool minimize) {
+	return product_result(a, NULL, op_not, minimize);
+}
+
+/**
+ * Return the minimal DFA accepting the same strings as the given DFA,
+ * using Hopcroft's partition refinement algorithm.
+ * Only states reachable from the start state take part, plus one extra
+ * "dead" state standing for DFA_NO_STATE. The partition starts as
+ * {accepting, non-accepting}; a splitter (B, c) splits every block into
+ * the states that go into B on class c and those that don't. When a block
+ * splits, only the smaller half needs to become a new splitter, which
+ * gives O(k n log n) time for n states and k classes.
+ */
+DFA DFA_minimize(DFA dfa) {
+	unsigned char classmap[DFA_NSYMBOLS];
+	int rep[DFA_NSYMBOLS];
+	int k = joint_classes(dfa, NULL, classmap, rep);
+	int size = DFA_get_size(dfa);
+
+	// Number the reachable states 0..n-1 breadth-first; n is the dead state
+	int *number = (int*)malloc(sizeof(int) * size);
+	int *original = (int*)malloc(sizeof(int) * (size + 1));
+	for (int s=0; s < size; s++) {
+		number[s] = -1;
+	}
+	int n = 0;
+	number[0] = n;
+	original[n++] = 0;
+	for (int i=0; i < n; i++) {
+		for (int c=0; c < k; c++) {
+			int t = DFA_get_transition(dfa, original[i], (char)rep[c]);
+			if (t != DFA_NO_STATE && number[t] < 0) {
+				number[t] = n;
+				original[n++] = t;
+			}
+		}
+	}
+	int dead = n;
+	int N = n + 1;
+	int *delta = (int*)malloc(sizeof(int) * N * k);
+	for (int s=0; s < n; s++) {
+		for (int c=0; c < k; c++) {
+			int t = DFA_get_transition(dfa, original[s], (char)rep[c]);
+			delta[s * k + c] = (t == DFA_NO_STATE) ? dead : number[t];
+		}
+	}
+	for (int c=0; c < k; c++) {
+		delta[dead * k + c] = dead;
+	}
+
+	// Predecessors of each (state, class), in compressed rows
+	int *predStart = (int*)calloc(N * k + 1, sizeof(int));
+	int *preds = (int*)malloc(sizeof(int) * N * k);
+	for (int i=0; i < N * k; i++) {
+		int t = delta[i];
+		int c = i % k;
+		predStart[t * k + c + 1] += 1;
+	}
+	for (int i=0; i < N * k; i++) {
+		predStart[i + 1] += predStart[i];
+	}
+	int *fill = (int*)malloc(sizeof(int) * N * k);
+	for (int i=0; i < N * k; i++) {
+		fill[i] = predStart[i];
+	}
+	for (int i=0; i < N * k; i++) {
+		int t = delta[i];
+		int c = i % k;
+		preds[fill[t * k + c]++] = i / k;
+	}
+	free(fill);
+
+	// The partition: elems holds the states block by block
+	int *elems = (int*)malloc(sizeof(int) * N);
+	int *loc = (int*)malloc(sizeof(int) * N);
+	int *blk = (int*)malloc(sizeof(int) * N);
+	int *first = (int*)malloc(sizeof(int) * N);
+	int *end = (int*)malloc(sizeof(int) * N);
+	int *marked = (int*)calloc(N, sizeof(int));
+	int nblocks = 0;
+	int pos = 0;
+	for (int pass=0; pass < 2; pass++) {
+		int start = pos;
+		for (int s=0; s < N; s++) {
+			bool accepting = s < n && DFA_get_accepting(dfa, original[s]);
+			if (accepting == (pass == 0)) {
+				elems[pos] = s;
+				loc[s] = pos++;
+				blk[s] = nblocks;
+			}
+		}
+		if (pos > start) {
+			first[nblocks] = start;
+			end[nblocks] = pos;
+			nblocks += 1;
+		}
+	}
+
+	// Worklist of splitters (block, class)
+	bool *inW = (bool*)calloc(N * k, sizeof(bool));
+	int *work = (int*)malloc(sizeof(int) * N * k);
+	int nwork = 0;
+	if (nblocks == 2) {
+		int smaller = (end[0] - first[0] <= end[1] - first[1]) ? 0 : 1;
+		for (int c=0; c < k; c++) {
+			inW[smaller * k + c] = true;
+			work[nwork++] = smaller * k + c;
+		}
+	}
+
+	int *X = (int*)malloc(sizeof(int) * N);
+	int *touched = (int*)malloc(sizeof(int) * N);
+	while (nwork > 0) {
+		int splitter = work[--nwork];
+		inW[splitter] = false;
+		int B = splitter / k;
+		int c = splitter % k;
+
+		// X = states that go into B on c
+		int nX = 0;
+		for (int i=first[B]; i < end[B]; i++) {
+			int t = elems[i];
+			for (int j=predStart[t * k + c]; j < predStart[t * k + c + 1]; j++) {
+				X[nX++] = preds[j];
+			}
+		}
+
+		// Move the members of X to the front of their blocks
+		int ntouched = 0;
+		for (int i=0; i < nX; i++) {
+			int s = X[i];
+			int b = blk[s];
+			if (marked[b] == 0) {
+				touched[ntouched++] = b;
+			}
+			int dst = first[b] + marked[b];
+			int other = elems[dst];
+			elems[loc[s]] = other;
+			loc[other] = loc[s];
+			elems[dst] = s;
+			loc[s] = dst;
+			marked[b] += 1;
+		}
+
+		// Split each touched block that X only partly covers
+		for (int i=0; i < ntouched; i++) {
+			int b = touched[i];
+			int m = marked[b];
+			marked[b] = 0;
+			if (m == end[b] - first[b]) {
+				continue;
+			}
+			int nb = nblocks++;
+			first[nb] = first[b];
+			end[nb] = first[b] + m;
+			first[b] = end[nb];
+			for (int j=first[nb]; j < end[nb]; j++) {
+				blk[elems[j]] = nb;
+			}
+			for (int d=0; d < k; d++) {
+				if (inW[b * k + d]) {
+					inW[nb * k + d] = true;
+					work[nwork++] = nb * k + d;
+				} else {
+					int smaller = (end[nb] - first[nb] <= end[b] - first[b]) ? nb : b;
+					inW[smaller * k + d] = true;
+					work[nwork++] = smaller * k + d;
+				}
+			}
+		}
+	}
+	free(X);
+	free(touched);
+	free(inW);
+	free(work);
+
+	// Number the blocks breadth-first from the start block, skipping dead
+	int deadBlock = blk[dead];
+	DFA result;
+	if (blk[0] == deadBlock) {
+		result = new_DFA(1);
+	} else {
+		int *blockNumber = (int*)malloc(sizeof(int) * nblocks);
+		int *blockRep = (int*)malloc(sizeof(int) * nblocks);
+		for (int b=0; b < nblocks; b++) {
+			blockNumber[b] = -1;
+		}
+		int count = 0;
+		blockNumber[blk[0]] = count;
+		blockRep[count++] = 0;
+		for (int i=0; i < count; i++) {
+			int s = blockRep[i];
+			for (int c=0; c < k; c++) {
+				int b = blk[delta[s * k + c]];
+				if (b != deadBlock && blockNumber[b] < 0) {
+					blockNumber[b] = count;
+					blockRep[count++] = delta[s * k + c];
+				}
+			}
+		}
+		result = new_DFA(count);
+		int next[DFA_NSYMBOLS];
+		for (int i=0; i < count; i++) {
+			int s = blockRep[i];
+			DFA_set_accepting(result, i, DFA_get_accepting(dfa, original[s]));
+			for (int c=0; c < k; c++) {
+				int b = blk[delta[s * k + c]];
+				next[c] = (b == deadBlock) ? DFA_NO_STATE : blockNumber[b];
+			}
+			for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+				DFA_set_transition(result, i, (char)sym, next[classmap[sym]]);
+			}
+		}
+		free(blockNumber);
+		free(blockRep);
+	}
+
+	free(number);
+	free(original);
+	free(delta);
+	free(predStart);
+	free(preds);
+	free(elems);
+	free(loc);
+	free(blk);
+	free(first);
+	free(end);
+	free(marked);
+	return result;
+}
+
+/**
+ * Store in rep a symbol of each class other than '\0', which can't occur
+ * in an input string, or -1 for a class containing only '\0'.
+ */
+static void input_reps(unsigned char classmap[DFA_NSYMBOLS], int nclasses, int rep[DFA_NSYMBOLS]) {
+	for (int c=0; c < nclasses; c++) {
+		rep[c] = -1;
+	}
+	for (int sym=DFA_NSYMBOLS-1; sym > 0; sym--) {
+		rep[classmap[sym]] = sym;
+	}
+}
+
+/**
+ * Return the representative of the given element of a union-find forest,
+ * halving the path to it on the way.
+ */
+static int uf_find(int *parent, int x) {
+	while (parent[x] != x) {
+		parent[x] = parent[parent[x]];
+		x = parent[x];
+	}
+	return x;
+}
+
+/**
+ * Return the state of the given DFA after reading the given symbol from
+ * the given state (which may be DFA_NO_STATE), or DFA_NO_STATE.
+ */
+static int step(DFA dfa, int state, int sym) {
+	return (state >= 0) ? DFA_get_transition(dfa, state, (char)sym) : DFA_NO_STATE;
+}
+
+static bool accepts(DFA dfa, int state) {
+	return state >= 0 && DFA_get_accepting(dfa, state);
+}
+
+/**
+ * Return a shortest string that one of a and b accepts and the other
+ * doesn't, found by searching the product breadth-first from (0,0).
+ * Only called when a and b are known to differ.
+ */
+static char *shortest_difference(DFA a, DFA b, int nclasses, int rep[DFA_NSYMBOLS]) {
+	int capacity = 64;
+	int *pa = (int*)malloc(sizeof(int) * capacity);
+	int *pb = (int*)malloc(sizeof(int) * capacity);
+	int *from = (int*)malloc(sizeof(int) * capacity);	// Pair we came from
+	unsigned char *via = (unsigned char*)malloc(capacity);	// on this symbol
+	PairMap map;
+	PairMap_init(&map, 128);
+
+	int n = 1;
+	pa[0] = 0;
+	pb[0] = 0;
+	from[0] = -1;
+	PairMap_put(&map, pair_key(0, 0), 0);
+	int found = -1;
+	for (int i=0; i < n && found < 0; i++) {
+		if (accepts(a, pa[i]) != accepts(b, pb[i])) {
+			found = i;
+			break;
+		}
+		for (int c=0; c < nclasses; c++) {
+			if (rep[c] < 0) {
+				continue;
+			}
+			int np = step(a, pa[i], rep[c]);
+			int nq = step(b, pb[i], rep[c]);
+			if (np < 0 && nq < 0) {
+				continue;	// Both stuck: never any difference
+			}
+			unsigned long long key = pair_key(np, nq);
+			if (map.keys[PairMap_slot(&map, key)] != EMPTY_KEY) {
+				continue;
+			}
+			if (n == capacity) {
+				capacity *= 2;
+				pa = (int*)realloc(pa, sizeof(int) * capacity);
+				pb = (int*)realloc(pb, sizeof(int) * capacity);
+				from = (int*)realloc(from, sizeof(int) * capacity);
+				via = (unsigned char*)realloc(via, capacity);
+			}
+			pa[n] = np;
+			pb[n] = nq;
+			from[n] = i;
+			via[n] = (unsigned char)rep[c];
+			PairMap_put(&map, key, n);
+			n += 1;
+		}
+	}
+
+	char *witness = NULL;
+	if (found >= 0) {
+		int len = 0;
+		for (int i=found; from[i] >= 0; i=from[i]) {
+			len += 1;
+		}
+		witness = (char*)malloc(len + 1);
+		witness[len] = '\0';
+		for (int i=found; from[i] >= 0; i=from[i]) {
+			witness[--len] = (char)via[i];
+		}
+	}
+	free(pa);
+	free(pb);
+	free(from);
+	free(via);
+	free(map.keys);
+	free(map.values);
+	return witness;
+}
+
+/**
+ * Return true if a and b accept the same strings, using Hopcroft and
+ * Karp's union-find algorithm.
+ * States of a are numbered 0..na-1 and states of b na..na+nb-1, with one
+ * more element standing for DFA_NO_STATE in either. Starting from the two
+ * start states, each pair of states assumed equivalent has its classes
+ * of successors merged; the automata differ exactly when some merged pair
+ * disagrees on accepting. There are at most na+nb merges, each looking at
+ * every symbol class once, so this is nearly linear in the size of a and
+ * b. Only when they differ is the product searched for a shortest witness.
+ */
+bool DFA_equivalent(DFA a, DFA b, char **witness) {
+	unsigned char classmap[DFA_NSYMBOLS];
+	int rep[DFA_NSYMBOLS];
+	int nclasses = joint_classes(a, b, classmap, rep);
+	input_reps(classmap, nclasses, rep);
+
+	int na = DFA_get_size(a);
+	int nb = DFA_get_size(b);
+	int dead = na + nb;
+	int *parent = (int*)malloc(sizeof(int) * (dead + 1));
+	for (int i=0; i <= dead; i++) {
+		parent[i] = i;
+	}
+	int *stack = (int*)malloc(sizeof(int) * 2 * (dead + 1));
+	int top = 0;
+
+	bool equivalent = true;
+	parent[na] = 0;
+	stack[top++] = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		int q = stack[--top];
+		int p = stack[--top];
+		if (accepts(a, p) != accepts(b, q)) {
+			equivalent = false;
+			break;
+		}
+		for (int c=0; c < nclasses; c++) {
+			if (rep[c] < 0) {
+				continue;
+			}
+			int np = step(a, p, rep[c]);
+			int nq = step(b, q, rep[c]);
+			int x = uf_find(parent, (np >= 0) ? np : dead);
+			int y = uf_find(parent, (nq >= 0) ? na + nq : dead);
+			if (x != y) {
+				parent[y] = x;
+				stack[top++] = np;
+				stack[top++] = nq;
+			}
+		}
+	}
+	free(parent);
+	free(stack);
+
+	if (witness != NULL) {
+		*witness = equivalent ? NULL : shortest_difference(a, b, nclasses, rep);
+	}
+	return equivalent;
+}
+
+/**
+ * A state with its visit count and its breadth-first rank, for sorting.
+ */
+typedef struct Ranked {
+	long long visits;
+	int rank;
+	int state;
+} Ranked;
+
+static int compare_ranked(const void *a, const void *b) {
+	const Ranked *x = (const Ranked*)a;
+	const Ranked *y = (const Ranked*)b;
+	if (x->visits != y->visits) {
+		return (x->visits > y->visits) ? -1 : 1;
+	}
+	return x->rank - y->rank;
+}
+
+/**
+ * Return a copy of the given DFA with its states renumbered.
+ * The states are ordered breadth-first (the unreachable ones after, in
+ * their old order), then, given visits, stably sorted by decreasing
+ * visits with every unvisited state counting as zero. A DFA runs through
+ * its states' rows and accepting flags, so the hot ones end up sharing
+ * cache lines and pages instead of being scattered in the order the
+ * construction happened to find them.
+ */
+DFA DFA_renumber(DFA dfa, const long long *visits) {
+	unsigned char classmap[DFA_NSYMBOLS];
+	int rep[DFA_NSYMBOLS];
+	int k = joint_classes(dfa, NULL, classmap, rep);
+	int size = DFA_get_size(dfa);
+
+	int *number = (int*)malloc(sizeof(int) * size);
+	int *original = (int*)malloc(sizeof(int) * size);
+	for (int s=0; s < size; s++) {
+		number[s] = -1;
+	}
+	int n = 0;
+	number[0] = n;
+	original[n++] = 0;
+	for (int i=0; i < n; i++) {
+		for (int c=0; c < k; c++) {
+			int t = DFA_get_transition(dfa, original[i], (char)rep[c]);
+			if (t != DFA_NO_STATE && number[t] < 0) {
+				number[t] = n;
+				original[n++] = t;
+			}
+		}
+	}
+	for (int s=0; s < size; s++) {
+		if (number[s] < 0) {
+			number[s] = n;
+			original[n++] = s;
+		}
+	}
+
+	if (visits != NULL && size > 1) {
+		// The start state stays first whatever its count
+		Ranked *ranked = (Ranked*)malloc(sizeof(Ranked) * (size - 1));
+		for (int i=1; i < size; i++) {
+			ranked[i - 1].visits = visits[original[i]];
+			ranked[i - 1].rank = i;
+			ranked[i - 1].state = original[i];
+		}
+		qsort(ranked, size - 1, sizeof(Ranked), compare_ranked);
+		for (int i=1; i < size; i++) {
+			original[i] = ranked[i - 1].state;
+			number[original[i]] = i;
+		}
+		free(ranked);
+	}
+
+	DFA result = new_DFA(size);
+	for (int i=0; i < size; i++) {
+		int s = original[i];
+		DFA_set_accepting(result, i, DFA_get_accepting(dfa, s));
+		for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+			int t = DFA_get_transition(dfa, s, (char)rep[classmap[sym]]);
+			if (t != DFA_NO_STATE) {
+				DFA_set_transition(result, i, (char)sym, number[t]);
+			}
+		}
+	}
+	DFA_set_storage(result, DFA_get_storage(dfa));
+	free(number);
+	free(original);
+	return result;
+}
+
+#ifdef MAIN
+
+#include <string.h>
+#include <time.h>
+
+static void test(DFA dfa, char *input) {
+	printf("  \"%s\": %s\n", input, DFA_execute(dfa, input) ? "true" : "false");
+}
+
+/**
+ * Return a DFA for strings containing the given word, where no proper
+ * prefix of the word occurs again inside it (like "got").
+ */
+static DFA contains_word(char *word) {
+	int n = strlen(word);
+	DFA dfa = new_DFA(n + 1);
+	for (int s=0; s < n; s++) {
+		DFA_set_transition_all(dfa, s, 0);
+		DFA_set_transition(dfa, s, word[0], 1);
+		DFA_set_transition(dfa, s, word[s], s + 1);
+	}
+	DFA_set_transition_all(dfa, n, n);
+	DFA_set_accepting(dfa, n, true);
+	return dfa;
+}
+
+/**
+ * Return a DFA with n states on the symbols a..p in which a few states
+ * get most of the traffic, as in real rule sets, but are scattered
+ * through the numbering: the i'th hottest state is perm[i], and a
+ * transition goes to the i'th hottest with probability falling off
+ * steeply in i (as the eighth power of a uniform variable).
+ */
+static DFA skewed_DFA(int n, unsigned seed) {
+	srand(seed);
+	int *perm = (int*)malloc(sizeof(int) * n);
+	for (int i=0; i < n; i++) {
+		perm[i] = i;
+	}
+	for (int i=n-1; i > 1; i--) {
+		int j = 1 + rand() % i;
+		int tmp = perm[i];
+		perm[i] = perm[j];
+		perm[j] = tmp;
+	}
+	DFA dfa = new_DFA(n);
+	for (int s=0; s < n; s++) {
+		for (int sym='a'; sym <= 'p'; sym++) {
+			double u = (double)rand() / RAND_MAX;
+			u = u * u;
+			u = u * u;
+			u = u * u;
+			DFA_set_transition(dfa, s, (char)sym, perm[(int)(u * (n - 1))]);
+		}
+		DFA_set_accepting(dfa, s, rand() % 4 == 0);
+	}
+	free(perm);
+	return dfa;
+}
+
+/**
+ * Return the fastest of three runs of the given DFA over the given input,
+ * in seconds, and the state it ends in through state.
+ */
+static double time_run(DFA dfa, const char *input, int *state) {
+	double best = 1e9;
+	for (int i=0; i < 3; i++) {
+		clock_t start = clock();
+		*state = DFA_run(dfa, 0, input);
+		double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+		if (seconds < best) {
+			best = seconds;
+		}
+	}
+	return best;
+}
+
+int main(int argc, char* argv[]) {
+	DFA got = contains_word("got");
+
+	// Strings ending in "at", with a redundant copy of the start state
+	DFA at = new_DFA(4);
+	for (int s=0; s < 4; s++) {
+		DFA_set_transition_all(at, s, s == 0 ? 3 : 0);
+		DFA_set_transition(at, s, 'a', 1);
+	}
+	DFA_set_transition(at, 1, 't', 2);
+	DFA_set_accepting(at, 2, true);
+
+	printf("minimizing \"ends in at\" with %d states...\n", DFA_get_size(at));
+	DFA atMin = DFA_minimize(at);
+	DFA_print(atMin);
+
+	printf("contains got AND NOT ends in at:\n");
+	DFA rule = DFA_difference(got, at, false);
+	DFA ruleMin = DFA_difference(got, at, true);
+	printf("  %d states, %d minimized\n", DFA_get_size(rule), DFA_get_size(ruleMin));
+	test(ruleMin, "I got it");
+	test(ruleMin, "I got a cat");
+	test(ruleMin, "forgot");
+	test(ruleMin, "goat");
+
+	printf("contains got AND ends in at:\n");
+	DFA both = DFA_intersect(got, at, true);
+	printf("  %d states\n", DFA_get_size(both));
+	test(both, "got a cat");
+	test(both, "got a dog");
+
+	printf("contains got OR ends in at:\n");
+	DFA either = DFA_union(got, at, true);
+	printf("  %d states\n", DFA_get_size(either));
+	test(either, "cat");
+	test(either, "gotten");
+	test(either, "dog");
+
+	printf("NOT exactly \"CSC\":\n");
+	DFA csc = new_DFA(4);
+	DFA_set_transition(csc, 0, 'C', 1);
+	DFA_set_transition(csc, 1, 'S', 2);
+	DFA_set_transition(csc, 2, 'C', 3);
+	DFA_set_accepting(csc, 3, true);
+	DFA notCSC = DFA_complement(csc, true);
+	printf("  %d states\n", DFA_get_size(notCSC));
+	test(notCSC, "CSC");
+	test(notCSC, "CS");
+	test(notCSC, "CSCC");
+	test(notCSC, "");
+
+	printf("got AND NOT got is empty:\n");
+	DFA empty = DFA_difference(got, got, true);
+	printf("  %d states\n", DFA_get_size(empty));
+	test(empty, "got");
+
+	printf("testing DFA_equivalent...\n");
+	char *witness;
+	printf("  ends in at vs. minimized: %s\n", DFA_equivalent(at, atMin, NULL) ? "true" : "false");
+	DFA_equivalent(got, ruleMin, &witness);
+	printf("  contains got vs. contains got AND NOT ends in at: \"%s\"\n", witness);
+	free(witness);
+	DFA_equivalent(at, csc, &witness);
+	printf("  ends in at vs. exactly CSC: \"%s\"\n", witness);
+	free(witness);
+
+	// Even numbers of 0's and 1's, and the same language with every
+	// state duplicated, and with the 1's doubled
+	DFA even = new_DFA(4);
+	DFA even8 = new_DFA(8);
+	DFA evenOdd = new_DFA(8);
+	for (int s=0; s < 8; s++) {
+		if (s < 4) {
+			DFA_set_transition(even, s, '0', s ^ 1);
+			DFA_set_transition(even, s, '1', s ^ 2);
+			DFA_set_accepting(even, s, s == 0);
+		}
+		DFA_set_transition(even8, s, '0', ((s & 3) ^ 1) + (s & 4 ? 0 : 4));
+		DFA_set_transition(even8, s, '1', (s & 3) ^ 2);
+		DFA_set_accepting(even8, s, (s & 3) == 0);
+		DFA_set_transition(evenOdd, s, '0', s ^ 1);
+		DFA_set_transition(evenOdd, s, '1', (s + 2) % 8);
+		DFA_set_accepting(evenOdd, s, s == 0);
+	}
+	printf("  even vs. 8-state even: %s\n", DFA_equivalent(even, even8, NULL) ? "true" : "false");
+	DFA_equivalent(even, evenOdd, &witness);
+	printf("  even vs. 1's in multiples of 4: \"%s\"\n", witness);
+	free(witness);
+
+	int big = 100000;
+	printf("  counting to %d in two ways...\n", big);
+	DFA mod = new_DFA(big);
+	DFA mod2 = new_DFA(2 * big);
+	for (int s=0; s < 2 * big; s++) {
+		if (s < big) {
+			DFA_set_transition(mod, s, 'a', (s + 1) % big);
+			DFA_set_accepting(mod, s, s == 0);
+		}
+		DFA_set_transition(mod2, s, 'a', (s + 1) % (2 * big));
+		DFA_set_accepting(mod2, s, s % big == 0);
+	}
+	printf("  equivalent: %s\n", DFA_equivalent(mod, mod2, NULL) ? "true" : "false");
+	DFA_set_accepting(mod2, big + 3, true);
+	DFA_equivalent(mod, mod2, &witness);
+	printf("  after changing one state, shortest difference has length %d\n", (int)strlen(witness));
+	free(witness);
+
+	printf("testing DFA_renumber...\n");
+	DFA bfs = DFA_renumber(at, NULL);
+	printf("  ends in at, breadth-first: %s\n", DFA_equivalent(at, bfs, NULL) ? "true" : "false");
+	long long atVisits[] = { 5, 1, 0, 9 };
+	DFA hot = DFA_renumber(at, atVisits);
+	printf("  ends in at, state 3 visited most: %s, state 3 is now %d\n",
+	       DFA_equivalent(at, hot, NULL) ? "true" : "false", DFA_get_transition(hot, 0, 'x'));
+	DFA_free(bfs);
+	DFA_free(hot);
+
+	int nstates = 65536;
+	long length = 1 << 22;
+	DFA skewed = skewed_DFA(nstates, 173);
+	char *sample = (char*)malloc(length + 1);
+	char *input = (char*)malloc(length + 1);
+	for (long i=0; i < length; i++) {
+		sample[i] = 'a' + rand() % 16;
+		input[i] = 'a' + rand() % 16;
+	}
+	sample[length] = input[length] = '\0';
+	long long *visits = (long long*)calloc(nstates, sizeof(long long));
+	int state = 0;
+	for (long i=0; i < length; i++) {
+		visits[state] += 1;
+		state = DFA_get_transition(skewed, state, sample[i]);
+	}
+	DFA profiled = DFA_renumber(skewed, visits);
+	printf("  %d-state DFA, %s after renumbering\n", nstates,
+	       DFA_equivalent(skewed, profiled, NULL) ? "equivalent" : "NOT EQUIVALENT");
+	int before, after;
+	double original = time_run(skewed, input, &before);
+	double renumbered = time_run(profiled, input, &after);
+	printf("  %ld bytes: %.1f MB/s as built, %.1f MB/s renumbered by profile, same result: %s\n",
+	       length, length / original / 1e6, length / renumbered / 1e6,
+	       DFA_get_accepting(skewed, before) == DFA_get_accepting(profiled, after) ? "true" : "false");
+	free(visits);
+	free(sample);
+	free(input);
+	DFA_free(skewed);
+	DFA_free(profiled);
+
+	DFA_free(even);
+	DFA_free(even8);
+	DFA_free(evenOdd);
+	DFA_free(mod);
+	DFA_free(mod2);
+	DFA_free(got);
+	DFA_free(at);
+	DFA_free(atMin);
+	DFA_free(rule);
+	DFA_free(ruleMin);
+	DFA_free(both);
+	DFA_free(either);
+	DFA_free(csc);
+	DFA_free(notCSC);
+	DFA_free(empty);
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * File: dfaops.h
+ *
+ * Operations that build new DFAs out of existing ones, so that compound
+ * rules like "contains got AND NOT ends in at" compile into a single DFA
+ * that scans its input once.
+ * None of these modify their arguments, and all return a new DFA that
+ * the caller must DFA_free. If minimize is true the result is minimized.
+ */
+
+#ifndef _dfaops_h
+#define _dfaops_h
+
+#include <stdbool.h>
+#include "dfa.h"
+
+/**
+ * Return a DFA accepting the strings accepted by both a and b.
+ */
+extern DFA DFA_intersect(DFA a, DFA b, bool minimize);
+
+/**
+ * Return a DFA accepting the strings accepted by a or b (or both).
+ */
+extern DFA DFA_union(DFA a, DFA b, bool minimize);
+
+/**
+ * Return a DFA accepting the strings accepted by a but not by b.
+ */
+extern DFA DFA_difference(DFA a, DFA b, bool minimize);
+
+/**
+ * Return a DFA accepting exactly the strings not accepted by a.
+ */
+extern DFA DFA_complement(DFA a, bool minimize);
+
+/**
+ * Return the minimal DFA accepting the same strings as the given DFA.
+ * States are numbered in breadth-first order from the start state, and
+ * states that can never reach an accepting state are dropped in favor of
+ * DFA_NO_STATE transitions.
+ */
+extern DFA DFA_minimize(DFA dfa);
+
+/**
+ * Return true if the DFAs a and b accept exactly the same strings.
+ * If they don't and witness is not NULL, *witness is set to a shortest
+ * string that one accepts and the other doesn't (which the caller must
+ * free); otherwise *witness is set to NULL.
+ * Time is nearly linear in the number of states of a and b.
+ */
+extern bool DFA_equivalent(DFA a, DFA b, char **witness);
+
+/**
+ * Return a copy of the given DFA with its states renumbered so that the
+ * ones used together are stored together, for fewer cache and TLB misses
+ * on big DFAs. If visits is NULL, states are numbered breadth-first from
+ * the start state. Otherwise visits[s] says how often state s was visited
+ * on some sample input (see Profile_get_visits), and the visited states
+ * come first, most visited first, then the rest breadth-first. The start
+ * state stays 0 and states that can't be reached are kept, at the end.
+ * The copy has the same storage as the given DFA.
+ */
+extern DFA DFA_renumber(DFA dfa, const long long *visits);
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * File: main.c
+ *
+ * The project's program (auto): runs the automata in rules.txt, compiled
+ * into it by dfagen, on each line of its input. With arguments, only the
+ * rules with those names are run.
+ *   ./auto < inputs.txt
+ *   ./auto csc even01
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "rules.h"
+
+#define MAX_LINE 4096
+
+int main(int argc, char* argv[]) {
+	bool selected[NRULES];
+	for (int i=0; i < NRULES; i++) {
+		selected[i] = (argc == 1);
+	}
+	for (int a=1; a < argc; a++) {
+		int i = 0;
+		while (i < NRULES && strcmp(rules[i].name, argv[a]) != 0) {
+			i += 1;
+		}
+		if (i == NRULES) {
+			fprintf(stderr, "auto: no rule named %s; the rules are:\n", argv[a]);
+			for (i=0; i < NRULES; i++) {
+				fprintf(stderr, "  %s\t%s\n", rules[i].name, rules[i].pattern);
+			}
+			return 2;
+		}
+		selected[i] = true;
+	}
+
+	char line[MAX_LINE];
+	while (fgets(line, sizeof(line), stdin) != NULL) {
+		size_t length = strcspn(line, "\r\n");
+		line[length] = '\0';
+		printf("Result for input \"%s\":", line);
+		for (int i=0; i < NRULES; i++) {
+			if (selected[i]) {
+				printf(" %s=%s", rules[i].name, StaticDFA_match(&rules[i], line, length) ? "true" : "false");
+			}
+		}
+		printf("\n");
+	}
+	return 0;
+}
@@ -0,0 +1,1115 @@
+/*
+ * File: matchd.c
+ *
+ * Implementation of the matching server in matchd.h.
+ * The server is one thread. Each time epoll_wait returns, it accepts new
+ * clients and reads what the ready ones have sent, noting where each
+ * complete request is in its client's buffer. Only then are the requests
+ * run: grouped by rule, so each rule's requests go through its BatchDFA
+ * as one batch. Replies are then appended to each client's output in the
+ * order of its requests and written right away, or when epoll says there
+ * is room. So requests that arrive together are batched together, and a
+ * request that arrives on its own doesn't wait for anything. A client
+ * with MATCHD_MAX_OUTPUT bytes of replies unread isn't read from (epoll
+ * stops watching it for input) until it has read them.
+ * A round runs all its requests on the Registry's current RuleSet, which
+ * stays the same until the round is over, however often it is replaced.
+ * Histograms have eight buckets per power of two, so a percentile is
+ * within an eighth of the true value.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "matchd.h"
+
+/**
+ * Most bytes read from one client before the requests read so far are
+ * run, so one busy client can't hold up the rest.
+ */
+#define READ_LIMIT (1 << 20)
+
+#define MAX_EVENTS 64
+
+#define HISTOGRAM_BUCKETS 496
+
+typedef struct Histogram {
+	long counts[HISTOGRAM_BUCKETS];
+	long total;
+	long max;
+	double sum;
+} Histogram;
+
+/**
+ * Return the bucket for the given value: values below 8 have their own,
+ * and each power of two above that is split into eight.
+ */
+static int Histogram_bucket(long value) {
+	if (value < 8) {
+		return value < 0 ? 0 : (int)value;
+	}
+	int e = 63 - __builtin_clzl(value);
+	return (e - 2) * 8 + (int)((value >> (e - 3)) & 7);
+}
+
+/**
+ * Return the largest value that goes in the given bucket.
+ */
+static long Histogram_bucket_limit(int bucket) {
+	if (bucket < 8) {
+		return bucket;
+	}
+	int e = bucket / 8 + 2;
+	return ((long)(8 + bucket % 8) << (e - 3)) + ((1L << (e - 3)) - 1);
+}
+
+/**
+ * Count the given value in the given Histogram.
+ */
+static void Histogram_add(Histogram *this, long value) {
+	this->counts[Histogram_bucket(value)] += 1;
+	this->total += 1;
+	this->sum += value;
+	if (value > this->max) {
+		this->max = value;
+	}
+}
+
+/**
+ * Return the value that the given fraction of the values in the given
+ * Histogram are no more than, to within its bucket.
+ */
+static long Histogram_percentile(Histogram *this, double fraction) {
+	long rank = (long)(fraction * (this->total - 1));
+	long seen = 0;
+	for (int b=0; b < HISTOGRAM_BUCKETS; b++) {
+		seen += this->counts[b];
+		if (seen > rank) {
+			long limit = Histogram_bucket_limit(b);
+			return limit < this->max ? limit : this->max;
+		}
+	}
+	return this->max;
+}
+
+/**
+ * Print a summary of the given Histogram and its non-empty buckets to out.
+ */
+static void Histogram_print(Histogram *this, const char *title, FILE *out) {
+	fprintf(out, "%s: %ld, mean %.0f, p50 %ld, p90 %ld, p99 %ld, p99.9 %ld, max %ld\n",
+		title, this->total, this->total > 0 ? this->sum / this->total : 0.0,
+		Histogram_percentile(this, 0.5), Histogram_percentile(this, 0.9),
+		Histogram_percentile(this, 0.99), Histogram_percentile(this, 0.999), this->max);
+	for (int b=0; b < HISTOGRAM_BUCKETS; b++) {
+		if (this->counts[b] > 0) {
+			fprintf(out, "  <= %ld: %ld\n", Histogram_bucket_limit(b), this->counts[b]);
+		}
+	}
+}
+
+/**
+ * Return the time in nanoseconds from some fixed point.
+ */
+static long now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+typedef struct Connection {
+	int fd;
+	char *in;
+	size_t inLength, inCapacity;
+	size_t inUsed;		// Bytes of complete requests at the front of in
+	char *out;
+	size_t outLength, outCapacity;
+	size_t outSent;
+	uint32_t events;	// What epoll is watching for
+	bool eof;		// Close once the output is written
+	bool failed;		// Close now
+	bool touched;		// In this round's list
+} Connection;
+
+typedef struct Pending {
+	Connection *conn;
+	size_t start;		// Where its header is in conn->in
+	MatchdRequest header;
+	long arrived;
+	long results;		// Where its bitmap goes in Matchd.results
+} Pending;
+
+struct Matchd {
+	char *path;
+	int listener;
+	int epoll;
+	int wake;		// eventfd that Matchd_stop writes to
+	atomic_bool stopping;
+	Registry registry;
+	int reader;		// Registry reader number
+	Connection **conns;	// By file descriptor
+	int nconns;
+	// This round's requests, and room to run them
+	Pending *pending;
+	int npending, pendingCapacity;
+	int *order;		// Indexes of pending, grouped by rule
+	long orderCapacity;
+	int *first;		// Per rule, where its group starts in order
+	long firstCapacity;
+	Connection **touched;
+	int ntouched, touchedCapacity;
+	long *offsets;
+	long offsetsCapacity;
+	char *data;
+	long dataCapacity;
+	uint64_t *accepted;
+	long acceptedCapacity;
+	uint64_t *results;
+	long resultsCapacity;
+	// Statistics
+	long clients, requests, records, bytes, batches;
+	long throttled;		// Times a client wasn't read from for unread replies
+	Histogram latency;	// Nanoseconds
+	Histogram batchSize;	// Requests
+};
+
+/**
+ * Make sure the given buffer has room for at least the given number of
+ * elements of the given size, doubling it if need be.
+ */
+static void *reserve(void *buffer, long *capacity, long needed, size_t size) {
+	if (needed <= *capacity) {
+		return buffer;
+	}
+	long newCapacity = *capacity < 16 ? 16 : *capacity;
+	while (newCapacity < needed) {
+		newCapacity *= 2;
+	}
+	*capacity = newCapacity;
+	return realloc(buffer, newCapacity * size);
+}
+
+/**
+ * Allocate and return a new Matchd listening on a Unix domain socket at
+ * the given path, serving the given Registry's rules, or NULL if the
+ * socket can't be set up or the Registry has no room for another reader.
+ */
+Matchd new_Matchd(const char *path, Registry registry) {
+	struct sockaddr_un address;
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listener < 0) {
+		return NULL;
+	}
+	int reader = Registry_register(registry);
+	if (reader < 0) {
+		close(listener);
+		errno = EBUSY;
+		return NULL;
+	}
+	unlink(path);
+	if (bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0
+	    || listen(listener, SOMAXCONN) < 0) {
+		Registry_unregister(registry, reader);
+		close(listener);
+		return NULL;
+	}
+
+	Matchd this = (Matchd)calloc(1, sizeof(struct Matchd));
+	this->path = (char*)malloc(strlen(path) + 1);
+	strcpy(this->path, path);
+	this->listener = listener;
+	this->epoll = epoll_create1(EPOLL_CLOEXEC);
+	this->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	atomic_init(&this->stopping, false);
+	// The listener and the eventfd are told apart from clients by pointer
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.ptr = &this->listener;
+	epoll_ctl(this->epoll, EPOLL_CTL_ADD, this->listener, &event);
+	event.data.ptr = &this->wake;
+	epoll_ctl(this->epoll, EPOLL_CTL_ADD, this->wake, &event);
+	this->registry = registry;
+	this->reader = reader;
+	return this;
+}
+
+/**
+ * Close the given client and forget it.
+ */
+static void Connection_close(Matchd this, Connection *conn) {
+	epoll_ctl(this->epoll, EPOLL_CTL_DEL, conn->fd, NULL);
+	close(conn->fd);
+	this->conns[conn->fd] = NULL;
+	free(conn->in);
+	free(conn->out);
+	free(conn);
+}
+
+/**
+ * Stop the given Matchd, remove its socket, and free it.
+ */
+void Matchd_free(Matchd this) {
+	if (this == NULL) {
+		return;
+	}
+	for (int fd=0; fd < this->nconns; fd++) {
+		if (this->conns[fd] != NULL) {
+			Connection_close(this, this->conns[fd]);
+		}
+	}
+	close(this->listener);
+	close(this->wake);
+	close(this->epoll);
+	unlink(this->path);
+	Registry_unregister(this->registry, this->reader);
+	free(this->conns);
+	free(this->pending);
+	free(this->order);
+	free(this->first);
+	free(this->touched);
+	free(this->offsets);
+	free(this->data);
+	free(this->accepted);
+	free(this->results);
+	free(this->path);
+	free(this);
+}
+
+/**
+ * Add the given client to this round's list, if it isn't there already.
+ */
+static void touch(Matchd this, Connection *conn) {
+	if (conn->touched) {
+		return;
+	}
+	conn->touched = true;
+	long capacity = this->touchedCapacity;
+	this->touched = (Connection**)reserve(this->touched, &capacity, this->ntouched + 1, sizeof(Connection*));
+	this->touchedCapacity = (int)capacity;
+	this->touched[this->ntouched++] = conn;
+}
+
+/**
+ * Accept every client waiting to connect.
+ */
+static void accept_clients(Matchd this) {
+	for (;;) {
+		int fd = accept4(this->listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			return;
+		}
+		if (fd >= this->nconns) {
+			int nconns = this->nconns < 16 ? 16 : this->nconns;
+			while (nconns <= fd) {
+				nconns *= 2;
+			}
+			this->conns = (Connection**)realloc(this->conns, sizeof(Connection*) * nconns);
+			for (int i=this->nconns; i < nconns; i++) {
+				this->conns[i] = NULL;
+			}
+			this->nconns = nconns;
+		}
+		Connection *conn = (Connection*)calloc(1, sizeof(Connection));
+		conn->fd = fd;
+		conn->events = EPOLLIN;
+		this->conns[fd] = conn;
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.ptr = conn;
+		epoll_ctl(this->epoll, EPOLL_CTL_ADD, fd, &event);
+		this->clients += 1;
+	}
+}
+
+/**
+ * Return true if the given client has too many bytes of replies it hasn't
+ * read for the server to read its requests.
+ */
+static bool backlogged(Connection *conn) {
+	return conn->outLength - conn->outSent >= MATCHD_MAX_OUTPUT;
+}
+
+/**
+ * Read what the given client has sent, up to READ_LIMIT bytes (or none if
+ * it is backlogged), and add the complete requests in it to this round's.
+ */
+static void read_requests(Matchd this, Connection *conn) {
+	touch(this, conn);
+	size_t total = 0;
+	while (total < READ_LIMIT && !conn->eof && !conn->failed && !backlogged(conn)) {
+		if (conn->inCapacity - conn->inLength < 4096) {
+			conn->inCapacity = conn->inCapacity < 65536 ? 65536 : conn->inCapacity * 2;
+			conn->in = (char*)realloc(conn->in, conn->inCapacity);
+		}
+		ssize_t r = read(conn->fd, conn->in + conn->inLength, conn->inCapacity - conn->inLength);
+		if (r > 0) {
+			conn->inLength += r;
+			total += r;
+		} else if (r == 0) {
+			conn->eof = true;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			break;
+		} else if (errno != EINTR) {
+			conn->failed = true;
+		}
+	}
+
+	long arrived = now();
+	size_t pos = conn->inUsed;
+	while (!conn->failed && conn->inLength - pos >= sizeof(MatchdRequest)) {
+		MatchdRequest header;
+		memcpy(&header, conn->in + pos, sizeof(header));
+		uint64_t frame = sizeof(header) + 4 * (uint64_t)header.count + header.size;
+		if (frame > MATCHD_MAX_REQUEST) {
+			conn->failed = true;
+			break;
+		}
+		if (conn->inLength - pos < frame) {
+			break;
+		}
+		uint64_t size = 0;
+		for (uint32_t i=0; i < header.count; i++) {
+			uint32_t length;
+			memcpy(&length, conn->in + pos + sizeof(header) + 4 * i, 4);
+			size += length;
+		}
+		if (size != header.size) {
+			conn->failed = true;
+			break;
+		}
+		long capacity = this->pendingCapacity;
+		this->pending = (Pending*)reserve(this->pending, &capacity, this->npending + 1, sizeof(Pending));
+		this->pendingCapacity = (int)capacity;
+		Pending *p = &this->pending[this->npending++];
+		p->conn = conn;
+		p->start = pos;
+		p->header = header;
+		p->arrived = arrived;
+		pos += frame;
+	}
+	conn->inUsed = pos;
+}
+
+/**
+ * Copy count bits, starting at the given bit of from, to the start of to.
+ */
+static void copy_bits(const uint64_t *from, long first, long count, uint64_t *to) {
+	long words = (count + 63) / 64;
+	int shift = first % 64;
+	const uint64_t *src = from + first / 64;
+	for (long w=0; w < words; w++) {
+		uint64_t word = src[w] >> shift;
+		if (shift != 0 && 64 * (w + 1) - shift < count) {
+			word |= src[w+1] << (64 - shift);
+		}
+		to[w] = word;
+	}
+	if (count % 64 != 0) {
+		to[words-1] &= ((uint64_t)1 << (count % 64)) - 1;
+	}
+}
+
+/**
+ * Run the requests in order[lo..hi), which are all for the given rule, as
+ * one batch, and put their bitmaps in Matchd.results.
+ */
+static void run_batch(Matchd this, BatchDFA rule, int lo, int hi) {
+	long nrecords = 0, nbytes = 0;
+	for (int i=lo; i < hi; i++) {
+		nrecords += this->pending[this->order[i]].header.count;
+		nbytes += this->pending[this->order[i]].header.size;
+	}
+	this->offsets = (long*)reserve(this->offsets, &this->offsetsCapacity, nrecords + 1, sizeof(long));
+	this->data = (char*)reserve(this->data, &this->dataCapacity, nbytes + 1, 1);
+	this->accepted = (uint64_t*)reserve(this->accepted, &this->acceptedCapacity, (nrecords + 63) / 64 + 1, sizeof(uint64_t));
+	long record = 0;
+	this->offsets[0] = 0;
+	for (int i=lo; i < hi; i++) {
+		Pending *p = &this->pending[this->order[i]];
+		const char *lengths = p->conn->in + p->start + sizeof(MatchdRequest);
+		for (uint32_t j=0; j < p->header.count; j++) {
+			uint32_t length;
+			memcpy(&length, lengths + 4 * j, 4);
+			this->offsets[record+1] = this->offsets[record] + length;
+			record += 1;
+		}
+		memcpy(this->data + this->offsets[record - p->header.count],
+		       lengths + 4 * p->header.count, p->header.size);
+	}
+	BatchDFA_execute(rule, this->data, this->offsets, nrecords, this->accepted);
+	record = 0;
+	for (int i=lo; i < hi; i++) {
+		Pending *p = &this->pending[this->order[i]];
+		copy_bits(this->accepted, record, p->header.count, this->results + p->results);
+		record += p->header.count;
+	}
+	this->batches += 1;
+	this->records += nrecords;
+	this->bytes += nbytes;
+	Histogram_add(&this->batchSize, hi - lo);
+}
+
+/**
+ * Append a reply to the given client's output.
+ */
+static void append_reply(Connection *conn, uint32_t id, uint32_t status, const void *payload, size_t size) {
+	MatchdReply reply = { id, status, (uint32_t)size };
+	size_t needed = conn->outLength + sizeof(reply) + size;
+	if (needed > conn->outCapacity) {
+		while (conn->outCapacity < needed) {
+			conn->outCapacity = conn->outCapacity < 4096 ? 4096 : conn->outCapacity * 2;
+		}
+		conn->out = (char*)realloc(conn->out, conn->outCapacity);
+	}
+	memcpy(conn->out + conn->outLength, &reply, sizeof(reply));
+	if (size > 0) {
+		memcpy(conn->out + conn->outLength + sizeof(reply), payload, size);
+	}
+	conn->outLength = needed;
+}
+
+static void print_stats(Matchd this, RuleSet rules, FILE *out);
+
+/**
+ * Run this round's requests on the current RuleSet and append their
+ * replies to their clients' output, in the order the requests came in.
+ */
+static void run_requests(Matchd this) {
+	RuleSet rules = Registry_enter(this->registry, this->reader);
+	int nrules = RuleSet_get_count(rules);
+	int n = this->npending;
+	long words = 0;
+	for (int i=0; i < n; i++) {
+		this->pending[i].results = words;
+		words += (this->pending[i].header.count + 63) / 64;
+	}
+	this->results = (uint64_t*)reserve(this->results, &this->resultsCapacity, words + 1, sizeof(uint64_t));
+	// Group the requests by rule, in the order they came in
+	this->order = (int*)reserve(this->order, &this->orderCapacity, n, sizeof(int));
+	this->first = (int*)reserve(this->first, &this->firstCapacity, nrules + 1, sizeof(int));
+	int *first = this->first;
+	memset(first, 0, sizeof(int) * (nrules + 1));
+	for (int i=0; i < n; i++) {
+		uint32_t rule = this->pending[i].header.rule;
+		if (rule < (uint32_t)nrules) {
+			first[rule + 1] += 1;
+		}
+	}
+	for (int r=0; r < nrules; r++) {
+		first[r + 1] += first[r];
+	}
+	for (int i=0; i < n; i++) {
+		uint32_t rule = this->pending[i].header.rule;
+		if (rule < (uint32_t)nrules) {
+			this->order[first[rule]++] = i;
+		}
+	}
+	// Now first[r] is where rule r's requests end
+	for (int r=0, lo=0; r < nrules; lo = first[r++]) {
+		if (first[r] > lo) {
+			run_batch(this, RuleSet_get_rule(rules, r), lo, first[r]);
+		}
+	}
+
+	for (int i=0; i < n; i++) {
+		Pending *p = &this->pending[i];
+		if (p->header.rule < (uint32_t)nrules) {
+			append_reply(p->conn, p->header.id, MATCHD_OK, this->results + p->results,
+				     sizeof(uint64_t) * ((p->header.count + 63) / 64));
+		} else if (p->header.rule == MATCHD_STATS) {
+			char *text;
+			size_t size;
+			FILE *out = open_memstream(&text, &size);
+			print_stats(this, rules, out);
+			fclose(out);
+			append_reply(p->conn, p->header.id, MATCHD_OK, text, size);
+			free(text);
+		} else {
+			append_reply(p->conn, p->header.id, MATCHD_NO_RULE, NULL, 0);
+		}
+	}
+	this->requests += n;
+	Registry_leave(this->registry, this->reader);
+}
+
+/**
+ * Write as much of the given client's output as its socket will take,
+ * and ask epoll to say when there is room for the rest, and to stop
+ * saying when it has sent more requests while it is backlogged.
+ */
+static void flush(Matchd this, Connection *conn) {
+	while (conn->outSent < conn->outLength && !conn->failed) {
+		ssize_t w = send(conn->fd, conn->out + conn->outSent, conn->outLength - conn->outSent, MSG_NOSIGNAL);
+		if (w > 0) {
+			conn->outSent += w;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			break;
+		} else if (errno != EINTR) {
+			conn->failed = true;
+		}
+	}
+	// Drop what was sent once it is at least half the buffer, so a client
+	// that reads slowly can't keep the buffer growing
+	if (conn->outSent > 0 && conn->outSent >= conn->outLength - conn->outSent) {
+		memmove(conn->out, conn->out + conn->outSent, conn->outLength - conn->outSent);
+		conn->outLength -= conn->outSent;
+		conn->outSent = 0;
+	}
+	// A client that has hung up would always be readable
+	uint32_t events = (conn->eof || backlogged(conn) ? 0 : EPOLLIN) | (conn->outLength > 0 ? EPOLLOUT : 0);
+	if (!conn->eof && backlogged(conn) && (conn->events & EPOLLIN)) {
+		this->throttled += 1;
+	}
+	if (events != conn->events && !conn->failed) {
+		struct epoll_event event;
+		event.events = events;
+		event.data.ptr = conn;
+		epoll_ctl(this->epoll, EPOLL_CTL_MOD, conn->fd, &event);
+		conn->events = events;
+	}
+}
+
+/**
+ * Serve clients until Matchd_stop is called.
+ */
+void Matchd_run(Matchd this) {
+	struct epoll_event events[MAX_EVENTS];
+	while (!atomic_load(&this->stopping)) {
+		int nevents = epoll_wait(this->epoll, events, MAX_EVENTS, -1);
+		if (nevents < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		for (int e=0; e < nevents; e++) {
+			void *ptr = events[e].data.ptr;
+			if (ptr == &this->listener) {
+				accept_clients(this);
+			} else if (ptr == &this->wake) {
+				uint64_t count;
+				if (read(this->wake, &count, sizeof(count)) < 0) {
+					// Already drained
+				}
+			} else {
+				Connection *conn = (Connection*)ptr;
+				if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+					read_requests(this, conn);
+				}
+				if (events[e].events & EPOLLOUT) {
+					touch(this, conn);
+				}
+			}
+		}
+
+		// Every client with requests or output is in the list
+		if (this->npending > 0) {
+			run_requests(this);
+		}
+		for (int i=0; i < this->ntouched; i++) {
+			flush(this, this->touched[i]);
+		}
+		long done = now();
+		for (int i=0; i < this->npending; i++) {
+			Histogram_add(&this->latency, done - this->pending[i].arrived);
+		}
+		this->npending = 0;
+		for (int i=0; i < this->ntouched; i++) {
+			Connection *conn = this->touched[i];
+			conn->touched = false;
+			if (conn->failed || (conn->eof && conn->outLength == 0)) {
+				Connection_close(this, conn);
+				continue;
+			}
+			memmove(conn->in, conn->in + conn->inUsed, conn->inLength - conn->inUsed);
+			conn->inLength -= conn->inUsed;
+			conn->inUsed = 0;
+		}
+		this->ntouched = 0;
+	}
+}
+
+/**
+ * Make Matchd_run return once it has replied to the requests it has
+ * read. This may be called from another thread or a signal handler.
+ */
+void Matchd_stop(Matchd this) {
+	atomic_store(&this->stopping, true);
+	uint64_t one = 1;
+	if (write(this->wake, &one, sizeof(one)) < 0) {
+		// The counter is already nonzero, so Matchd_run will wake anyway
+	}
+}
+
+/**
+ * Print the given Matchd's statistics, with the given RuleSet's rules,
+ * to out.
+ */
+static void print_stats(Matchd this, RuleSet rules, FILE *out) {
+	fprintf(out, "rules version %ld:", RuleSet_get_version(rules));
+	for (int i=0; i < RuleSet_get_count(rules); i++) {
+		fprintf(out, " %d=%s", i, RuleSet_get_name(rules, i));
+	}
+	fprintf(out, "\nclients %ld, requests %ld, records %ld, bytes %ld, batches %ld, throttled %ld\n",
+		this->clients, this->requests, this->records, this->bytes, this->batches, this->throttled);
+	Histogram_print(&this->latency, "latency (ns)", out);
+	Histogram_print(&this->batchSize, "requests per batch", out);
+}
+
+/**
+ * Print the given Matchd's statistics to out.
+ */
+void Matchd_print_stats(Matchd this, FILE *out) {
+	print_stats(this, Registry_enter(this->registry, this->reader), out);
+	Registry_leave(this->registry, this->reader);
+}
+
+/**
+ * Return a socket connected to the server at the given path, or -1 if
+ * it can't be reached.
+ */
+int matchd_connect(const char *path) {
+	struct sockaddr_un address;
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * Write all n bytes of the given buffer to the given socket.
+ */
+static bool send_all(int fd, const char *buf, size_t n) {
+	while (n > 0) {
+		ssize_t w = send(fd, buf, n, MSG_NOSIGNAL);
+		if (w < 0 && errno == EINTR) {
+			continue;
+		}
+		if (w <= 0) {
+			return false;
+		}
+		buf += w;
+		n -= w;
+	}
+	return true;
+}
+
+/**
+ * Read all n bytes for the given buffer from the given socket.
+ */
+static bool receive_all(int fd, char *buf, size_t n) {
+	while (n > 0) {
+		ssize_t r = read(fd, buf, n);
+		if (r < 0 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			return false;
+		}
+		buf += r;
+		n -= r;
+	}
+	return true;
+}
+
+/**
+ * Write a request for the given rule on the n given records to the given
+ * socket. Returns false if it couldn't be written.
+ */
+bool matchd_send(int fd, uint32_t id, uint32_t rule, const char *data, const long *offsets, int n) {
+	MatchdRequest header = { id, rule, (uint32_t)n, (uint32_t)(offsets[n] - offsets[0]) };
+	size_t size = sizeof(header) + 4 * (size_t)n + header.size;
+	if (size > MATCHD_MAX_REQUEST) {
+		return false;
+	}
+	// One write, so a small request goes out in one packet
+	char *buf = (char*)malloc(size);
+	memcpy(buf, &header, sizeof(header));
+	for (int i=0; i < n; i++) {
+		uint32_t length = (uint32_t)(offsets[i+1] - offsets[i]);
+		memcpy(buf + sizeof(header) + 4 * i, &length, 4);
+	}
+	memcpy(buf + sizeof(header) + 4 * n, data + offsets[0], header.size);
+	bool ok = send_all(fd, buf, size);
+	free(buf);
+	return ok;
+}
+
+/**
+ * Read a reply from the given socket into reply, and its payload into
+ * newly allocated memory pointed to by payload. Returns false if the
+ * connection failed.
+ */
+bool matchd_receive(int fd, MatchdReply *reply, void **payload) {
+	*payload = NULL;
+	if (!receive_all(fd, (char*)reply, sizeof(*reply))) {
+		reply->size = 0;
+		return false;
+	}
+	if (reply->size == 0) {
+		return true;
+	}
+	*payload = malloc(reply->size);
+	if (!receive_all(fd, (char*)*payload, reply->size)) {
+		free(*payload);
+		*payload = NULL;
+		return false;
+	}
+	return true;
+}
+
+#ifdef MAIN
+
+/*
+ * The test program is the server:
+ *   matchd rules.txt socket
+ * serves the rules in rules.txt (a name and a regular expression per
+ * line, see Registry_load) at the given socket path until interrupted,
+ * then prints its statistics to stderr. On SIGHUP it compiles rules.txt
+ * again and switches to the new rules without stopping. With no
+ * arguments, it runs a server in a thread and tests it with some clients
+ * instead.
+ */
+
+#include <signal.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+static void *serve(void *arg) {
+	Matchd_run((Matchd)arg);
+	return NULL;
+}
+
+typedef struct Republisher {
+	Registry registry;
+	DFA *dfas;
+	char **names;
+	int n;
+	atomic_bool done;
+	long published;
+} Republisher;
+
+/**
+ * Keep publishing the same rules again until told to stop.
+ */
+static void *republish(void *arg) {
+	Republisher *this = (Republisher*)arg;
+	while (!atomic_load(&this->done)) {
+		Registry_publish(this->registry, this->dfas, this->names, this->n);
+		this->published += 1;
+		struct timespec pause = { 0, 200000 };
+		nanosleep(&pause, NULL);
+	}
+	return NULL;
+}
+
+/**
+ * Fill the given buffers with n random records of up to maxLength bytes
+ * from the given alphabet.
+ */
+static void random_records(int n, int maxLength, const char *alphabet, char *data, long *offsets) {
+	int k = strlen(alphabet);
+	offsets[0] = 0;
+	for (int i=0; i < n; i++) {
+		int length = rand() % (maxLength + 1);
+		for (int j=0; j < length; j++) {
+			data[offsets[i] + j] = alphabet[rand() % k];
+		}
+		offsets[i+1] = offsets[i] + length;
+	}
+}
+
+/**
+ * Return true if the given reply is right for the given request.
+ */
+static bool check_reply(DFA *dfas, int nrules, uint32_t rule, const char *data, const long *offsets, int n,
+			MatchdReply *reply, const uint64_t *bits) {
+	if (rule >= (uint32_t)nrules) {
+		return reply->status == MATCHD_NO_RULE && reply->size == 0;
+	}
+	if (reply->status != MATCHD_OK || reply->size != sizeof(uint64_t) * ((n + 63) / 64)) {
+		return false;
+	}
+	char record[64];
+	for (int i=0; i < n; i++) {
+		int length = offsets[i+1] - offsets[i];
+		memcpy(record, data + offsets[i], length);
+		record[length] = '\0';
+		if (((bits[i / 64] >> (i % 64)) & 1) != DFA_execute(dfas[rule], record)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static int test(void) {
+	// Strings with an even number of 0's and of 1's
+	DFA even = new_DFA(4);
+	for (int s=0; s < 4; s++) {
+		DFA_set_transition(even, s, '0', s ^ 1);
+		DFA_set_transition(even, s, '1', s ^ 2);
+	}
+	DFA_set_accepting(even, 0, true);
+	// Strings ending in "at"
+	DFA endsInAt = new_DFA(3);
+	for (int s=0; s < 3; s++) {
+		DFA_set_transition_all(endsInAt, s, 0);
+		DFA_set_transition(endsInAt, s, 'a', 1);
+	}
+	DFA_set_transition(endsInAt, 1, 't', 2);
+	DFA_set_accepting(endsInAt, 2, true);
+	DFA dfas[] = { even, endsInAt };
+	char *names[] = { "even", "endsInAt" };
+	Registry registry = new_Registry();
+	Registry_publish(registry, dfas, names, 2);
+
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/matchd-test-%d.sock", (int)getpid());
+	Matchd server = new_Matchd(path, registry);
+	if (server == NULL) {
+		perror(path);
+		return 1;
+	}
+	pthread_t thread;
+	pthread_create(&thread, NULL, serve, server);
+
+	// Several clients each send a burst of requests before reading any
+	// replies, some for a rule that doesn't exist
+	srand(173);
+	int nclients = 4, nrequests = 200, maxRecords = 40, maxLength = 30;
+	int fds[4];
+	uint32_t *rules = (uint32_t*)malloc(sizeof(uint32_t) * nclients * nrequests);
+	int *counts = (int*)malloc(sizeof(int) * nclients * nrequests);
+	long **offsets = (long**)malloc(sizeof(long*) * nclients * nrequests);
+	char **data = (char**)malloc(sizeof(char*) * nclients * nrequests);
+	for (int c=0; c < nclients; c++) {
+		fds[c] = matchd_connect(path);
+	}
+	for (int r=0; r < nrequests; r++) {
+		for (int c=0; c < nclients; c++) {
+			int i = c * nrequests + r;
+			rules[i] = (rand() % 10 == 0) ? 7 : rand() % 2;
+			counts[i] = rand() % (maxRecords + 1);
+			offsets[i] = (long*)malloc(sizeof(long) * (counts[i] + 1));
+			data[i] = (char*)malloc(counts[i] * maxLength + 1);
+			random_records(counts[i], maxLength, rules[i] == 0 ? "01" : "atx", data[i], offsets[i]);
+			matchd_send(fds[c], r, rules[i], data[i], offsets[i], counts[i]);
+		}
+	}
+	int wrong = 0;
+	for (int c=0; c < nclients; c++) {
+		for (int r=0; r < nrequests; r++) {
+			int i = c * nrequests + r;
+			MatchdReply reply;
+			void *payload;
+			if (!matchd_receive(fds[c], &reply, &payload) || reply.id != r
+			    || !check_reply(dfas, 2, rules[i], data[i], offsets[i], counts[i], &reply, (uint64_t*)payload)) {
+				wrong += 1;
+			}
+			free(payload);
+			free(offsets[i]);
+			free(data[i]);
+		}
+	}
+	printf("%d clients x %d pipelined requests: %d wrong replies\n", nclients, nrequests, wrong);
+
+	// Round trips of one small request at a time, while the rules are
+	// published again and again
+	Republisher republisher = { registry, dfas, names, 2 };
+	atomic_init(&republisher.done, false);
+	republisher.published = 0;
+	pthread_t publisher;
+	pthread_create(&publisher, NULL, republish, &republisher);
+	int nrounds = 20000;
+	long roundOffsets[9];
+	char roundData[8 * 10];
+	Histogram roundTrips;
+	memset(&roundTrips, 0, sizeof(roundTrips));
+	random_records(8, 10, "01", roundData, roundOffsets);
+	for (int r=0; r < nrounds; r++) {
+		long start = now();
+		MatchdReply reply;
+		void *payload;
+		matchd_send(fds[0], r, 0, roundData, roundOffsets, 8);
+		if (!matchd_receive(fds[0], &reply, &payload) || reply.id != r
+		    || !check_reply(dfas, 2, 0, roundData, roundOffsets, 8, &reply, (uint64_t*)payload)) {
+			wrong += 1;
+		}
+		Histogram_add(&roundTrips, now() - start);
+		free(payload);
+	}
+	atomic_store(&republisher.done, true);
+	pthread_join(publisher, NULL);
+	printf("%d round trips of 8 records: mean %.0fns, p50 %ldns, p99 %ldns\n", nrounds,
+	       roundTrips.sum / roundTrips.total, Histogram_percentile(&roundTrips, 0.5),
+	       Histogram_percentile(&roundTrips, 0.99));
+	printf("rules published %ld times meanwhile, %d wrong replies so far\n", republisher.published, wrong);
+
+	// New rules apply to the requests after they're published
+	DFA swapped[] = { endsInAt, even };
+	char *swappedNames[] = { "endsInAt", "even" };
+	Registry_publish(registry, swapped, swappedNames, 2);
+	long atOffsets[] = { 0, 2, 4 };
+	MatchdReply atReply;
+	void *atPayload;
+	matchd_send(fds[0], 0, 0, "atta", atOffsets, 2);
+	if (!matchd_receive(fds[0], &atReply, &atPayload)
+	    || !check_reply(swapped, 2, 0, "atta", atOffsets, 2, &atReply, (uint64_t*)atPayload)) {
+		wrong += 1;
+		printf("rule 0 didn't change to endsInAt\n");
+	}
+	free(atPayload);
+
+	// A client that goes away with replies unread doesn't bother anyone
+	matchd_send(fds[1], 0, 0, roundData, roundOffsets, 8);
+	close(fds[1]);
+
+	// A client that sends requests without reading the replies isn't read
+	// from once too many are waiting, and gets them all once it reads
+	int flood = matchd_connect(path);
+	fcntl(flood, F_SETFL, O_NONBLOCK);
+	uint32_t nflood = 0;
+	for (int stalls=0; stalls < 200; ) {
+		if (matchd_send(flood, nflood, MATCHD_STATS, roundData, roundOffsets, 0)) {
+			nflood += 1;
+			stalls = 0;
+		} else {
+			struct timespec pause = { 0, 1000000 };
+			nanosleep(&pause, NULL);
+			stalls += 1;
+		}
+	}
+	MatchdReply reply;
+	void *payload;
+	long throttled = 0;
+	matchd_send(fds[2], 0, MATCHD_STATS, roundData, roundOffsets, 0);
+	if (matchd_receive(fds[2], &reply, &payload) && reply.status == MATCHD_OK) {
+		char *text = (char*)realloc(payload, reply.size + 1);
+		text[reply.size] = '\0';
+		char *found = strstr(text, "throttled ");
+		throttled = found == NULL ? 0 : atol(found + strlen("throttled "));
+		payload = text;
+	}
+	free(payload);
+	fcntl(flood, F_SETFL, 0);
+	uint32_t received = 0;
+	while (received < nflood && matchd_receive(flood, &reply, &payload)) {
+		if (reply.id != received || reply.status != MATCHD_OK) {
+			wrong += 1;
+		}
+		received += 1;
+		free(payload);
+	}
+	close(flood);
+	printf("%u requests sent without reading: throttled %ld times, %u replies read\n",
+	       nflood, throttled, received);
+	if (throttled == 0 || received != nflood) {
+		wrong += 1;
+	}
+
+	matchd_send(fds[2], 0, MATCHD_STATS, roundData, roundOffsets, 0);
+	if (matchd_receive(fds[2], &reply, &payload) && reply.status == MATCHD_OK) {
+		printf("server statistics:\n%.*s", (int)reply.size, (char*)payload);
+	} else {
+		wrong += 1;
+	}
+	free(payload);
+
+	Matchd_stop(server);
+	pthread_join(thread, NULL);
+	Matchd_free(server);
+	Registry_free(registry);
+	for (int c=0; c < nclients; c++) {
+		if (c != 1) {
+			close(fds[c]);
+		}
+	}
+	free(rules);
+	free(counts);
+	free(offsets);
+	free(data);
+	DFA_free(even);
+	DFA_free(endsInAt);
+	return wrong > 0;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc == 1) {
+		return test();
+	}
+	if (argc != 3) {
+		fprintf(stderr, "usage: matchd [rules.txt socket]\n");
+		return 2;
+	}
+	Registry registry = new_Registry();
+	long version = Registry_load(registry, argv[1], stderr);
+	if (version < 0) {
+		return 1;
+	}
+	Matchd server = new_Matchd(argv[2], registry);
+	if (server == NULL) {
+		perror(argv[2]);
+		return 1;
+	}
+
+	// The signals are taken here, so the server thread never stops for
+	// them, and rules are compiled here too
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGHUP);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	pthread_t thread;
+	pthread_create(&thread, NULL, serve, server);
+	fprintf(stderr, "matchd: serving %s (version %ld) at %s\n", argv[1], version, argv[2]);
+	for (;;) {
+		struct timespec timeout = { 1, 0 };
+		int sig = sigtimedwait(&signals, NULL, &timeout);
+		if (sig == SIGHUP) {
+			version = Registry_load(registry, argv[1], stderr);
+			if (version >= 0) {
+				fprintf(stderr, "matchd: now serving version %ld\n", version);
+			}
+		} else if (sig == SIGINT || sig == SIGTERM) {
+			break;
+		} else {
+			Registry_collect(registry);
+		}
+	}
+	Matchd_stop(server);
+	pthread_join(thread, NULL);
+	Matchd_print_stats(server, stderr);
+	Matchd_free(server);
+	Registry_free(registry);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * File: matchd.h
+ *
+ * A matching server: one process holds a set of DFAs, built once, and
+ * runs batches of records through them for any number of clients on the
+ * same host, over a Unix domain socket.
+ * A client writes requests and reads replies, each a fixed header and a
+ * payload, in host byte order. Requests may be pipelined: a client can
+ * send many before reading any replies, and the replies come back in the
+ * order of the requests. The server waits for connections with epoll,
+ * and all the requests for a DFA that arrive together, from however many
+ * clients, are run as one BatchDFA batch.
+ * The rules come from a Registry, so they can be replaced while the
+ * server runs; a request's rule is an index into the current RuleSet.
+ */
+
+#ifndef _matchd_h
+#define _matchd_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Registry.h"
+
+/**
+ * The header of a request. It is followed by count uint32_t record
+ * lengths, then the size bytes of the records themselves.
+ */
+typedef struct MatchdRequest {
+	uint32_t id;		// Copied to the reply
+	uint32_t rule;		// Index of the DFA, or MATCHD_STATS
+	uint32_t count;		// Number of records
+	uint32_t size;		// Total bytes in the records
+} MatchdRequest;
+
+/**
+ * The header of a reply. It is followed by size bytes: for a match, a
+ * bitmap of (count + 63) / 64 uint64_t words with bit i % 64 of word
+ * i / 64 set if record i was accepted; for MATCHD_STATS, a text report.
+ */
+typedef struct MatchdReply {
+	uint32_t id;
+	uint32_t status;	// MATCHD_OK or MATCHD_NO_RULE
+	uint32_t size;
+} MatchdReply;
+
+/**
+ * A request for this rule gets the server's statistics as text.
+ */
+#define MATCHD_STATS 0xffffffffu
+
+#define MATCHD_OK 0
+#define MATCHD_NO_RULE 1
+
+/**
+ * The server drops clients that send bigger requests than this.
+ */
+#define MATCHD_MAX_REQUEST (64 << 20)
+
+/**
+ * The server stops reading from a client once this many bytes of replies
+ * are waiting for it to read, and starts again when it has read them, so
+ * a client that sends requests but never reads the replies can't make
+ * the server's memory grow without bound.
+ */
+#define MATCHD_MAX_OUTPUT (4 << 20)
+
+typedef struct Matchd *Matchd;
+
+/**
+ * Allocate and return a new Matchd listening on a Unix domain socket at
+ * the given path (replacing any socket already there), serving the rules
+ * of the given Registry, or NULL if the socket can't be set up or the
+ * Registry has no room for another reader. The Registry must outlive
+ * the Matchd.
+ */
+extern Matchd new_Matchd(const char *path, Registry registry);
+
+/**
+ * Stop the given Matchd, remove its socket, and free it.
+ */
+extern void Matchd_free(Matchd server);
+
+/**
+ * Serve clients until Matchd_stop is called.
+ */
+extern void Matchd_run(Matchd server);
+
+/**
+ * Make Matchd_run return once it has replied to the requests it has
+ * read. This may be called from another thread or a signal handler.
+ */
+extern void Matchd_stop(Matchd server);
+
+/**
+ * Print the given Matchd's statistics, including histograms of request
+ * latency (from reading a request to writing its reply) and of the
+ * number of requests run together in a batch, to out. Don't call this
+ * while Matchd_run is running: ask for MATCHD_STATS instead.
+ */
+extern void Matchd_print_stats(Matchd server, FILE *out);
+
+/**
+ * Return a socket connected to the server at the given path, or -1 if
+ * it can't be reached.
+ */
+extern int matchd_connect(const char *path);
+
+/**
+ * Write a request for the given rule, on the n records where record i is
+ * the bytes from data[offsets[i]] up to data[offsets[i+1]], to the given
+ * socket. Returns false if it couldn't be written.
+ */
+extern bool matchd_send(int fd, uint32_t id, uint32_t rule, const char *data, const long *offsets, int n);
+
+/**
+ * Read a reply from the given socket into reply, and its payload into
+ * newly allocated memory pointed to by payload (NULL if it is empty).
+ * Returns false if the connection failed.
+ * Don't forget to free() the payload.
+ */
+extern bool matchd_receive(int fd, MatchdReply *reply, void **payload);
+
+#endif
@@ -0,0 +1,562 @@
+/*
+ * File: nfa.c
+ *
+ * Implementation of the NFA API in nfa.h.
+ * Transitions are kept as a Set of destination states for each state and
+ * input symbol, and also as a plain array of the same states for running.
+ * A simulation tracks the set of current states in an NFARun that belongs
+ * to the caller, so running never modifies the NFA.
+ * While few states are active the NFARun keeps them in a sparse set
+ * (Briggs and Torczon): a list of the members plus, for each state, its
+ * index in the list, so insertion, lookup and clearing are all O(1) and a
+ * step costs time in proportion to the active states and their moves.
+ * Once more than 1/SPARSE_LIMIT of the states are active it switches to
+ * a bit vector, where a step costs a pass over the words instead, and
+ * switches back when the count falls below half that.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "nfa.h"
+#include "profile.h"
+
+/**
+ * Runs use a bit vector when more than nstates/SPARSE_LIMIT are active.
+ */
+#define SPARSE_LIMIT 32
+
+/**
+ * Size passed to new_Set for each transition Set (buckets for IntHashSet).
+ * Most have only a few states, and sizing them by the number of states
+ * made big NFAs take gigabytes.
+ */
+#define TRANSITION_SET_SIZE 16
+
+struct NFA {
+	int nstates;
+	Set *transitions;	// nstates rows of NFA_NSYMBOLS sets, NULL if empty
+	int **successors;	// The same as arrays: count, then the states
+	bool *accepting;
+	Set empty;		// Returned for transitions that were never added
+};
+
+/**
+ * Allocate and return a new NFA containing the given number of states.
+ */
+NFA new_NFA(int nstates) {
+	NFA this = (NFA)malloc(sizeof(struct NFA));
+	if (this == NULL) {
+		return NULL;
+	}
+	this->nstates = nstates;
+	this->transitions = (Set*)calloc(nstates * NFA_NSYMBOLS, sizeof(Set));
+	this->successors = (int**)calloc(nstates * NFA_NSYMBOLS, sizeof(int*));
+	this->accepting = (bool*)calloc(nstates, sizeof(bool));
+	this->empty = new_Set(1);
+	return this;
+}
+
+/**
+ * Free the given NFA.
+ */
+void NFA_free(NFA this) {
+	if (this == NULL) {
+		return;
+	}
+	for (int i=0; i < this->nstates * NFA_NSYMBOLS; i++) {
+		Set_free(this->transitions[i]);
+		free(this->successors[i]);
+	}
+	free(this->transitions);
+	free(this->successors);
+	free(this->accepting);
+	Set_free(this->empty);
+	free(this);
+}
+
+/**
+ * Return the number of states in the given NFA.
+ */
+int NFA_get_size(NFA this) {
+	return this->nstates;
+}
+
+/**
+ * Return the set of next states specified by the given NFA's transition
+ * function from the given state on input symbol sym.
+ */
+Set NFA_get_transitions(NFA this, int state, char sym) {
+	Set set = this->transitions[state * NFA_NSYMBOLS + (unsigned char)sym];
+	return set != NULL ? set : this->empty;
+}
+
+/**
+ * For the given NFA, add the state dst to the set of next states from
+ * state src on input symbol sym.
+ */
+void NFA_add_transition(NFA this, int src, char sym, int dst) {
+	int i = src * NFA_NSYMBOLS + (unsigned char)sym;
+	if (this->transitions[i] == NULL) {
+		this->transitions[i] = new_Set(TRANSITION_SET_SIZE);
+	} else if (Set_lookup(this->transitions[i], dst)) {
+		return;
+	}
+	Set_insert(this->transitions[i], dst);
+	// The array grows whenever its length (count+1) reaches a power of 2
+	int *succ = this->successors[i];
+	int length = (succ == NULL) ? 0 : succ[0] + 1;
+	if (length == 0 || (length & (length - 1)) == 0) {
+		succ = (int*)realloc(succ, sizeof(int) * (length == 0 ? 2 : 2 * length));
+		this->successors[i] = succ;
+		if (length == 0) {
+			succ[0] = 0;
+		}
+	}
+	succ[++succ[0]] = dst;
+}
+
+/**
+ * Add a transition for the given NFA for each symbol in the given str.
+ */
+void NFA_add_transition_str(NFA this, int src, char *str, int dst) {
+	for (char *p=str; *p != '\0'; p++) {
+		NFA_add_transition(this, src, *p, dst);
+	}
+}
+
+/**
+ * Add a transition for the given NFA for each input symbol.
+ */
+void NFA_add_transition_all(NFA this, int src, int dst) {
+	for (int sym=0; sym < NFA_NSYMBOLS; sym++) {
+		NFA_add_transition(this, src, (char)sym, dst);
+	}
+}
+
+/**
+ * Set whether the given NFA's state is accepting or not.
+ */
+void NFA_set_accepting(NFA this, int state, bool value) {
+	this->accepting[state] = value;
+}
+
+/**
+ * Return true if the given NFA's state is an accepting state.
+ */
+bool NFA_get_accepting(NFA this, int state) {
+	return this->accepting[state];
+}
+
+/**
+ * Return a hash of the given symbol's column of the NFA's transitions
+ * that doesn't depend on the order sets are iterated in.
+ */
+static unsigned hash_column(NFA this, int sym) {
+	unsigned h = 0;
+	for (int s=0; s < NFA_get_size(this); s++) {
+		SetIterator iterator = Set_iterator(NFA_get_transitions(this, s, (char)sym));
+		while (SetIterator_hasNext(iterator)) {
+			unsigned x = (unsigned)s * 2654435761u ^ (unsigned)SetIterator_next(iterator);
+			x = (x ^ (x >> 16)) * 0x45d9f3bu;
+			h += x ^ (x >> 16);
+		}
+		free(iterator);
+	}
+	return h;
+}
+
+/**
+ * Group the input symbols of the given NFA into classes of symbols that
+ * go to the same states from every state, storing the class of each
+ * symbol in classmap and returning the number of classes.
+ */
+int NFA_get_classes(NFA this, unsigned char classmap[NFA_NSYMBOLS]) {
+	int rep[NFA_NSYMBOLS];
+	unsigned hash[NFA_NSYMBOLS];
+	int nclasses = 0;
+	for (int sym=0; sym < NFA_NSYMBOLS; sym++) {
+		hash[sym] = hash_column(this, sym);
+		int c;
+		for (c=0; c < nclasses; c++) {
+			if (hash[rep[c]] != hash[sym]) {
+				continue;
+			}
+			int s;
+			for (s=0; s < NFA_get_size(this); s++) {
+				if (!Set_equals(NFA_get_transitions(this, s, (char)sym),
+						NFA_get_transitions(this, s, (char)rep[c]))) {
+					break;
+				}
+			}
+			if (s == NFA_get_size(this)) {
+				break;
+			}
+		}
+		if (c == nclasses) {
+			rep[nclasses++] = sym;
+		}
+		classmap[sym] = c;
+	}
+	return nclasses;
+}
+
+typedef unsigned long long Word;
+
+#define WORD_BITS 64
+
+/**
+ * Return the index of the lowest 1 bit of the given (nonzero) word.
+ */
+static inline int lowest_bit(Word w) {
+#ifdef __GNUC__
+	return __builtin_ctzll(w);
+#else
+	int i = 0;
+	while (!(w & 1)) {
+		w >>= 1;
+		i += 1;
+	}
+	return i;
+#endif
+}
+
+/**
+ * A set of states, kept as a sparse set or a bit vector.
+ */
+typedef struct StateSet {
+	int count;
+	int *members;		// Sparse: the states, in no order
+	unsigned *index;	// Sparse: where each state is in members
+	Word *bits;		// Dense
+} StateSet;
+
+struct NFARun {
+	NFA nfa;
+	bool dense;		// Which representation current and next use
+	int words;		// Words in each bit vector
+	StateSet current;
+	StateSet next;
+};
+
+static void StateSet_init(StateSet *set, int nstates, int words) {
+	set->count = 0;
+	set->members = (int*)malloc(sizeof(int) * (nstates > 0 ? nstates : 1));
+	set->index = (unsigned*)calloc(nstates > 0 ? nstates : 1, sizeof(unsigned));
+	set->bits = (Word*)calloc(words, sizeof(Word));
+}
+
+static void StateSet_free(StateSet *set) {
+	free(set->members);
+	free(set->index);
+	free(set->bits);
+}
+
+/**
+ * Add the given state to the given sparse set if it isn't there already.
+ */
+static inline void StateSet_add_sparse(StateSet *set, int state) {
+	// Stale entries in index may be anything, so it is compared unsigned
+	unsigned i = set->index[state];
+	if (i >= (unsigned)set->count || set->members[i] != state) {
+		set->index[state] = set->count;
+		set->members[set->count++] = state;
+	}
+}
+
+/**
+ * Add the given state to the given dense set if it isn't there already.
+ */
+static inline void StateSet_add_dense(StateSet *set, int state) {
+	Word bit = (Word)1 << (state % WORD_BITS);
+	if (!(set->bits[state / WORD_BITS] & bit)) {
+		set->bits[state / WORD_BITS] |= bit;
+		set->count += 1;
+	}
+}
+
+/**
+ * Allocate and return a new NFARun for the given NFA, in its start state.
+ */
+NFARun new_NFARun(NFA nfa) {
+	NFARun this = (NFARun)malloc(sizeof(struct NFARun));
+	this->nfa = nfa;
+	this->words = (nfa->nstates + WORD_BITS - 1) / WORD_BITS + 1;
+	StateSet_init(&this->current, nfa->nstates, this->words);
+	StateSet_init(&this->next, nfa->nstates, this->words);
+	this->dense = false;
+	NFARun_reset(this);
+	return this;
+}
+
+/**
+ * Free the given NFARun (but not its NFA).
+ */
+void NFARun_free(NFARun this) {
+	if (this == NULL) {
+		return;
+	}
+	StateSet_free(&this->current);
+	StateSet_free(&this->next);
+	free(this);
+}
+
+/**
+ * Put the given NFARun back in the start state of its NFA.
+ */
+void NFARun_reset(NFARun this) {
+	if (this->dense) {
+		memset(this->current.bits, 0, sizeof(Word) * this->words);
+		memset(this->next.bits, 0, sizeof(Word) * this->words);
+		this->dense = false;
+	}
+	this->current.count = 0;
+	StateSet_add_sparse(&this->current, 0);
+}
+
+/**
+ * Move the given NFARun's current states from one representation to the
+ * other.
+ */
+static void switch_representation(NFARun this) {
+	StateSet *set = &this->current;
+	if (this->dense) {
+		set->count = 0;
+		for (int w=0; w < this->words; w++) {
+			for (Word bits=set->bits[w]; bits != 0; bits &= bits - 1) {
+				StateSet_add_sparse(set, w * WORD_BITS + lowest_bit(bits));
+			}
+		}
+		memset(set->bits, 0, sizeof(Word) * this->words);
+		memset(this->next.bits, 0, sizeof(Word) * this->words);
+	} else {
+		for (int i=0; i < set->count; i++) {
+			int state = set->members[i];
+			set->bits[state / WORD_BITS] |= (Word)1 << (state % WORD_BITS);
+		}
+	}
+	this->dense = !this->dense;
+}
+
+/**
+ * Advance the given NFARun over each symbol of the given input string.
+ * Stops early once no states are active, since nothing can revive them.
+ */
+void NFARun_step(NFARun this, const char *input) {
+	NFA nfa = this->nfa;
+	int limit = nfa->nstates / SPARSE_LIMIT;
+	const char *p = input;
+	PROFILE_BEGIN(nfa);
+	for (; *p != '\0' && this->current.count > 0; p++) {
+		int **row = nfa->successors + (unsigned char)*p;
+		StateSet *current = &this->current;
+		StateSet *next = &this->next;
+		next->count = 0;
+		if (!this->dense) {
+			for (int i=0; i < current->count; i++) {
+				int state = current->members[i];
+				PROFILE_STEP(state, (unsigned char)*p);
+				const int *succ = row[state * NFA_NSYMBOLS];
+				for (int j=(succ != NULL) ? succ[0] : 0; j > 0; j--) {
+					StateSet_add_sparse(next, succ[j]);
+				}
+			}
+		} else {
+			memset(next->bits, 0, sizeof(Word) * this->words);
+			for (int w=0; w < this->words; w++) {
+				for (Word bits=current->bits[w]; bits != 0; bits &= bits - 1) {
+					int state = w * WORD_BITS + lowest_bit(bits);
+					PROFILE_STEP(state, (unsigned char)*p);
+					const int *succ = row[state * NFA_NSYMBOLS];
+					for (int j=(succ != NULL) ? succ[0] : 0; j > 0; j--) {
+						StateSet_add_dense(next, succ[j]);
+					}
+				}
+			}
+		}
+		StateSet swap = *current;
+		*current = *next;
+		*next = swap;
+		if (this->dense ? this->current.count < limit / 2 : this->current.count > limit) {
+			switch_representation(this);
+		}
+	}
+	PROFILE_END(-1, p - input, *p != '\0');
+}
+
+/**
+ * Return true if the given NFARun is in at least one accepting state.
+ */
+bool NFARun_accepting(NFARun this) {
+	if (this->dense) {
+		for (int w=0; w < this->words; w++) {
+			for (Word bits=this->current.bits[w]; bits != 0; bits &= bits - 1) {
+				if (this->nfa->accepting[w * WORD_BITS + lowest_bit(bits)]) {
+					return true;
+				}
+			}
+		}
+	} else {
+		for (int i=0; i < this->current.count; i++) {
+			if (this->nfa->accepting[this->current.members[i]]) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * Run the given NFA on the given input string, and return true if it accepts
+ * the input, otherwise false.
+ */
+bool NFA_execute(NFA this, char *input) {
+	NFARun run = new_NFARun(this);
+	NFARun_step(run, input);
+	bool result = NFARun_accepting(run);
+	NFARun_free(run);
+	return result;
+}
+
+/**
+ * Print the given NFA to stdout.
+ */
+void NFA_print(NFA this) {
+	printf("NFA with %d states\n", this->nstates);
+	for (int src=0; src < this->nstates; src++) {
+		printf("%d%s:", src, this->accepting[src] ? " (accepting)" : "");
+		for (int sym=0; sym < NFA_NSYMBOLS; sym++) {
+			Set dsts = this->transitions[src * NFA_NSYMBOLS + sym];
+			if (dsts == NULL || Set_isEmpty(dsts)) {
+				continue;
+			}
+			char *s = Set_toString(dsts);
+			if (isgraph(sym)) {
+				printf(" '%c'->{%s}", sym, s);
+			} else {
+				printf(" %d->{%s}", sym, s);
+			}
+			free(s);
+		}
+		printf("\n");
+	}
+}
+
+#ifdef MAIN
+
+#include <time.h>
+
+static void test(NFA nfa, char *input) {
+	printf("\"%s\": %s\n", input, NFA_execute(nfa, input) ? "true" : "false");
+}
+
+int main(int argc, char* argv[]) {
+	printf("building NFA for strings ending in \"at\"...\n");
+	NFA endsInAt = new_NFA(3);
+	NFA_add_transition_all(endsInAt, 0, 0);
+	NFA_add_transition(endsInAt, 0, 'a', 1);
+	NFA_add_transition(endsInAt, 1, 't', 2);
+	NFA_set_accepting(endsInAt, 2, true);
+	test(endsInAt, "at");
+	test(endsInAt, "cat");
+	test(endsInAt, "attic");
+	test(endsInAt, "");
+
+	printf("building NFA for strings containing \"got\"...\n");
+	NFA containsGot = new_NFA(4);
+	NFA_add_transition_all(containsGot, 0, 0);
+	NFA_add_transition(containsGot, 0, 'g', 1);
+	NFA_add_transition(containsGot, 1, 'o', 2);
+	NFA_add_transition(containsGot, 2, 't', 3);
+	NFA_add_transition_all(containsGot, 3, 3);
+	NFA_set_accepting(containsGot, 3, true);
+	test(containsGot, "gogot");
+	test(containsGot, "I got it");
+	test(containsGot, "goat");
+
+	printf("testing two NFARuns over one NFA...\n");
+	NFARun run1 = new_NFARun(containsGot);
+	NFARun run2 = new_NFARun(containsGot);
+	NFARun_step(run1, "go");
+	NFARun_step(run2, "xx");
+	NFARun_step(run1, "t");
+	NFARun_step(run2, "t");
+	printf("run1 accepting: %d\n", NFARun_accepting(run1));
+	printf("run2 accepting: %d\n", NFARun_accepting(run2));
+	NFARun_free(run1);
+	NFARun_free(run2);
+
+	int nwords = 1000, length = 20;
+	printf("building NFA for containing one of %d random words...\n", nwords);
+	NFA words = new_NFA(1 + nwords * length);
+	NFA_add_transition_all(words, 0, 0);
+	char *word = (char*)malloc(nwords * (length + 1));
+	unsigned int seed = 173;
+	for (int w=0; w < nwords; w++) {
+		int state = 0;
+		for (int i=0; i < length; i++) {
+			seed = seed * 1103515245 + 12345;
+			word[w * (length + 1) + i] = 'a' + (seed >> 16) % 4;
+			int next = 1 + w * length + i;
+			NFA_add_transition(words, state, word[w * (length + 1) + i], next);
+			state = next;
+		}
+		word[w * (length + 1) + length] = '\0';
+		NFA_add_transition_all(words, state, state);
+		NFA_set_accepting(words, state, true);
+	}
+	char text[201];
+	int mismatches = 0;
+	clock_t start = clock();
+	for (int t=0; t < 200; t++) {
+		for (int i=0; i < 200; i++) {
+			seed = seed * 1103515245 + 12345;
+			text[i] = 'a' + (seed >> 16) % 4;
+		}
+		text[200] = '\0';
+		if (t % 2 == 0) {
+			memcpy(text + t % 150, word + (t % nwords) * (length + 1), length);
+		}
+		bool expected = false;
+		for (int w=0; w < nwords && !expected; w++) {
+			expected = strstr(text, word + w * (length + 1)) != NULL;
+		}
+		mismatches += NFA_execute(words, text) != expected;
+	}
+	printf("%d mismatches, %.2fs (sparse: few states active)\n", mismatches,
+	       (double)(clock() - start) / CLOCKS_PER_SEC);
+
+	int k = 1000;
+	printf("building NFA for %d'th symbol from the end being 'a'...\n", k);
+	NFA fromEnd = new_NFA(k + 1);
+	NFA_add_transition_all(fromEnd, 0, 0);
+	NFA_add_transition(fromEnd, 0, 'a', 1);
+	for (int s=1; s < k; s++) {
+		NFA_add_transition_all(fromEnd, s, s + 1);
+	}
+	NFA_set_accepting(fromEnd, k, true);
+	char *ab = (char*)malloc(3 * k + 1);
+	mismatches = 0;
+	start = clock();
+	for (int t=0; t < 10; t++) {
+		int n = k + t * k / 5;
+		for (int i=0; i < n; i++) {
+			seed = seed * 1103515245 + 12345;
+			ab[i] = 'a' + (seed >> 16) % 2;
+		}
+		ab[n] = '\0';
+		mismatches += NFA_execute(fromEnd, ab) != (ab[n - k] == 'a');
+	}
+	printf("%d mismatches, %.2fs (dense: many states active)\n", mismatches,
+	       (double)(clock() - start) / CLOCKS_PER_SEC);
+
+	free(word);
+	free(ab);
+	NFA_free(words);
+	NFA_free(fromEnd);
+	NFA_free(endsInAt);
+	NFA_free(containsGot);
+}
+
+#endif
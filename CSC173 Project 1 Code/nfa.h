@@ -17,6 +17,12 @@
  */
 typedef struct NFA *NFA;
 
+/**
+ * The number of distinct input symbols (bytes). State 0 is always the
+ * start state.
+ */
+#define NFA_NSYMBOLS 256
+
 /**
  * Allocate and return a new NFA containing the given number of states.
  */
@@ -35,6 +41,7 @@ extern int NFA_get_size(NFA nfa);
 /**
  * Return the set of next states specified by the given NFA's transition
  * function from the given state on input symbol sym.
+ * The set belongs to the NFA: don't modify or free it.
  */
 extern Set NFA_get_transitions(NFA nfa, int state, char sym);
 
@@ -64,12 +71,55 @@ extern void NFA_set_accepting(NFA nfa, int state, bool value);
  */
 extern bool NFA_get_accepting(NFA nfa, int state);
 
+/**
+ * Group the input symbols of the given NFA into classes of symbols that
+ * go to the same states from every state, storing the class of each
+ * symbol in classmap and returning the number of classes.
+ * Classes are numbered in order of their smallest symbol.
+ */
+extern int NFA_get_classes(NFA nfa, unsigned char classmap[NFA_NSYMBOLS]);
+
 /**
  * Run the given NFA on the given input string, and return true if it accepts
  * the input, otherwise false.
+ * Running never modifies the NFA; the set of current states lives in an
+ * NFARun private to the call. So once it has been built one NFA can be
+ * shared by any number of threads without locking.
  */
 extern bool NFA_execute(NFA nfa, char *input);
 
+/**
+ * The run state of an NFA: the set of states it is currently in.
+ * Each caller (thread) that wants to feed input a piece at a time
+ * uses its own NFARun over a shared NFA.
+ */
+typedef struct NFARun *NFARun;
+
+/**
+ * Allocate and return a new NFARun for the given NFA, in its start state.
+ */
+extern NFARun new_NFARun(NFA nfa);
+
+/**
+ * Free the given NFARun (but not its NFA).
+ */
+extern void NFARun_free(NFARun run);
+
+/**
+ * Put the given NFARun back in the start state of its NFA.
+ */
+extern void NFARun_reset(NFARun run);
+
+/**
+ * Advance the given NFARun over each symbol of the given input string.
+ */
+extern void NFARun_step(NFARun run, const char *input);
+
+/**
+ * Return true if the given NFARun is in at least one accepting state.
+ */
+extern bool NFARun_accepting(NFARun run);
+
 /**
  * Print the given NFA to System.out.
  */
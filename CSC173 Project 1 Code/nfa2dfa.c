@@ -0,0 +1,371 @@
+/*
+ * File: nfa2dfa.c
+ *
+ * Implementation of the subset construction in nfa2dfa.h.
+ * Input symbols that every state of the NFA treats the same way are put
+ * in one class, and the NFA's transitions are copied into flat arrays per
+ * state and class, so the construction only works out one successor set
+ * per DFA state and class. Each set of NFA states is kept as a sorted
+ * array, and a hash table maps the sets already found to their DFA state.
+ * Sets are hashed Zobrist-style: every NFA state has a random 64-bit key
+ * and a set's fingerprint is the XOR of its members' keys, so it is
+ * worked out as the successors are collected, in any order. Only a set
+ * whose fingerprint is already in the table is compared element by
+ * element, and only a new set is sorted.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "nfa2dfa.h"
+#include "nfaops.h"
+
+/**
+ * The sets of NFA states found so far, stored end to end, with a hash
+ * table (open addressing) from set to index.
+ */
+typedef struct Subsets {
+	int count;
+	int capacity;
+	int *start;		// Set i is elements[start[i]..start[i]+size[i]]
+	int *size;
+	uint64_t *fingerprint;
+	int *elements;
+	int nelements;
+	int elementCapacity;
+	int *table;		// Set indexes, or -1 for empty slots
+	int tableSize;		// A power of 2
+} Subsets;
+
+static int compare_ints(const void *a, const void *b) {
+	int x = *(const int*)a;
+	int y = *(const int*)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Return n random 64-bit keys, one per NFA state, from a fixed seed so
+ * the DFA comes out the same every time (splitmix64).
+ */
+static uint64_t *new_keys(int n) {
+	uint64_t *keys = (uint64_t*)malloc(sizeof(uint64_t) * (n > 0 ? n : 1));
+	uint64_t x = 0x9e3779b97f4a7c15u;
+	for (int i=0; i < n; i++) {
+		uint64_t z = (x += 0x9e3779b97f4a7c15u);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+		keys[i] = z ^ (z >> 31);
+	}
+	return keys;
+}
+
+/**
+ * Return the index of the set of n states with the given fingerprint
+ * whose members are exactly the states s with stamp[s] == round, or -1
+ * if it hasn't been found.
+ */
+static int Subsets_find(Subsets *this, int n, uint64_t fingerprint, const int *stamp, int round) {
+	for (int i=fingerprint & (this->tableSize - 1); this->table[i] >= 0; i = (i + 1) & (this->tableSize - 1)) {
+		int j = this->table[i];
+		if (this->fingerprint[j] != fingerprint || this->size[j] != n) {
+			continue;
+		}
+		const int *elements = this->elements + this->start[j];
+		int e = 0;
+		while (e < n && stamp[elements[e]] == round) {
+			e += 1;
+		}
+		if (e == n) {
+			return j;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Add the given sorted set, which must not be there already, and return
+ * its index.
+ */
+static int Subsets_add(Subsets *this, const int *set, int n, uint64_t fingerprint) {
+	if (2 * (this->count + 1) > this->tableSize) {
+		free(this->table);
+		this->tableSize = (this->tableSize == 0) ? 64 : 2 * this->tableSize;
+		this->table = (int*)malloc(sizeof(int) * this->tableSize);
+		memset(this->table, -1, sizeof(int) * this->tableSize);
+		for (int j=0; j < this->count; j++) {
+			int i = this->fingerprint[j] & (this->tableSize - 1);
+			while (this->table[i] >= 0) {
+				i = (i + 1) & (this->tableSize - 1);
+			}
+			this->table[i] = j;
+		}
+	}
+	if (this->count == this->capacity) {
+		this->capacity = (this->capacity == 0) ? 64 : 2 * this->capacity;
+		this->start = (int*)realloc(this->start, sizeof(int) * this->capacity);
+		this->size = (int*)realloc(this->size, sizeof(int) * this->capacity);
+		this->fingerprint = (uint64_t*)realloc(this->fingerprint, sizeof(uint64_t) * this->capacity);
+	}
+	while (this->nelements + n > this->elementCapacity) {
+		this->elementCapacity = (this->elementCapacity == 0) ? 256 : 2 * this->elementCapacity;
+		this->elements = (int*)realloc(this->elements, sizeof(int) * this->elementCapacity);
+	}
+	int j = this->count++;
+	this->start[j] = this->nelements;
+	this->size[j] = n;
+	this->fingerprint[j] = fingerprint;
+	memcpy(this->elements + this->nelements, set, sizeof(int) * n);
+	this->nelements += n;
+	int i = fingerprint & (this->tableSize - 1);
+	while (this->table[i] >= 0) {
+		i = (i + 1) & (this->tableSize - 1);
+	}
+	this->table[i] = j;
+	return j;
+}
+
+/**
+ * Return a new DFA accepting the same strings as the given NFA, built by
+ * the subset construction from the NFA as it is.
+ */
+static DFA subsets_of(NFA nfa) {
+	int n = NFA_get_size(nfa);
+	unsigned char classmap[NFA_NSYMBOLS];
+	int k = NFA_get_classes(nfa, classmap);
+	int rep[NFA_NSYMBOLS];
+	for (int sym=NFA_NSYMBOLS-1; sym >= 0; sym--) {
+		rep[classmap[sym]] = sym;
+	}
+
+	// Successors of NFA state s on class c are succ[succStart[s*k+c]..next)
+	int *succStart = (int*)malloc(sizeof(int) * (n * k + 1));
+	int nsucc = 0;
+	int succCapacity = 64;
+	int *succ = (int*)malloc(sizeof(int) * succCapacity);
+	for (int i=0; i < n * k; i++) {
+		succStart[i] = nsucc;
+		SetIterator iterator = Set_iterator(NFA_get_transitions(nfa, i / k, (char)rep[i % k]));
+		while (SetIterator_hasNext(iterator)) {
+			if (nsucc == succCapacity) {
+				succCapacity *= 2;
+				succ = (int*)realloc(succ, sizeof(int) * succCapacity);
+			}
+			succ[nsucc++] = SetIterator_next(iterator);
+		}
+		free(iterator);
+	}
+	succStart[n * k] = nsucc;
+
+	Subsets subsets;
+	memset(&subsets, 0, sizeof(subsets));
+	int *set = (int*)malloc(sizeof(int) * n);
+	int *stamp = (int*)calloc(n, sizeof(int));
+	int round = 0;
+	uint64_t *keys = new_keys(n);
+	set[0] = 0;
+	Subsets_add(&subsets, set, 1, keys[0]);
+
+	DFA dfa = new_DFA(1);
+	for (int d=0; d < subsets.count; d++) {
+		for (int i=0; i < subsets.size[d]; i++) {
+			if (NFA_get_accepting(nfa, subsets.elements[subsets.start[d] + i])) {
+				DFA_set_accepting(dfa, d, true);
+				break;
+			}
+		}
+		for (int c=0; c < k; c++) {
+			round += 1;
+			int size = 0;
+			uint64_t fingerprint = 0;
+			for (int i=0; i < subsets.size[d]; i++) {
+				int s = subsets.elements[subsets.start[d] + i];
+				for (int j=succStart[s*k+c]; j < succStart[s*k+c+1]; j++) {
+					if (stamp[succ[j]] != round) {
+						stamp[succ[j]] = round;
+						set[size++] = succ[j];
+						fingerprint ^= keys[succ[j]];
+					}
+				}
+			}
+			if (size == 0) {
+				continue;
+			}
+			int dst = Subsets_find(&subsets, size, fingerprint, stamp, round);
+			if (dst < 0) {
+				qsort(set, size, sizeof(int), compare_ints);
+				dst = Subsets_add(&subsets, set, size, fingerprint);
+				DFA_add_state(dfa);
+			}
+			for (int sym=0; sym < NFA_NSYMBOLS; sym++) {
+				if (classmap[sym] == c) {
+					DFA_set_transition(dfa, d, (char)sym, dst);
+				}
+			}
+		}
+	}
+
+	free(succStart);
+	free(succ);
+	free(set);
+	free(stamp);
+	free(keys);
+	free(subsets.start);
+	free(subsets.size);
+	free(subsets.fingerprint);
+	free(subsets.elements);
+	free(subsets.table);
+	return dfa;
+}
+
+/**
+ * Return a new DFA accepting the same strings as the given NFA.
+ * The NFA is reduced first (see NFA_reduce), since the subset
+ * construction can build up to one DFA state per set of NFA states and
+ * every NFA state it doesn't have to track makes the sets fewer.
+ */
+DFA NFA_to_DFA(NFA nfa) {
+	NFA reduced = NFA_reduce(nfa);
+	DFA dfa = subsets_of(reduced);
+	NFA_free(reduced);
+	return dfa;
+}
+
+/**
+ * Return a new DFA accepting the reversals of the strings the given DFA
+ * accepts.
+ */
+DFA DFA_reverse(DFA dfa) {
+	// NFA state s+1 is DFA state s, and NFA state 0 stands for all the
+	// accepting states at once, so the NFA needs only one start state
+	int n = DFA_get_size(dfa);
+	NFA nfa = new_NFA(n + 1);
+	for (int s=0; s < n; s++) {
+		for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+			int t = DFA_get_transition(dfa, s, (char)sym);
+			if (t == DFA_NO_STATE) {
+				continue;
+			}
+			NFA_add_transition(nfa, t + 1, (char)sym, s + 1);
+			if (DFA_get_accepting(dfa, t)) {
+				NFA_add_transition(nfa, 0, (char)sym, s + 1);
+			}
+		}
+	}
+	NFA_set_accepting(nfa, 1, true);
+	NFA_set_accepting(nfa, 0, DFA_get_accepting(dfa, 0));
+	DFA reverse = NFA_to_DFA(nfa);
+	NFA_free(nfa);
+	return reverse;
+}
+
+#ifdef MAIN
+
+#include <stdio.h>
+#include <time.h>
+#include "regexp.h"
+
+/**
+ * Run the given NFA and DFA on every string of up to maxlen symbols from
+ * the given alphabet, and return how many they disagree on.
+ */
+static int compare(NFA nfa, DFA dfa, const char *alphabet, int maxlen) {
+	int k = strlen(alphabet);
+	char input[16];
+	int digits[16];
+	int mismatches = 0;
+	for (int len=0; len <= maxlen; len++) {
+		memset(digits, 0, sizeof(digits));
+		while (true) {
+			for (int i=0; i < len; i++) {
+				input[i] = alphabet[digits[i]];
+			}
+			input[len] = '\0';
+			if (NFA_execute(nfa, input) != DFA_execute(dfa, input)) {
+				mismatches += 1;
+			}
+			int i = 0;
+			while (i < len && ++digits[i] == k) {
+				digits[i++] = 0;
+			}
+			if (i == len) {
+				break;
+			}
+		}
+	}
+	return mismatches;
+}
+
+/**
+ * Run the given DFA on every string of up to maxlen symbols from the given
+ * alphabet and its reverse on the reversed string, and return how many
+ * they disagree on.
+ */
+static int compare_reverse(DFA dfa, DFA reverse, const char *alphabet, int maxlen) {
+	int k = strlen(alphabet);
+	char input[16], reversed[16];
+	int digits[16];
+	int mismatches = 0;
+	for (int len=0; len <= maxlen; len++) {
+		memset(digits, 0, sizeof(digits));
+		while (true) {
+			for (int i=0; i < len; i++) {
+				input[i] = reversed[len - 1 - i] = alphabet[digits[i]];
+			}
+			input[len] = reversed[len] = '\0';
+			if (DFA_execute(dfa, input) != DFA_execute(reverse, reversed)) {
+				mismatches += 1;
+			}
+			int i = 0;
+			while (i < len && ++digits[i] == k) {
+				digits[i++] = 0;
+			}
+			if (i == len) {
+				break;
+			}
+		}
+	}
+	return mismatches;
+}
+
+static void test(NFA nfa, const char *name, const char *alphabet, int maxlen) {
+	DFA dfa = NFA_to_DFA(nfa);
+	DFA unreduced = subsets_of(nfa);
+	DFA reverse = DFA_reverse(dfa);
+	printf("%-22s NFA %2d states, DFA %2d states (%2d unreduced), %d mismatches, reverse %d mismatches\n", name,
+	       NFA_get_size(nfa), DFA_get_size(dfa), DFA_get_size(unreduced), compare(nfa, dfa, alphabet, maxlen),
+	       compare_reverse(dfa, reverse, alphabet, maxlen));
+	DFA_free(reverse);
+	DFA_free(unreduced);
+	DFA_free(dfa);
+}
+
+int main(int argc, char* argv[]) {
+	NFA endsInAt = new_NFA(3);
+	NFA_add_transition_all(endsInAt, 0, 0);
+	NFA_add_transition(endsInAt, 0, 'a', 1);
+	NFA_add_transition(endsInAt, 1, 't', 2);
+	NFA_set_accepting(endsInAt, 2, true);
+	test(endsInAt, "ends in \"at\"", "atx", 7);
+	NFA_free(endsInAt);
+
+	char *patterns[] = {
+		".*got.*", "(a|b)*a(a|b)(a|b)", "CSC", "(ab|a)*(ba|b)?", "[^a]*a[^a]*", "(aa|b)*|c+", "", NULL
+	};
+	for (int i=0; patterns[i] != NULL; i++) {
+		NFA nfa = regexp_compile(patterns[i], NULL);
+		test(nfa, patterns[i], "abcgot", 6);
+		NFA_free(nfa);
+	}
+
+	// An a 16 from the end: 2^17 subsets, most found many times over
+	NFA nfa = regexp_compile("(a|b)*a(a|b){16}", NULL);
+	clock_t start = clock();
+	DFA dfa = NFA_to_DFA(nfa);
+	double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("a 16 from the end:     NFA %d states, DFA %d states in %.3fs\n",
+	       NFA_get_size(nfa), DFA_get_size(dfa), seconds);
+	DFA_free(dfa);
+	NFA_free(nfa);
+}
+
+#endif
@@ -0,0 +1,34 @@
+/*
+ * File: nfa2dfa.h
+ *
+ * Converting an NFA to an equivalent DFA with the subset construction
+ * (FOCS Section 10.4), so a rule written as an NFA (or a regular
+ * expression, see regexp.h) can be run a table lookup per byte.
+ */
+
+#ifndef _nfa2dfa_h
+#define _nfa2dfa_h
+
+#include "dfa.h"
+#include "nfa.h"
+
+/**
+ * Return a new DFA accepting the same strings as the given NFA.
+ * The NFA's bisimilar states are merged first (see NFA_reduce), then
+ * each state of the DFA is a set of states of the reduced NFA reachable
+ * on the same input, and only sets that some input reaches are built.
+ * There is no state for the empty set: transitions to it are
+ * DFA_NO_STATE.
+ * The NFA is not modified.
+ */
+extern DFA NFA_to_DFA(NFA nfa);
+
+/**
+ * Return a new DFA accepting the reversals of the strings the given DFA
+ * accepts, so a rule about how strings end can be run from the end of
+ * the input. It is built with the subset construction from the given
+ * DFA's transitions turned around, and is not minimized.
+ */
+extern DFA DFA_reverse(DFA dfa);
+
+#endif
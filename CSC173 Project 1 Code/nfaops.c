@@ -0,0 +1,1058 @@
+/*
+ * File: nfaops.c
+ *
+ * Antichain-based inclusion checking for NFAs, after Abdulla et al.
+ * To check that a is included in b, search pairs (p, S) where p is a state
+ * of a and S is the set of states b could be in after the same input.
+ * A pair with p accepting and no accepting state in S gives a string in a
+ * but not in b. Where the subset construction would build every S, here a
+ * pair is dropped if some pair (r, R) already found is at least as likely
+ * to fail: p is simulated by r and every state of R is simulated by some
+ * state of S. A pair is also dropped if a state of S simulates p, and S
+ * only keeps states not simulated by other states of S.
+ * Simulation is computed over a and b side by side. It is the largest
+ * relation where q simulates p if q is accepting whenever p is, and every
+ * move of p can be matched by a move of q to a state simulating it.
+ * Pairs are taken out of it starting from the ones that fail outright,
+ * by following each pair taken out back to its predecessors.
+ * Reduction refines partitions of the states by signature: each round,
+ * a state's signature is its block and the set of (class, block) pairs
+ * it can move to, and states with the same signature make up the next
+ * round's blocks, until no block splits. The partition of the reversed
+ * transitions refined the same way merges states with the same pasts.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "nfaops.h"
+
+/**
+ * Beyond this many states (of a and b together) simulation isn't
+ * computed and each state only simulates itself, which gives the plain
+ * antichain algorithm. The relation takes n^2 bits, and at -O2 checking
+ * the 2040'th from the end against a renumbered copy (4082 states) takes
+ * under a second with it.
+ */
+#define SIMULATION_LIMIT 4096
+
+/**
+ * The NFAs a and b side by side: states of a are 0..na-1 and states of b
+ * are na..n-1. Successors are listed once per class of symbols that both
+ * NFAs treat the same way.
+ */
+typedef struct Union {
+	int na;
+	int n;
+	int nclasses;
+	int rep[NFA_NSYMBOLS];		// Input symbol for each class, or -1
+	int *succStart;			// Successors of s on class c are
+	int *succ;			// succ[succStart[s*nclasses+c]..next)
+	bool *accepting;
+	int words;			// Words per row of sim
+	unsigned long long *sim;	// Bit q of row p set if q simulates p, or NULL
+} Union;
+
+/**
+ * Return true if q simulates p. Without a relation (beyond
+ * SIMULATION_LIMIT states) each state only simulates itself.
+ */
+static bool simulates(Union *u, int p, int q) {
+	if (u->sim == NULL) {
+		return p == q;
+	}
+	return (u->sim[(size_t)p * u->words + q / 64] >> (q % 64)) & 1;
+}
+
+static int compare_ints(const void *a, const void *b) {
+	int x = *(const int*)a;
+	int y = *(const int*)b;
+	return (x > y) - (x < y);
+}
+
+static int compare_longs(const void *a, const void *b) {
+	long x = *(const long*)a;
+	long y = *(const long*)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Return true if the given symbols go to the same states from every state
+ * of the given NFA.
+ */
+static bool same_column(NFA nfa, int sym1, int sym2) {
+	for (int s=0; s < NFA_get_size(nfa); s++) {
+		if (!Set_equals(NFA_get_transitions(nfa, s, (char)sym1), NFA_get_transitions(nfa, s, (char)sym2))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Group the symbols into classes that a and b treat the same way, and
+ * pick a symbol of each class to use in counterexamples: a printable one
+ * if there is one, and never '\0', which can't occur in an input string.
+ */
+static void union_classes(Union *u, NFA a, NFA b) {
+	int first[NFA_NSYMBOLS];	// Smallest symbol of each class
+	int classOf[NFA_NSYMBOLS];
+	u->nclasses = 0;
+	for (int sym=0; sym < NFA_NSYMBOLS; sym++) {
+		int c;
+		for (c=0; c < u->nclasses; c++) {
+			if (same_column(a, first[c], sym) && same_column(b, first[c], sym)) {
+				break;
+			}
+		}
+		if (c == u->nclasses) {
+			first[u->nclasses++] = sym;
+		}
+		classOf[sym] = c;
+	}
+	for (int c=0; c < u->nclasses; c++) {
+		u->rep[c] = -1;
+	}
+	for (int sym=NFA_NSYMBOLS-1; sym > 0; sym--) {
+		int c = classOf[sym];
+		if (u->rep[c] < 0 || isgraph(sym) || !isgraph(u->rep[c])) {
+			u->rep[c] = sym;
+		}
+	}
+}
+
+/**
+ * Return true if q can't simulate p whatever their successors do: p is
+ * accepting and q isn't, or p moves on a class of symbols q doesn't.
+ * moves gives the number of classes each state moves on.
+ */
+static bool fails_outright(Union *u, const int *moves, int p, int q) {
+	if ((u->accepting[p] && !u->accepting[q]) || moves[p] > moves[q]) {
+		return true;
+	}
+	int k = u->nclasses;
+	for (int c=0; c < k; c++) {
+		if (u->rep[c] >= 0 && u->succStart[p * k + c] < u->succStart[p * k + c + 1]
+		    && u->succStart[q * k + c] == u->succStart[q * k + c + 1]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * The pairs taken out of the simulation and not yet followed back, and
+ * the predecessors of each state on each class (laid out like succ).
+ */
+typedef struct Removed {
+	int *pairs;			// p and q of each pair
+	long count;
+	long capacity;
+	int *predStart;
+	int *pred;
+} Removed;
+
+/**
+ * Given that q0 no longer simulates p0, take out of the simulation every
+ * pair (p, q) that moves to (p0, q0) on some class when no other successor
+ * of q on that class simulates p0, and so on from the pairs taken out.
+ */
+static void follow_back(Union *u, Removed *r, int p0, int q0) {
+	int k = u->nclasses;
+	r->pairs[0] = p0;
+	r->pairs[1] = q0;
+	r->count = 1;
+	while (r->count > 0) {
+		r->count -= 1;
+		int p1 = r->pairs[2 * r->count], q1 = r->pairs[2 * r->count + 1];
+		for (int c=0; c < k; c++) {
+			if (u->rep[c] < 0) {
+				continue;
+			}
+			for (int j=r->predStart[(size_t)q1 * k + c]; j < r->predStart[(size_t)q1 * k + c + 1]; j++) {
+				int q = r->pred[j];
+				int t, end = u->succStart[q * k + c + 1];
+				for (t=u->succStart[q * k + c]; t < end && !simulates(u, p1, u->succ[t]); t++) {
+				}
+				if (t < end) {
+					continue;
+				}
+				for (int i=r->predStart[(size_t)p1 * k + c]; i < r->predStart[(size_t)p1 * k + c + 1]; i++) {
+					int p = r->pred[i];
+					if (p == q || !simulates(u, p, q)) {
+						continue;
+					}
+					u->sim[(size_t)p * u->words + q / 64] &= ~(1ULL << (q % 64));
+					if (r->count == r->capacity) {
+						r->capacity *= 2;
+						r->pairs = (int*)realloc(r->pairs, sizeof(int) * 2 * r->capacity);
+					}
+					r->pairs[2 * r->count] = p;
+					r->pairs[2 * r->count + 1] = q;
+					r->count += 1;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Compute the largest simulation relation over the states of the given
+ * Union, or leave sim NULL if it has more than SIMULATION_LIMIT states.
+ * Pairs that fail outright are left out to begin with, then each one is
+ * followed back to the pairs that fail because of it. Every pair is taken
+ * out at most once, so where going over all n^2 pairs until none changes
+ * could take n rounds, this only looks at each pair's predecessors once.
+ */
+static void union_simulation(Union *u) {
+	int n = u->n, k = u->nclasses;
+	u->sim = NULL;
+	if (n > SIMULATION_LIMIT) {
+		return;
+	}
+	int *moves = (int*)calloc(n, sizeof(int));
+	for (int s=0; s < n; s++) {
+		for (int c=0; c < k; c++) {
+			if (u->rep[c] >= 0 && u->succStart[s * k + c] < u->succStart[s * k + c + 1]) {
+				moves[s] += 1;
+			}
+		}
+	}
+	u->words = (n + 63) / 64;
+	u->sim = (unsigned long long*)calloc((size_t)n * u->words, sizeof(unsigned long long));
+	for (int p=0; p < n; p++) {
+		for (int q=0; q < n; q++) {
+			if (p == q || !fails_outright(u, moves, p, q)) {
+				u->sim[(size_t)p * u->words + q / 64] |= 1ULL << (q % 64);
+			}
+		}
+	}
+
+	Removed r;
+	r.capacity = 1024;
+	r.pairs = (int*)malloc(sizeof(int) * 2 * r.capacity);
+	r.predStart = (int*)calloc((size_t)n * k + 1, sizeof(int));
+	r.pred = (int*)malloc(sizeof(int) * (u->succStart[n * k] + 1));
+	for (int s=0; s < n; s++) {
+		for (int c=0; c < k; c++) {
+			for (int j=u->succStart[s * k + c]; j < u->succStart[s * k + c + 1]; j++) {
+				r.predStart[(size_t)u->succ[j] * k + c + 1] += 1;
+			}
+		}
+	}
+	for (size_t i=0; i < (size_t)n * k; i++) {
+		r.predStart[i+1] += r.predStart[i];
+	}
+	int *next = (int*)malloc(sizeof(int) * ((size_t)n * k + 1));
+	memcpy(next, r.predStart, sizeof(int) * ((size_t)n * k + 1));
+	for (int s=0; s < n; s++) {
+		for (int c=0; c < k; c++) {
+			for (int j=u->succStart[s * k + c]; j < u->succStart[s * k + c + 1]; j++) {
+				r.pred[next[(size_t)u->succ[j] * k + c]++] = s;
+			}
+		}
+	}
+	free(next);
+
+	for (int p=0; p < n; p++) {
+		for (int q=0; q < n; q++) {
+			if (p != q && fails_outright(u, moves, p, q)) {
+				follow_back(u, &r, p, q);
+			}
+		}
+	}
+	free(moves);
+	free(r.pairs);
+	free(r.predStart);
+	free(r.pred);
+}
+
+/**
+ * Fill in the given Union of NFAs a and b.
+ */
+static void init_Union(Union *u, NFA a, NFA b) {
+	u->na = NFA_get_size(a);
+	u->n = u->na + NFA_get_size(b);
+	union_classes(u, a, b);
+	int k = u->nclasses;
+	u->accepting = (bool*)malloc(sizeof(bool) * u->n);
+	u->succStart = (int*)malloc(sizeof(int) * ((size_t)u->n * k + 1));
+	int capacity = 64;
+	u->succ = (int*)malloc(sizeof(int) * capacity);
+	int count = 0;
+	for (int s=0; s < u->n; s++) {
+		NFA nfa = (s < u->na) ? a : b;
+		int local = (s < u->na) ? s : s - u->na;
+		int offset = (s < u->na) ? 0 : u->na;
+		u->accepting[s] = NFA_get_accepting(nfa, local);
+		for (int c=0; c < k; c++) {
+			u->succStart[s * k + c] = count;
+			if (u->rep[c] < 0) {
+				continue;
+			}
+			SetIterator iterator = Set_iterator(NFA_get_transitions(nfa, local, (char)u->rep[c]));
+			while (SetIterator_hasNext(iterator)) {
+				if (count == capacity) {
+					capacity *= 2;
+					u->succ = (int*)realloc(u->succ, sizeof(int) * capacity);
+				}
+				u->succ[count++] = offset + SetIterator_next(iterator);
+			}
+			free(iterator);
+		}
+	}
+	u->succStart[u->n * k] = count;
+	union_simulation(u);
+}
+
+static void Union_free(Union *u) {
+	free(u->succStart);
+	free(u->succ);
+	free(u->accepting);
+	free(u->sim);
+}
+
+/**
+ * The pairs (p, S) found so far, in the order they were found. The sets
+ * are stored one after another in pool. Pairs are also chained together
+ * by p so that pairs that might subsume a new one are quick to find.
+ */
+typedef struct Pairs {
+	int count;
+	int capacity;
+	int *p;
+	int *setStart;
+	int *setSize;
+	int *parent;		// Pair this one was reached from, or -1
+	unsigned char *via;	// on this symbol
+	bool *alive;		// False once subsumed by a later pair
+	int *nextWithP;
+	int *firstWithP;	// Per state of a
+	int *pool;
+	int poolSize;
+	int poolCapacity;
+} Pairs;
+
+static void init_Pairs(Pairs *this, int na) {
+	this->count = 0;
+	this->capacity = 64;
+	this->p = (int*)malloc(sizeof(int) * this->capacity);
+	this->setStart = (int*)malloc(sizeof(int) * this->capacity);
+	this->setSize = (int*)malloc(sizeof(int) * this->capacity);
+	this->parent = (int*)malloc(sizeof(int) * this->capacity);
+	this->via = (unsigned char*)malloc(this->capacity);
+	this->alive = (bool*)malloc(sizeof(bool) * this->capacity);
+	this->nextWithP = (int*)malloc(sizeof(int) * this->capacity);
+	this->firstWithP = (int*)malloc(sizeof(int) * na);
+	for (int i=0; i < na; i++) {
+		this->firstWithP[i] = -1;
+	}
+	this->poolCapacity = 256;
+	this->pool = (int*)malloc(sizeof(int) * this->poolCapacity);
+	this->poolSize = 0;
+}
+
+static void Pairs_free(Pairs *this) {
+	free(this->p);
+	free(this->setStart);
+	free(this->setSize);
+	free(this->parent);
+	free(this->via);
+	free(this->alive);
+	free(this->nextWithP);
+	free(this->firstWithP);
+	free(this->pool);
+}
+
+/**
+ * Add the pair (p, set) to the given Pairs and return its index.
+ */
+static int Pairs_add(Pairs *this, int p, int *set, int size, int parent, int via) {
+	if (this->count == this->capacity) {
+		this->capacity *= 2;
+		this->p = (int*)realloc(this->p, sizeof(int) * this->capacity);
+		this->setStart = (int*)realloc(this->setStart, sizeof(int) * this->capacity);
+		this->setSize = (int*)realloc(this->setSize, sizeof(int) * this->capacity);
+		this->parent = (int*)realloc(this->parent, sizeof(int) * this->capacity);
+		this->via = (unsigned char*)realloc(this->via, this->capacity);
+		this->alive = (bool*)realloc(this->alive, sizeof(bool) * this->capacity);
+		this->nextWithP = (int*)realloc(this->nextWithP, sizeof(int) * this->capacity);
+	}
+	while (this->poolSize + size > this->poolCapacity) {
+		this->poolCapacity *= 2;
+		this->pool = (int*)realloc(this->pool, sizeof(int) * this->poolCapacity);
+	}
+	int i = this->count++;
+	this->p[i] = p;
+	this->setStart[i] = this->poolSize;
+	this->setSize[i] = size;
+	memcpy(this->pool + this->poolSize, set, sizeof(int) * size);
+	this->poolSize += size;
+	this->parent[i] = parent;
+	this->via[i] = (unsigned char)via;
+	this->alive[i] = true;
+	this->nextWithP[i] = this->firstWithP[p];
+	this->firstWithP[p] = i;
+	return i;
+}
+
+/**
+ * Return true if every state of R is simulated by some state of S, so
+ * that S accepts at least what R accepts.
+ */
+static bool covered(Union *u, const int *R, int nR, const int *S, int nS) {
+	for (int i=0; i < nR; i++) {
+		int j;
+		for (j=0; j < nS && !simulates(u, R[i], S[j]); j++) {
+		}
+		if (j == nS) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Return true if the new pair (p, S) can be dropped: either a state of S
+ * simulates p, or some live pair (r, R) has r simulating p and S covering
+ * R. Otherwise mark dead any live pairs that the new pair subsumes.
+ */
+static bool subsumed(Union *u, Pairs *pairs, int p, const int *S, int nS) {
+	for (int j=0; j < nS; j++) {
+		if (simulates(u, p, S[j])) {
+			return true;
+		}
+	}
+	// Without a simulation relation, only p itself is worth looking at
+	int first = (u->sim == NULL) ? p : 0;
+	int last = (u->sim == NULL) ? p + 1 : u->na;
+	for (int r=first; r < last; r++) {
+		if (!simulates(u, p, r)) {
+			continue;
+		}
+		for (int i=pairs->firstWithP[r]; i >= 0; i=pairs->nextWithP[i]) {
+			if (pairs->alive[i] && covered(u, pairs->pool + pairs->setStart[i], pairs->setSize[i], S, nS)) {
+				return true;
+			}
+		}
+	}
+	for (int r=first; r < last; r++) {
+		if (!simulates(u, r, p)) {
+			continue;
+		}
+		for (int i=pairs->firstWithP[r]; i >= 0; i=pairs->nextWithP[i]) {
+			if (pairs->alive[i] && covered(u, S, nS, pairs->pool + pairs->setStart[i], pairs->setSize[i])) {
+				pairs->alive[i] = false;
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * Remove from the given set of states those simulated by another state
+ * in it (keeping the first of states that simulate each other), and
+ * return its new size.
+ */
+static int reduce(Union *u, int *set, int size, bool *drop) {
+	for (int i=0; i < size; i++) {
+		drop[i] = false;
+		for (int j=0; j < size && !drop[i]; j++) {
+			if (j != i && simulates(u, set[i], set[j]) && (!simulates(u, set[j], set[i]) || j < i)) {
+				drop[i] = true;
+			}
+		}
+	}
+	int n = 0;
+	for (int i=0; i < size; i++) {
+		if (!drop[i]) {
+			set[n++] = set[i];
+		}
+	}
+	return n;
+}
+
+/**
+ * Return true if every string accepted by a is also accepted by b,
+ * otherwise set *counterexample (if not NULL) to one that isn't.
+ */
+bool NFA_included(NFA a, NFA b, char **counterexample) {
+	Union u;
+	init_Union(&u, a, b);
+	int k = u.nclasses;
+	Pairs pairs;
+	init_Pairs(&pairs, u.na);
+
+	int *set = (int*)malloc(sizeof(int) * u.n);
+	bool *drop = (bool*)malloc(sizeof(bool) * u.n);
+	int *stamp = (int*)malloc(sizeof(int) * u.n);	// Last round to add each state
+	for (int s=0; s < u.n; s++) {
+		stamp[s] = -1;
+	}
+	int round = 0;
+
+	int found = -1;
+	set[0] = u.na;
+	if (u.accepting[0] && !u.accepting[u.na]) {
+		found = Pairs_add(&pairs, 0, set, 1, -1, 0);
+	} else if (!subsumed(&u, &pairs, 0, set, 1)) {
+		Pairs_add(&pairs, 0, set, 1, -1, 0);
+	}
+	for (int i=0; i < pairs.count && found < 0; i++) {
+		if (!pairs.alive[i]) {
+			continue;
+		}
+		int p = pairs.p[i];
+		for (int c=0; c < k && found < 0; c++) {
+			if (u.rep[c] < 0) {
+				continue;
+			}
+			// The set b moves to on c, with simulated states removed
+			int size = 0;
+			bool accepting = false;
+			round += 1;
+			for (int j=0; j < pairs.setSize[i]; j++) {
+				int s = pairs.pool[pairs.setStart[i] + j];
+				for (int t=u.succStart[s * k + c]; t < u.succStart[s * k + c + 1]; t++) {
+					int dst = u.succ[t];
+					if (stamp[dst] != round) {
+						stamp[dst] = round;
+						set[size++] = dst;
+						accepting = accepting || u.accepting[dst];
+					}
+				}
+			}
+			size = reduce(&u, set, size, drop);
+			for (int t=u.succStart[p * k + c]; t < u.succStart[p * k + c + 1] && found < 0; t++) {
+				int q = u.succ[t];
+				if (u.accepting[q] && !accepting) {
+					found = Pairs_add(&pairs, q, set, size, i, u.rep[c]);
+				} else if (!subsumed(&u, &pairs, q, set, size)) {
+					Pairs_add(&pairs, q, set, size, i, u.rep[c]);
+				}
+			}
+		}
+	}
+
+	if (counterexample != NULL) {
+		*counterexample = NULL;
+		if (found >= 0) {
+			int len = 0;
+			for (int i=found; pairs.parent[i] >= 0; i=pairs.parent[i]) {
+				len += 1;
+			}
+			char *str = (char*)malloc(len + 1);
+			str[len] = '\0';
+			for (int i=found; pairs.parent[i] >= 0; i=pairs.parent[i]) {
+				str[--len] = (char)pairs.via[i];
+			}
+			*counterexample = str;
+		}
+	}
+	free(set);
+	free(drop);
+	free(stamp);
+	Pairs_free(&pairs);
+	Union_free(&u);
+	return found < 0;
+}
+
+/**
+ * Return true if the given NFA accepts every string, otherwise set
+ * *counterexample (if not NULL) to one that it doesn't.
+ * This is inclusion of a one-state NFA that accepts everything.
+ */
+bool NFA_universal(NFA a, char **counterexample) {
+	NFA all = new_NFA(1);
+	NFA_add_transition_all(all, 0, 0);
+	NFA_set_accepting(all, 0, true);
+	bool result = NFA_included(all, a, counterexample);
+	NFA_free(all);
+	return result;
+}
+
+/**
+ * An NFA's transitions over its symbol classes, in arrays that are quick
+ * to refine partitions over: the successors of s on class c are
+ * succ[succStart[s*k+c]..succStart[s*k+c+1]).
+ */
+typedef struct Graph {
+	int n;
+	int k;
+	int *succStart;
+	int *succ;
+	bool *accepting;
+} Graph;
+
+static void Graph_free(Graph *g) {
+	free(g->succStart);
+	free(g->succ);
+	free(g->accepting);
+}
+
+/**
+ * Return the graph with every edge of the given one turned around, and
+ * the start state as the only "accepting" state.
+ */
+static Graph Graph_reverse(const Graph *g) {
+	Graph r;
+	int n = g->n, k = g->k;
+	r.n = n;
+	r.k = k;
+	r.succStart = (int*)calloc((size_t)n * k + 1, sizeof(int));
+	r.succ = (int*)malloc(sizeof(int) * (g->succStart[n * k] + 1));
+	r.accepting = (bool*)calloc(n > 0 ? n : 1, sizeof(bool));
+	r.accepting[0] = true;
+	for (int i=0; i < n * k; i++) {
+		for (int j=g->succStart[i]; j < g->succStart[i+1]; j++) {
+			r.succStart[g->succ[j] * k + i % k + 1] += 1;
+		}
+	}
+	for (int i=0; i < n * k; i++) {
+		r.succStart[i+1] += r.succStart[i];
+	}
+	int *fill = (int*)malloc(sizeof(int) * (n * k + 1));
+	memcpy(fill, r.succStart, sizeof(int) * (n * k + 1));
+	for (int i=0; i < n * k; i++) {
+		for (int j=g->succStart[i]; j < g->succStart[i+1]; j++) {
+			r.succ[fill[g->succ[j] * k + i % k]++] = i / k;
+		}
+	}
+	free(fill);
+	return r;
+}
+
+/**
+ * Return the graph of the blocks of the given partition of the given
+ * graph's states, where block[s] is s's block (numbered from 0, with
+ * the start state in block 0) or -1 to leave s out, and m is the number
+ * of blocks. A block is accepting if any of its states is.
+ */
+static Graph Graph_quotient(const Graph *g, const int *block, int m) {
+	Graph q;
+	int k = g->k;
+	q.n = m;
+	q.k = k;
+	q.succStart = (int*)calloc((size_t)m * k + 1, sizeof(int));
+	q.accepting = (bool*)calloc(m > 0 ? m : 1, sizeof(bool));
+	// Count edges between blocks, then fill them in and drop duplicates
+	for (int s=0; s < g->n; s++) {
+		if (block[s] < 0) {
+			continue;
+		}
+		q.accepting[block[s]] |= g->accepting[s];
+		for (int c=0; c < k; c++) {
+			for (int j=g->succStart[s*k+c]; j < g->succStart[s*k+c+1]; j++) {
+				if (block[g->succ[j]] >= 0) {
+					q.succStart[block[s] * k + c + 1] += 1;
+				}
+			}
+		}
+	}
+	for (int i=0; i < m * k; i++) {
+		q.succStart[i+1] += q.succStart[i];
+	}
+	int *fill = (int*)malloc(sizeof(int) * (m * k + 1));
+	memcpy(fill, q.succStart, sizeof(int) * (m * k + 1));
+	int *succ = (int*)malloc(sizeof(int) * (q.succStart[m * k] + 1));
+	for (int s=0; s < g->n; s++) {
+		if (block[s] < 0) {
+			continue;
+		}
+		for (int c=0; c < k; c++) {
+			for (int j=g->succStart[s*k+c]; j < g->succStart[s*k+c+1]; j++) {
+				if (block[g->succ[j]] >= 0) {
+					succ[fill[block[s] * k + c]++] = block[g->succ[j]];
+				}
+			}
+		}
+	}
+	q.succ = (int*)malloc(sizeof(int) * (q.succStart[m * k] + 1));
+	int nsucc = 0;
+	for (int i=0; i < m * k; i++) {
+		int lo = q.succStart[i], hi = fill[i];
+		qsort(succ + lo, hi - lo, sizeof(int), compare_ints);
+		q.succStart[i] = nsucc;
+		for (int j=lo; j < hi; j++) {
+			if (j == lo || succ[j] != succ[j-1]) {
+				q.succ[nsucc++] = succ[j];
+			}
+		}
+	}
+	q.succStart[m * k] = nsucc;
+	free(succ);
+	free(fill);
+	return q;
+}
+
+/**
+ * Mark the states of the given graph reachable from the given states.
+ */
+static void mark_reachable(const Graph *g, int *queue, int count, bool *marked) {
+	for (int i=0; i < count; i++) {
+		marked[queue[i]] = true;
+	}
+	for (int head=0; head < count; head++) {
+		int s = queue[head];
+		for (int j=g->succStart[s * g->k]; j < g->succStart[(s + 1) * g->k]; j++) {
+			if (!marked[g->succ[j]]) {
+				marked[g->succ[j]] = true;
+				queue[count++] = g->succ[j];
+			}
+		}
+	}
+}
+
+/**
+ * Number the states of the given graph that some input reaches from the
+ * start and that can reach an accepting state, keeping the start state
+ * even if it can't, and return how many there are.
+ */
+static int trim(const Graph *g, int *block) {
+	int n = g->n;
+	bool *forward = (bool*)calloc(n, sizeof(bool));
+	bool *backward = (bool*)calloc(n, sizeof(bool));
+	int *queue = (int*)malloc(sizeof(int) * n);
+	queue[0] = 0;
+	mark_reachable(g, queue, 1, forward);
+	int count = 0;
+	for (int s=0; s < n; s++) {
+		if (g->accepting[s]) {
+			queue[count++] = s;
+		}
+	}
+	Graph r = Graph_reverse(g);
+	mark_reachable(&r, queue, count, backward);
+	Graph_free(&r);
+	int m = 0;
+	for (int s=0; s < n; s++) {
+		block[s] = (s == 0 || (forward[s] && backward[s])) ? m++ : -1;
+	}
+	free(forward);
+	free(backward);
+	free(queue);
+	return m;
+}
+
+/**
+ * Refine the given partition of the given graph's states (block[s] from
+ * 0 to m-1) until states in the same block are accepting alike and go,
+ * on each class, to the same set of blocks: the coarsest such partition
+ * is the largest bisimulation that respects the starting one. Blocks are
+ * renumbered in order of their first state. Returns the number of blocks.
+ */
+static int refine(const Graph *g, int *block, int m) {
+	int n = g->n, k = g->k;
+	// A state's signature is its block, then its (class, block) moves
+	// sorted and without duplicates
+	long *sigs = (long*)malloc(sizeof(long) * (n + g->succStart[n * k] + 1));
+	int *sigStart = (int*)malloc(sizeof(int) * (n + 1));
+	int tableSize = 16;
+	while (tableSize < 2 * n) {
+		tableSize *= 2;
+	}
+	int *table = (int*)malloc(sizeof(int) * tableSize);
+	int *next = (int*)malloc(sizeof(int) * (n > 0 ? n : 1));
+	for (;;) {
+		int nsigs = 0;
+		for (int s=0; s < n; s++) {
+			sigStart[s] = nsigs;
+			sigs[nsigs++] = block[s];
+			int first = nsigs;
+			for (int c=0; c < k; c++) {
+				for (int j=g->succStart[s*k+c]; j < g->succStart[s*k+c+1]; j++) {
+					sigs[nsigs++] = (long)c * m + block[g->succ[j]];
+				}
+			}
+			qsort(sigs + first, nsigs - first, sizeof(long), compare_longs);
+			int end = first;
+			for (int j=first; j < nsigs; j++) {
+				if (j == first || sigs[j] != sigs[j-1]) {
+					sigs[end++] = sigs[j];
+				}
+			}
+			nsigs = end;
+		}
+		sigStart[n] = nsigs;
+		for (int i=0; i < tableSize; i++) {
+			table[i] = -1;
+		}
+		int count = 0;
+		for (int s=0; s < n; s++) {
+			int length = sigStart[s+1] - sigStart[s];
+			unsigned long h = 14695981039346656037u;
+			for (int j=sigStart[s]; j < sigStart[s+1]; j++) {
+				h = (h ^ (unsigned long)sigs[j]) * 1099511628211u;
+			}
+			int i = (int)(h & (tableSize - 1));
+			while (table[i] >= 0) {
+				int t = table[i];
+				if (sigStart[t+1] - sigStart[t] == length
+				    && memcmp(sigs + sigStart[t], sigs + sigStart[s], sizeof(long) * length) == 0) {
+					break;
+				}
+				i = (i + 1) & (tableSize - 1);
+			}
+			if (table[i] < 0) {
+				table[i] = s;
+				next[s] = count++;
+			} else {
+				next[s] = next[table[i]];
+			}
+		}
+		memcpy(block, next, sizeof(int) * n);
+		// Blocks only ever split, so the same count means no change
+		if (count == m) {
+			break;
+		}
+		m = count;
+	}
+	free(sigs);
+	free(sigStart);
+	free(table);
+	free(next);
+	return m;
+}
+
+/**
+ * Replace the given graph with its quotient by the given partition.
+ */
+static void replace(Graph *g, const int *block, int m) {
+	Graph q = Graph_quotient(g, block, m);
+	Graph_free(g);
+	*g = q;
+}
+
+/**
+ * Return a new NFA accepting the same strings as the given NFA, with the
+ * states that no accepted string passes through removed, and states
+ * merged that are equivalent under forward or backward bisimulation.
+ */
+NFA NFA_reduce(NFA nfa) {
+	if (NFA_get_size(nfa) == 0) {
+		return new_NFA(0);
+	}
+	unsigned char classmap[NFA_NSYMBOLS];
+	Graph g;
+	g.n = NFA_get_size(nfa);
+	g.k = NFA_get_classes(nfa, classmap);
+	int rep[NFA_NSYMBOLS];
+	for (int sym=NFA_NSYMBOLS-1; sym >= 0; sym--) {
+		rep[classmap[sym]] = sym;
+	}
+	int n = g.n, k = g.k;
+	g.succStart = (int*)malloc(sizeof(int) * ((size_t)n * k + 1));
+	g.accepting = (bool*)malloc(sizeof(bool) * (n > 0 ? n : 1));
+	int nsucc = 0, succCapacity = 64;
+	g.succ = (int*)malloc(sizeof(int) * succCapacity);
+	for (int i=0; i < n * k; i++) {
+		g.succStart[i] = nsucc;
+		SetIterator iterator = Set_iterator(NFA_get_transitions(nfa, i / k, (char)rep[i % k]));
+		while (SetIterator_hasNext(iterator)) {
+			if (nsucc == succCapacity) {
+				succCapacity *= 2;
+				g.succ = (int*)realloc(g.succ, sizeof(int) * succCapacity);
+			}
+			g.succ[nsucc++] = SetIterator_next(iterator);
+		}
+		free(iterator);
+	}
+	g.succStart[n * k] = nsucc;
+	for (int s=0; s < n; s++) {
+		g.accepting[s] = NFA_get_accepting(nfa, s);
+	}
+
+	// Each kind of merge can make room for the others, so go round until
+	// none of them finds anything
+	int *block = (int*)malloc(sizeof(int) * (n > 0 ? n : 1));
+	for (;;) {
+		int before = g.n;
+		replace(&g, block, trim(&g, block));
+
+		// Forward: start from accepting or not
+		bool mixed = false;
+		for (int s=0; s < g.n; s++) {
+			block[s] = g.accepting[s] != g.accepting[0];
+			mixed |= block[s];
+		}
+		replace(&g, block, refine(&g, block, mixed ? 2 : 1));
+
+		// Backward: the same on the reversed graph, from start or not
+		Graph r = Graph_reverse(&g);
+		for (int s=0; s < g.n; s++) {
+			block[s] = (s != 0);
+		}
+		int m = refine(&r, block, g.n > 1 ? 2 : 1);
+		Graph_free(&r);
+		replace(&g, block, m);
+		if (g.n == before) {
+			break;
+		}
+	}
+	free(block);
+
+	NFA result = new_NFA(g.n);
+	for (int s=0; s < g.n; s++) {
+		NFA_set_accepting(result, s, g.accepting[s]);
+	}
+	for (int sym=0; sym < NFA_NSYMBOLS; sym++) {
+		int c = classmap[sym];
+		for (int s=0; s < g.n; s++) {
+			for (int j=g.succStart[s*k+c]; j < g.succStart[s*k+c+1]; j++) {
+				NFA_add_transition(result, s, (char)sym, g.succ[j]);
+			}
+		}
+	}
+	Graph_free(&g);
+	return result;
+}
+
+#ifdef MAIN
+
+#include <stdio.h>
+#include <time.h>
+#include "regexp.h"
+
+static void test_included(char *name, NFA a, NFA b) {
+	char *counterexample;
+	bool result = NFA_included(a, b, &counterexample);
+	printf("%s: %s", name, result ? "true" : "false");
+	if (!result) {
+		printf(" (\"%s\")", counterexample);
+	}
+	printf("\n");
+	free(counterexample);
+}
+
+static void test_universal(char *name, NFA a) {
+	char *counterexample;
+	bool result = NFA_universal(a, &counterexample);
+	printf("%s: %s", name, result ? "true" : "false");
+	if (!result) {
+		printf(" (\"%s\")", counterexample);
+	}
+	printf("\n");
+	free(counterexample);
+}
+
+/**
+ * Return an NFA for strings over {a,b} whose n'th symbol from the end is
+ * 'a', whose subset DFA has 2^n states. If reversed, the states other than
+ * the start state are numbered backwards.
+ */
+static NFA nth_from_end(int n, bool reversed) {
+	NFA nfa = new_NFA(n + 1);
+	int state[n + 1];
+	for (int i=0; i <= n; i++) {
+		state[i] = (i == 0 || !reversed) ? i : n + 1 - i;
+	}
+	NFA_add_transition_str(nfa, 0, "ab", 0);
+	NFA_add_transition(nfa, 0, 'a', state[1]);
+	for (int i=1; i < n; i++) {
+		NFA_add_transition_str(nfa, state[i], "ab", state[i+1]);
+	}
+	NFA_set_accepting(nfa, state[n], true);
+	return nfa;
+}
+
+int main(int argc, char* argv[]) {
+	NFA endsInAt = new_NFA(3);
+	NFA_add_transition_all(endsInAt, 0, 0);
+	NFA_add_transition(endsInAt, 0, 'a', 1);
+	NFA_add_transition(endsInAt, 1, 't', 2);
+	NFA_set_accepting(endsInAt, 2, true);
+
+	NFA containsAt = new_NFA(3);
+	NFA_add_transition_all(containsAt, 0, 0);
+	NFA_add_transition(containsAt, 0, 'a', 1);
+	NFA_add_transition(containsAt, 1, 't', 2);
+	NFA_add_transition_all(containsAt, 2, 2);
+	NFA_set_accepting(containsAt, 2, true);
+
+	test_included("ends in at <= contains at", endsInAt, containsAt);
+	test_included("contains at <= ends in at", containsAt, endsInAt);
+	test_included("ends in at <= ends in at", endsInAt, endsInAt);
+
+	// Either the last symbol is 'x', or it isn't (or there isn't one)
+	NFA lastX = new_NFA(3);
+	NFA_set_accepting(lastX, 0, true);
+	NFA_add_transition_all(lastX, 0, 0);
+	NFA_add_transition(lastX, 0, 'x', 1);
+	NFA_set_accepting(lastX, 1, true);
+	for (int sym=1; sym < NFA_NSYMBOLS; sym++) {
+		if (sym != 'x') {
+			NFA_add_transition(lastX, 0, (char)sym, 2);
+		}
+	}
+	NFA_set_accepting(lastX, 2, true);
+	test_universal("last is x or not x is universal", lastX);
+	NFA_set_accepting(lastX, 0, false);
+	test_universal("without the empty string", lastX);
+	test_universal("contains at is universal", containsAt);
+
+	// And one big enough for computing the simulation to be most of it
+	int sizes[] = { 24, 1000 };
+	for (int i=0; i < 2; i++) {
+		int n = sizes[i];
+		NFA nth = nth_from_end(n, false);
+		NFA nthReversed = nth_from_end(n, true);
+		NFA nthMinus1 = nth_from_end(n - 1, false);
+		printf("%d'th from the end is 'a' (subset DFA has 2^%d states):\n", n, n);
+		clock_t start = clock();
+		test_included("  two numberings", nth, nthReversed);
+		if (n < 100) {
+			test_included("  n'th <= (n-1)'th", nth, nthMinus1);
+		} else {
+			// The counterexample is n symbols long
+			printf("  n'th <= (n-1)'th: %s\n", NFA_included(nth, nthMinus1, NULL) ? "true" : "false");
+		}
+		printf("  %.2fs\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+		NFA_free(nth);
+		NFA_free(nthReversed);
+		NFA_free(nthMinus1);
+	}
+
+	// Reducing regular expressions' NFAs
+	char *patterns[] = { "(ab|ab|ab)c", "(ab|ac)*", "[a-z]*(cat|hat|bat)",
+			     "(a|b)*abb", "x*(yx*)*", "(ab|a)*(ba|b)?", "(0|1)(0|1)(0|1)|(0|1)(0|1)" };
+	for (int i=0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+		NFA nfa = regexp_compile(patterns[i], NULL);
+		NFA reduced = NFA_reduce(nfa);
+		bool same = NFA_included(nfa, reduced, NULL) && NFA_included(reduced, nfa, NULL);
+		printf("reduce %-28s %2d states -> %2d, %s\n", patterns[i], NFA_get_size(nfa),
+		       NFA_get_size(reduced), same ? "same language" : "DIFFERENT LANGUAGE");
+		NFA_free(nfa);
+		NFA_free(reduced);
+	}
+
+	// And random NFAs over {a,b}, some with unreachable and dead states
+	srand(173);
+	int trials = 500, different = 0, states = 0, reducedStates = 0;
+	for (int t=0; t < trials; t++) {
+		int size = 2 + rand() % 8;
+		NFA nfa = new_NFA(size);
+		for (int s=0; s < size; s++) {
+			NFA_set_accepting(nfa, s, rand() % 3 == 0);
+			for (int e=rand() % 4; e > 0; e--) {
+				NFA_add_transition(nfa, s, "ab"[rand() % 2], rand() % size);
+			}
+		}
+		NFA reduced = NFA_reduce(nfa);
+		if (!NFA_included(nfa, reduced, NULL) || !NFA_included(reduced, nfa, NULL)) {
+			different += 1;
+		}
+		states += size;
+		reducedStates += NFA_get_size(reduced);
+		NFA_free(nfa);
+		NFA_free(reduced);
+	}
+	printf("reduce %d random NFAs: %d states -> %d, %d with a different language\n",
+	       trials, states, reducedStates, different);
+
+	NFA_free(endsInAt);
+	NFA_free(containsAt);
+	NFA_free(lastX);
+	return different > 0;
+}
+
+#endif
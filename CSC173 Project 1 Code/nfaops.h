@@ -0,0 +1,47 @@
+/*
+ * File: nfaops.h
+ *
+ * Language inclusion and universality checks for NFAs that never build
+ * the subset DFA. Both explore sets of states of the NFA on the right
+ * lazily and keep only an antichain of them: a set that is implied by one
+ * already seen (using a simulation preorder between states) is dropped.
+ * @see Abdulla, Chen, Holik, Mayr & Vojnar, "When Simulation Meets
+ * Antichains", TACAS 2010.
+ * Also reduction of NFAs by merging bisimilar states, which the subset
+ * construction does first (see nfa2dfa.h).
+ */
+
+#ifndef _nfaops_h
+#define _nfaops_h
+
+#include <stdbool.h>
+#include "nfa.h"
+
+/**
+ * Return true if every string accepted by a is also accepted by b.
+ * If not and counterexample is not NULL, *counterexample is set to a string
+ * accepted by a but not by b (which the caller must free); otherwise
+ * *counterexample is set to NULL.
+ */
+extern bool NFA_included(NFA a, NFA b, char **counterexample);
+
+/**
+ * Return true if the given NFA accepts every string.
+ * If not and counterexample is not NULL, *counterexample is set to a string
+ * it doesn't accept (which the caller must free); otherwise *counterexample
+ * is set to NULL.
+ */
+extern bool NFA_universal(NFA a, char **counterexample);
+
+/**
+ * Return a new NFA accepting the same strings as the given NFA, usually
+ * with fewer states: states that no accepted string passes through are
+ * removed, and states are merged that accept the same futures step for
+ * step (forward bisimulation) or are reached by the same pasts step for
+ * step (backward bisimulation). State 0 is still the start state.
+ * Regular expressions with repeated parts, like "(ab|ac)*", and NFAs
+ * built from overlapping pieces have many such states.
+ */
+extern NFA NFA_reduce(NFA nfa);
+
+#endif
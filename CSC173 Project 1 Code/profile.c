@@ -0,0 +1,338 @@
+/*
+ * File: profile.c
+ *
+ * Implementation of the Profile API in profile.h.
+ * Counts are plain long longs: each thread counts into its own attached
+ * Profile, so nothing needs to be atomic. The automaton it was attached
+ * for is kept with it, and a call only counts if it runs that automaton.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "profile.h"
+
+struct Profile {
+	int nstates;
+	int nclasses;
+	unsigned char classmap[PROFILE_NSYMBOLS];
+	long long *visits;		// Per state
+	long long *transitions;		// nstates rows of nclasses counts
+	long long calls;
+	long long bytes;
+	long long skipped;
+	long long earlyExits;
+	long long nanoseconds;
+	long long ignored;		// Calls that ran another automaton
+};
+
+/**
+ * The Profile attached to this thread, or NULL, and the automaton it was
+ * attached for.
+ */
+static _Thread_local Profile current = NULL;
+static _Thread_local const void *currentAutomaton = NULL;
+
+/**
+ * Allocate and return a new Profile, with all counts zero, for an
+ * automaton with the given number of states and symbol classes.
+ */
+Profile new_Profile(int nstates, const unsigned char classmap[PROFILE_NSYMBOLS], int nclasses) {
+	Profile this = (Profile)malloc(sizeof(struct Profile));
+	if (this == NULL) {
+		return NULL;
+	}
+	this->nstates = nstates;
+	if (classmap == NULL) {
+		nclasses = PROFILE_NSYMBOLS;
+		for (int sym=0; sym < PROFILE_NSYMBOLS; sym++) {
+			this->classmap[sym] = sym;
+		}
+	} else {
+		memcpy(this->classmap, classmap, PROFILE_NSYMBOLS);
+	}
+	this->nclasses = nclasses;
+	this->visits = (long long*)malloc(sizeof(long long) * nstates);
+	this->transitions = (long long*)malloc(sizeof(long long) * nstates * nclasses);
+	Profile_reset(this);
+	return this;
+}
+
+/**
+ * Free the given Profile.
+ */
+void Profile_free(Profile this) {
+	if (this == NULL) {
+		return;
+	}
+	free(this->visits);
+	free(this->transitions);
+	free(this);
+}
+
+/**
+ * Set all the counts of the given Profile back to zero.
+ */
+void Profile_reset(Profile this) {
+	memset(this->visits, 0, sizeof(long long) * this->nstates);
+	memset(this->transitions, 0, sizeof(long long) * this->nstates * this->nclasses);
+	this->calls = 0;
+	this->bytes = 0;
+	this->skipped = 0;
+	this->earlyExits = 0;
+	this->nanoseconds = 0;
+	this->ignored = 0;
+}
+
+/**
+ * Make the given Profile the one the engines count into when they run the
+ * given automaton on the calling thread, or stop counting if profile is
+ * NULL.
+ */
+void Profile_attach(Profile profile, const void *automaton) {
+	current = profile;
+	currentAutomaton = (profile == NULL) ? NULL : automaton;
+}
+
+/**
+ * Return the number of times the given state was visited.
+ */
+long long Profile_get_visits(Profile this, int state) {
+	return this->visits[state];
+}
+
+/**
+ * Return the number of transitions taken from the given state on symbols
+ * in the class of the given symbol.
+ */
+long long Profile_get_transitions(Profile this, int state, char symbol) {
+	return this->transitions[state * this->nclasses + this->classmap[(unsigned char)symbol]];
+}
+
+/**
+ * Return the number of calls counted by the given Profile.
+ */
+long long Profile_get_calls(Profile this) {
+	return this->calls;
+}
+
+/**
+ * Return the number of bytes stepped over counted by the given Profile.
+ */
+long long Profile_get_bytes(Profile this) {
+	return this->bytes;
+}
+
+/**
+ * Return the number of bytes skipped counted by the given Profile.
+ */
+long long Profile_get_skipped(Profile this) {
+	return this->skipped;
+}
+
+/**
+ * Return the number of early exits counted by the given Profile.
+ */
+long long Profile_get_early_exits(Profile this) {
+	return this->earlyExits;
+}
+
+/**
+ * Return the number of nanoseconds counted by the given Profile.
+ */
+long long Profile_get_nanoseconds(Profile this) {
+	return this->nanoseconds;
+}
+
+/**
+ * Return the number of calls the given Profile ignored because they ran
+ * another automaton.
+ */
+long long Profile_get_ignored(Profile this) {
+	return this->ignored;
+}
+
+/**
+ * Return the first symbol in each class of the given Profile.
+ */
+static void class_reps(Profile this, int *rep) {
+	for (int c=0; c < this->nclasses; c++) {
+		rep[c] = -1;
+	}
+	for (int sym=PROFILE_NSYMBOLS-1; sym >= 0; sym--) {
+		rep[this->classmap[sym]] = sym;
+	}
+}
+
+/**
+ * Write the counts of the given Profile to the given stream as one JSON
+ * object.
+ */
+void Profile_write_json(Profile this, FILE *out) {
+	fprintf(out, "{\"calls\": %lld, \"bytes\": %lld, \"skipped\": %lld, "
+		"\"early_exits\": %lld, \"nanoseconds\": %lld, \"ignored_calls\": %lld,\n",
+		this->calls, this->bytes, this->skipped, this->earlyExits, this->nanoseconds, this->ignored);
+	fprintf(out, " \"classmap\": [");
+	for (int sym=0; sym < PROFILE_NSYMBOLS; sym++) {
+		fprintf(out, "%s%d", sym == 0 ? "" : ",", this->classmap[sym]);
+	}
+	fprintf(out, "],\n \"states\": [");
+	bool first = true;
+	for (int s=0; s < this->nstates; s++) {
+		if (this->visits[s] == 0) {
+			continue;
+		}
+		fprintf(out, "%s\n  {\"state\": %d, \"visits\": %lld, \"transitions\": {",
+			first ? "" : ",", s, this->visits[s]);
+		first = false;
+		const long long *row = this->transitions + s * this->nclasses;
+		bool firstClass = true;
+		for (int c=0; c < this->nclasses; c++) {
+			if (row[c] != 0) {
+				fprintf(out, "%s\"%d\": %lld", firstClass ? "" : ", ", c, row[c]);
+				firstClass = false;
+			}
+		}
+		fprintf(out, "}}");
+	}
+	fprintf(out, "\n ]}\n");
+}
+
+/**
+ * Write the per-state counts of the given Profile to the given stream as
+ * CSV.
+ */
+void Profile_write_csv(Profile this, FILE *out) {
+	int *rep = (int*)malloc(sizeof(int) * this->nclasses);
+	class_reps(this, rep);
+	fprintf(out, "state,visits,class,first_symbol,transitions\n");
+	for (int s=0; s < this->nstates; s++) {
+		if (this->visits[s] == 0) {
+			continue;
+		}
+		fprintf(out, "%d,%lld,,,\n", s, this->visits[s]);
+		const long long *row = this->transitions + s * this->nclasses;
+		for (int c=0; c < this->nclasses; c++) {
+			if (row[c] != 0) {
+				fprintf(out, "%d,%lld,%d,%d,%lld\n", s, this->visits[s], c, rep[c], row[c]);
+			}
+		}
+	}
+	free(rep);
+}
+
+/**
+ * Return the Profile this thread has attached for the given automaton, and
+ * set *start to start timing a call to it, or return NULL if there is no
+ * such Profile. A call to another automaton while one is attached is
+ * counted as ignored.
+ */
+Profile Profile_begin(const void *automaton, long long *start) {
+	*start = 0;
+	if (current == NULL) {
+		return NULL;
+	}
+	if (automaton != currentAutomaton) {
+		current->ignored += 1;
+		return NULL;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	*start = (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+	return current;
+}
+
+/**
+ * Count, in the given Profile (if not NULL), a visit to the given state
+ * and a transition from it on the given symbol.
+ */
+void Profile_step(Profile this, int state, unsigned char symbol) {
+	if (this == NULL || state < 0 || state >= this->nstates) {
+		return;
+	}
+	this->visits[state] += 1;
+	this->transitions[state * this->nclasses + this->classmap[symbol]] += 1;
+}
+
+/**
+ * Count bytes of the given automaton's input passed over without stepping
+ * through it.
+ */
+void Profile_skip(const void *automaton, long nbytes) {
+	if (current != NULL && automaton == currentAutomaton) {
+		current->skipped += nbytes;
+	}
+}
+
+/**
+ * Finish timing, in the given Profile (if not NULL), a call that stepped
+ * over nbytes bytes and ended in the given state (or none, if state is
+ * negative).
+ */
+void Profile_end(Profile this, long long start, int state, long nbytes, bool early) {
+	if (this == NULL) {
+		return;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	this->nanoseconds += (long long)now.tv_sec * 1000000000LL + now.tv_nsec - start;
+	this->calls += 1;
+	this->bytes += nbytes;
+	if (early) {
+		this->earlyExits += 1;
+	}
+	if (state >= 0 && state < this->nstates) {
+		this->visits[state] += 1;
+	}
+}
+
+#ifdef MAIN
+
+#include "dfa.h"
+
+int main(int argc, char* argv[]) {
+	printf("building DFA for strings containing \"end\"...\n");
+	DFA dfa = new_DFA(4);
+	for (int s=0; s < 3; s++) {
+		DFA_set_transition_all(dfa, s, 0);
+		DFA_set_transition(dfa, s, 'e', 1);
+	}
+	DFA_set_transition(dfa, 1, 'n', 2);
+	DFA_set_transition(dfa, 2, 'd', 3);
+	DFA_set_transition_all(dfa, 3, 3);
+	DFA_set_accepting(dfa, 3, true);
+
+	unsigned char classmap[DFA_NSYMBOLS];
+	int nclasses = DFA_get_classes(dfa, classmap);
+	Profile profile = new_Profile(DFA_get_size(dfa), classmap, nclasses);
+	// Another DFA run on the same thread meanwhile isn't counted
+	DFA other = new_DFA(1);
+	DFA_set_transition_all(other, 0, 0);
+	Profile_attach(profile, dfa);
+	char *inputs[] = { "the end", "ened", "weekend", "" };
+	for (int i=0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+		printf("\"%s\": %s\n", inputs[i], DFA_execute(dfa, inputs[i]) ? "true" : "false");
+		DFA_execute(other, "not counted either");
+	}
+	Profile_attach(NULL, NULL);
+	DFA_execute(dfa, "not counted");
+
+#ifdef DFA_PROFILE
+	printf("calls %lld, bytes %lld, early exits %lld, ignored calls %lld\n", Profile_get_calls(profile),
+	       Profile_get_bytes(profile), Profile_get_early_exits(profile), Profile_get_ignored(profile));
+	printf("state 1 visited %lld times, took 'n' %lld times\n",
+	       Profile_get_visits(profile, 1), Profile_get_transitions(profile, 1, 'n'));
+	Profile_write_json(profile, stdout);
+	Profile_write_csv(profile, stdout);
+#else
+	printf("engines compiled without DFA_PROFILE: calls %lld\n", Profile_get_calls(profile));
+#endif
+
+	Profile_free(profile);
+	DFA_free(other);
+	DFA_free(dfa);
+}
+
+#endif
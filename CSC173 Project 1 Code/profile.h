@@ -0,0 +1,125 @@
+/*
+ * File: profile.h
+ *
+ * Execution profiling for the automaton engines.
+ * A Profile counts, for one automaton, how often each state was visited,
+ * how many transitions were taken from each state on each symbol class,
+ * how many calls there were, the bytes they stepped over and skipped,
+ * how many stopped early (before the end of their input), and the time
+ * spent in them. Profiles are attached to a thread for one automaton, and
+ * the engines count into the calling thread's profile when they run that
+ * automaton, so there is no locking. Runs of any other automaton on the
+ * thread are only counted as ignored calls, so they can't get mixed in.
+ *
+ * The engines (DFA_run, NFARun_step, AhoCorasick_scan and _find, and
+ * JitDFA_run) only count when compiled with -DDFA_PROFILE ("make
+ * PROFILE=1"). Otherwise the PROFILE_ hooks below expand to nothing and
+ * the hot loops are exactly what they would be without them. Each engine
+ * counts under the object it was called with: the DFA, the NFA of the
+ * NFARun, the AhoCorasick, or the JitDFA.
+ * Skipped bytes are counted where the scanner's prefilter jumps ahead or
+ * it stops reading a decided line (under the Scanner), where
+ * StaticDFA_match exits early (under the StaticDFA), and where a JitDFA
+ * runs native code, which has no per-byte hooks.
+ */
+
+#ifndef _profile_h
+#define _profile_h
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define PROFILE_NSYMBOLS 256
+
+typedef struct Profile *Profile;
+
+/**
+ * Allocate and return a new Profile, with all counts zero, for an
+ * automaton with the given number of states whose input symbols fall into
+ * nclasses classes according to classmap. If classmap is NULL, each of
+ * the PROFILE_NSYMBOLS symbols is its own class. For a DFA, the classes
+ * from DFA_get_classes keep the per-class counts small.
+ */
+extern Profile new_Profile(int nstates, const unsigned char classmap[PROFILE_NSYMBOLS], int nclasses);
+
+/**
+ * Free the given Profile. It must not be attached to any thread.
+ */
+extern void Profile_free(Profile profile);
+
+/**
+ * Set all the counts of the given Profile back to zero.
+ */
+extern void Profile_reset(Profile profile);
+
+/**
+ * Make the given Profile the one the engines count into when they run the
+ * given automaton (a DFA, NFA, AhoCorasick, JitDFA, StaticDFA or Scanner)
+ * on the calling thread, or stop counting if profile is NULL.
+ */
+extern void Profile_attach(Profile profile, const void *automaton);
+
+/**
+ * Return the number of times the given state was visited: the bytes read
+ * while in it, plus the calls that ended in it.
+ */
+extern long long Profile_get_visits(Profile profile, int state);
+
+/**
+ * Return the number of transitions taken from the given state on symbols
+ * in the class of the given symbol.
+ */
+extern long long Profile_get_transitions(Profile profile, int state, char symbol);
+
+/**
+ * Return the number of calls, bytes stepped over, bytes skipped, early
+ * exits, or nanoseconds counted by the given Profile, or the number of
+ * calls it ignored because they ran some other automaton while it was
+ * attached.
+ */
+extern long long Profile_get_calls(Profile profile);
+extern long long Profile_get_bytes(Profile profile);
+extern long long Profile_get_skipped(Profile profile);
+extern long long Profile_get_early_exits(Profile profile);
+extern long long Profile_get_nanoseconds(Profile profile);
+extern long long Profile_get_ignored(Profile profile);
+
+/**
+ * Write the counts of the given Profile to the given stream as one JSON
+ * object. Only non-zero per-state and per-class counts are written.
+ */
+extern void Profile_write_json(Profile profile, FILE *out);
+
+/**
+ * Write the per-state counts of the given Profile to the given stream as
+ * CSV, one row per (state, class) with a non-zero transition count, and
+ * one row with an empty class for each visited state.
+ */
+extern void Profile_write_csv(Profile profile, FILE *out);
+
+/*
+ * Hooks called by the engines when compiled with DFA_PROFILE.
+ * Profile_begin returns the calling thread's Profile if it is attached
+ * for the given automaton, and NULL otherwise, and the hooks that take
+ * that result do nothing with NULL. PROFILE_BEGIN keeps it in a local,
+ * so the steps of one call all count into the same Profile (or none).
+ */
+extern Profile Profile_begin(const void *automaton, long long *start);
+extern void Profile_step(Profile profile, int state, unsigned char symbol);
+extern void Profile_skip(const void *automaton, long nbytes);
+extern void Profile_end(Profile profile, long long start, int state, long nbytes, bool early);
+
+#ifdef DFA_PROFILE
+#define PROFILE_BEGIN(automaton) long long profile_start_; \
+	Profile profile_ = Profile_begin(automaton, &profile_start_)
+#define PROFILE_STEP(state, symbol) Profile_step(profile_, state, symbol)
+#define PROFILE_SKIP(automaton, nbytes) Profile_skip(automaton, nbytes)
+#define PROFILE_END(state, nbytes, early) Profile_end(profile_, profile_start_, state, nbytes, early)
+#else
+#define PROFILE_BEGIN(automaton) ((void)0)
+#define PROFILE_STEP(state, symbol) ((void)0)
+#define PROFILE_SKIP(automaton, nbytes) ((void)0)
+#define PROFILE_END(state, nbytes, early) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,904 @@
+/*
+ * File: regexp.c
+ *
+ * Implementation of the regular expression compiler in regexp.h.
+ * The pattern is parsed into a tree whose leaves are sets of bytes, and
+ * each leaf (a "position") becomes a state of the NFA. A walk over the
+ * tree works out which positions can come first and last in the strings
+ * each subtree matches; wherever position q can follow position p (across
+ * a concatenation or around a loop) there are transitions from p to q on
+ * the bytes of q.
+ * Each group (parenthesized subpattern) also puts tags on the lists of
+ * first and last positions: entering a subtree's strings at a first
+ * position starts the groups inside it that contain that position, and
+ * leaving at a last position ends them. Skipping a subtree that matches
+ * the empty string starts and ends its groups in one place. A transition
+ * from p to q gets the tags of leaving at p and of entering at q, and
+ * when two transitions overlap the one made first is kept. The order the
+ * transitions are made in gives their priority: a loop is made before
+ * the way out of it and an alternative before the ones to its right, so
+ * the first thread to get through (see RegexpTags) makes the usual
+ * greedy, leftmost-alternative choices. There are no empty moves, so
+ * unlike Perl it never takes an iteration of a repeat that matches
+ * nothing: (a*)+ on "aa" leaves group 1 at 0,2, not 2,2.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "regexp.h"
+
+// Longest line of a rules file
+#define MAX_LINE 4096
+
+/**
+ * Largest count allowed in {m,n}.
+ */
+#define MAX_REPEAT 255
+
+typedef enum { RE_EMPTY, RE_BYTES, RE_CAT, RE_ALT, RE_STAR, RE_PLUS, RE_QUEST, RE_GROUP } NodeType;
+
+/**
+ * A node of the tree. Leaves (RE_BYTES) have a position, and the bytes
+ * they match are the position's entry in Parser.bytes. An RE_GROUP has
+ * the number of its group (counting open parentheses from 1).
+ */
+typedef struct Node {
+	NodeType type;
+	int left;
+	int right;
+	int position;
+	int group;
+} Node;
+
+typedef struct ByteSet {
+	unsigned char bits[NFA_NSYMBOLS / 8];
+} ByteSet;
+
+typedef struct Parser {
+	const char *p;
+	const char *error;
+	Node *nodes;
+	int nnodes;
+	int nodeCapacity;
+	ByteSet *bytes;		// Bytes matched by each position
+	int npositions;
+	int byteCapacity;
+	int ngroups;
+	// Transitions in the order they were made, if recording tags:
+	bool tagged;
+	int *edgeFrom;
+	int *edgeTo;
+	uint64_t *edgeTags;
+	int nedges;
+	int edgeCapacity;
+} Parser;
+
+/**
+ * A list of positions, each with the tags set on entering or leaving a
+ * subtree there. The lists for two different subtrees never share
+ * positions, so joining them needs no check for duplicates.
+ */
+typedef struct Positions {
+	int *items;
+	uint64_t *tags;
+	int count;
+} Positions;
+
+struct RegexpTags {
+	int ngroups;
+	int nstates;
+	int *edgeStart;		// Transitions from state s are edgeStart[s]..edgeStart[s+1]-1
+	int *edgeTo;
+	uint64_t *edgeTags;
+	uint64_t *finals;	// Per state
+};
+
+static int parse_alt(Parser *this);
+
+static void ByteSet_add(ByteSet *set, int b) {
+	set->bits[b / 8] |= 1 << (b % 8);
+}
+
+static bool ByteSet_has(const ByteSet *set, int b) {
+	return (set->bits[b / 8] >> (b % 8)) & 1;
+}
+
+static void ByteSet_add_range(ByteSet *set, int lo, int hi) {
+	for (int b=lo; b <= hi; b++) {
+		ByteSet_add(set, b);
+	}
+}
+
+static void ByteSet_add_all(ByteSet *set, const ByteSet *other, bool negate) {
+	for (int i=0; i < NFA_NSYMBOLS / 8; i++) {
+		set->bits[i] |= negate ? ~other->bits[i] : other->bits[i];
+	}
+}
+
+static int new_node(Parser *this, NodeType type, int left, int right) {
+	if (this->nnodes == this->nodeCapacity) {
+		this->nodeCapacity = (this->nodeCapacity == 0) ? 32 : 2 * this->nodeCapacity;
+		this->nodes = (Node*)realloc(this->nodes, sizeof(Node) * this->nodeCapacity);
+	}
+	Node *node = &this->nodes[this->nnodes];
+	node->type = type;
+	node->left = left;
+	node->right = right;
+	node->position = -1;
+	node->group = 0;
+	return this->nnodes++;
+}
+
+/**
+ * Return a new leaf matching the given bytes.
+ */
+static int new_leaf(Parser *this, const ByteSet *bytes) {
+	if (this->npositions == this->byteCapacity) {
+		this->byteCapacity = (this->byteCapacity == 0) ? 32 : 2 * this->byteCapacity;
+		this->bytes = (ByteSet*)realloc(this->bytes, sizeof(ByteSet) * this->byteCapacity);
+	}
+	this->bytes[this->npositions] = *bytes;
+	int node = new_node(this, RE_BYTES, -1, -1);
+	this->nodes[node].position = this->npositions++;
+	return node;
+}
+
+/**
+ * Return a copy of the given subtree with new positions, so that it can
+ * be repeated.
+ */
+static int copy_node(Parser *this, int node) {
+	Node n = this->nodes[node];
+	if (n.type == RE_BYTES) {
+		ByteSet bytes = this->bytes[n.position];
+		return new_leaf(this, &bytes);
+	}
+	int left = (n.left >= 0) ? copy_node(this, n.left) : -1;
+	int right = (n.right >= 0) ? copy_node(this, n.right) : -1;
+	int copy = new_node(this, n.type, left, right);
+	this->nodes[copy].group = n.group;
+	return copy;
+}
+
+/**
+ * Set this->error and return -1, so callers can return fail(...).
+ */
+static int fail(Parser *this, const char *message) {
+	if (this->error == NULL) {
+		this->error = message;
+	}
+	return -1;
+}
+
+static int hex_digit(int c) {
+	if (isdigit(c)) {
+		return c - '0';
+	} else if (isxdigit(c)) {
+		return tolower(c) - 'a' + 10;
+	}
+	return -1;
+}
+
+/**
+ * Parse the escape after a backslash (this->p is just past it), adding
+ * the bytes it matches to set. Returns the single byte it stands for, or
+ * -1 if it stands for a set like \d, or -2 on error.
+ */
+static int parse_escape(Parser *this, ByteSet *set) {
+	int c = (unsigned char)*this->p;
+	if (c == '\0') {
+		fail(this, "trailing backslash");
+		return -2;
+	}
+	this->p += 1;
+	if (c == 'C') {
+		ByteSet_add_range(set, 0, NFA_NSYMBOLS - 1);
+		return -1;
+	}
+	ByteSet shorthand;
+	memset(&shorthand, 0, sizeof(shorthand));
+	switch (tolower(c)) {
+	case 'd':
+		ByteSet_add_range(&shorthand, '0', '9');
+		break;
+	case 'w':
+		ByteSet_add_range(&shorthand, '0', '9');
+		ByteSet_add_range(&shorthand, 'a', 'z');
+		ByteSet_add_range(&shorthand, 'A', 'Z');
+		ByteSet_add(&shorthand, '_');
+		break;
+	case 's':
+		ByteSet_add_range(&shorthand, '\t', '\r');
+		ByteSet_add(&shorthand, ' ');
+		break;
+	default:
+		if (c == 'n') {
+			c = '\n';
+		} else if (c == 't') {
+			c = '\t';
+		} else if (c == 'r') {
+			c = '\r';
+		} else if (c == 'x') {
+			int hi = hex_digit((unsigned char)this->p[0]);
+			int lo = (hi >= 0) ? hex_digit((unsigned char)this->p[1]) : -1;
+			if (lo < 0) {
+				fail(this, "\\x needs two hex digits");
+				return -2;
+			}
+			this->p += 2;
+			c = hi * 16 + lo;
+		} else if (isalnum(c)) {
+			fail(this, "unknown escape");
+			return -2;
+		}
+		ByteSet_add(set, c);
+		return c;
+	}
+	ByteSet_add_all(set, &shorthand, isupper(c));
+	return -1;
+}
+
+/**
+ * Parse a bracket expression (this->p is just past the '[').
+ */
+static int parse_class(Parser *this) {
+	ByteSet set;
+	memset(&set, 0, sizeof(set));
+	bool negate = (*this->p == '^');
+	if (negate) {
+		this->p += 1;
+	}
+	bool first = true;
+	while (*this->p != ']' || first) {
+		int lo = (unsigned char)*this->p;
+		if (lo == '\0') {
+			return fail(this, "missing ]");
+		}
+		this->p += 1;
+		if (lo == '\\') {
+			lo = parse_escape(this, &set);
+			if (lo == -2) {
+				return -1;
+			}
+		} else {
+			ByteSet_add(&set, lo);
+		}
+		first = false;
+		if (lo < 0 || this->p[0] != '-' || this->p[1] == ']' || this->p[1] == '\0') {
+			continue;
+		}
+		this->p += 1;
+		int hi = (unsigned char)*this->p++;
+		if (hi == '\\') {
+			ByteSet ignored;
+			hi = parse_escape(this, &ignored);
+			if (hi == -2) {
+				return -1;
+			} else if (hi == -1) {
+				return fail(this, "range ends in a set");
+			}
+		}
+		if (hi < lo) {
+			return fail(this, "range out of order");
+		}
+		ByteSet_add_range(&set, lo, hi);
+	}
+	this->p += 1;
+	if (negate) {
+		ByteSet all;
+		memset(&all, 0, sizeof(all));
+		ByteSet_add_all(&all, &set, true);
+		set = all;
+	}
+	return new_leaf(this, &set);
+}
+
+/**
+ * Parse a single character, escape, class, '.' or parenthesized pattern.
+ */
+static int parse_atom(Parser *this) {
+	ByteSet set;
+	memset(&set, 0, sizeof(set));
+	int c = (unsigned char)*this->p++;
+	switch (c) {
+	case '(': {
+		int group = ++this->ngroups;
+		int node = parse_alt(this);
+		if (node < 0) {
+			return -1;
+		} else if (*this->p != ')') {
+			return fail(this, "missing )");
+		}
+		this->p += 1;
+		node = new_node(this, RE_GROUP, node, -1);
+		this->nodes[node].group = group;
+		return node;
+	}
+	case '[':
+		return parse_class(this);
+	case '.':
+		ByteSet_add_range(&set, 0, NFA_NSYMBOLS - 1);
+		set.bits['\n' / 8] &= ~(1 << ('\n' % 8));
+		return new_leaf(this, &set);
+	case '\\':
+		if (parse_escape(this, &set) == -2) {
+			return -1;
+		}
+		return new_leaf(this, &set);
+	case '*': case '+': case '?': case '{':
+		return fail(this, "nothing to repeat");
+	case '^': case '$':
+		return fail(this, "^ and $ aren't supported (patterns match whole strings)");
+	case ')': case ']': case '}':
+		return fail(this, "unmatched bracket");
+	default:
+		ByteSet_add(&set, c);
+		return new_leaf(this, &set);
+	}
+}
+
+/**
+ * Parse a decimal count for {m,n} and return it, or -1 if there isn't one.
+ */
+static int parse_count(Parser *this) {
+	if (!isdigit((unsigned char)*this->p)) {
+		return -1;
+	}
+	int n = 0;
+	while (isdigit((unsigned char)*this->p)) {
+		n = n * 10 + (*this->p++ - '0');
+		if (n > MAX_REPEAT) {
+			return MAX_REPEAT + 1;
+		}
+	}
+	return n;
+}
+
+/**
+ * Return a tree matching min to max (-1 for no limit) copies of node,
+ * built from copies of it.
+ */
+static int repeat(Parser *this, int node, int min, int max) {
+	int result = -1;
+	for (int i=0; i < min; i++) {
+		int copy = (i == 0) ? node : copy_node(this, node);
+		result = (result < 0) ? copy : new_node(this, RE_CAT, result, copy);
+	}
+	if (max < 0) {
+		int copy = (min == 0) ? node : copy_node(this, node);
+		int loop = new_node(this, RE_STAR, copy, -1);
+		return (result < 0) ? loop : new_node(this, RE_CAT, result, loop);
+	}
+	for (int i=min; i < max; i++) {
+		int copy = (i == 0) ? node : copy_node(this, node);
+		int optional = new_node(this, RE_QUEST, copy, -1);
+		result = (result < 0) ? optional : new_node(this, RE_CAT, result, optional);
+	}
+	return (result < 0) ? new_node(this, RE_EMPTY, -1, -1) : result;
+}
+
+/**
+ * Parse an atom followed by any number of repetition operators.
+ */
+static int parse_repeat(Parser *this) {
+	int node = parse_atom(this);
+	while (node >= 0) {
+		char c = *this->p;
+		if (c == '*' || c == '+' || c == '?') {
+			this->p += 1;
+			node = new_node(this, c == '*' ? RE_STAR : c == '+' ? RE_PLUS : RE_QUEST, node, -1);
+		} else if (c == '{') {
+			this->p += 1;
+			int min = parse_count(this);
+			int max = min;
+			if (*this->p == ',') {
+				this->p += 1;
+				max = parse_count(this);
+			}
+			if (min < 0 || *this->p != '}') {
+				return fail(this, "bad {m,n}");
+			} else if (min > MAX_REPEAT || max > MAX_REPEAT) {
+				return fail(this, "count in {m,n} too large");
+			} else if (max >= 0 && max < min) {
+				return fail(this, "{m,n} with n less than m");
+			}
+			this->p += 1;
+			node = repeat(this, node, min, max);
+		} else {
+			break;
+		}
+	}
+	return node;
+}
+
+/**
+ * Parse a sequence of repeated atoms, up to '|', ')' or the end.
+ */
+static int parse_cat(Parser *this) {
+	int node = -1;
+	while (*this->p != '\0' && *this->p != '|' && *this->p != ')') {
+		int next = parse_repeat(this);
+		if (next < 0) {
+			return -1;
+		}
+		node = (node < 0) ? next : new_node(this, RE_CAT, node, next);
+	}
+	return (node < 0) ? new_node(this, RE_EMPTY, -1, -1) : node;
+}
+
+/**
+ * Parse alternatives separated by '|'.
+ */
+static int parse_alt(Parser *this) {
+	int node = parse_cat(this);
+	while (node >= 0 && *this->p == '|') {
+		this->p += 1;
+		int next = parse_cat(this);
+		node = (next < 0) ? -1 : new_node(this, RE_ALT, node, next);
+	}
+	return node;
+}
+
+static Positions join(Positions a, Positions b) {
+	Positions result;
+	result.count = a.count + b.count;
+	int n = (result.count > 0) ? result.count : 1;
+	result.items = (int*)malloc(sizeof(int) * n);
+	result.tags = (uint64_t*)malloc(sizeof(uint64_t) * n);
+	if (a.count > 0) {
+		memcpy(result.items, a.items, sizeof(int) * a.count);
+		memcpy(result.tags, a.tags, sizeof(uint64_t) * a.count);
+	}
+	if (b.count > 0) {
+		memcpy(result.items + a.count, b.items, sizeof(int) * b.count);
+		memcpy(result.tags + a.count, b.tags, sizeof(uint64_t) * b.count);
+	}
+	return result;
+}
+
+static Positions copy_positions(Positions a) {
+	Positions none = { NULL, NULL, 0 };
+	return join(a, none);
+}
+
+static void free_positions(Positions a) {
+	free(a.items);
+	free(a.tags);
+}
+
+/**
+ * Add the given tags to every position of the list.
+ */
+static void add_tags(Positions a, uint64_t tags) {
+	for (int i=0; i < a.count; i++) {
+		a.tags[i] |= tags;
+	}
+}
+
+/**
+ * Return the tag for the start (or end) of the given group, or 0 if it is
+ * past REGEXP_MAX_GROUPS.
+ */
+static uint64_t group_tag(int group, bool end) {
+	if (group > REGEXP_MAX_GROUPS) {
+		return 0;
+	}
+	return 1ULL << (2 * (group - 1) + (end ? 1 : 0));
+}
+
+/**
+ * Add transitions from each state in from to each state in to, on the
+ * bytes of the target. Position p is state p+1 of the NFA.
+ */
+static void connect(Parser *this, NFA nfa, Positions from, Positions to) {
+	for (int j=0; j < to.count; j++) {
+		const ByteSet *bytes = &this->bytes[to.items[j]];
+		for (int b=0; b < NFA_NSYMBOLS; b++) {
+			if (!ByteSet_has(bytes, b)) {
+				continue;
+			}
+			for (int i=0; i < from.count; i++) {
+				NFA_add_transition(nfa, from.items[i] + 1, (char)b, to.items[j] + 1);
+			}
+		}
+	}
+	if (!this->tagged) {
+		return;
+	}
+	for (int i=0; i < from.count; i++) {
+		for (int j=0; j < to.count; j++) {
+			if (this->nedges == this->edgeCapacity) {
+				this->edgeCapacity = (this->edgeCapacity == 0) ? 64 : 2 * this->edgeCapacity;
+				this->edgeFrom = (int*)realloc(this->edgeFrom, sizeof(int) * this->edgeCapacity);
+				this->edgeTo = (int*)realloc(this->edgeTo, sizeof(int) * this->edgeCapacity);
+				this->edgeTags = (uint64_t*)realloc(this->edgeTags, sizeof(uint64_t) * this->edgeCapacity);
+			}
+			this->edgeFrom[this->nedges] = from.items[i] + 1;
+			this->edgeTo[this->nedges] = to.items[j] + 1;
+			this->edgeTags[this->nedges] = from.tags[i] | to.tags[j];
+			this->nedges += 1;
+		}
+	}
+}
+
+/**
+ * Work out whether the given subtree matches the empty string, and the
+ * positions that can start and end its strings, adding the transitions
+ * between positions inside it to nfa. If it matches the empty string,
+ * *empty is set to the tags of doing so. The caller frees first and last.
+ */
+static bool glushkov(Parser *this, NFA nfa, int node, Positions *first, Positions *last, uint64_t *empty) {
+	Node n = this->nodes[node];
+	Positions none = { NULL, NULL, 0 };
+	Positions lf, ll, rf, rl;
+	uint64_t le, re;
+	bool lnull, rnull;
+	*empty = 0;
+	switch (n.type) {
+	case RE_EMPTY:
+		*first = copy_positions(none);
+		*last = copy_positions(none);
+		return true;
+	case RE_BYTES:
+		*first = copy_positions((Positions){ &n.position, &(uint64_t){ 0 }, 1 });
+		*last = copy_positions((Positions){ &n.position, &(uint64_t){ 0 }, 1 });
+		return false;
+	case RE_GROUP:
+		lnull = glushkov(this, nfa, n.left, first, last, &le);
+		add_tags(*first, group_tag(n.group, false));
+		add_tags(*last, group_tag(n.group, true));
+		*empty = le | group_tag(n.group, false) | group_tag(n.group, true);
+		return lnull;
+	case RE_CAT:
+		lnull = glushkov(this, nfa, n.left, &lf, &ll, &le);
+		rnull = glushkov(this, nfa, n.right, &rf, &rl, &re);
+		connect(this, nfa, ll, rf);
+		if (lnull) {
+			add_tags(rf, le);
+		}
+		if (rnull) {
+			add_tags(ll, re);
+		}
+		*first = lnull ? join(lf, rf) : copy_positions(lf);
+		*last = rnull ? join(ll, rl) : copy_positions(rl);
+		*empty = le | re;
+		break;
+	case RE_ALT:
+		lnull = glushkov(this, nfa, n.left, &lf, &ll, &le);
+		rnull = glushkov(this, nfa, n.right, &rf, &rl, &re);
+		*first = join(lf, rf);
+		*last = join(ll, rl);
+		*empty = lnull ? le : re;
+		free_positions(lf);
+		free_positions(ll);
+		free_positions(rf);
+		free_positions(rl);
+		return lnull || rnull;
+	default:	// RE_STAR, RE_PLUS, RE_QUEST
+		lnull = glushkov(this, nfa, n.left, first, last, &le);
+		if (n.type != RE_QUEST) {
+			connect(this, nfa, *last, *first);
+		}
+		*empty = lnull ? le : 0;
+		return lnull || n.type != RE_PLUS;
+	}
+	free_positions(lf);
+	free_positions(ll);
+	free_positions(rf);
+	free_positions(rl);
+	return lnull && rnull;
+}
+
+/**
+ * Return the transitions recorded by the given parser, in priority order
+ * for each state and without duplicates, as RegexpTags for an NFA of
+ * nstates states.
+ */
+static RegexpTags new_RegexpTags(Parser *this, int nstates) {
+	RegexpTags tags = (RegexpTags)malloc(sizeof(struct RegexpTags));
+	tags->ngroups = this->ngroups;
+	tags->nstates = nstates;
+	tags->edgeStart = (int*)calloc(nstates + 1, sizeof(int));
+	tags->edgeTo = (int*)malloc(sizeof(int) * (this->nedges > 0 ? this->nedges : 1));
+	tags->edgeTags = (uint64_t*)malloc(sizeof(uint64_t) * (this->nedges > 0 ? this->nedges : 1));
+	tags->finals = (uint64_t*)calloc(nstates, sizeof(uint64_t));
+	for (int i=0; i < this->nedges; i++) {
+		tags->edgeStart[this->edgeFrom[i] + 1] += 1;
+	}
+	for (int s=0; s < nstates; s++) {
+		tags->edgeStart[s + 1] += tags->edgeStart[s];
+	}
+	// Place each state's transitions in order, dropping repeats of a target
+	int *fill = (int*)malloc(sizeof(int) * (nstates + 1));
+	memcpy(fill, tags->edgeStart, sizeof(int) * (nstates + 1));
+	for (int i=0; i < this->nedges; i++) {
+		int from = this->edgeFrom[i];
+		int to = this->edgeTo[i];
+		int j;
+		for (j=tags->edgeStart[from]; j < fill[from] && tags->edgeTo[j] != to; j++) {
+		}
+		if (j == fill[from]) {
+			tags->edgeTo[j] = to;
+			tags->edgeTags[j] = this->edgeTags[i];
+			fill[from] += 1;
+		}
+	}
+	// Close up the gaps left by the repeats
+	int n = 0;
+	for (int s=0; s < nstates; s++) {
+		int start = tags->edgeStart[s];
+		tags->edgeStart[s] = n;
+		for (int j=start; j < fill[s]; j++) {
+			tags->edgeTo[n] = tags->edgeTo[j];
+			tags->edgeTags[n] = tags->edgeTags[j];
+			n += 1;
+		}
+	}
+	tags->edgeStart[nstates] = n;
+	free(fill);
+	return tags;
+}
+
+/**
+ * Compile the given pattern as regexp_compile does, and also return its
+ * tags through tags if it isn't NULL.
+ */
+static NFA compile(const char *pattern, const char **error, RegexpTags *tags) {
+	Parser parser;
+	memset(&parser, 0, sizeof(parser));
+	parser.p = pattern;
+	parser.tagged = (tags != NULL);
+	int root = parse_alt(&parser);
+	if (root >= 0 && *parser.p != '\0') {
+		root = fail(&parser, "unmatched )");
+	}
+	if (root >= 0 && tags != NULL && parser.ngroups > REGEXP_MAX_GROUPS) {
+		root = fail(&parser, "too many groups");
+	}
+	NFA nfa = NULL;
+	if (root >= 0) {
+		nfa = new_NFA(parser.npositions + 1);
+		Positions first, last;
+		uint64_t empty;
+		bool nullable = glushkov(&parser, nfa, root, &first, &last, &empty);
+		Positions start = { (int[]){ -1 }, (uint64_t[]){ 0 }, 1 };
+		connect(&parser, nfa, start, first);
+		for (int i=0; i < last.count; i++) {
+			NFA_set_accepting(nfa, last.items[i] + 1, true);
+		}
+		NFA_set_accepting(nfa, 0, nullable);
+		if (tags != NULL) {
+			*tags = new_RegexpTags(&parser, parser.npositions + 1);
+			for (int i=0; i < last.count; i++) {
+				(*tags)->finals[last.items[i] + 1] = last.tags[i];
+			}
+			(*tags)->finals[0] = nullable ? empty : 0;
+		}
+		free_positions(first);
+		free_positions(last);
+	} else if (error != NULL) {
+		*error = parser.error;
+	}
+	free(parser.nodes);
+	free(parser.bytes);
+	free(parser.edgeFrom);
+	free(parser.edgeTo);
+	free(parser.edgeTags);
+	return nfa;
+}
+
+/**
+ * Return a new NFA accepting exactly the strings matched by the given
+ * regular expression, or NULL if it has a syntax error.
+ */
+NFA regexp_compile(const char *pattern, const char **error) {
+	return compile(pattern, error, NULL);
+}
+
+/**
+ * Return a new NFA for the given regular expression as regexp_compile
+ * does, and set *tags to where its groups start and end.
+ */
+NFA regexp_compile_tagged(const char *pattern, const char **error, RegexpTags *tags) {
+	*tags = NULL;
+	return compile(pattern, error, tags);
+}
+
+/**
+ * Free the given RegexpTags.
+ */
+void RegexpTags_free(RegexpTags this) {
+	if (this == NULL) {
+		return;
+	}
+	free(this->edgeStart);
+	free(this->edgeTo);
+	free(this->edgeTags);
+	free(this->finals);
+	free(this);
+}
+
+/**
+ * Return the number of groups in the pattern of the given RegexpTags.
+ */
+int RegexpTags_get_groups(RegexpTags this) {
+	return this->ngroups;
+}
+
+/**
+ * Return the number of transitions out of the given state.
+ */
+int RegexpTags_get_edges(RegexpTags this, int state) {
+	return this->edgeStart[state + 1] - this->edgeStart[state];
+}
+
+/**
+ * Return the target of the i'th transition out of the given state, and
+ * set *tags to the tags it sets.
+ */
+int RegexpTags_get_edge(RegexpTags this, int state, int i, uint64_t *tags) {
+	int j = this->edgeStart[state] + i;
+	*tags = this->edgeTags[j];
+	return this->edgeTo[j];
+}
+
+/**
+ * Return the tags set when the input ends in the given state.
+ */
+uint64_t RegexpTags_get_final(RegexpTags this, int state) {
+	return this->finals[state];
+}
+
+/**
+ * Read the rules in the file at the given path, or return NULL having
+ * printed what's wrong with it to errors.
+ */
+RegexpRule *regexp_read_rules(const char *path, int *n, FILE *errors) {
+	FILE *in = fopen(path, "r");
+	if (in == NULL) {
+		if (errors != NULL) {
+			fprintf(errors, "%s: %s\n", path, strerror(errno));
+		}
+		return NULL;
+	}
+	int capacity = 16, count = 0, lineno = 0;
+	bool ok = true;
+	RegexpRule *rules = (RegexpRule*)malloc(sizeof(RegexpRule) * capacity);
+	char line[MAX_LINE];
+	while (fgets(line, sizeof(line), in) != NULL) {
+		lineno += 1;
+		line[strcspn(line, "\r\n")] = '\0';
+		char *p = line;
+		while (isspace((unsigned char)*p)) {
+			p += 1;
+		}
+		if (*p == '\0' || *p == '#') {
+			continue;
+		}
+		char *name = p;
+		while (isalnum((unsigned char)*p) || *p == '_') {
+			p += 1;
+		}
+		if (p == name || isdigit((unsigned char)*name) || !isspace((unsigned char)*p)) {
+			if (errors != NULL) {
+				fprintf(errors, "%s:%d: expected a name (a C identifier) and a pattern\n", path, lineno);
+			}
+			ok = false;
+			continue;
+		}
+		*p++ = '\0';
+		while (isspace((unsigned char)*p)) {
+			p += 1;
+		}
+		const char *error;
+		NFA nfa = regexp_compile(p, &error);
+		if (nfa == NULL) {
+			if (errors != NULL) {
+				fprintf(errors, "%s:%d: %s\n", path, lineno, error);
+			}
+			ok = false;
+			continue;
+		}
+		if (count == capacity) {
+			capacity *= 2;
+			rules = (RegexpRule*)realloc(rules, sizeof(RegexpRule) * capacity);
+		}
+		rules[count].name = (char*)malloc(strlen(name) + 1);
+		strcpy(rules[count].name, name);
+		rules[count].pattern = (char*)malloc(strlen(p) + 1);
+		strcpy(rules[count].pattern, p);
+		rules[count].nfa = nfa;
+		count += 1;
+	}
+	fclose(in);
+	if (!ok) {
+		regexp_free_rules(rules, count);
+		return NULL;
+	}
+	*n = count;
+	return rules;
+}
+
+/**
+ * Free the given array of n rules and their NFAs.
+ */
+void regexp_free_rules(RegexpRule *rules, int n) {
+	for (int i=0; i < n; i++) {
+		free(rules[i].name);
+		free(rules[i].pattern);
+		NFA_free(rules[i].nfa);
+	}
+	free(rules);
+}
+
+#ifdef MAIN
+
+#include <stdio.h>
+
+/**
+ * Check the given pattern against inputs that should (yes) and shouldn't
+ * (no) match it, printing any that don't come out as expected.
+ */
+static void test(const char *pattern, char **yes, char **no) {
+	const char *error = NULL;
+	NFA nfa = regexp_compile(pattern, &error);
+	if (nfa == NULL) {
+		printf("%-24s error: %s\n", pattern, error);
+		return;
+	}
+	int failures = 0;
+	for (int i=0; yes[i] != NULL; i++) {
+		if (!NFA_execute(nfa, yes[i])) {
+			printf("  should match \"%s\"\n", yes[i]);
+			failures += 1;
+		}
+	}
+	for (int i=0; no[i] != NULL; i++) {
+		if (NFA_execute(nfa, no[i])) {
+			printf("  shouldn't match \"%s\"\n", no[i]);
+			failures += 1;
+		}
+	}
+	printf("%-24s %d states, %d failures\n", pattern, NFA_get_size(nfa), failures);
+	NFA_free(nfa);
+}
+
+#define LIST(...) (char*[]){ __VA_ARGS__, NULL }
+
+int main(int argc, char* argv[]) {
+	test("CSC", LIST("CSC"), LIST("CS", "CSCC", ""));
+	test(".*at", LIST("at", "cat", "that"), LIST("attic", "a", ""));
+	test(".*got.*", LIST("got", "I got it", "gogot"), LIST("goat", "go t"));
+	test("(0|1)*", LIST("", "0110"), LIST("012"));
+	test("a(b|c)*d?", LIST("a", "abcbd", "ad"), LIST("abdd", "b"));
+	test("[a-c]+[^a-c]", LIST("abcx", "a-"), LIST("abc", "xa"));
+	test("[]a-]*", LIST("]", "a-]", ""), LIST("b"));
+	test("\\d{3}-\\d{4}", LIST("555-1234"), LIST("55-1234", "555-12345"));
+	test("x{2,}y{0,2}", LIST("xx", "xxxxyy"), LIST("x", "xxyyy"));
+	test("(ab){1,3}", LIST("ab", "ababab"), LIST("", "abababab"));
+	test("\\w+\\s\\W", LIST("hi\t!", "a_1 ."), LIST("hi !!", "hi a"));
+	test("\\x41\\.\\*", LIST("A.*"), LIST("AB*"));
+	test("a||b|", LIST("a", "b", ""), LIST("ab"));
+	test("(a*)*b", LIST("b", "aab"), LIST("a"));
+	test("\\C*at", LIST("at", "c\nat"), LIST("a\nt", "ta"));
+
+	printf("testing syntax errors...\n");
+	char *bad[] = { "(ab", "ab)", "[ab", "*a", "a{3,2}", "a{256}", "a\\", "^a", "[z-a]", "\\q", NULL };
+	for (int i=0; bad[i] != NULL; i++) {
+		test(bad[i], LIST(NULL), LIST(NULL));
+	}
+
+	printf("reading rules.txt...\n");
+	int n;
+	RegexpRule *rules = regexp_read_rules("rules.txt", &n, stdout);
+	if (rules != NULL) {
+		for (int i=0; i < n; i++) {
+			printf("%-24s %d states\n", rules[i].name, NFA_get_size(rules[i].nfa));
+		}
+		regexp_free_rules(rules, n);
+	}
+}
+
+#endif
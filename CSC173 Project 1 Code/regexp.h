@@ -0,0 +1,117 @@
+/*
+ * File: regexp.h
+ *
+ * Compiling regular expressions into NFAs, so rules can be written as
+ * patterns rather than built a transition at a time.
+ * The syntax is the usual one:
+ *   - Any character other than the special ones .[]()|*+?{}\^$ matches
+ *     itself
+ *   - . matches any byte except newline
+ *   - [abc], [a-z] and [^...] match one byte in (or not in) a set
+ *   - \C matches any byte, newline included
+ *   - \d \w \s (and \D \W \S) match digits, word characters and spaces;
+ *     \n \t \r and \xHH match those bytes; \ before anything else matches
+ *     that character
+ *   - Concatenation, | for alternatives, and ( ) for grouping (and
+ *     capturing, see regexp_compile_tagged)
+ *   - * + ? {m} {m,} and {m,n} for repetition (counts up to 255)
+ * A pattern matches whole strings: the caller decides what a pattern
+ * "occurring in" a string means (see scan.h), so ^ and $ are errors.
+ * The NFA is the position (Glushkov) automaton of the pattern: one state
+ * per symbol set in the pattern plus the start state, and no epsilon
+ * transitions, so it can be run or determinized as it is.
+ */
+
+#ifndef _regexp_h
+#define _regexp_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include "nfa.h"
+
+/**
+ * The most groups a pattern can have for regexp_compile_tagged.
+ */
+#define REGEXP_MAX_GROUPS 32
+
+/**
+ * Where the groups of a pattern start and end in its NFA. Group g
+ * (numbered from 1 by its open parenthesis) has tag 2(g-1), set where
+ * the group starts, and tag 2(g-1)+1, set where it ends; a set of tags is
+ * a bit mask. Every transition from one state to another sets the same
+ * tags whatever the byte, and the transitions out of a state are in
+ * priority order: if threads running the NFA keep only the first one to
+ * reach each state, in that order, the first to accept at the end has
+ * made the usual greedy, leftmost-alternative choices, except that it
+ * never takes an iteration of a repeat that matches nothing. A tag a
+ * thread never sets (in a group it didn't go through) is unset.
+ */
+typedef struct RegexpTags *RegexpTags;
+
+/**
+ * Return a new NFA accepting exactly the strings matched by the given
+ * regular expression, or NULL if it has a syntax error. In that case, if
+ * error is not NULL, *error is set to a message describing the problem.
+ */
+extern NFA regexp_compile(const char *pattern, const char **error);
+
+/**
+ * Return a new NFA as regexp_compile does, and set *tags to where its
+ * groups start and end (or NULL if there is an error, which includes
+ * having more than REGEXP_MAX_GROUPS groups). The NFA must not be changed
+ * or reduced, since the tags are for its states.
+ */
+extern NFA regexp_compile_tagged(const char *pattern, const char **error, RegexpTags *tags);
+
+/**
+ * Free the given RegexpTags.
+ */
+extern void RegexpTags_free(RegexpTags tags);
+
+/**
+ * Return the number of groups in the pattern.
+ */
+extern int RegexpTags_get_groups(RegexpTags tags);
+
+/**
+ * Return the number of transitions out of the given state (to distinct
+ * states; each is taken on the bytes its NFA transitions say).
+ */
+extern int RegexpTags_get_edges(RegexpTags tags, int state);
+
+/**
+ * Return the state the i'th transition out of the given state goes to,
+ * in priority order, and set *set to the tags it sets.
+ */
+extern int RegexpTags_get_edge(RegexpTags tags, int state, int i, uint64_t *set);
+
+/**
+ * Return the tags set when the input ends in the given (accepting) state.
+ */
+extern uint64_t RegexpTags_get_final(RegexpTags tags, int state);
+
+/**
+ * A named regular expression from a file of rules.
+ */
+typedef struct RegexpRule {
+	char *name;
+	char *pattern;
+	NFA nfa;		// The pattern, compiled
+} RegexpRule;
+
+/**
+ * Read the rules in the file at the given path: every line that isn't
+ * blank or a comment (starting with #) is a name, which must be a C
+ * identifier, then white space and a regular expression. Return a newly
+ * allocated array of the rules, in order, and set *n to how many there
+ * are; or, if the file can't be read or any line is bad, print every
+ * problem to errors (if it isn't NULL) and return NULL.
+ */
+extern RegexpRule *regexp_read_rules(const char *path, int *n, FILE *errors);
+
+/**
+ * Free the given array of n rules and their NFAs.
+ */
+extern void regexp_free_rules(RegexpRule *rules, int n);
+
+#endif
@@ -0,0 +1,643 @@
+/*
+ * File: scan.c
+ *
+ * Implementation of the file scanner in scan.h.
+ * The DFA is copied into a table over its symbol classes, with newline
+ * in a class of its own that goes back to the start state, so the whole
+ * file is one pass of the DFA with no stop at each line. Two extra states
+ * stand for a newline ending a line that matches (with SCAN_WHOLE_LINE)
+ * and for a line that can't match any more: DFA_NO_STATE and states that
+ * can't reach an accepting state before the end of the line go there.
+ * States that decide the line are numbered last, so the inner loop is a
+ * table lookup per byte and a comparison every few bytes. Only when a
+ * line is decided are its ends found, with memchr (vectorized in the C
+ * library) skipping to its end, and lines are counted only if printed.
+ * When every matching line must contain one of a few literals (see
+ * Prefilter.h), the DFA runs only on the lines where the search finds
+ * one, and the text in between is skipped.
+ * Big files are mapped with mmap; small ones are read into a buffer.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "scan.h"
+#include "Prefilter.h"
+#include "profile.h"
+
+/**
+ * Files at least this big are mapped rather than read.
+ */
+#define MMAP_THRESHOLD (1 << 20)
+
+/**
+ * A file with a NUL in this many bytes at its start counts as binary.
+ */
+#define BINARY_CHECK 4096
+
+/**
+ * What entering a state means for the current line.
+ */
+#define STOP_NONE 0	// Keep going
+#define STOP_MATCH 1	// The line matches
+#define STOP_DEAD 2	// The line doesn't match
+#define STOP_LINE_MATCH 3	// End of a line that matches
+
+struct Scanner {
+	int options;
+	FILE *out;
+	unsigned char classmap[DFA_NSYMBOLS];
+	int nclasses;
+	int *next;		// nstates+2 rows of nclasses
+	int start;		// Row offset of the start state
+	int firstStop;		// Row offsets from here on have stop codes
+	unsigned char *stop;	// Stop code for each state
+	bool *accepting;	// For a last line with no newline
+	Prefilter prefilter;	// NULL to run the DFA over everything
+	atomic_long files;
+	atomic_long bytes;
+	atomic_long matches;
+};
+
+/**
+ * Text to be printed for one file.
+ */
+typedef struct Output {
+	char *data;
+	size_t length;
+	size_t capacity;
+} Output;
+
+static void Output_append(Output *this, const char *data, size_t n) {
+	if (this->length + n > this->capacity) {
+		this->capacity = (this->capacity == 0) ? 4096 : this->capacity;
+		while (this->length + n > this->capacity) {
+			this->capacity *= 2;
+		}
+		this->data = (char*)realloc(this->data, this->capacity);
+	}
+	memcpy(this->data + this->length, data, n);
+	this->length += n;
+}
+
+/**
+ * Store in live which states of the given DFA can reach an accepting
+ * state without reading a newline, searching backward from the
+ * accepting states.
+ */
+static void find_live(DFA dfa, const unsigned char *classmap, int k, int newline, bool *live) {
+	int n = DFA_get_size(dfa);
+	int rep[DFA_NSYMBOLS];
+	for (int sym=DFA_NSYMBOLS-1; sym >= 0; sym--) {
+		rep[classmap[sym]] = sym;
+	}
+	// Predecessors of t are pred[predStart[t]..predStart[t+1])
+	int *predStart = (int*)calloc(n + 1, sizeof(int));
+	int *dsts = (int*)malloc(sizeof(int) * n * k);
+	for (int s=0; s < n; s++) {
+		for (int c=0; c < k; c++) {
+			int t = (c == newline) ? DFA_NO_STATE : DFA_get_transition(dfa, s, (char)rep[c]);
+			dsts[s * k + c] = t;
+			if (t != DFA_NO_STATE) {
+				predStart[t + 1] += 1;
+			}
+		}
+	}
+	for (int t=0; t < n; t++) {
+		predStart[t + 1] += predStart[t];
+	}
+	int *fill = (int*)malloc(sizeof(int) * (n + 1));
+	memcpy(fill, predStart, sizeof(int) * (n + 1));
+	int *pred = (int*)malloc(sizeof(int) * (predStart[n] > 0 ? predStart[n] : 1));
+	for (int i=0; i < n * k; i++) {
+		if (dsts[i] != DFA_NO_STATE) {
+			pred[fill[dsts[i]]++] = i / k;
+		}
+	}
+	int *queue = (int*)malloc(sizeof(int) * (n > 0 ? n : 1));
+	int head = 0, tail = 0;
+	for (int s=0; s < n; s++) {
+		live[s] = DFA_get_accepting(dfa, s);
+		if (live[s]) {
+			queue[tail++] = s;
+		}
+	}
+	while (head < tail) {
+		int t = queue[head++];
+		for (int i=predStart[t]; i < predStart[t + 1]; i++) {
+			if (!live[pred[i]]) {
+				live[pred[i]] = true;
+				queue[tail++] = pred[i];
+			}
+		}
+	}
+	free(predStart);
+	free(dsts);
+	free(fill);
+	free(pred);
+	free(queue);
+}
+
+/**
+ * Allocate and return a new Scanner that prints the lines matching the
+ * given DFA to out.
+ */
+Scanner new_Scanner(DFA dfa, int options, FILE *out) {
+	Scanner this = (Scanner)malloc(sizeof(struct Scanner));
+	this->options = options;
+	this->out = out;
+	atomic_init(&this->files, 0);
+	atomic_init(&this->bytes, 0);
+	atomic_init(&this->matches, 0);
+
+	// Give newline a class of its own, unless it has one already
+	int k = DFA_get_classes(dfa, this->classmap);
+	int newline = this->classmap['\n'];
+	for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+		if (sym != '\n' && this->classmap[sym] == newline) {
+			newline = k++;
+			this->classmap['\n'] = newline;
+			break;
+		}
+	}
+	this->nclasses = k;
+
+	// States where the line goes on come first, so the inner loop only
+	// has to compare; table entries are row offsets (state * k)
+	int n = DFA_get_size(dfa);
+	int dead = n, lineMatch = n + 1;
+	bool whole = options & SCAN_WHOLE_LINE;
+	bool *live = (bool*)malloc(sizeof(bool) * (n > 0 ? n : 1));
+	find_live(dfa, this->classmap, k, newline, live);
+	unsigned char *stop = (unsigned char*)malloc(n + 2);
+	for (int s=0; s < n; s++) {
+		if (DFA_get_accepting(dfa, s) && !whole) {
+			stop[s] = STOP_MATCH;
+		} else {
+			stop[s] = live[s] ? STOP_NONE : STOP_DEAD;
+		}
+	}
+	stop[dead] = STOP_DEAD;
+	stop[lineMatch] = STOP_LINE_MATCH;
+	int *number = (int*)malloc(sizeof(int) * (n + 2));
+	int count = 0;
+	for (int s=0; s < n + 2; s++) {
+		if (stop[s] == STOP_NONE) {
+			number[s] = count++;
+		}
+	}
+	this->firstStop = count * k;
+	for (int s=0; s < n + 2; s++) {
+		if (stop[s] != STOP_NONE) {
+			number[s] = count++;
+		}
+	}
+	this->start = number[0] * k;
+	this->next = (int*)malloc(sizeof(int) * (n + 2) * k);
+	this->stop = (unsigned char*)malloc(n + 2);
+	this->accepting = (bool*)calloc(n + 2, sizeof(bool));
+	for (int s=0; s < n + 2; s++) {
+		this->stop[number[s]] = stop[s];
+		for (int c=0; c < k; c++) {
+			this->next[number[s] * k + c] = number[s] * k;	// Stop states stay put
+		}
+	}
+	for (int sym=0; sym < DFA_NSYMBOLS; sym++) {
+		int c = this->classmap[sym];
+		for (int s=0; s < n; s++) {
+			if (stop[s] != STOP_NONE) {
+				continue;
+			}
+			int t = DFA_get_transition(dfa, s, (char)sym);
+			t = (t == DFA_NO_STATE || !live[t]) ? dead : t;
+			this->next[number[s] * k + c] = number[t] * k;
+		}
+	}
+	for (int s=0; s < n; s++) {
+		bool accepting = DFA_get_accepting(dfa, s);
+		this->accepting[number[s]] = accepting;
+		if (stop[s] == STOP_NONE) {
+			this->next[number[s] * k + newline] = (whole && accepting) ? number[lineMatch] * k : this->start;
+		}
+	}
+	free(stop);
+	free(number);
+	free(live);
+
+	// A literal with a newline in it can't be in a line
+	this->prefilter = new_Prefilter(dfa);
+	for (int i=0; this->prefilter != NULL && i < Prefilter_get_count(this->prefilter); i++) {
+		int length;
+		const char *literal = Prefilter_get_literal(this->prefilter, i, &length);
+		if (memchr(literal, '\n', length) != NULL) {
+			Prefilter_free(this->prefilter);
+			this->prefilter = NULL;
+		}
+	}
+	return this;
+}
+
+/**
+ * Free the given Scanner.
+ */
+void Scanner_free(Scanner this) {
+	if (this == NULL) {
+		return;
+	}
+	free(this->next);
+	free(this->stop);
+	free(this->accepting);
+	Prefilter_free(this->prefilter);
+	free(this);
+}
+
+/**
+ * Add the given matching line (without its newline) to out.
+ */
+static void print_line(Scanner this, Output *out, const char *path, long lineno,
+		       const unsigned char *line, const unsigned char *eol) {
+	char number[24];
+	Output_append(out, path, strlen(path));
+	Output_append(out, ":", 1);
+	if (this->options & SCAN_LINE_NUMBERS) {
+		Output_append(out, number, sprintf(number, "%ld:", lineno));
+	}
+	Output_append(out, (const char*)line, eol - line);
+	Output_append(out, "\n", 1);
+}
+
+/**
+ * Find the lines of the given buffer that match, printing them to out
+ * unless quiet, and return how many there are. With SCAN_FILES this
+ * stops at the first match.
+ */
+static long scan_buffer(Scanner this, const unsigned char *buf, size_t n,
+			const char *path, bool quiet, Output *out) {
+	const int k = this->nclasses;
+	const int *next = this->next;
+	const unsigned char *classmap = this->classmap;
+	const int firstStop = this->firstStop;
+	const unsigned char *end = buf + n;
+	const unsigned char *resume = buf;	// Always the start of a line
+	const unsigned char *counted = buf;	// Lines before here are in lineno
+	long lineno = 1;
+	long count = 0;
+	while (resume < end) {
+		// Run the DFA to the end, or over just the next line with a
+		// literal in it
+		const unsigned char *limit = end;
+		if (this->prefilter != NULL) {
+			const unsigned char *hit = (const unsigned char*)
+				Prefilter_find(this->prefilter, (const char*)resume, end - resume);
+			if (hit == NULL) {
+				PROFILE_SKIP(this, end - resume);
+				break;
+			}
+			while (hit > resume && hit[-1] != '\n') {
+				hit -= 1;
+			}
+			PROFILE_SKIP(this, hit - resume);
+			resume = hit;
+			limit = (const unsigned char*)memchr(hit, '\n', end - hit);
+			limit = (limit == NULL) ? end : limit + 1;
+		}
+		const unsigned char *p = resume;
+		int state = this->start;
+		// Four bytes at a time until something happens (stop states stay
+		// put), then one at a time to find the byte where it did
+		while (state < firstStop && limit - p >= 4) {
+			int s = next[state + classmap[p[0]]];
+			s = next[s + classmap[p[1]]];
+			s = next[s + classmap[p[2]]];
+			s = next[s + classmap[p[3]]];
+			if (s >= firstStop) {
+				break;
+			}
+			state = s;
+			p += 4;
+		}
+		while (state < firstStop && p < limit) {
+			state = next[state + classmap[*p++]];
+		}
+		const unsigned char *at = (p > resume) ? p - 1 : p;	// Where it happened
+		const unsigned char *eol;
+		bool matched;
+		if (state < firstStop && limit[-1] == '\n') {
+			// Ran to the end of a line without deciding it
+			eol = at = limit - 1;
+			matched = false;
+		} else if (state < firstStop) {
+			// Ran off the end: the last line matches only if it has no
+			// newline and is accepted whole
+			eol = at = end;
+			matched = this->accepting[state / k];
+		} else if (this->stop[state / k] == STOP_LINE_MATCH) {
+			eol = at;
+			matched = true;
+		} else {
+			eol = (const unsigned char*)memchr(p, '\n', end - p);
+			if (eol == NULL) {
+				eol = end;
+			}
+			PROFILE_SKIP(this, eol - p);	// The rest of the line can't change it
+			matched = (this->stop[state / k] == STOP_MATCH);
+		}
+		if (matched) {
+			count += 1;
+			if (this->options & SCAN_FILES) {
+				PROFILE_SKIP(this, end - eol);
+				break;
+			}
+			const unsigned char *line = at;
+			while (line > resume && line[-1] != '\n') {
+				line -= 1;
+			}
+			if (!quiet && (this->options & SCAN_LINE_NUMBERS)) {
+				while ((counted = (const unsigned char*)memchr(counted, '\n', line - counted)) != NULL) {
+					lineno += 1;
+					counted += 1;
+				}
+				counted = line;
+			}
+			if (!quiet) {
+				print_line(this, out, path, lineno, line, eol);
+			}
+		}
+		resume = eol + 1;
+	}
+	return count;
+}
+
+/**
+ * Scan the file with the given path, printing what it finds.
+ */
+static void scan_file(Scanner this, const char *path) {
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "scan: %s: %s\n", path, strerror(errno));
+		if (fd >= 0) {
+			close(fd);
+		}
+		return;
+	}
+	size_t n = st.st_size;
+	unsigned char *buf = NULL;
+	bool mapped = false;
+	if (n >= MMAP_THRESHOLD) {
+		buf = (unsigned char*)mmap(NULL, n, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (buf != MAP_FAILED) {
+			mapped = true;
+			madvise(buf, n, MADV_SEQUENTIAL);
+		} else {
+			buf = NULL;
+		}
+	}
+	if (!mapped && n > 0) {
+		buf = (unsigned char*)malloc(n);
+		size_t got = 0;
+		while (got < n) {
+			ssize_t r = read(fd, buf + got, n - got);
+			if (r <= 0) {
+				break;
+			}
+			got += r;
+		}
+		n = got;
+	}
+	close(fd);
+
+	bool binary = n > 0 && memchr(buf, '\0', n < BINARY_CHECK ? n : BINARY_CHECK) != NULL;
+	bool quiet = binary || (this->options & (SCAN_COUNT | SCAN_FILES));
+	Output out = { NULL, 0, 0 };
+	long count = (n > 0) ? scan_buffer(this, buf, n, path, quiet, &out) : 0;
+	if (count > 0) {
+		char number[24];
+		if (this->options & SCAN_FILES) {
+			Output_append(&out, path, strlen(path));
+			Output_append(&out, "\n", 1);
+		} else if (this->options & SCAN_COUNT) {
+			Output_append(&out, path, strlen(path));
+			Output_append(&out, number, sprintf(number, ":%ld\n", count));
+		} else if (binary) {
+			Output_append(&out, "Binary file ", 12);
+			Output_append(&out, path, strlen(path));
+			Output_append(&out, " matches\n", 9);
+		}
+	}
+	if (out.length > 0) {
+		flockfile(this->out);
+		fwrite(out.data, 1, out.length, this->out);
+		funlockfile(this->out);
+	}
+	free(out.data);
+	if (mapped) {
+		munmap(buf, n);
+	} else {
+		free(buf);
+	}
+	atomic_fetch_add(&this->files, 1);
+	atomic_fetch_add(&this->bytes, (long)n);
+	atomic_fetch_add(&this->matches, count);
+}
+
+/**
+ * A file or directory to scan.
+ */
+typedef struct ScanTask {
+	Scanner scanner;
+	ThreadPool pool;
+	char *path;
+} ScanTask;
+
+static void submit(Scanner scanner, ThreadPool pool, const char *path, void (*func)(void*)) {
+	ScanTask *task = (ScanTask*)malloc(sizeof(ScanTask));
+	task->scanner = scanner;
+	task->pool = pool;
+	task->path = (char*)malloc(strlen(path) + 1);
+	strcpy(task->path, path);
+	ThreadPool_submit(pool, func, task);
+}
+
+static void ScanTask_file(void *arg) {
+	ScanTask *task = (ScanTask*)arg;
+	scan_file(task->scanner, task->path);
+	free(task->path);
+	free(task);
+}
+
+/**
+ * Submit a task for each file and subdirectory of a directory.
+ */
+static void ScanTask_directory(void *arg) {
+	ScanTask *task = (ScanTask*)arg;
+	DIR *dir = opendir(task->path);
+	if (dir == NULL) {
+		fprintf(stderr, "scan: %s: %s\n", task->path, strerror(errno));
+	} else {
+		size_t length = strlen(task->path);
+		bool slash = (length > 0 && task->path[length-1] == '/');
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != NULL) {
+			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+				continue;
+			}
+			char *child = (char*)malloc(length + strlen(entry->d_name) + 2);
+			sprintf(child, slash ? "%s%s" : "%s/%s", task->path, entry->d_name);
+			int type = entry->d_type;
+			if (type == DT_UNKNOWN) {
+				struct stat st;
+				if (lstat(child, &st) == 0) {
+					type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+				}
+			}
+			if (type == DT_DIR) {
+				submit(task->scanner, task->pool, child, ScanTask_directory);
+			} else if (type == DT_REG) {
+				submit(task->scanner, task->pool, child, ScanTask_file);
+			}
+			free(child);
+		}
+		closedir(dir);
+	}
+	free(task->path);
+	free(task);
+}
+
+/**
+ * Scan the given files, and every file under the given directories, on
+ * the workers of the given ThreadPool.
+ */
+void Scanner_scan(Scanner this, ThreadPool pool, char **paths, int npaths) {
+	for (int i=0; i < npaths; i++) {
+		struct stat st;
+		if (stat(paths[i], &st) < 0) {
+			fprintf(stderr, "scan: %s: %s\n", paths[i], strerror(errno));
+		} else if (S_ISDIR(st.st_mode)) {
+			submit(this, pool, paths[i], ScanTask_directory);
+		} else {
+			submit(this, pool, paths[i], ScanTask_file);
+		}
+	}
+	ThreadPool_wait(pool);
+}
+
+/**
+ * Return the number of files the given Scanner has scanned.
+ */
+long Scanner_get_files(Scanner this) {
+	return atomic_load(&this->files);
+}
+
+/**
+ * Return the number of bytes the given Scanner has scanned.
+ */
+long Scanner_get_bytes(Scanner this) {
+	return atomic_load(&this->bytes);
+}
+
+/**
+ * Return the number of matching lines the given Scanner has found.
+ */
+long Scanner_get_matches(Scanner this) {
+	return atomic_load(&this->matches);
+}
+
+#ifdef MAIN
+
+/*
+ * The test program is a grep-like tool:
+ *   scan [-c] [-l] [-n] [-s] [-j threads] pattern [path...]
+ * The pattern is a regular expression (see regexp.h) found anywhere in
+ * a line, unless it starts with ^ or ends with $. Paths default to ".".
+ * -c, -l and -n are as for grep; -s prints throughput to stderr.
+ */
+
+#include <time.h>
+#include "regexp.h"
+#include "nfa2dfa.h"
+
+int main(int argc, char* argv[]) {
+	int options = 0;
+	bool stats = false;
+	int nthreads = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "clnsj:")) != -1) {
+		switch (opt) {
+		case 'c': options |= SCAN_COUNT; break;
+		case 'l': options |= SCAN_FILES; break;
+		case 'n': options |= SCAN_LINE_NUMBERS; break;
+		case 's': stats = true; break;
+		case 'j': nthreads = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: scan [-c] [-l] [-n] [-s] [-j threads] pattern [path...]\n");
+			return 2;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "usage: scan [-c] [-l] [-n] [-s] [-j threads] pattern [path...]\n");
+		return 2;
+	}
+
+	// Strip ^ and an unescaped trailing $, which regexp_compile doesn't take
+	char *pattern = argv[optind++];
+	bool anchored = (pattern[0] == '^');
+	size_t length = strlen(pattern);
+	char *body = (char*)malloc(length + 1);
+	strcpy(body, pattern + anchored);
+	length -= anchored;
+	int backslashes = 0;
+	while (backslashes + 1 < length && body[length - 2 - backslashes] == '\\') {
+		backslashes += 1;
+	}
+	if (length > 0 && body[length-1] == '$' && backslashes % 2 == 0) {
+		body[length-1] = '\0';
+		options |= SCAN_WHOLE_LINE;
+	}
+	const char *error;
+	NFA nfa = regexp_compile(body, &error);
+	if (nfa == NULL) {
+		fprintf(stderr, "scan: %s: %s\n", pattern, error);
+		return 2;
+	}
+	if (!anchored) {
+		NFA_add_transition_all(nfa, 0, 0);
+	}
+	DFA dfa = NFA_to_DFA(nfa);
+	Scanner scanner = new_Scanner(dfa, options, stdout);
+	NFA_free(nfa);
+	DFA_free(dfa);
+
+	char *here[] = { "." };
+	ThreadPool pool = new_ThreadPool(nthreads);
+	struct timespec start, finish;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (optind < argc) {
+		Scanner_scan(scanner, pool, argv + optind, argc - optind);
+	} else {
+		Scanner_scan(scanner, pool, here, 1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &finish);
+	double seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+	if (stats) {
+		fprintf(stderr, "%ld files, %.1f MB, %ld matches, %d threads, %.3f s, %.0f MB/s\n",
+			Scanner_get_files(scanner), Scanner_get_bytes(scanner) / 1e6,
+			Scanner_get_matches(scanner), ThreadPool_size(pool), seconds,
+			seconds > 0 ? Scanner_get_bytes(scanner) / 1e6 / seconds : 0.0);
+	}
+	int status = (Scanner_get_matches(scanner) > 0) ? 0 : 1;
+	ThreadPool_free(pool);
+	Scanner_free(scanner);
+	free(body);
+	return status;
+}
+
+#endif
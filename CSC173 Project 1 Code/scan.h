@@ -0,0 +1,69 @@
+/*
+ * File: scan.h
+ *
+ * Finding the lines of files that match a DFA, grep-style, over whole
+ * directory trees. Directories and files are tasks on a ThreadPool, so
+ * idle workers steal whole subtrees from busy ones.
+ * A line matches if the DFA accepts some prefix of it (or, with
+ * SCAN_WHOLE_LINE, all of it); to find a pattern anywhere in a line,
+ * give the DFA a start state that loops on every byte. The DFA is run
+ * over each file's bytes in one pass, and only matching lines are copied
+ * to the output.
+ */
+
+#ifndef _scan_h
+#define _scan_h
+
+#include <stdio.h>
+#include "dfa.h"
+#include "ThreadPool.h"
+
+typedef struct Scanner *Scanner;
+
+/**
+ * Options for new_Scanner, or'ed together.
+ */
+#define SCAN_WHOLE_LINE 1	// A line matches if the DFA accepts all of it
+#define SCAN_LINE_NUMBERS 2	// Print "path:number:line" not "path:line"
+#define SCAN_COUNT 4		// Print "path:count" for files with matches
+#define SCAN_FILES 8		// Print just the paths of files with matches
+
+/**
+ * Allocate and return a new Scanner that prints the lines matching the
+ * given DFA to out. The DFA isn't used after this returns, so the caller
+ * may free it.
+ */
+extern Scanner new_Scanner(DFA dfa, int options, FILE *out);
+
+/**
+ * Free the given Scanner.
+ */
+extern void Scanner_free(Scanner scanner);
+
+/**
+ * Scan the given files, and every file under the given directories, on
+ * the workers of the given ThreadPool. The output for a file is printed
+ * all at once, but files come out in whatever order they finish.
+ * Symbolic links are followed only when given as paths. Files that look
+ * binary (with a NUL in their first block) just get "Binary file X
+ * matches". Returns when every file has been scanned.
+ */
+extern void Scanner_scan(Scanner scanner, ThreadPool pool, char **paths, int npaths);
+
+/**
+ * Return the number of files the given Scanner has scanned.
+ */
+extern long Scanner_get_files(Scanner scanner);
+
+/**
+ * Return the number of bytes the given Scanner has scanned.
+ */
+extern long Scanner_get_bytes(Scanner scanner);
+
+/**
+ * Return the number of matching lines the given Scanner has found (with
+ * SCAN_FILES, the number of matching files).
+ */
+extern long Scanner_get_matches(Scanner scanner);
+
+#endif
@@ -0,0 +1,265 @@
+/*
+ * File: utf8.c
+ *
+ * Implementation of the UTF-8 DFA construction in utf8.h.
+ * After the lead byte of an n-byte encoding, what is left to read is n-1
+ * continuation bytes of 6 bits each, and the code points still possible
+ * are a set of intervals of those 6(n-1) bits. That (count, intervals)
+ * pair is the DFA state: continuation byte 0x80+j keeps the part of the
+ * intervals whose top 6 bits are j, and the state for each pair is built
+ * once, so identical tails of different encodings share states.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "utf8.h"
+
+typedef int Interval[2];
+
+/**
+ * The states made by one call of DFA_add_utf8_ranges, with the number of
+ * continuation bytes and the intervals each one stands for.
+ */
+typedef struct Fragment {
+	int count;
+	int capacity;
+	int *state;
+	int *remaining;
+	int *nintervals;
+	Interval **intervals;
+} Fragment;
+
+static int compare_intervals(const void *a, const void *b) {
+	const int *x = (const int*)a;
+	const int *y = (const int*)b;
+	return (x[0] > y[0]) - (x[0] < y[0]);
+}
+
+/**
+ * Store in out the parts of the n intervals that lie in [lo, hi], shifted
+ * down by base, and return how many there are.
+ */
+static int clip(const Interval *in, int n, int lo, int hi, int base, Interval *out) {
+	int m = 0;
+	for (int i=0; i < n; i++) {
+		int a = (in[i][0] > lo) ? in[i][0] : lo;
+		int b = (in[i][1] < hi) ? in[i][1] : hi;
+		if (a <= b) {
+			out[m][0] = a - base;
+			out[m][1] = b - base;
+			m += 1;
+		}
+	}
+	return m;
+}
+
+/**
+ * Return the state of the given DFA that reads remaining continuation
+ * bytes encoding a value in the given intervals and then goes to dst,
+ * making it (and the states after it) if this Fragment doesn't have it yet.
+ * Returns DFA_NO_STATE if there are no intervals.
+ */
+static int fragment_state(DFA dfa, Fragment *f, int remaining, Interval *iv, int n, int dst) {
+	if (n == 0) {
+		return DFA_NO_STATE;
+	} else if (remaining == 0) {
+		return dst;
+	}
+	for (int i=0; i < f->count; i++) {
+		if (f->remaining[i] == remaining && f->nintervals[i] == n
+		    && memcmp(f->intervals[i], iv, sizeof(Interval) * n) == 0) {
+			return f->state[i];
+		}
+	}
+	int s = DFA_add_state(dfa);
+	if (f->count == f->capacity) {
+		f->capacity = (f->capacity == 0) ? 16 : 2 * f->capacity;
+		f->state = (int*)realloc(f->state, sizeof(int) * f->capacity);
+		f->remaining = (int*)realloc(f->remaining, sizeof(int) * f->capacity);
+		f->nintervals = (int*)realloc(f->nintervals, sizeof(int) * f->capacity);
+		f->intervals = (Interval**)realloc(f->intervals, sizeof(Interval*) * f->capacity);
+	}
+	int i = f->count++;
+	f->state[i] = s;
+	f->remaining[i] = remaining;
+	f->nintervals[i] = n;
+	f->intervals[i] = (Interval*)malloc(sizeof(Interval) * n);
+	memcpy(f->intervals[i], iv, sizeof(Interval) * n);
+
+	int width = 1 << (6 * (remaining - 1));	// Values per continuation byte
+	Interval *sub = (Interval*)malloc(sizeof(Interval) * n);
+	for (int j=0; j < 64; j++) {
+		int m = clip(iv, n, j * width, (j + 1) * width - 1, j * width, sub);
+		int t = fragment_state(dfa, f, remaining - 1, sub, m, dst);
+		if (t != DFA_NO_STATE) {
+			DFA_set_transition(dfa, s, (char)(0x80 + j), t);
+		}
+	}
+	free(sub);
+	return s;
+}
+
+/**
+ * Add states and transitions to the given DFA so that from state src, the
+ * UTF-8 encoding of any code point in the given ranges leads to state dst.
+ */
+void DFA_add_utf8_ranges(DFA dfa, int src, const int ranges[][2], int nranges, int dst) {
+	// Sort and merge the ranges, leaving out surrogates
+	Interval *iv = (Interval*)malloc(sizeof(Interval) * (2 * nranges + 1));
+	int n = 0;
+	for (int i=0; i < nranges; i++) {
+		n += clip(&ranges[i], 1, 0, 0xD7FF, 0, iv + n);
+		n += clip(&ranges[i], 1, 0xE000, UTF8_MAX_CODE_POINT, 0, iv + n);
+	}
+	qsort(iv, n, sizeof(Interval), compare_intervals);
+	int merged = 0;
+	for (int i=0; i < n; i++) {
+		if (merged > 0 && iv[i][0] <= iv[merged-1][1] + 1) {
+			if (iv[i][1] > iv[merged-1][1]) {
+				iv[merged-1][1] = iv[i][1];
+			}
+		} else {
+			iv[merged][0] = iv[i][0];
+			iv[merged][1] = iv[i][1];
+			merged += 1;
+		}
+	}
+	n = merged;
+
+	for (int i=0; i < n; i++) {
+		for (int cp=iv[i][0]; cp <= iv[i][1] && cp < 0x80; cp++) {
+			DFA_set_transition(dfa, src, (char)cp, dst);
+		}
+	}
+
+	// For each length of encoding: the range of lead bytes, the bits of
+	// the code point in the lead byte, the number of continuation bytes,
+	// and the smallest and largest code point with that length
+	static const int leads[3][6] = {
+		{ 0xC2, 0xDF, 0x1F, 1, 0x80, 0x7FF },
+		{ 0xE0, 0xEF, 0x0F, 2, 0x800, 0xFFFF },
+		{ 0xF0, 0xF4, 0x07, 3, 0x10000, UTF8_MAX_CODE_POINT },
+	};
+	Fragment f = { 0, 0, NULL, NULL, NULL, NULL };
+	Interval *sub = (Interval*)malloc(sizeof(Interval) * (n + 1));
+	for (int l=0; l < 3; l++) {
+		int remaining = leads[l][3];
+		int bits = 6 * remaining;
+		for (int b=leads[l][0]; b <= leads[l][1]; b++) {
+			int base = (b & leads[l][2]) << bits;
+			int lo = (base > leads[l][4]) ? base : leads[l][4];
+			int hi = (base + (1 << bits) - 1 < leads[l][5]) ? base + (1 << bits) - 1 : leads[l][5];
+			int m = clip(iv, n, lo, hi, base, sub);
+			int t = fragment_state(dfa, &f, remaining, sub, m, dst);
+			if (t != DFA_NO_STATE) {
+				DFA_set_transition(dfa, src, (char)b, t);
+			}
+		}
+	}
+	for (int i=0; i < f.count; i++) {
+		free(f.intervals[i]);
+	}
+	free(f.state);
+	free(f.remaining);
+	free(f.nintervals);
+	free(f.intervals);
+	free(sub);
+	free(iv);
+}
+
+/**
+ * Store the UTF-8 encoding of the given code point, followed by '\0', in
+ * buf and return its length in bytes.
+ */
+int utf8_encode(int cp, char *buf) {
+	int n;
+	if (cp < 0x80) {
+		buf[0] = (char)cp;
+		n = 1;
+	} else if (cp < 0x800) {
+		buf[0] = (char)(0xC0 | (cp >> 6));
+		buf[1] = (char)(0x80 | (cp & 0x3F));
+		n = 2;
+	} else if (cp < 0x10000) {
+		buf[0] = (char)(0xE0 | (cp >> 12));
+		buf[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		buf[2] = (char)(0x80 | (cp & 0x3F));
+		n = 3;
+	} else {
+		buf[0] = (char)(0xF0 | (cp >> 18));
+		buf[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+		buf[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		buf[3] = (char)(0x80 | (cp & 0x3F));
+		n = 4;
+	}
+	buf[n] = '\0';
+	return n;
+}
+
+#ifdef MAIN
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/**
+ * Vowels, with their accented forms from Latin-1 Supplement and Latin
+ * Extended-A (plus a few consonants in between, to keep the list short).
+ */
+static const int vowels[][2] = {
+	{ 'a', 'a' }, { 'e', 'e' }, { 'i', 'i' }, { 'o', 'o' }, { 'u', 'u' },
+	{ 'A', 'A' }, { 'E', 'E' }, { 'I', 'I' }, { 'O', 'O' }, { 'U', 'U' },
+	{ 0xC0, 0xC6 }, { 0xC8, 0xCF }, { 0xD2, 0xD6 }, { 0xD9, 0xDC },
+	{ 0xE0, 0xE6 }, { 0xE8, 0xEF }, { 0xF2, 0xF6 }, { 0xF9, 0xFC },
+	{ 0x100, 0x105 }, { 0x112, 0x11B }, { 0x128, 0x131 }, { 0x14C, 0x153 },
+	{ 0x168, 0x173 },
+};
+
+static void test(DFA dfa, char *input) {
+	printf("  \"%s\": %s\n", input, DFA_execute(dfa, input) ? "true" : "false");
+}
+
+int main(int argc, char* argv[]) {
+	printf("building DFA for strings starting with a vowel...\n");
+	DFA dfa = new_DFA(2);
+	DFA_set_transition_all(dfa, 1, 1);
+	DFA_set_accepting(dfa, 1, true);
+	DFA_add_utf8_ranges(dfa, 0, vowels, sizeof(vowels) / sizeof(vowels[0]), 1);
+	printf("  %d states\n", DFA_get_size(dfa));
+	test(dfa, "apple");
+	test(dfa, "\xc3\xa9t\xc3\xa9");		// "été"
+	test(dfa, "\xc3\x9c" "ber");		// "Über"
+	test(dfa, "\xc5\x8d" "kina");		// "ōkina"
+	test(dfa, "\xce\xa9mega");		// "Ωmega"
+	test(dfa, "xyz");
+	test(dfa, "\xc3");			// Truncated
+	test(dfa, "\xc1\xa1");			// Overlong 'a'
+
+	printf("checking every code point against a mixed class...\n");
+	static const int mixed[][2] = {
+		{ 0x10FF00, 0x10FFFF }, { 'A', 'Z' }, { 0xE0, 0x1FF }, { 0x800, 0x900 },
+		{ 0xD000, 0xE100 }, { 0x1F600, 0x1F64F }, { 0x1F640, 0x1F700 },
+	};
+	int nmixed = sizeof(mixed) / sizeof(mixed[0]);
+	DFA class = new_DFA(2);
+	DFA_set_accepting(class, 1, true);
+	DFA_add_utf8_ranges(class, 0, mixed, nmixed, 1);
+	int errors = 0;
+	char buf[5];
+	for (int cp=1; cp <= UTF8_MAX_CODE_POINT; cp++) {
+		bool expected = cp < 0xD800 || cp > 0xDFFF;
+		bool inClass = false;
+		for (int i=0; i < nmixed; i++) {
+			inClass = inClass || (mixed[i][0] <= cp && cp <= mixed[i][1]);
+		}
+		utf8_encode(cp, buf);
+		if (DFA_execute(class, buf) != (expected && inClass)) {
+			errors += 1;
+		}
+	}
+	printf("  %d states, %d errors\n", DFA_get_size(class), errors);
+
+	DFA_free(dfa);
+	DFA_free(class);
+}
+
+#endif
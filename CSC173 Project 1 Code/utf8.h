@@ -0,0 +1,40 @@
+/*
+ * File: utf8.h
+ *
+ * Compiling sets of Unicode code points into DFA states that read their
+ * UTF-8 encodings a byte at a time, so a DFA can match Unicode classes on
+ * raw UTF-8 input with no decoding step: each byte is still one table
+ * lookup, just as for ASCII.
+ */
+
+#ifndef _utf8_h
+#define _utf8_h
+
+#include "dfa.h"
+
+/**
+ * The largest Unicode code point.
+ */
+#define UTF8_MAX_CODE_POINT 0x10FFFF
+
+/**
+ * Add states and transitions to the given DFA so that from state src, the
+ * UTF-8 encoding of any code point in the given ranges leads to state dst.
+ * The ranges are nranges pairs of code points lo, hi (inclusive) in any
+ * order, and may overlap. Surrogates (U+D800..U+DFFF) and anything above
+ * UTF8_MAX_CODE_POINT are left out, and only shortest-form encodings are
+ * accepted, so invalid UTF-8 never reaches dst.
+ * Transitions from src on ASCII bytes in the ranges and on the lead bytes
+ * of longer encodings are overwritten; other transitions are untouched.
+ * The new states are shared wherever the rest of the encodings are the
+ * same (e.g. one state for "any continuation byte").
+ */
+extern void DFA_add_utf8_ranges(DFA dfa, int src, const int ranges[][2], int nranges, int dst);
+
+/**
+ * Store the UTF-8 encoding of the given code point, followed by '\0', in
+ * buf (which must have room for 5 bytes) and return its length in bytes.
+ */
+extern int utf8_encode(int codePoint, char *buf);
+
+#endif
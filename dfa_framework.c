@@ -5,25 +5,25 @@
 
 #define MAX_STATES 10
 
+// The automata only describe the language; the current state of a run is
+// a local variable of DFA_run/NFA_run, so one automaton can be shared by
+// several threads at once.
 struct DFA {
     int startState;
-    int currentState;
     int acceptState;
     int (*transitionFunction)(int, char);
 };
 
 struct NFA {
     int startState;
-    int currentState;
     int acceptStates[10];  // Array to hold multiple accept states
     int acceptStateCount;  
     int (*transitionFunction)(int, char);
 };
 
-int characterCounts[7] = {0};  
-char characters[7] = {'a', 'e', 'h', 'i', 'g', 'n', 'p'};
+const char characters[7] = {'a', 'e', 'h', 'i', 'g', 'n', 'p'};
 
-void countCharacters(char input) {
+void countCharacters(int characterCounts[7], char input) {
     for (int i = 0; i < 7; i++) {
         if (input == characters[i]) {
             characterCounts[i]++;
@@ -42,17 +42,32 @@ int transitionForCSC(int state, char input) {
 
 // Transition function for the string containing "end"
 int transitionForContainsEnd(int state, char input) {
-    if (state == 0 && input == 'e') return 1;
+    if (state == 3) return 3;  // Already seen "end"
     if (state == 1 && input == 'n') return 2;
     if (state == 2 && input == 'd') return 3;
-    return state;
+    if (input == 'e') return 1;  // Start (again) of "end"
+    return 0;  // Mismatch: fall back to the start
 }
 
 // Transition function for string starting with a vowel
+// Accented vowels like "é" are two UTF-8 bytes, 0xC3 then one of the
+// bytes below, so state 3 means "seen 0xC3 first"
 int transitionForStartsWithVowel(int state, char input) {
+    unsigned char byte = (unsigned char)input;
     if (state == 0 && (input == 'a' || input == 'e' || input == 'i' || input == 'o' || input == 'u')) {
         return 1;
     }
+    if (state == 0 && byte == 0xC3) {
+        return 3;
+    }
+    if (state == 3) {
+        // à-å, è-ë, ì-ï, ò-ö, ù-ü
+        if ((byte >= 0xA0 && byte <= 0xA5) || (byte >= 0xA8 && byte <= 0xAF) ||
+            (byte >= 0xB2 && byte <= 0xB6) || (byte >= 0xB9 && byte <= 0xBC)) {
+            return 1;
+        }
+        return 2;
+    }
     if(state==0){
         return 2; //Move to a non-accept state if first char is not a vowel
     }
@@ -81,26 +96,26 @@ int transitionForEndInAt(int state, char input) {
 
 // Transition function for the NFA recognizing strings containing "got"
 int transitionForContainsGot(int state, char input) {
-    if (state == 0 && input == 'g') {
-        return 1;
+    if (state == 3) {
+        return 3;  // Already seen "got"
     } else if (state == 1 && input == 'o') {
         return 2;
     } else if (state == 2 && input == 't') {
         return 3;
+    } else if (input == 'g') {
+        return 1;  // Start (again) of "got"
     }
-    return state;  // Stay in the same state if no valid transition
+    return 0;  // Mismatch: fall back to the start
 }
 
 // Transition function for the NFA recognizing strings that have more than one a, e, h, i, or g, or more than two n’s or p’s
 bool transitionForCharacterCounts(const char* input) {
-    // Reset character counts for each new input string
-    for (int i = 0; i < 7; i++) {
-        characterCounts[i] = 0;
-    }
+    // Character counts for this input string only
+    int characterCounts[7] = {0};
 
     // Count the occurrences of each character in the input string
     for (int i = 0; i < strlen(input); i++) {
-        countCharacters(input[i]);
+        countCharacters(characterCounts, input[i]);
     }
 
     // Check conditions for 'a', 'e', 'h', 'i', 'g', 'n', and 'p'
@@ -121,31 +136,31 @@ bool transitionForCharacterCounts(const char* input) {
 }
 
 
-bool DFA_run(struct DFA* dfa, const char* input) {
-    dfa->currentState = dfa->startState;
-    for (int i = 0; i < strlen(input); ++i) {
-        dfa->currentState = dfa->transitionFunction(dfa->currentState, input[i]);
+bool DFA_run(const struct DFA* dfa, const char* input) {
+    int currentState = dfa->startState;
+    for (int i = 0; input[i] != '\0'; ++i) {
+        currentState = dfa->transitionFunction(currentState, input[i]);
     }
-    return dfa->currentState == dfa->acceptState;
+    return currentState == dfa->acceptState;
 }
 
-bool NFA_run(struct NFA* nfa, const char* input) {
+bool NFA_run(const struct NFA* nfa, const char* input) {
     int i, j;
-    nfa->currentState = nfa->startState;
+    int currentState = nfa->startState;
     
-    for (i = 0; i < strlen(input); ++i) {
-        int nextState = nfa->transitionFunction(nfa->currentState, input[i]);
+    for (i = 0; input[i] != '\0'; ++i) {
+        int nextState = nfa->transitionFunction(currentState, input[i]);
         
         if (nextState == -1) {
             return false;
         }
         
-        nfa->currentState = nextState;
+        currentState = nextState;
     }
     
     // Check if the final state is an accept state
     for (j = 0; j < nfa->acceptStateCount; ++j) {
-        if (nfa->currentState == nfa->acceptStates[j]) {
+        if (currentState == nfa->acceptStates[j]) {
             return true;
         }
     }
@@ -153,7 +168,7 @@ bool NFA_run(struct NFA* nfa, const char* input) {
     return false;
 }
 
-void DFA_repl(struct DFA* dfa, const char* description) {
+void DFA_repl(const struct DFA* dfa, const char* description) {
     char input[128];
     printf("Testing DFA that %s...\n", description);
 
@@ -168,7 +183,7 @@ void DFA_repl(struct DFA* dfa, const char* description) {
     }
 }
 
-void NFA_repl(struct NFA* nfa, const char* description) {
+void NFA_repl(const struct NFA* nfa, const char* description) {
     char input[128];
     printf("Testing NFA that %s...\n", description);
 
@@ -179,9 +194,6 @@ void NFA_repl(struct NFA* nfa, const char* description) {
 
         if (strcmp(input, "quit") == 0) break;
 
-        // Reset the NFA's current state to the start state before processing each input
-        nfa->currentState = nfa->startState;
-
         printf("Result for input \"%s\": %s\n", input, NFA_run(nfa, input) ? "true" : "false");
     }
 }
@@ -358,13 +370,13 @@ void NFA_repl_characterCounts() {
 //
 
 int main() {
-    struct DFA dfaForCSC = {0, 0, 3, transitionForCSC};
-    struct DFA dfaForContainsEnd = {0, 0, 3, transitionForContainsEnd};
-    struct DFA dfaForStartsWithVowel = {0, 0, 1, transitionForStartsWithVowel};
-    struct DFA dfaForEven01 = {0, 0, 0, transitionForEven01};
+    const struct DFA dfaForCSC = {0, 3, transitionForCSC};
+    const struct DFA dfaForContainsEnd = {0, 3, transitionForContainsEnd};
+    const struct DFA dfaForStartsWithVowel = {0, 1, transitionForStartsWithVowel};
+    const struct DFA dfaForEven01 = {0, 0, transitionForEven01};
 
-    struct NFA nfaForEndInAt = {0, 0, {2}, 1, transitionForEndInAt};
-    struct NFA nfaForContainsGot = {0, 0, {3}, 1, transitionForContainsGot};
+    const struct NFA nfaForEndInAt = {0, {2}, 1, transitionForEndInAt};
+    const struct NFA nfaForContainsGot = {0, {3}, 1, transitionForContainsGot};
 
     printf("CSC173 Project 1 by Gem and Tamuda \n");
 
@@ -378,7 +390,7 @@ int main() {
     NFA_repl_characterCounts();
 
     // // Create an NFA
-    // struct NFA nfaForEndInAt = {0, 0, {2}, 1, transitionForEndInAt};
+    // struct NFA nfaForEndInAt = {0, {2}, 1, transitionForEndInAt};
 
     // // Convert the NFA to a DFA
     // DFAState* initialDFAState = NFA_to_DFA(&nfaForEndInAt);